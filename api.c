@@ -1482,6 +1482,11 @@ void devstatus_an(struct io_data *io_data, struct cgpu_info *cgpu, bool isjson,
 	int last_share_pool = -1;
 	time_t last_share_pool_time = -1, last_device_valid_work = -1;
 	double last_share_diff = -1;
+	double nonce_diff = 0;
+	double nonce_rate = 0;
+	struct timeval tv_work_wait = {0, 0};
+	struct timeval tv_restart_latency = {0, 0}, tv_restart_latency_max = {0, 0};
+	unsigned int restarts = 0;
 	int procs = per_proc ? 1 : cgpu->procs, i;
 	for (i = 0, proc = cgpu; i < procs; ++i, proc = proc->next_proc)
 	{
@@ -1512,6 +1517,18 @@ void devstatus_an(struct io_data *io_data, struct cgpu_info *cgpu, bool isjson,
 		}
 		if (proc->last_device_valid_work > last_device_valid_work)
 			last_device_valid_work = proc->last_device_valid_work;
+		timeradd(&tv_work_wait, &proc->tv_work_wait, &tv_work_wait);
+		timeradd(&tv_restart_latency, &proc->tv_restart_latency, &tv_restart_latency);
+		if (timercmp(&proc->tv_restart_latency_max, &tv_restart_latency_max, >))
+			tv_restart_latency_max = proc->tv_restart_latency_max;
+		restarts += proc->restarts;
+		if (proc->auto_nonce_diff)
+		{
+			// The lowest difficulty in use accounts for the most nonces
+			if (proc->auto_nonce_diff < nonce_diff || !nonce_diff)
+				nonce_diff = proc->auto_nonce_diff;
+			nonce_rate += proc->auto_nonce_rate;
+		}
 		if (per_proc)
 			break;
 	}
@@ -1557,6 +1574,20 @@ void devstatus_an(struct io_data *io_data, struct cgpu_info *cgpu, bool isjson,
 	double rejp = diff1 ?
 			(double)(diff_rejected) / (double)(diff1) : 0;
 	root = api_add_percent(root, "Device Rejected%", &rejp, false);
+	root = api_add_timeval(root, "Work Wait Time", &tv_work_wait, true);
+	root = api_add_uint(root, "Restarts", &restarts, true);
+	if (restarts)
+	{
+		struct timeval tv_avg;
+		us_to_timeval(&tv_avg, timeval_to_us(&tv_restart_latency) / restarts);
+		root = api_add_timeval(root, "Restart Latency", &tv_avg, true);
+		root = api_add_timeval(root, "Max Restart Latency", &tv_restart_latency_max, true);
+	}
+	if (nonce_diff)
+	{
+		root = api_add_diff(root, "Nonce Difficulty", &nonce_diff, true);
+		root = api_add_double(root, "Nonce Rate", &nonce_rate, false);
+	}
 
 	if ((per_proc || cgpu->procs <= 1) && cgpu->drv->get_api_extra_device_status)
 		root = api_add_extra(root, cgpu->drv->get_api_extra_device_status(cgpu));
@@ -2020,6 +2051,13 @@ static void summary(struct io_data *io_data, __maybe_unused SOCKETTYPE c, __mayb
 	root = api_add_int(root, "Stale", &(total_stale), true);
 	root = api_add_uint(root, "Get Failures", &(total_go), true);
 	root = api_add_uint(root, "Local Work", &(local_work), true);
+	root = api_add_uint(root, "Rolled Work Used", &(total_pop_rolled), true);
+	root = api_add_uint(root, "Fresh Work Used", &(total_pop_fresh), true);
+	// In milliseconds
+	double submit_latency = total_submit_latency_count ? (total_submit_latency * 1e3 / total_submit_latency_count) : 0;
+	root = api_add_double(root, "Nonce Submit Latency", &submit_latency, true);
+	submit_latency = max_submit_latency * 1e3;
+	root = api_add_double(root, "Max Nonce Submit Latency", &submit_latency, true);
 	root = api_add_uint(root, "Remote Failures", &(total_ro), true);
 	root = api_add_uint(root, "Network Blocks", &(new_blocks), true);
 	root = api_add_mhtotal(root, "Total MH", &(total_mhashes_done), true);
@@ -3032,6 +3070,8 @@ static void minerstats(struct io_data *io_data, __maybe_unused SOCKETTYPE c, __m
 				extra = cgpu->drv->get_api_stats(cgpu);
 			else
 				extra = NULL;
+			extra = bfg_tseries_api(extra, cgpu);
+			extra = bfg_autotune_api(extra, cgpu);
 
 			i = itemstats(io_data, i, cgpu->proc_repr_ns, &(cgpu->cgminer_stats), NULL, extra, isjson);
 		}
@@ -3119,6 +3159,13 @@ static void minecoin(struct io_data *io_data, __maybe_unused SOCKETTYPE c, __may
 		
 		root = api_add_diff(root, "Difficulty Accepted", &goal->diff_accepted, false);
 		
+		struct mining_algorithm * const malgo = goal->malgo;
+		const int queue_target = malgo->base_queue + malgo_queue_target(malgo);
+		root = api_add_int(root, "Queue Target", &queue_target, true);
+		root = api_add_int(root, "Queue Depth", &malgo->staged, true);
+		root = api_add_double(root, "Work Consumption Rate", &malgo->queue_pop_rate, true);
+		root = api_add_elapsed(root, "Upstream Latency", &malgo->upstream_latency, true);
+		
 		root = print_data(root, buf, isjson, precom);
 		io_add(io_data, buf);
 		if (isjson)
@@ -0,0 +1,73 @@
+#!/bin/sh
+# Compares thread count, CPU time, hashrate and nonce wakeup latency with and
+# without --minerloop-reactor, running the same devices each time. With no
+# arguments, these are BENCH_DEVICES (default 50) simulated Icarus sticks:
+#     BENCH_DEVICES=200 ./bench-minerloop-reactor.sh
+# Arguments select other devices instead, for example:
+#     ./bench-minerloop-reactor.sh -S bfsb:auto
+#     ./bench-minerloop-reactor.sh -S bitforce@vsim:bitforce:50
+# Only drivers marked minerloop_reactor_safe are shared by the reactor; devices
+# of other drivers keep a thread each in both runs.
+# The wakeup latency is how late icarus read each nonce after the device sent
+# it, averaged and maximised over all its processors; other drivers show "?".
+# BENCH_SECONDS sets how long each run mines (default 60), BENCH_API_PORT the
+# RPC port used to read the statistics, and BFGMINER_OPTS adds other options.
+PROG="${PROG:-bfgminer}"
+MYDIR="$(dirname "$0")"
+if test -x "$MYDIR/bfgminer" && test "$PROG" = bfgminer; then
+	PROG="$MYDIR/bfgminer"
+fi
+SECS="${BENCH_SECONDS:-60}"
+PORT="${BENCH_API_PORT:-4028}"
+HZ="$(getconf CLK_TCK)"
+if test $# = 0; then
+	set -- -S "icarus@vsim:icarus:${BENCH_DEVICES:-50}:0.38:2"
+fi
+
+rpc() {
+	echo "$1" | nc -q1 127.0.0.1 "$PORT" 2>/dev/null
+}
+
+bench() {
+	label="$1"; shift
+	"$PROG" --benchmark --no-default-config --real-quiet --api-listen --api-port "$PORT" $BFGMINER_OPTS "$@" >/dev/null 2>&1 </dev/null &
+	pid=$!
+	sleep "$SECS"
+	if ! kill -0 "$pid" 2>/dev/null; then
+		echo "$label: $PROG exited early" >&2
+		return 1
+	fi
+	threads="$(sed -n 's/^Threads:[[:space:]]*//p' "/proc/$pid/status")"
+	# utime and stime, counted after the parenthesised command name
+	ticks="$(sed 's/^.*) //' "/proc/$pid/stat" | cut -d' ' -f12,13 | tr ' ' '+')"
+	cpu="$(echo "scale=2; ($ticks) / $HZ" | bc)"
+	mhs="$(rpc summary | tr ',' '\n' | sed -n 's/^MHS av=//p')"
+	# One STATS record per processor; the average is weighted by its wakeups
+	latency="$(rpc stats | tr '|' '\n' | awk -F, '
+		{
+			n = 0; avg = 0; mx = 0
+			for (i = 1; i <= NF; ++i) {
+				split($i, kv, "=")
+				if (kv[1] == "read_wakeups") n = kv[2] + 0
+				else if (kv[1] == "read_wakeup_latency_avg_ms") avg = kv[2] + 0
+				else if (kv[1] == "read_wakeup_latency_max_ms") mx = kv[2] + 0
+			}
+			wakeups += n; total += n * avg
+			if (mx > worst) worst = mx
+		}
+		END {
+			if (wakeups)
+				printf "wakeups=%d wakeup_latency_avg_ms=%.3f wakeup_latency_max_ms=%.3f", wakeups, total / wakeups, worst
+			else
+				printf "wakeups=0 wakeup_latency_avg_ms=? wakeup_latency_max_ms=?"
+		}')"
+	echo "$label: threads=$threads cpu_seconds=$cpu mhs_av=${mhs:-?} $latency"
+	rpc quit >/dev/null
+	sleep 1
+	kill "$pid" 2>/dev/null
+	wait "$pid" 2>/dev/null
+	return 0
+}
+
+bench "thread per device" "$@"
+bench "minerloop reactor" --minerloop-reactor "$@"
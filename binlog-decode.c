@@ -0,0 +1,164 @@
+/*
+ * Copyright 2026 BFGMiner contributors
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.  See COPYING for more details.
+ */
+
+// Converts binary share/nonce logs back to the CSV format of --sharelog/--noncelog
+
+#include "config.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "binlog.h"
+
+static
+uint32_t upk_le(const uint8_t * const p, const int sz)
+{
+	uint32_t rv = 0;
+	for (int i = sz; i--; )
+		rv = (rv << 8) | p[i];
+	return rv;
+}
+
+static
+uint64_t upk_u64le(const uint8_t * const p)
+{
+	return ((uint64_t)upk_le(&p[4], 4) << 32) | upk_le(p, 4);
+}
+
+static
+void hexprint(FILE * const out, const uint8_t *p, size_t sz)
+{
+	for ( ; sz; --sz, ++p)
+		fprintf(out, "%02x", *p);
+}
+
+static
+bool decode_record(FILE * const out, const uint8_t * const rec, const size_t reclen)
+{
+	char procname[BINLOG_PROCNAME_SZ + 1];
+	const unsigned long t = upk_u64le(&rec[8]);
+	const unsigned thr_id = upk_le(&rec[0x10], 4);
+
+	memcpy(procname, &rec[0x14], BINLOG_PROCNAME_SZ);
+	procname[BINLOG_PROCNAME_SZ] = '\0';
+
+	switch (rec[4])
+	{
+		case BLRT_SHARE:
+		{
+			const size_t displen = rec[5];
+			const size_t urllen = upk_le(&rec[6], 2);
+			if (BINLOG_SHARE_FIXED_SZ + displen + urllen > reclen)
+				return false;
+			// timestamp,disposition,target,pool,dev,thr,sharehash,sharedata
+			fprintf(out, "%lu,%.*s,", t, (int)displen, (const char *)&rec[BINLOG_SHARE_FIXED_SZ]);
+			hexprint(out, &rec[0x20], 32);
+			fprintf(out, ",%.*s,%s,%u,", (int)urllen, (const char *)&rec[BINLOG_SHARE_FIXED_SZ + displen], procname, thr_id);
+			hexprint(out, &rec[0x40], 32);
+			fputc(',', out);
+			hexprint(out, &rec[0x60], 128);
+			fputc('\n', out);
+			return true;
+		}
+		case BLRT_NONCE:
+			if (reclen < BINLOG_NONCE_SZ)
+				return false;
+			// timestamp,proc,hash,data,midstate
+			fprintf(out, "%lu,%s,", t, procname);
+			hexprint(out, &rec[0x20], 32);
+			fputc(',', out);
+			hexprint(out, &rec[0x40], 80);
+			fputc(',', out);
+			hexprint(out, &rec[0x90], 32);
+			fputc('\n', out);
+			return true;
+	}
+	return false;
+}
+
+static
+int decode_file(const char * const filename, FILE * const in, FILE * const out)
+{
+	uint8_t hdr[BINLOG_FILEHDR_SZ], *rec = NULL;
+	size_t recsz = 0, reclen;
+	uint32_t hdrsz;
+
+	if (fread(hdr, sizeof(hdr), 1, in) != 1 || memcmp(hdr, BINLOG_MAGIC, 8))
+	{
+		fprintf(stderr, "%s: Not a BFGMiner binary log\n", filename);
+		return 1;
+	}
+	if (upk_le(&hdr[8], 4) != BINLOG_VERSION)
+	{
+		fprintf(stderr, "%s: Unsupported binary log version %lu\n", filename, (unsigned long)upk_le(&hdr[8], 4));
+		return 1;
+	}
+	// Skip any header extension
+	for (hdrsz = upk_le(&hdr[0xc], 4); hdrsz > sizeof(hdr); --hdrsz)
+		if (fgetc(in) == EOF)
+			return 0;
+
+	while (true)
+	{
+		uint8_t lenbuf[4];
+		if (fread(lenbuf, sizeof(lenbuf), 1, in) != 1)
+			break;
+		reclen = upk_le(lenbuf, 4);
+		if (!reclen)
+			// Zero-filled tail of a file that was not closed cleanly
+			break;
+		if (reclen < BINLOG_RECHDR_SZ)
+		{
+			fprintf(stderr, "%s: Corrupt record length %lu\n", filename, (unsigned long)reclen);
+			free(rec);
+			return 1;
+		}
+		if (reclen > recsz)
+		{
+			recsz = reclen;
+			rec = realloc(rec, recsz);
+		}
+		memcpy(rec, lenbuf, sizeof(lenbuf));
+		if (fread(&rec[4], reclen - 4, 1, in) != 1)
+		{
+			fprintf(stderr, "%s: Truncated record\n", filename);
+			break;
+		}
+		if (!decode_record(out, rec, reclen))
+			fprintf(stderr, "%s: Skipping unknown or malformed record type %u\n", filename, (unsigned)rec[4]);
+	}
+	free(rec);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	int rv = 0;
+
+	if (argc < 2)
+		return decode_file("stdin", stdin, stdout);
+
+	for (int i = 1; i < argc; ++i)
+	{
+		FILE * const in = fopen(argv[i], "rb");
+		if (!in)
+		{
+			perror(argv[i]);
+			rv = 1;
+			continue;
+		}
+		if (decode_file(argv[i], in, stdout))
+			rv = 1;
+		fclose(in);
+	}
+	return rv;
+}
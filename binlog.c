@@ -0,0 +1,358 @@
+/*
+ * Copyright 2026 BFGMiner contributors
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.  See COPYING for more details.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+
+#include "binlog.h"
+#include "logging.h"
+#include "miner.h"
+#include "util.h"
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+// Records are queued here by the submitting threads; the writer swaps buffers
+#define BINLOG_QUEUE_SZ  0x40000
+
+struct bfg_binlog {
+	char *path;
+	const char *purpose;
+	size_t segsz;
+
+	pthread_mutex_t mutex;
+	pthread_cond_t cond_writer;
+	pthread_cond_t cond_space;
+	uint8_t *buf;
+	uint8_t *spare;
+	size_t buflen;
+	bool shutdown;
+	unsigned long dropped;
+	pthread_t pth;
+
+	// Only touched by the writer thread after open
+	int fd;
+	uint8_t *map;
+	size_t used;
+};
+
+static
+bool binlog_write_filehdr(uint8_t * const p)
+{
+	memcpy(p, BINLOG_MAGIC, 8);
+	pk_u32le(p, 8, BINLOG_VERSION);
+	pk_u32le(p, 0xc, BINLOG_FILEHDR_SZ);
+	return true;
+}
+
+static
+bool binlog_check_filehdr(const uint8_t * const p)
+{
+	return !(memcmp(p, BINLOG_MAGIC, 8) || upk_u32le(p, 8) != BINLOG_VERSION);
+}
+
+// Finds the end of the existing records in a file we are appending to
+static
+size_t binlog_find_end(const uint8_t * const p, const size_t sz)
+{
+	size_t off = upk_u32le(p, 0xc), reclen;
+	while (off + BINLOG_RECHDR_SZ <= sz)
+	{
+		reclen = upk_u32le(p, off);
+		if (reclen < BINLOG_RECHDR_SZ || off + reclen > sz)
+			break;
+		off += reclen;
+	}
+	return off;
+}
+
+static
+bool binlog_open_segment(struct bfg_binlog * const bl)
+{
+	struct stat st;
+	uint8_t hdr[BINLOG_FILEHDR_SZ];
+
+	bl->fd = open(bl->path, O_RDWR | O_CREAT | O_BINARY, 0666);
+	if (bl->fd == -1)
+		applogr(false, LOG_ERR, "Failed to open %s for %s: %s", bl->path, bl->purpose, bfg_strerror(errno, BST_ERRNO));
+	if (fstat(bl->fd, &st))
+		goto err;
+	if (st.st_size > 0)
+	{
+		if (st.st_size < BINLOG_FILEHDR_SZ || read(bl->fd, hdr, sizeof(hdr)) != sizeof(hdr) || !binlog_check_filehdr(hdr))
+		{
+			applog(LOG_ERR, "%s exists but is not a binary %s", bl->path, bl->purpose);
+			close(bl->fd);
+			bl->fd = -1;
+			return false;
+		}
+	}
+
+#ifdef HAVE_SYS_MMAN_H
+	if ((size_t)st.st_size > bl->segsz)
+		bl->segsz = st.st_size;
+	if (ftruncate(bl->fd, bl->segsz))
+		goto err;
+	bl->map = mmap(NULL, bl->segsz, PROT_READ | PROT_WRITE, MAP_SHARED, bl->fd, 0);
+	if (bl->map == MAP_FAILED)
+	{
+		bl->map = NULL;
+		goto err;
+	}
+	if (st.st_size > 0)
+		bl->used = binlog_find_end(bl->map, st.st_size);
+	else
+	{
+		binlog_write_filehdr(bl->map);
+		bl->used = BINLOG_FILEHDR_SZ;
+	}
+#else
+	if (st.st_size > 0)
+	{
+		// Without mmap, files are always truncated to their contents
+		bl->used = st.st_size;
+		if (lseek(bl->fd, 0, SEEK_END) == -1)
+			goto err;
+	}
+	else
+	{
+		binlog_write_filehdr(hdr);
+		if (write(bl->fd, hdr, sizeof(hdr)) != sizeof(hdr))
+			goto err;
+		bl->used = BINLOG_FILEHDR_SZ;
+	}
+#endif
+	return true;
+
+err:
+	applog(LOG_ERR, "Failed to set up %s in %s: %s", bl->purpose, bl->path, bfg_strerror(errno, BST_ERRNO));
+	close(bl->fd);
+	bl->fd = -1;
+	return false;
+}
+
+static
+void binlog_close_segment(struct bfg_binlog * const bl)
+{
+	if (bl->fd == -1)
+		return;
+#ifdef HAVE_SYS_MMAN_H
+	if (bl->map)
+	{
+		msync(bl->map, bl->used, MS_SYNC);
+		munmap(bl->map, bl->segsz);
+		bl->map = NULL;
+	}
+	// Drop the preallocated tail so the file only holds records
+	if (ftruncate(bl->fd, bl->used))
+		applog(LOG_WARNING, "Failed to truncate %s: %s", bl->path, bfg_strerror(errno, BST_ERRNO));
+#endif
+	close(bl->fd);
+	bl->fd = -1;
+}
+
+static
+void binlog_rotate(struct bfg_binlog * const bl)
+{
+	char newpath[strlen(bl->path) + 0x16];
+
+	binlog_close_segment(bl);
+	snprintf(newpath, sizeof(newpath), "%s.%lu", bl->path, (unsigned long)time(NULL));
+	if (rename(bl->path, newpath))
+		applog(LOG_ERR, "Failed to rotate %s to %s: %s", bl->path, newpath, bfg_strerror(errno, BST_ERRNO));
+	else
+		applog(LOG_INFO, "Rotated %s to %s", bl->purpose, newpath);
+	binlog_open_segment(bl);
+}
+
+static
+void binlog_write_batch(struct bfg_binlog * const bl, const uint8_t *p, size_t len)
+{
+	size_t reclen;
+
+	while (len)
+	{
+		reclen = upk_u32le(p, 0);
+		if (bl->used + reclen > bl->segsz && bl->used > BINLOG_FILEHDR_SZ)
+			binlog_rotate(bl);
+		if (unlikely(bl->fd == -1))
+		{
+			// Try again to open the file every batch
+			if (!binlog_open_segment(bl))
+				return;
+		}
+#ifdef HAVE_SYS_MMAN_H
+		if (unlikely(bl->used + reclen > bl->segsz))
+		{
+			applog(LOG_ERR, "Record too large for %s segment", bl->purpose);
+			return;
+		}
+		memcpy(&bl->map[bl->used], p, reclen);
+#else
+		if (write(bl->fd, p, reclen) != (ssize_t)reclen)
+		{
+			applog(LOG_ERR, "%s write error: %s", bl->purpose, bfg_strerror(errno, BST_ERRNO));
+			return;
+		}
+#endif
+		bl->used += reclen;
+		p += reclen;
+		len -= reclen;
+	}
+}
+
+static
+void *binlog_writer_thread(void * const userp)
+{
+	struct bfg_binlog * const bl = userp;
+	struct timeval tv_timeout;
+	struct timespec ts_timeout;
+	uint8_t *batch;
+	size_t batchlen;
+	bool shutdown;
+
+	RenameThread("binlog");
+
+	mutex_lock(&bl->mutex);
+	while (true)
+	{
+		// Wait for the buffer to half-fill, but never sit on records for more than a second
+		if (bl->buflen < BINLOG_QUEUE_SZ / 2 && !bl->shutdown)
+		{
+			gettimeofday(&tv_timeout, NULL);
+			tv_timeout.tv_sec += 1;
+			timeval_to_spec(&ts_timeout, &tv_timeout);
+			pthread_cond_timedwait(&bl->cond_writer, &bl->mutex, &ts_timeout);
+		}
+		shutdown = bl->shutdown;
+		if (!bl->buflen)
+		{
+			if (shutdown)
+				break;
+			continue;
+		}
+		batch = bl->buf;
+		batchlen = bl->buflen;
+		bl->buf = bl->spare;
+		bl->spare = batch;
+		bl->buflen = 0;
+		pthread_cond_broadcast(&bl->cond_space);
+		mutex_unlock(&bl->mutex);
+
+		binlog_write_batch(bl, batch, batchlen);
+#ifdef HAVE_SYS_MMAN_H
+		if (bl->map)
+			msync(bl->map, bl->used, MS_ASYNC);
+#endif
+
+		mutex_lock(&bl->mutex);
+		if (shutdown && !bl->buflen)
+			break;
+	}
+	mutex_unlock(&bl->mutex);
+
+	binlog_close_segment(bl);
+	return NULL;
+}
+
+struct bfg_binlog *bfg_binlog_open(const char * const path, const size_t segment_size, const char * const purpose)
+{
+	struct bfg_binlog * const bl = malloc(sizeof(*bl));
+	*bl = (struct bfg_binlog){
+		.path = strdup(path),
+		.purpose = purpose,
+		.segsz = segment_size,
+		.buf = malloc(BINLOG_QUEUE_SZ),
+		.spare = malloc(BINLOG_QUEUE_SZ),
+		.fd = -1,
+	};
+	if (!binlog_open_segment(bl))
+	{
+		free(bl->path);
+		free(bl->buf);
+		free(bl->spare);
+		free(bl);
+		return NULL;
+	}
+	mutex_init(&bl->mutex);
+	if (unlikely(pthread_cond_init(&bl->cond_writer, NULL) || pthread_cond_init(&bl->cond_space, NULL)))
+		quit(1, "Failed to pthread_cond_init in %s", __func__);
+	if (unlikely(pthread_create(&bl->pth, NULL, binlog_writer_thread, bl)))
+		quit(1, "Failed to create %s writer thread", purpose);
+	return bl;
+}
+
+void bfg_binlog_append(struct bfg_binlog * const bl, const void * const rec, const size_t reclen)
+{
+	const size_t padded = binlog_padded_len(reclen);
+	uint8_t *p;
+
+	if (unlikely(padded > BINLOG_QUEUE_SZ || reclen < BINLOG_RECHDR_SZ))
+		applogr(, LOG_ERR, "%s: Bad record length %lu", __func__, (unsigned long)reclen);
+
+	mutex_lock(&bl->mutex);
+	while (true)
+	{
+		if (unlikely(bl->shutdown))
+		{
+			++bl->dropped;
+			mutex_unlock(&bl->mutex);
+			return;
+		}
+		if (likely(bl->buflen + padded <= BINLOG_QUEUE_SZ))
+			break;
+		// Writer is behind; wait for it to swap buffers
+		pthread_cond_signal(&bl->cond_writer);
+		pthread_cond_wait(&bl->cond_space, &bl->mutex);
+	}
+	p = &bl->buf[bl->buflen];
+	memcpy(p, rec, reclen);
+	memset(&p[reclen], 0, padded - reclen);
+	pk_u32le(p, 0, padded);
+	bl->buflen += padded;
+	if (bl->buflen >= BINLOG_QUEUE_SZ / 2)
+		pthread_cond_signal(&bl->cond_writer);
+	mutex_unlock_noyield(&bl->mutex);
+}
+
+// Flushes and closes the file; the log remains valid so late appends are just dropped
+void bfg_binlog_close(struct bfg_binlog * const bl)
+{
+	mutex_lock(&bl->mutex);
+	if (bl->shutdown)
+	{
+		mutex_unlock(&bl->mutex);
+		return;
+	}
+	bl->shutdown = true;
+	pthread_cond_signal(&bl->cond_writer);
+	pthread_cond_broadcast(&bl->cond_space);
+	mutex_unlock(&bl->mutex);
+	pthread_join(bl->pth, NULL);
+
+	if (bl->dropped)
+		applog(LOG_WARNING, "%lu records dropped from %s during shutdown", bl->dropped, bl->purpose);
+}
@@ -0,0 +1,52 @@
+#ifndef BFG_BINLOG_H
+#define BFG_BINLOG_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* On-disk format (all integers little endian):
+ *   File header: "BFGBLOG\0" magic, u32 version, u32 header size
+ *   Records follow back to back, each padded to a multiple of 8 bytes and
+ *   starting with a common header:
+ *     0x00  u32  total record length (0 marks the end of a preallocated file)
+ *     0x04  u8   record type
+ *     0x05  u8   type-specific
+ *     0x06  u16  type-specific
+ *     0x08  u64  timestamp
+ *     0x10  u32  thread id
+ *     0x14  char processor name[12], NUL padded
+ */
+
+#define BINLOG_MAGIC  "BFGBLOG"
+#define BINLOG_VERSION  1
+#define BINLOG_FILEHDR_SZ  0x10
+#define BINLOG_RECHDR_SZ  0x20
+#define BINLOG_PROCNAME_SZ  12
+#define BINLOG_ALIGN  8
+
+enum binlog_rectype {
+	BLRT_END   = 0,
+	// 0x05: disposition length, 0x06: pool URL length
+	// 0x20: target[32], 0x40: hash[32], 0x60: data[128], 0xe0: disposition, pool URL
+	BLRT_SHARE = 1,
+	// 0x20: hash[32], 0x40: data[80], 0x90: midstate[32]
+	BLRT_NONCE = 2,
+};
+
+#define BINLOG_SHARE_FIXED_SZ  0xe0
+#define BINLOG_NONCE_SZ        0xb0
+
+static inline
+size_t binlog_padded_len(const size_t len)
+{
+	return (len + BINLOG_ALIGN - 1) & ~(size_t)(BINLOG_ALIGN - 1);
+}
+
+struct bfg_binlog;
+
+extern struct bfg_binlog *bfg_binlog_open(const char *path, size_t segment_size, const char *purpose);
+extern void bfg_binlog_append(struct bfg_binlog *, const void *rec, size_t reclen);
+extern void bfg_binlog_close(struct bfg_binlog *);
+
+#endif
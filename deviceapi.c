@@ -13,6 +13,7 @@
 
 #include "config.h"
 
+#include <assert.h>
 #include <ctype.h>
 #ifdef WIN32
 #include <winsock2.h>
@@ -21,6 +22,9 @@
 #endif
 #include <stdbool.h>
 #include <stdint.h>
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif
 #include <sys/time.h>
 #include <sys/types.h>
 #include <time.h>
@@ -143,6 +147,8 @@ bool hashes_done(struct thr_info *thr, int64_t hashes, struct timeval *tvp_hashe
 		thr->scanhash_working = true;
 	
 	thr->hashes_done += hashes;
+	if (hashes > 0)
+		bfg_tseries_add(cgpu, BTSM_HASHES, hashes);
 	if (hashes > cgpu->max_hashes)
 		cgpu->max_hashes = hashes;
 	
@@ -176,6 +182,330 @@ bool hashes_done2(struct thr_info *thr, int64_t hashes, uint32_t *max_nonce)
 	return hashes_done(thr, hashes, &tv_delta, max_nonce);
 }
 
+struct bfg_tseries *bfg_tseries_new(void)
+{
+	struct bfg_tseries * const ts = malloc(sizeof(*ts));
+	*ts = (struct bfg_tseries){
+		.next_sample = 0,
+	};
+	mutex_init(&ts->mutex);
+	timer_set_now(&ts->tv_sample_start);
+	return ts;
+}
+
+// Must hold ts->mutex
+static
+void __bfg_tseries_advance(struct bfg_tseries * const ts, const struct timeval * const tvp_now)
+{
+	struct timeval tv_end;
+	int i;
+	
+	for (i = 0; i < BFG_TSERIES_SAMPLES; ++i)
+	{
+		timer_set_delay(&tv_end, &ts->tv_sample_start, BFG_TSERIES_INTERVAL * 1000000);
+		if (!timer_passed(&tv_end, tvp_now))
+			return;
+		
+		float * const sample = ts->samples[ts->next_sample];
+		for (int j = 0; j < BTSM_COUNT; ++j)
+		{
+			if (j < BTSM_TEMP)
+				sample[j] = ts->cur[j];
+			else
+			if (ts->cur_count[j])
+				sample[j] = ts->cur[j] / ts->cur_count[j];
+			else
+				sample[j] = 0;
+			ts->cur[j] = 0;
+			ts->cur_count[j] = 0;
+		}
+		ts->next_sample = (ts->next_sample + 1) % BFG_TSERIES_SAMPLES;
+		if (ts->samples_filled < BFG_TSERIES_SAMPLES)
+			++ts->samples_filled;
+		ts->tv_sample_start = tv_end;
+	}
+	// Idle for longer than the whole series; start afresh from now
+	ts->tv_sample_start = *tvp_now;
+}
+
+void bfg_tseries_add(struct cgpu_info * const proc, const enum bfg_tseries_metric metric, const double value)
+{
+	struct bfg_tseries * const ts = proc->tseries;
+	struct timeval tv_now;
+	
+	if (unlikely(!ts))
+		return;
+	timer_set_now(&tv_now);
+	mutex_lock(&ts->mutex);
+	__bfg_tseries_advance(ts, &tv_now);
+	ts->cur[metric] += value;
+	++ts->cur_count[metric];
+	mutex_unlock(&ts->mutex);
+}
+
+// Adds the completed samples, oldest first, as space-separated lists
+struct api_data *bfg_tseries_api(struct api_data *root, struct cgpu_info * const proc)
+{
+	static const char * const names[BTSM_COUNT] = {
+		[BTSM_HASHES] = "MHS Series",
+		[BTSM_NONCES] = "Nonces Series",
+		[BTSM_HW_ERRORS] = "Hardware Errors Series",
+		[BTSM_TEMP] = "Temperature Series",
+		[BTSM_JOB_LATENCY] = "Job Latency Series",
+	};
+	struct bfg_tseries * const ts = proc->tseries;
+	struct timeval tv_now;
+	char buf[BFG_TSERIES_SAMPLES * 0x10], *p;
+	double v;
+	int interval = BFG_TSERIES_INTERVAL;
+	
+	if (!ts)
+		return root;
+	root = api_add_int(root, "Series Interval", &interval, true);
+	timer_set_now(&tv_now);
+	mutex_lock(&ts->mutex);
+	__bfg_tseries_advance(ts, &tv_now);
+	for (int j = 0; j < BTSM_COUNT; ++j)
+	{
+		p = buf;
+		*p = '\0';
+		for (unsigned i = 0; i < ts->samples_filled; ++i)
+		{
+			const unsigned sample = (ts->next_sample + BFG_TSERIES_SAMPLES - ts->samples_filled + i) % BFG_TSERIES_SAMPLES;
+			v = ts->samples[sample][j];
+			switch (j)
+			{
+				case BTSM_HASHES:
+					v /= 1e6 * BFG_TSERIES_INTERVAL;
+					break;
+				case BTSM_JOB_LATENCY:
+					v *= 1e3;  // ms
+					break;
+			}
+			p += sprintf(p, "%s%.*f", i ? " " : "", (j == BTSM_NONCES || j == BTSM_HW_ERRORS) ? 0 : 2, v);
+		}
+		root = api_add_string(root, names[j], buf, true);
+	}
+	mutex_unlock(&ts->mutex);
+	return root;
+}
+
+#define AUTOTUNE_STEP(at, setting)  (((setting) - (at)->min) / (at)->step)
+
+// Visits the processors sharing the tuned option with leader, the first of them
+#define for_each_autotune_proc(proc, leader, at)  \
+	for (proc = leader; proc && proc->device == (leader)->device && (proc == (leader) || (at)->group); proc = proc->next_proc)  \
+		if (proc == (leader) || (at)->group(proc) == (leader))
+
+struct cgpu_info *bfg_set_device_group_device(struct cgpu_info * const proc)
+{
+	return proc->device;
+}
+
+// For drivers whose processors on the same chip share their thread's cgpu_data
+struct cgpu_info *bfg_set_device_group_chip(struct cgpu_info * const proc)
+{
+	void * const chip = proc->thr[0]->cgpu_data;
+	struct cgpu_info *first;
+	
+	for (first = proc->device; first->thr[0]->cgpu_data != chip; first = first->next_proc)
+	{}
+	return first;
+}
+
+/* Options shared by a chip or device are set on every processor sharing
+ * them, so each driver sees the same setting however it stores it */
+static
+bool bfg_autotune_apply(struct cgpu_info * const leader, struct bfg_autotune * const at, const int setting)
+{
+	char replybuf[0x2000], value[0x10];
+	enum bfg_set_device_replytype success;
+	struct cgpu_info *proc;
+	const char *msg;
+	
+	snprintf(value, sizeof(value), "%d", setting);
+	for_each_autotune_proc(proc, leader, at)
+	{
+		msg = proc_set_device(proc, at->optname, value, replybuf, &success);
+		if (success != SDR_OK)
+		{
+			applog(LOG_ERR, "%"PRIpreprv": Autotune failed to set %s to %d (%s), disabling autotune",
+			       proc->proc_repr, at->optname, setting, msg ?: "unknown error");
+			at->enabled = false;
+			return false;
+		}
+	}
+	applog(LOG_DEBUG, "%"PRIpreprv": Autotune set %s to %d",
+	       leader->proc_repr, at->optname, setting);
+	at->setting = setting;
+	return true;
+}
+
+static
+void bfg_autotune_totals(struct cgpu_info * const leader, const struct bfg_autotune * const at, double * const out_diff1, double * const out_bad_diff1)
+{
+	struct cgpu_info *proc;
+	
+	*out_diff1 = *out_bad_diff1 = 0;
+	for_each_autotune_proc(proc, leader, at)
+	{
+		*out_diff1 += proc->diff1;
+		*out_bad_diff1 += proc->bad_diff1;
+	}
+}
+
+static
+void bfg_autotune_start_sample(struct cgpu_info * const leader, struct bfg_autotune * const at, const struct timeval * const tvp_now)
+{
+	at->tv_sample_start = *tvp_now;
+	bfg_autotune_totals(leader, at, &at->diff1_start, &at->bad_diff1_start);
+}
+
+/* Hill climbs from the minimum setting: each step away from the current
+ * setting is kept only if it scores better, and settings with too many
+ * hardware errors or above the target temperature become the new limit.
+ * After a failed step, the next attempt is put off for longer each time.
+ * A tuner for a shared option scores all the processors sharing it together. */
+void bfg_autotune_poll(struct cgpu_info * const leader, const struct timeval * const tvp_now)
+{
+	struct bfg_autotune * const at = leader->autotune;
+	struct cgpu_info *proc;
+	double good, bad;
+	float temp = 0;
+	bool hot = false;
+	int next;
+	
+	if (!at)
+		return;
+	mutex_lock(&at->mutex);
+	if (!at->enabled)
+		goto out;
+	if (!at->started)
+	{
+		at->started = true;
+		if (bfg_autotune_apply(leader, at, at->min))
+			bfg_autotune_start_sample(leader, at, tvp_now);
+		goto out;
+	}
+	if (timer_elapsed(&at->tv_sample_start, tvp_now) < BFG_AUTOTUNE_INTERVAL)
+		goto out;
+	
+	const double elapsed = timer_elapsed_us(&at->tv_sample_start, tvp_now) / 1e6;
+	bfg_autotune_totals(leader, at, &good, &bad);
+	good -= at->diff1_start;
+	bad -= at->bad_diff1_start;
+	if (good < 0 || bad < 0)
+	{
+		// Stats were zeroed
+		bfg_autotune_start_sample(leader, at, tvp_now);
+		goto out;
+	}
+	for_each_autotune_proc(proc, leader, at)
+	{
+		if (proc->temp > temp)
+			temp = proc->temp;
+		if (proc->temp > 0 && proc->temp >= proc->targettemp)
+			hot = true;
+	}
+	const float score = good * 4294967296. / elapsed;
+	const float hw_rate = (good + bad) ? (bad / (good + bad)) : 0;
+	
+	at->history[at->history_next] = (struct bfg_autotune_sample){
+		.when = time(NULL),
+		.setting = at->setting,
+		.score = score,
+		.hw_rate = hw_rate,
+	};
+	at->history_next = (at->history_next + 1) % BFG_AUTOTUNE_HISTORY;
+	if (at->history_count < BFG_AUTOTUNE_HISTORY)
+		++at->history_count;
+	
+	float * const scorep = &at->score[AUTOTUNE_STEP(at, at->setting)];
+	*scorep = (*scorep) ? ((*scorep + score) / 2) : score;
+	
+	next = at->setting;
+	if (hw_rate > BFG_AUTOTUNE_MAX_HW_RATE || hot)
+	{
+		if (at->setting > at->min)
+			next = at->setting - at->step;
+		at->ceiling = next;
+		at->dir = -1;
+		at->probing = false;
+		applog(LOG_WARNING, "%"PRIpreprv": Autotune: %s %d gave %.1f%% hardware errors at %.0fC, limiting to %d",
+		       leader->proc_repr, at->optname, at->setting, hw_rate * 100, temp, next);
+	}
+	else
+	if (at->probing)
+	{
+		at->probing = false;
+		if (*scorep > at->score[AUTOTUNE_STEP(at, at->prev_setting)] * (1 + BFG_AUTOTUNE_HYSTERESIS))
+			at->hold_next = 1;
+		else
+		{
+			next = at->prev_setting;
+			at->dir = -at->dir;
+			at->hold = at->hold_next;
+			if (at->hold_next < 0x10)
+				at->hold_next *= 2;
+		}
+	}
+	else
+	if (at->hold)
+		--at->hold;
+	else
+	{
+		next = at->setting + (at->dir * at->step);
+		if (next > at->ceiling || next < at->min)
+		{
+			at->dir = -at->dir;
+			next = at->setting + (at->dir * at->step);
+		}
+		if (next > at->ceiling || next < at->min)
+			next = at->setting;
+		else
+		{
+			at->probing = true;
+			at->prev_setting = at->setting;
+		}
+	}
+	
+	if (next != at->setting && !bfg_autotune_apply(leader, at, next))
+		goto out;
+	bfg_autotune_start_sample(leader, at, tvp_now);
+out:
+	mutex_unlock(&at->mutex);
+}
+
+struct api_data *bfg_autotune_api(struct api_data *root, struct cgpu_info * const proc)
+{
+	struct bfg_autotune * const at = proc->autotune;
+	char buf[BFG_AUTOTUNE_HISTORY * 0x20], *p = buf;
+	int best;
+	
+	if (!at)
+		return root;
+	mutex_lock(&at->mutex);
+	best = at->min;
+	for (int i = at->min; i <= at->ceiling; i += at->step)
+		if (at->score[AUTOTUNE_STEP(at, i)] > at->score[AUTOTUNE_STEP(at, best)])
+			best = i;
+	root = api_add_string(root, "Autotune Option", at->optname, true);
+	root = api_add_string(root, "Autotune State", (!at->enabled) ? "Off" : (at->probing ? "Probing" : (at->hold ? "Holding" : "Searching")), false);
+	root = api_add_int(root, "Autotune Setting", &at->setting, true);
+	root = api_add_int(root, "Autotune Best", &best, true);
+	root = api_add_int(root, "Autotune Limit", &at->ceiling, true);
+	// Each sample is setting/score/HW error percent, oldest first; scores are MH/s
+	*p = '\0';
+	for (unsigned i = 0; i < at->history_count; ++i)
+	{
+		const struct bfg_autotune_sample * const sample = &at->history[(at->history_next + BFG_AUTOTUNE_HISTORY - at->history_count + i) % BFG_AUTOTUNE_HISTORY];
+		p += sprintf(p, "%s%d/%.2f/%.2f", i ? " " : "", sample->setting, sample->score / 1e6, sample->hw_rate * 100);
+	}
+	root = api_add_string(root, "Autotune History", buf, true);
+	mutex_unlock(&at->mutex);
+	return root;
+}
+
 /* A generic wait function for threads that poll that will wait a specified
  * time tdiff waiting on a work restart request. Returns zero if the condition
  * was met (work restart requested) or ETIMEDOUT if not.
@@ -216,25 +546,79 @@ int restart_wait(struct thr_info *thr, unsigned int mstime)
 }
 
 static
-struct work *get_and_prepare_work(struct thr_info *thr)
+bool prepare_work_or_disable(struct thr_info * const thr, struct work * const work)
 {
 	struct cgpu_info *proc = thr->cgpu;
 	struct device_drv *api = proc->drv;
-	struct work *work;
 	
-	work = get_work(thr);
-	if (!work)
-		return NULL;
 	if (api->prepare_work && !api->prepare_work(thr, work)) {
 		free_work(work);
 		applog(LOG_ERR, "%"PRIpreprv": Work prepare failed, disabling!", proc->proc_repr);
 		proc->deven = DEV_RECOVER_ERR;
 		run_cmd(cmd_idle);
-		return NULL;
+		return false;
+	}
+	return true;
+}
+
+static
+struct work *get_and_prepare_work(struct thr_info *thr)
+{
+	struct cgpu_info *proc = thr->cgpu;
+	struct timeval tv_start, tv_waited;
+	struct work *work;
+	
+	work = thr->prefetch_work;
+	if (work)
+	{
+		thr->prefetch_work = NULL;
+		if (likely(!stale_work(work, false)))
+		{
+			thread_reportin(thr);
+			return work;
+		}
+		free_work(work);
 	}
+	
+	// Without prefetched work, the processor is idle until we return
+	timer_set_now(&tv_start);
+	work = get_work(thr);
+	if (!work)
+		return NULL;
+	if (!prepare_work_or_disable(thr, work))
+		return NULL;
+	timer_set_now(&tv_waited);
+	timersub(&tv_waited, &tv_start, &tv_waited);
+	timeradd(&proc->tv_work_wait, &tv_waited, &proc->tv_work_wait);
 	return work;
 }
 
+// Gets and prepares the next work while the current job runs, if any is staged
+static
+void prefetch_work(struct thr_info * const thr)
+{
+	struct work *work;
+	
+	if (thr->prefetch_work || thr->work_restart)
+		return;
+	work = try_get_work(thr);
+	if (!work)
+		return;
+	if (!prepare_work_or_disable(thr, work))
+		return;
+	thr->prefetch_work = work;
+}
+
+static
+void drop_prefetched_work(struct thr_info * const thr)
+{
+	if (thr->prefetch_work)
+	{
+		free_work(thr->prefetch_work);
+		thr->prefetch_work = NULL;
+	}
+}
+
 // Miner loop to manage a single processor (with possibly multiple threads per processor)
 void minerloop_scanhash(struct thr_info *mythr)
 {
@@ -314,6 +698,8 @@ disabled:
 void mt_disable_start__async(struct thr_info * const mythr)
 {
 	mt_disable_start(mythr);
+	mt_timers_changed(mythr);
+	drop_prefetched_work(mythr);
 	if (mythr->prev_work)
 		free_work(mythr->prev_work);
 	mythr->prev_work = mythr->work;
@@ -328,13 +714,29 @@ bool do_job_prepare(struct thr_info *mythr, struct timeval *tvp_now)
 	struct timeval tv_worktime;
 	
 	mythr->tv_morework.tv_sec = -1;
+	mt_timers_changed(mythr);
 	mythr->_job_transition_in_progress = true;
+	mythr->tv_job_prepare = *tvp_now;
 	if (mythr->work)
 		timersub(tvp_now, &mythr->work->tv_work_start, &tv_worktime);
 	if ((!mythr->work) || abandon_work(mythr->work, &tv_worktime, proc->max_hashes))
 	{
+		if (mythr->work_restart)
+			drop_prefetched_work(mythr);
 		mythr->work_restart = false;
 		request_work(mythr);
+		if (unlikely(mythr->minerloop_shared))
+		{
+			// A shared minerloop cannot wait in get_work, so check back shortly instead
+			if (mythr->prefetch_work && stale_work(mythr->prefetch_work, false))
+				drop_prefetched_work(mythr);
+			prefetch_work(mythr);
+			if (!mythr->prefetch_work)
+			{
+				timer_set_delay(&mythr->tv_morework, tvp_now, 10000);
+				return true;
+			}
+		}
 		// FIXME: Allow get_work to return NULL to retry on notification
 		if (mythr->next_work)
 			free_work(mythr->next_work);
@@ -376,6 +778,7 @@ void do_get_results(struct thr_info *mythr, bool proceed_with_new_job)
 	
 	mythr->_job_transition_in_progress = true;
 	mythr->tv_results_jobstart = mythr->tv_jobstart;
+	mt_timers_changed(mythr);
 	mythr->_proceed_with_new_job = proceed_with_new_job;
 	if (api->job_get_results)
 		api->job_get_results(mythr, work);
@@ -407,9 +810,27 @@ void do_job_start(struct thr_info *mythr)
 	struct device_drv *api = proc->drv;
 	
 	thread_reportin(mythr);
+	mt_timers_changed(mythr);
 	api->job_start(mythr);
 }
 
+// Records how long it took to get fresh work to the device after restart_threads
+static
+void restart_complete(struct thr_info * const mythr, const struct timeval * const tvp_now)
+{
+	struct cgpu_info * const proc = mythr->cgpu;
+	struct timeval tv_latency;
+	
+	if (!timer_isset(&mythr->tv_restart))
+		return;
+	timersub(tvp_now, &mythr->tv_restart, &tv_latency);
+	timer_unset(&mythr->tv_restart);
+	timeradd(&proc->tv_restart_latency, &tv_latency, &proc->tv_restart_latency);
+	if (timercmp(&tv_latency, &proc->tv_restart_latency_max, >))
+		proc->tv_restart_latency_max = tv_latency;
+	++proc->restarts;
+}
+
 void mt_job_transition(struct thr_info *mythr)
 {
 	struct timeval tv_now;
@@ -424,15 +845,22 @@ void mt_job_transition(struct thr_info *mythr)
 		mythr->prev_work = mythr->work;
 		mythr->work = mythr->next_work;
 		mythr->next_work = NULL;
+		// If another restart came in meanwhile, this work is already stale
+		if (!mythr->work_restart)
+			restart_complete(mythr, &tv_now);
 	}
 	mythr->tv_jobstart = tv_now;
 	mythr->_job_transition_in_progress = false;
+	mt_timers_changed(mythr);
+	bfg_tseries_add(mythr->cgpu, BTSM_JOB_LATENCY, timer_elapsed_us(&mythr->tv_job_prepare, &tv_now) / 1e6);
 }
 
 void job_start_complete(struct thr_info *mythr)
 {
 	struct timeval tv_now;
 	
+	// Drivers often set tv_morework around this, while polling another processor
+	mt_timers_changed(mythr);
 	if (unlikely(!mythr->prev_work))
 		return;
 	
@@ -452,6 +880,7 @@ void job_start_abort(struct thr_info *mythr, bool failure)
 	}
 	mythr->work = NULL;
 	mythr->_job_transition_in_progress = false;
+	mt_timers_changed(mythr);
 }
 
 bool do_process_results(struct thr_info *mythr, struct timeval *tvp_now, struct work *work, bool stopping)
@@ -475,172 +904,763 @@ bool do_process_results(struct thr_info *mythr, struct timeval *tvp_now, struct
 	return true;
 }
 
+// FD_SETSIZE limits fd values (except on Windows, where it limits the count)
+static inline
+bool select_fd_fits(const SOCKETTYPE fd)
+{
+#ifdef WIN32
+	return true;
+#else
+	return fd < FD_SETSIZE;
+#endif
+}
+
+static
+bool notifier_select_fits(const struct thr_info * const thr)
+{
+	if (!(select_fd_fits(thr->notifier[0]) && select_fd_fits(thr->work_restart_notifier[0])))
+		return false;
+	if (thr->mutex_request[1] != INVSOCK && !select_fd_fits(thr->mutex_request[0]))
+		return false;
+	return true;
+}
+
 static
-void do_notifier_select(struct thr_info *thr, struct timeval *tvp_timeout)
+void notifier_select_add(struct thr_info * const thr, fd_set * const rfds, int * const maxfdp)
 {
-	struct cgpu_info *cgpu = thr->cgpu;
-	struct timeval tv_now;
-	int maxfd;
-	fd_set rfds;
-	
-	timer_set_now(&tv_now);
-	FD_ZERO(&rfds);
-	FD_SET(thr->notifier[0], &rfds);
-	maxfd = thr->notifier[0];
-	FD_SET(thr->work_restart_notifier[0], &rfds);
-	set_maxfd(&maxfd, thr->work_restart_notifier[0]);
-	if (thr->mutex_request[1] != INVSOCK)
+	// Callers check notifier_select_fits; this only keeps FD_SET in bounds if they didn't
+	if (unlikely(!notifier_select_fits(thr)))
 	{
-		FD_SET(thr->mutex_request[0], &rfds);
-		set_maxfd(&maxfd, thr->mutex_request[0]);
-	}
-	if (select(maxfd + 1, &rfds, NULL, NULL, select_timeout(tvp_timeout, &tv_now)) < 0)
+		applog(LOG_ERR, "%"PRIpreprv": Notifier fd too large for select", thr->cgpu->proc_repr);
 		return;
-	if (thr->mutex_request[1] != INVSOCK && FD_ISSET(thr->mutex_request[0], &rfds))
+	}
+	FD_SET(thr->notifier[0], rfds);
+	set_maxfd(maxfdp, thr->notifier[0]);
+	FD_SET(thr->work_restart_notifier[0], rfds);
+	set_maxfd(maxfdp, thr->work_restart_notifier[0]);
+	if (thr->mutex_request[1] != INVSOCK)
 	{
-		// FIXME: This can only handle one request at a time!
-		pthread_mutex_t *mutexp = &cgpu->device_mutex;
-		notifier_read(thr->mutex_request);
-		mutex_lock(mutexp);
-		pthread_cond_signal(&cgpu->device_cond);
-		pthread_cond_wait(&cgpu->device_cond, mutexp);
-		mutex_unlock(mutexp);
+		FD_SET(thr->mutex_request[0], rfds);
+		set_maxfd(maxfdp, thr->mutex_request[0]);
 	}
-	if (FD_ISSET(thr->notifier[0], &rfds)) {
-		notifier_read(thr->notifier);
+	if (thr->poll_fd != -1 && select_fd_fits(thr->poll_fd))
+	{
+		FD_SET(thr->poll_fd, rfds);
+		set_maxfd(maxfdp, thr->poll_fd);
 	}
-	if (FD_ISSET(thr->work_restart_notifier[0], &rfds))
-		notifier_read(thr->work_restart_notifier);
 }
 
-void cgpu_setup_control_requests(struct cgpu_info * const cgpu)
+static void timer_wheel_all_dirty(struct bfg_timer_wheel *);
+
+static
+void notifier_handle_mutex_request(struct thr_info * const thr)
 {
-	mutex_init(&cgpu->device_mutex);
-	notifier_init(cgpu->thr[0]->mutex_request);
-	pthread_cond_init(&cgpu->device_cond, bfg_condattr);
+	struct cgpu_info *cgpu = thr->cgpu;
+	
+	// FIXME: This can only handle one request at a time!
+	pthread_mutex_t *mutexp = &cgpu->device_mutex;
+	notifier_read(thr->mutex_request);
+	mutex_lock(mutexp);
+	pthread_cond_signal(&cgpu->device_cond);
+	pthread_cond_wait(&cgpu->device_cond, mutexp);
+	mutex_unlock(mutexp);
+	// The other thread may have changed any processor's deadlines
+	if (thr->timer_wheel)
+		timer_wheel_all_dirty(thr->timer_wheel);
 }
 
-void cgpu_request_control(struct cgpu_info * const cgpu)
+// The device has data, so the driver need not wait for its next tv_poll
+static
+void notifier_handle_poll_fd(struct thr_info * const thr)
 {
-	struct thr_info * const thr = cgpu->thr[0];
-	if (pthread_equal(pthread_self(), thr->pth))
-		return;
-	mutex_lock(&cgpu->device_mutex);
-	notifier_wake(thr->mutex_request);
-	pthread_cond_wait(&cgpu->device_cond, &cgpu->device_mutex);
+	thr->cgpu->drv->poll(thr);
+	mt_timers_changed(thr);
 }
 
-void cgpu_release_control(struct cgpu_info * const cgpu)
+// The device fd goes first, since a control request lets another thread read or close it
+static
+void notifier_select_handle(struct thr_info * const thr, fd_set * const rfds)
 {
-	struct thr_info * const thr = cgpu->thr[0];
-	if (pthread_equal(pthread_self(), thr->pth))
+	if (unlikely(!notifier_select_fits(thr)))
 		return;
-	pthread_cond_signal(&cgpu->device_cond);
-	mutex_unlock(&cgpu->device_mutex);
+	if (thr->poll_fd != -1 && select_fd_fits(thr->poll_fd) && FD_ISSET(thr->poll_fd, rfds))
+		notifier_handle_poll_fd(thr);
+	if (thr->mutex_request[1] != INVSOCK && FD_ISSET(thr->mutex_request[0], rfds))
+		notifier_handle_mutex_request(thr);
+	if (FD_ISSET(thr->notifier[0], rfds)) {
+		notifier_read(thr->notifier);
+	}
+	if (FD_ISSET(thr->work_restart_notifier[0], rfds))
+		notifier_read(thr->work_restart_notifier);
 }
 
 static
-void _minerloop_setup(struct thr_info *mythr)
+void do_notifier_select(struct thr_info *thr, struct timeval *tvp_timeout)
 {
-	struct cgpu_info * const cgpu = mythr->cgpu, *proc;
-	
-	if (mythr->work_restart_notifier[1] == -1)
-		notifier_init(mythr->work_restart_notifier);
+	struct timeval tv_now;
+	int maxfd = -1;
+	fd_set rfds;
 	
-	for (proc = cgpu; proc; proc = proc->next_proc)
-	{
-		mythr = proc->thr[0];
-		timer_set_now(&mythr->tv_watchdog);
-		proc->disable_watchdog = true;
-	}
+	timer_set_now(&tv_now);
+	FD_ZERO(&rfds);
+	notifier_select_add(thr, &rfds, &maxfd);
+	if (select(maxfd + 1, &rfds, NULL, NULL, select_timeout(tvp_timeout, &tv_now)) < 0)
+		return;
+	notifier_select_handle(thr, &rfds);
 }
 
-void minerloop_async(struct thr_info *mythr)
+#ifdef HAVE_SYS_EPOLL_H
+// Handles a ready fd from an epoll set; returns false if it is not one of thr's notifiers
+static
+bool notifier_handle_fd(struct thr_info * const thr, const int fd)
 {
-	struct thr_info *thr = mythr;
-	struct cgpu_info *cgpu = mythr->cgpu;
-	struct device_drv *api = cgpu->drv;
-	struct timeval tv_now;
-	struct timeval tv_timeout;
-	struct cgpu_info *proc;
-	bool is_running, should_be_running;
-	
-	_minerloop_setup(mythr);
-	
-	while (likely(!cgpu->shutdown)) {
-		tv_timeout.tv_sec = -1;
-		timer_set_now(&tv_now);
-		for (proc = cgpu; proc; proc = proc->next_proc)
-		{
-			mythr = proc->thr[0];
-			
-			// Nothing should happen while we're starting a job
-			if (unlikely(mythr->busy_state == TBS_STARTING_JOB))
-				goto defer_events;
-			
-			is_running = mythr->work;
-			should_be_running = (proc->deven == DEV_ENABLED && !mythr->pause);
-			
-			if (should_be_running)
+	if (thr->notifier_epoll_mutex_request && fd == thr->mutex_request[0])
+		notifier_handle_mutex_request(thr);
+	else
+	if (fd == thr->notifier[0])
+		notifier_read(thr->notifier);
+	else
+	if (fd == thr->work_restart_notifier[0])
+		notifier_read(thr->work_restart_notifier);
+	else
+	if (thr->poll_fd_epfd != -1 && fd == thr->poll_fd)
+		notifier_handle_poll_fd(thr);
+	else
+		return false;
+	return true;
+}
+
+static
+bool notifier_epoll_add(const int epfd, const int fd)
+{
+	struct epoll_event ev = {
+		.events = EPOLLIN,
+		.data.fd = fd,
+	};
+	return !epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+static
+void notifier_epoll_disable(struct thr_info * const thr)
+{
+	if (thr->poll_fd_epfd == thr->notifier_epfd)
+		thr->poll_fd_epfd = -1;
+	close(thr->notifier_epfd);
+	thr->notifier_epfd = -1;
+}
+
+static
+int notifier_epoll_timeout(struct timeval * const tvp_timeout)
+{
+	struct timeval tv_now;
+	
+	timer_set_now(&tv_now);
+	if (!select_timeout(tvp_timeout, &tv_now))
+		return -1;
+	// Round up, so a timer about to expire doesn't cause a busy loop
+	return (tvp_timeout->tv_sec * 1000) + ((tvp_timeout->tv_usec + 999) / 1000);
+}
+#endif
+
+// Drivers may set or change poll_fd from any callback, so this is checked on every pass; epfd is -1 for select
+static
+void notifier_watch_poll_fd(const int epfd, struct thr_info * const thr, struct timeval * const tvp_timeout)
+{
+	if (thr->poll_fd == -1)
+		return;
+#ifdef HAVE_SYS_EPOLL_H
+	if (epfd != -1)
+	{
+		if (thr->poll_fd_epfd != -1)
+			return;
+		if (notifier_epoll_add(epfd, thr->poll_fd))
+		{
+			thr->poll_fd_epfd = epfd;
+			return;
+		}
+	}
+	else
+#endif
+	if (select_fd_fits(thr->poll_fd))
+		return;
+	// Poll the driver right away, so it notices and falls back to its own tv_poll
+	applog(LOG_DEBUG, "%"PRIpreprv": Cannot wait on device fd %d", thr->cgpu->proc_repr, thr->poll_fd);
+	thr->poll_fd = -1;
+	timer_set_now(&thr->tv_poll);
+	mt_timers_changed(thr);
+	*tvp_timeout = thr->tv_poll;
+}
+
+void mt_poll_fd(struct thr_info * const thr, const int fd)
+{
+	if (fd == thr->poll_fd)
+		return;
+#ifdef HAVE_SYS_EPOLL_H
+	if (thr->poll_fd_epfd != -1)
+	{
+		epoll_ctl(thr->poll_fd_epfd, EPOLL_CTL_DEL, thr->poll_fd, NULL);
+		thr->poll_fd_epfd = -1;
+	}
+#endif
+	thr->poll_fd = fd;
+}
+
+// The notifiers never change, so with epoll they are only registered once rather than on every wait
+static
+void notifier_wait_setup(struct thr_info * const thr)
+{
+#ifdef HAVE_SYS_EPOLL_H
+	const int epfd = epoll_create(3);
+	
+	if (epfd == -1)
+		return;
+	if (!(notifier_epoll_add(epfd, thr->notifier[0]) && notifier_epoll_add(epfd, thr->work_restart_notifier[0])))
+	{
+		applog(LOG_DEBUG, "%"PRIpreprv": %s failed, using select", thr->cgpu->proc_repr, "epoll_ctl");
+		close(epfd);
+		return;
+	}
+	thr->notifier_epfd = epfd;
+#endif
+}
+
+static
+void do_notifier_wait(struct thr_info * const thr, struct timeval * const tvp_timeout)
+{
+#ifdef HAVE_SYS_EPOLL_H
+	// Drivers may only set up control requests once the minerloop is running
+	if (unlikely(thr->notifier_epfd != -1 && thr->mutex_request[1] != INVSOCK && !thr->notifier_epoll_mutex_request))
+	{
+		if (notifier_epoll_add(thr->notifier_epfd, thr->mutex_request[0]))
+			thr->notifier_epoll_mutex_request = true;
+		else
+			notifier_epoll_disable(thr);
+	}
+	notifier_watch_poll_fd(thr->notifier_epfd, thr, tvp_timeout);
+	if (thr->notifier_epfd != -1)
+	{
+		struct epoll_event evs[4];
+		int n, i;
+		
+		n = epoll_wait(thr->notifier_epfd, evs, sizeof(evs) / sizeof(*evs), notifier_epoll_timeout(tvp_timeout));
+		for (i = 0; i < n; ++i)
+			notifier_handle_fd(thr, evs[i].data.fd);
+		return;
+	}
+#else
+	notifier_watch_poll_fd(-1, thr, tvp_timeout);
+#endif
+	do_notifier_select(thr, tvp_timeout);
+}
+
+void cgpu_setup_control_requests(struct cgpu_info * const cgpu)
+{
+	mutex_init(&cgpu->device_mutex);
+	notifier_init(cgpu->thr[0]->mutex_request);
+	pthread_cond_init(&cgpu->device_cond, bfg_condattr);
+}
+
+void cgpu_request_control(struct cgpu_info * const cgpu)
+{
+	struct thr_info * const thr = cgpu->thr[0];
+	if (pthread_equal(pthread_self(), thr->pth))
+		return;
+	mutex_lock(&cgpu->device_mutex);
+	notifier_wake(thr->mutex_request);
+	pthread_cond_wait(&cgpu->device_cond, &cgpu->device_mutex);
+}
+
+void cgpu_release_control(struct cgpu_info * const cgpu)
+{
+	struct thr_info * const thr = cgpu->thr[0];
+	if (pthread_equal(pthread_self(), thr->pth))
+		return;
+	pthread_cond_signal(&cgpu->device_cond);
+	mutex_unlock(&cgpu->device_mutex);
+}
+
+/* The poll, watchdog and morework deadlines of every processor in a minerloop
+ * are kept in a hashed timer wheel, so a wakeup only dispatches processors that
+ * are due. Drivers assign these timevals directly, so the minerloop marks a
+ * processor's timers dirty whenever it calls into the driver for it (and for
+ * its device's first processor, which drivers often poll through), and only
+ * dirty timers are rescheduled after each pass. Drivers changing another
+ * processor's deadlines from their own callbacks call mt_timers_changed. */
+#define BFG_TIMER_WHEEL_SLOTS    0x100
+#define BFG_TIMER_WHEEL_TICK_US  4000
+
+struct bfg_wheel_timer {
+	struct bfg_wheel_proc *wproc;
+	struct timeval *tvp;
+	// The deadline as scheduled; slot is -1 when not in the wheel
+	struct timeval tv_due;
+	int slot;
+	struct bfg_wheel_timer *prev, *next;
+};
+
+// A processor's timers, which are rescheduled together
+struct bfg_wheel_proc {
+	struct bfg_timer_wheel *wheel;
+	struct thr_info *thr;
+	struct bfg_wheel_timer timers[3];
+	bool dirty;
+	struct bfg_wheel_proc *dirty_next;
+};
+
+struct bfg_timer_wheel {
+	struct bfg_wheel_timer *slots[BFG_TIMER_WHEEL_SLOTS];
+	// Bit set for each slot that has timers in it
+	uint64_t slots_used[BFG_TIMER_WHEEL_SLOTS / 64];
+	struct bfg_wheel_proc *wprocs;
+	int wprocs_count;
+	int timers_per_proc;
+	struct bfg_wheel_proc *dirty;
+	// Set when anything may have changed, such as another thread taking control of the device
+	bool all_dirty;
+	int timers_scheduled;
+	// Earliest tick which may still have timers due
+	int64_t tick;
+	// Earliest deadline in the wheel, found again only after it is removed
+	struct timeval tv_next;
+	bool tv_next_valid;
+};
+
+static inline
+int64_t timer_wheel_tick(const struct timeval * const tvp)
+{
+	return ((int64_t)tvp->tv_sec * 1000000 + tvp->tv_usec) / BFG_TIMER_WHEEL_TICK_US;
+}
+
+// Only minerloop_async uses tv_morework, so other minerloops must not have it in their wheel
+static
+struct bfg_timer_wheel *timer_wheel_new(struct thr_info * const mythr, const bool with_morework)
+{
+	struct bfg_timer_wheel * const wheel = malloc(sizeof(*wheel));
+	struct cgpu_info *proc;
+	struct timeval tv_now;
+	int i = 0;
+	
+	*wheel = (struct bfg_timer_wheel){
+		.timers_per_proc = with_morework ? 3 : 2,
+		.all_dirty = true,
+		.tv_next_valid = true,
+	};
+	timer_unset(&wheel->tv_next);
+	for (proc = mythr->cgpu; proc; proc = proc->next_proc)
+		++wheel->wprocs_count;
+	wheel->wprocs = malloc(sizeof(*wheel->wprocs) * wheel->wprocs_count);
+	for (proc = mythr->cgpu; proc; proc = proc->next_proc)
+	{
+		struct thr_info * const thr = proc->thr[0];
+		struct bfg_wheel_proc * const wproc = &wheel->wprocs[i++];
+		struct timeval * const tvps[] = {
+			&thr->tv_poll,
+			&thr->tv_watchdog,
+			&thr->tv_morework,
+		};
+		*wproc = (struct bfg_wheel_proc){
+			.wheel = wheel,
+			.thr = thr,
+		};
+		for (int j = 0; j < wheel->timers_per_proc; ++j)
+			wproc->timers[j] = (struct bfg_wheel_timer){
+				.wproc = wproc,
+				.tvp = tvps[j],
+				.slot = -1,
+			};
+		thr->timer_wheel_proc = wproc;
+	}
+	timer_set_now(&tv_now);
+	wheel->tick = timer_wheel_tick(&tv_now);
+	return wheel;
+}
+
+static
+void timer_wheel_free(struct bfg_timer_wheel * const wheel)
+{
+	if (!wheel)
+		return;
+	for (int i = 0; i < wheel->wprocs_count; ++i)
+		wheel->wprocs[i].thr->timer_wheel_proc = NULL;
+	free(wheel->wprocs);
+	free(wheel);
+}
+
+static
+void timer_wheel_touch(struct bfg_wheel_proc * const wproc)
+{
+	struct bfg_timer_wheel * const wheel = wproc->wheel;
+	
+	if (wproc->dirty)
+		return;
+	wproc->dirty = true;
+	wproc->dirty_next = wheel->dirty;
+	wheel->dirty = wproc;
+}
+
+static
+void timer_wheel_all_dirty(struct bfg_timer_wheel * const wheel)
+{
+	wheel->all_dirty = true;
+}
+
+// Must be called from the minerloop, after changing deadlines of a processor it did not call into the driver for
+void mt_timers_changed(struct thr_info * const thr)
+{
+	struct thr_info * const master_thr = thr->cgpu->device->thr[0];
+	
+	if (thr->timer_wheel_proc)
+		timer_wheel_touch(thr->timer_wheel_proc);
+	if (master_thr->timer_wheel_proc)
+		timer_wheel_touch(master_thr->timer_wheel_proc);
+}
+
+static
+void timer_wheel_remove(struct bfg_timer_wheel * const wheel, struct bfg_wheel_timer * const timer)
+{
+	const int slot = timer->slot;
+	
+	DL_DELETE(wheel->slots[slot], timer);
+	if (!wheel->slots[slot])
+		wheel->slots_used[slot / 64] &= ~((uint64_t)1 << (slot % 64));
+	timer->slot = -1;
+	--wheel->timers_scheduled;
+	if (wheel->tv_next_valid && timercmp(&timer->tv_due, &wheel->tv_next, ==))
+		wheel->tv_next_valid = false;
+}
+
+static
+void timer_wheel_insert(struct bfg_timer_wheel * const wheel, struct bfg_wheel_timer * const timer)
+{
+	// A timerclear'd deadline is "due at the epoch", and would make the minerloop spin forever
+	assert(timerisset(timer->tvp));
+	timer->tv_due = *timer->tvp;
+	// Overdue timers go in the current slot, to be dispatched on the next pass
+	const int64_t tick = timer_wheel_tick(&timer->tv_due);
+	const int slot = ((tick > wheel->tick) ? tick : wheel->tick) % BFG_TIMER_WHEEL_SLOTS;
+	timer->slot = slot;
+	DL_APPEND(wheel->slots[slot], timer);
+	wheel->slots_used[slot / 64] |= (uint64_t)1 << (slot % 64);
+	if (wheel->tv_next_valid)
+		reduce_timeout_to(&wheel->tv_next, &timer->tv_due);
+	++wheel->timers_scheduled;
+}
+
+// (Re)schedules a processor's timers whose deadline changed, and those which fired but are still set
+static
+void timer_wheel_sync_proc(struct bfg_timer_wheel * const wheel, struct bfg_wheel_proc * const wproc)
+{
+	wproc->dirty = false;
+	for (int i = 0; i < wheel->timers_per_proc; ++i)
+	{
+		struct bfg_wheel_timer * const timer = &wproc->timers[i];
+		if (timer->slot != -1)
+		{
+			if (timercmp(&timer->tv_due, timer->tvp, ==))
+				continue;
+			timer_wheel_remove(wheel, timer);
+		}
+		if (timer_isset(timer->tvp))
+			timer_wheel_insert(wheel, timer);
+	}
+}
+
+static
+void timer_wheel_sync(struct bfg_timer_wheel * const wheel)
+{
+	struct bfg_wheel_proc *wproc;
+	
+	if (unlikely(wheel->all_dirty))
+	{
+		wheel->all_dirty = false;
+		for (int i = 0; i < wheel->wprocs_count; ++i)
+			timer_wheel_sync_proc(wheel, &wheel->wprocs[i]);
+		wheel->dirty = NULL;
+		return;
+	}
+	while ((wproc = wheel->dirty))
+	{
+		wheel->dirty = wproc->dirty_next;
+		timer_wheel_sync_proc(wheel, wproc);
+	}
+}
+
+// Returns how many ticks after tick the next slot with timers is, or -1 if there is none within limit ticks
+static
+int timer_wheel_skip(const struct bfg_timer_wheel * const wheel, const int64_t tick, const int limit)
+{
+	int i = 0;
+	
+	while (i <= limit)
+	{
+		const int slot = (tick + i) % BFG_TIMER_WHEEL_SLOTS;
+		const uint64_t bits = wheel->slots_used[slot / 64] >> (slot % 64);
+		if (bits)
+		{
+			i += __builtin_ctzll(bits);
+			return (i <= limit) ? i : -1;
+		}
+		i += 64 - (slot % 64);
+	}
+	return -1;
+}
+
+// Removes and returns a timer due by tvp_now, or returns NULL if there are none
+static
+struct bfg_wheel_timer *timer_wheel_pop(struct bfg_timer_wheel * const wheel, const struct timeval * const tvp_now)
+{
+	const int64_t now_tick = timer_wheel_tick(tvp_now);
+	struct bfg_wheel_timer *timer;
+	int skip;
+	
+	// One lap visits every slot, so there is no need to catch up any further
+	if (now_tick - wheel->tick >= BFG_TIMER_WHEEL_SLOTS)
+		wheel->tick = now_tick - BFG_TIMER_WHEEL_SLOTS + 1;
+	while (true)
+	{
+		const int limit = (now_tick > wheel->tick) ? (now_tick - wheel->tick) : 0;
+		skip = timer_wheel_skip(wheel, wheel->tick, limit);
+		if (skip < 0)
+		{
+			wheel->tick += limit;
+			return NULL;
+		}
+		wheel->tick += skip;
+		DL_FOREACH(wheel->slots[wheel->tick % BFG_TIMER_WHEEL_SLOTS], timer)
+		{
+			if (timercmp(&timer->tv_due, tvp_now, >))
+				continue;
+			timer_wheel_remove(wheel, timer);
+			// Whatever handles it may or may not set it again
+			timer_wheel_touch(timer->wproc);
+			return timer;
+		}
+		if (wheel->tick >= now_tick)
+			return NULL;
+		++wheel->tick;
+	}
+}
+
+// Reduces *tvp_timeout to the earliest deadline in the wheel
+static
+void timer_wheel_next(struct bfg_timer_wheel * const wheel, struct timeval * const tvp_timeout)
+{
+	struct bfg_wheel_timer *timer;
+	int64_t tick = wheel->tick;
+	int skip, limit = BFG_TIMER_WHEEL_SLOTS - 1;
+	
+	if (!wheel->tv_next_valid)
+	{
+		// Only slots with timers are visited, and the first holding one due this lap has the earliest
+		bool found = false;
+		timer_unset(&wheel->tv_next);
+		while (!found && (skip = timer_wheel_skip(wheel, tick, limit)) >= 0)
+		{
+			tick += skip;
+			limit -= skip + 1;
+			DL_FOREACH(wheel->slots[tick % BFG_TIMER_WHEEL_SLOTS], timer)
 			{
-				if (unlikely(!(is_running || mythr->_job_transition_in_progress)))
-				{
-					mt_disable_finish(mythr);
-					goto djp;
-				}
-				if (unlikely(mythr->work_restart))
-					goto djp;
+				reduce_timeout_to(&wheel->tv_next, &timer->tv_due);
+				// Anything in a later lap is due after this
+				if (timer_wheel_tick(&timer->tv_due) <= tick)
+					found = true;
+			}
+			++tick;
+		}
+		wheel->tv_next_valid = true;
+	}
+	reduce_timeout_to(tvp_timeout, &wheel->tv_next);
+}
+
+// Dispatches due poll and watchdog timers; returns the thread of a processor it ran, or NULL when none remain
+static
+struct thr_info *minerloop_run_timer(struct thr_info * const mythr, struct timeval * const tvp_now)
+{
+	struct bfg_wheel_timer *timer;
+	
+	while ((timer = timer_wheel_pop(mythr->timer_wheel, tvp_now)))
+	{
+		struct thr_info * const thr = timer->wproc->thr;
+		struct cgpu_info * const proc = thr->cgpu;
+		
+		// The deadline may have moved later since it was scheduled
+		if (!timer_passed(timer->tvp, tvp_now))
+			continue;
+		if (timer->tvp == &thr->tv_poll)
+		{
+			proc->drv->poll(thr);
+			mt_timers_changed(thr);
+		}
+		else
+		if (timer->tvp == &thr->tv_watchdog)
+		{
+			timer_set_delay(&thr->tv_watchdog, tvp_now, WATCHDOG_INTERVAL * 1000000);
+			bfg_watchdog(proc, tvp_now);
+			// Also picks up any deadline another thread changed without waking the minerloop
+			mt_timers_changed(thr);
+		}
+		else
+			// tv_morework is handled by the next pass of minerloop_async; this only ensures the wakeup
+			continue;
+		return thr;
+	}
+	return NULL;
+}
+
+static
+void minerloop_timers_done(struct thr_info * const mythr, struct timeval * const tvp_timeout)
+{
+	timer_wheel_sync(mythr->timer_wheel);
+	timer_wheel_next(mythr->timer_wheel, tvp_timeout);
+}
+
+static
+void _minerloop_setup(struct thr_info *mythr, const bool async)
+{
+	struct cgpu_info * const cgpu = mythr->cgpu, *proc;
+	struct thr_info * const loopthr = mythr;
+	
+	if (mythr->work_restart_notifier[1] == -1)
+		notifier_init(mythr->work_restart_notifier);
+	
+	for (proc = cgpu; proc; proc = proc->next_proc)
+	{
+		mythr = proc->thr[0];
+		timer_set_now(&mythr->tv_watchdog);
+		proc->disable_watchdog = true;
+		if (!async)
+			timer_unset(&mythr->tv_morework);
+		else
+		if (!timerisset(&mythr->tv_morework))
+			// Threads start with it cleared, meaning a job should be started right away
+			timer_set_now(&mythr->tv_morework);
+	}
+	
+	loopthr->timer_wheel = timer_wheel_new(loopthr, async);
+	timer_wheel_sync(loopthr->timer_wheel);
+}
+
+// Runs one pass of the async state machine over all processors of a device
+static
+void minerloop_async_once(struct thr_info *mythr, struct timeval * const tvp_now, struct timeval * const tvp_timeout)
+{
+	struct thr_info * const loopthr = mythr;
+	struct cgpu_info *cgpu = mythr->cgpu;
+	struct cgpu_info *proc;
+	bool is_running, should_be_running;
+	
+	for (proc = cgpu; proc; proc = proc->next_proc)
+	{
+		mythr = proc->thr[0];
+		
+		// Nothing should happen while we're starting a job
+		if (unlikely(mythr->busy_state == TBS_STARTING_JOB))
+			goto defer_events;
+		
+		is_running = mythr->work;
+		should_be_running = (proc->deven == DEV_ENABLED && !mythr->pause);
+		
+		if (should_be_running)
+		{
+			if (unlikely(!(is_running || mythr->_job_transition_in_progress)))
+			{
+				mt_disable_finish(mythr);
+				mt_timers_changed(mythr);
+				goto djp;
 			}
-			else  // ! should_be_running
+			if (unlikely(mythr->work_restart))
+				goto djp;
+		}
+		else  // ! should_be_running
+		{
+			if (unlikely(mythr->_job_transition_in_progress && timer_isset(&mythr->tv_morework)))
+			{
+				// Really only happens at startup
+				applog(LOG_DEBUG, "%"PRIpreprv": Job transition in progress, with morework timer enabled: unsetting in-progress flag", proc->proc_repr);
+				mythr->_job_transition_in_progress = false;
+			}
+			if (unlikely((is_running || !mythr->_mt_disable_called) && !mythr->_job_transition_in_progress))
 			{
-				if (unlikely(mythr->_job_transition_in_progress && timer_isset(&mythr->tv_morework)))
-				{
-					// Really only happens at startup
-					applog(LOG_DEBUG, "%"PRIpreprv": Job transition in progress, with morework timer enabled: unsetting in-progress flag", proc->proc_repr);
-					mythr->_job_transition_in_progress = false;
-				}
-				if (unlikely((is_running || !mythr->_mt_disable_called) && !mythr->_job_transition_in_progress))
-				{
 disabled: ;
-					if (is_running)
-					{
-						if (mythr->busy_state != TBS_GETTING_RESULTS)
-							do_get_results(mythr, false);
-						else
-							// Avoid starting job when pending result fetch completes
-							mythr->_proceed_with_new_job = false;
-					}
-					else  // !mythr->_mt_disable_called
-						mt_disable_start__async(mythr);
+				if (is_running)
+				{
+					if (mythr->busy_state != TBS_GETTING_RESULTS)
+						do_get_results(mythr, false);
+					else
+						// Avoid starting job when pending result fetch completes
+						mythr->_proceed_with_new_job = false;
 				}
-				
-				timer_unset(&mythr->tv_morework);
+				else  // !mythr->_mt_disable_called
+					mt_disable_start__async(mythr);
 			}
 			
-			if (timer_passed(&mythr->tv_morework, &tv_now))
+			if (timer_isset(&mythr->tv_morework))
 			{
-djp: ;
-				if (!do_job_prepare(mythr, &tv_now))
-					goto disabled;
-			}
-			
-defer_events:
-			if (timer_passed(&mythr->tv_poll, &tv_now))
-				api->poll(mythr);
-			
-			if (timer_passed(&mythr->tv_watchdog, &tv_now))
-			{
-				timer_set_delay(&mythr->tv_watchdog, &tv_now, WATCHDOG_INTERVAL * 1000000);
-				bfg_watchdog(proc, &tv_now);
+				timer_unset(&mythr->tv_morework);
+				mt_timers_changed(mythr);
 			}
-			
-			reduce_timeout_to(&tv_timeout, &mythr->tv_morework);
-			reduce_timeout_to(&tv_timeout, &mythr->tv_poll);
-			reduce_timeout_to(&tv_timeout, &mythr->tv_watchdog);
 		}
 		
-		do_notifier_select(thr, &tv_timeout);
+		if (timer_passed(&mythr->tv_morework, tvp_now))
+		{
+djp: ;
+			if (!do_job_prepare(mythr, tvp_now))
+				goto disabled;
+		}
+		
+defer_events:
+		// Have the next work ready so the job transition only needs to talk to the device
+		if (mythr->busy_state == TBS_IDLE && mythr->work && !mythr->_job_transition_in_progress && proc->deven == DEV_ENABLED && !mythr->pause)
+			prefetch_work(mythr);
+	}
+	
+	while (minerloop_run_timer(loopthr, tvp_now))
+	{}
+	minerloop_timers_done(loopthr, tvp_timeout);
+}
+
+static bool minerloop_reactor(struct thr_info *);
+
+static
+void _minerloop_async(struct thr_info *mythr, const bool may_share)
+{
+	struct cgpu_info *cgpu = mythr->cgpu;
+	struct timeval tv_now;
+	struct timeval tv_timeout;
+	
+	_minerloop_setup(mythr, true);
+	
+	if (may_share && opt_minerloop_reactor && minerloop_reactor(mythr))
+		return;
+	
+	notifier_wait_setup(mythr);
+	while (likely(!cgpu->shutdown)) {
+		tv_timeout.tv_sec = -1;
+		timer_set_now(&tv_now);
+		minerloop_async_once(mythr, &tv_now, &tv_timeout);
+		do_notifier_wait(mythr, &tv_timeout);
+	}
+}
+
+void minerloop_async(struct thr_info * const mythr)
+{
+	_minerloop_async(mythr, true);
+}
+
+void minerloop_async_unshared(struct thr_info * const mythr)
+{
+	_minerloop_async(mythr, false);
+}
+
+static
+void queue_drop_pending(struct thr_info *mythr)
+{
+	if (mythr->next_work)
+	{
+		free_work(mythr->next_work);
+		mythr->next_work = NULL;
 	}
+	drop_prefetched_work(mythr);
 }
 
 static
@@ -650,10 +1670,97 @@ void do_queue_flush(struct thr_info *mythr)
 	struct device_drv *api = proc->drv;
 	
 	api->queue_flush(mythr);
-	if (mythr->next_work)
+	queue_drop_pending(mythr);
+}
+
+// Replaces the device queue with fresh work, in one command if the driver supports it
+static
+void do_queue_restart(struct thr_info *mythr)
+{
+	struct cgpu_info *proc = mythr->cgpu;
+	struct device_drv *api = proc->drv;
+	struct timeval tv_now;
+	struct work *work;
+	
+	mythr->work_restart = false;
+	if (!api->queue_replace)
 	{
-		free_work(mythr->next_work);
-		mythr->next_work = NULL;
+		do_queue_flush(mythr);
+		return;
+	}
+	
+	queue_drop_pending(mythr);
+	request_work(mythr);
+	work = get_and_prepare_work(mythr);
+	if (work && api->queue_replace(mythr, work))
+	{
+		timer_set_now(&tv_now);
+		restart_complete(mythr, &tv_now);
+		return;
+	}
+	api->queue_flush(mythr);
+	// Appended by minerloop_queue as usual
+	mythr->next_work = work;
+}
+
+static
+void minerloop_queue_proc(struct thr_info * const mythr)
+{
+	struct cgpu_info * const proc = mythr->cgpu;
+	struct device_drv * const api = proc->drv;
+	struct work *work;
+	
+	if (proc->deven == DEV_ENABLED && !mythr->pause)
+	{
+		if (unlikely(mythr->_mt_disable_called))
+		{
+			mt_disable_finish(mythr);
+			mt_timers_changed(mythr);
+		}
+		
+		if (unlikely(mythr->work_restart))
+		{
+			do_queue_restart(mythr);
+			mt_timers_changed(mythr);
+		}
+		
+		while (!mythr->queue_full)
+		{
+			if (mythr->next_work)
+			{
+				work = mythr->next_work;
+				mythr->next_work = NULL;
+			}
+			else
+			{
+				request_work(mythr);
+				// FIXME: Allow get_work to return NULL to retry on notification
+				work = get_and_prepare_work(mythr);
+			}
+			if (!work)
+				break;
+			mt_timers_changed(mythr);
+			if (!api->queue_append(mythr, work))
+				mythr->next_work = work;
+			else
+			if (unlikely(timer_isset(&mythr->tv_restart) && !mythr->work_restart))
+			{
+				struct timeval tv_appended;
+				timer_set_now(&tv_appended);
+				restart_complete(mythr, &tv_appended);
+			}
+		}
+		
+		// Have work ready for when the queue has room again
+		if (mythr->queue_full && !mythr->next_work)
+			prefetch_work(mythr);
+	}
+	else
+	if (unlikely(!mythr->_mt_disable_called))
+	{
+		do_queue_flush(mythr);
+		mt_disable_start(mythr);
+		mt_timers_changed(mythr);
 	}
 }
 
@@ -661,82 +1768,62 @@ void minerloop_queue(struct thr_info *thr)
 {
 	struct thr_info *mythr;
 	struct cgpu_info *cgpu = thr->cgpu;
-	struct device_drv *api = cgpu->drv;
 	struct timeval tv_now;
 	struct timeval tv_timeout;
 	struct cgpu_info *proc;
-	bool should_be_running;
-	struct work *work;
 	
-	_minerloop_setup(thr);
+	_minerloop_setup(thr, false);
+	notifier_wait_setup(thr);
 	
 	while (likely(!cgpu->shutdown)) {
 		tv_timeout.tv_sec = -1;
 		timer_set_now(&tv_now);
 		for (proc = cgpu; proc; proc = proc->next_proc)
+			minerloop_queue_proc(proc->thr[0]);
+		
+		while ((mythr = minerloop_run_timer(thr, &tv_now)))
 		{
-			mythr = proc->thr[0];
-			
-			should_be_running = (proc->deven == DEV_ENABLED && !mythr->pause);
-redo:
-			if (should_be_running)
-			{
-				if (unlikely(mythr->_mt_disable_called))
-					mt_disable_finish(mythr);
-				
-				if (unlikely(mythr->work_restart))
-				{
-					mythr->work_restart = false;
-					do_queue_flush(mythr);
-				}
-				
-				while (!mythr->queue_full)
-				{
-					if (mythr->next_work)
-					{
-						work = mythr->next_work;
-						mythr->next_work = NULL;
-					}
-					else
-					{
-						request_work(mythr);
-						// FIXME: Allow get_work to return NULL to retry on notification
-						work = get_and_prepare_work(mythr);
-					}
-					if (!work)
-						break;
-					if (!api->queue_append(mythr, work))
-						mythr->next_work = work;
-				}
-			}
-			else
-			if (unlikely(!mythr->_mt_disable_called))
-			{
-				do_queue_flush(mythr);
-				mt_disable_start(mythr);
-			}
-			
-			if (timer_passed(&mythr->tv_poll, &tv_now))
-				api->poll(mythr);
-			
-			if (timer_passed(&mythr->tv_watchdog, &tv_now))
-			{
-				timer_set_delay(&mythr->tv_watchdog, &tv_now, WATCHDOG_INTERVAL * 1000000);
-				bfg_watchdog(proc, &tv_now);
-			}
-			
-			should_be_running = (proc->deven == DEV_ENABLED && !mythr->pause);
-			if (should_be_running && !mythr->queue_full)
-				goto redo;
-			
-			reduce_timeout_to(&tv_timeout, &mythr->tv_poll);
-			reduce_timeout_to(&tv_timeout, &mythr->tv_watchdog);
+			proc = mythr->cgpu;
+			// Polling may have made room in the queue
+			if (proc->deven == DEV_ENABLED && !mythr->pause && !mythr->queue_full)
+				minerloop_queue_proc(mythr);
 		}
 		
-		// HACK: Some designs set the main thr tv_poll from secondary thrs
-		reduce_timeout_to(&tv_timeout, &cgpu->thr[0]->tv_poll);
-		
-		do_notifier_select(thr, &tv_timeout);
+		// NOTE: Secondary thrs' driver calls also mark the main thr, since some designs change its tv_poll from them
+		minerloop_timers_done(thr, &tv_timeout);
+		do_notifier_wait(thr, &tv_timeout);
+	}
+}
+
+static
+void miner_thread_cleanup(struct thr_info * const mythr)
+{
+	struct cgpu_info * const cgpu = mythr->cgpu;
+	struct device_drv * const drv = cgpu->drv;
+	struct cgpu_info *proc = cgpu;
+	
+	do
+	{
+		proc->deven = DEV_DISABLED;
+		proc->status = LIFE_DEAD2;
+	}
+	while ( (proc = proc->next_proc) && !proc->threads);
+	mythr->getwork = 0;
+	mythr->has_pth = false;
+	cgsleep_ms(1);
+	
+	if (drv->thread_shutdown)
+		drv->thread_shutdown(mythr);
+
+	notifier_destroy(mythr->notifier);
+	timer_wheel_free(mythr->timer_wheel);
+	mythr->timer_wheel = NULL;
+	if (mythr->notifier_epfd != -1)
+	{
+		if (mythr->poll_fd_epfd == mythr->notifier_epfd)
+			mythr->poll_fd_epfd = -1;
+		close(mythr->notifier_epfd);
+		mythr->notifier_epfd = -1;
 	}
 }
 
@@ -774,24 +1861,295 @@ void *miner_thread(void *userdata)
 		minerloop_scanhash(mythr);
 	__thr_being_msg(LOG_NOTICE, mythr, "shutting down");
 
-out: ;
-	struct cgpu_info *proc = cgpu;
-	do
+out:
+	miner_thread_cleanup(mythr);
+	return NULL;
+}
+
+bool opt_minerloop_reactor;
+
+// With select, each device needs up to 4 fds watched, plus one for the reactor itself
+#define MINERLOOP_REACTOR_MAX_DEVICES  ((FD_SETSIZE - 1) / 4)
+#define MINERLOOP_REACTOR_MAX_EVENTS  0x40
+
+/* A reactor runs minerloop_async for many devices in the thread of the first
+ * device assigned to it; other devices' threads hand over and exit */
+struct minerloop_reactor {
+	pthread_t pth;
+	notifier_t notifier;
+	// epoll set of every device's notifiers, or -1 to use select
+	int epfd;
+	struct thr_info *thrs[MINERLOOP_REACTOR_MAX_DEVICES];
+	int thrs_count;
+	struct minerloop_reactor *next;
+};
+
+static struct minerloop_reactor *minerloop_reactors;
+static pthread_mutex_t minerloop_reactors_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Control requests may be set up after the device joined, so this is checked on every pass
+static
+void minerloop_reactor_watch_mutex_request(struct minerloop_reactor * const reactor, struct thr_info * const thr)
+{
+#ifdef HAVE_SYS_EPOLL_H
+	if (reactor->epfd == -1 || thr->mutex_request[1] == INVSOCK || thr->notifier_epoll_mutex_request)
+		return;
+	if (notifier_epoll_add(reactor->epfd, thr->mutex_request[0]))
+		thr->notifier_epoll_mutex_request = true;
+	else
+		applog(LOG_ERR, "%"PRIpreprv": %s failed for control requests", thr->cgpu->proc_repr, "epoll_ctl");
+#endif
+}
+
+// Returns false if the reactor cannot wait on thr's notifiers
+static
+bool minerloop_reactor_watch(struct minerloop_reactor * const reactor, struct thr_info * const thr)
+{
+#ifdef HAVE_SYS_EPOLL_H
+	if (reactor->epfd != -1)
 	{
-		proc->deven = DEV_DISABLED;
-		proc->status = LIFE_DEAD2;
+		if (!notifier_epoll_add(reactor->epfd, thr->notifier[0]))
+			return false;
+		if (!notifier_epoll_add(reactor->epfd, thr->work_restart_notifier[0]))
+		{
+			epoll_ctl(reactor->epfd, EPOLL_CTL_DEL, thr->notifier[0], NULL);
+			return false;
+		}
+		minerloop_reactor_watch_mutex_request(reactor, thr);
+		return true;
 	}
-	while ( (proc = proc->next_proc) && !proc->threads);
-	mythr->getwork = 0;
-	mythr->has_pth = false;
-	cgsleep_ms(1);
+#endif
+	return notifier_select_fits(thr);
+}
+
+static
+void minerloop_reactor_unwatch(struct minerloop_reactor * const reactor, struct thr_info * const thr)
+{
+#ifdef HAVE_SYS_EPOLL_H
+	if (reactor->epfd == -1)
+		return;
+	epoll_ctl(reactor->epfd, EPOLL_CTL_DEL, thr->notifier[0], NULL);
+	epoll_ctl(reactor->epfd, EPOLL_CTL_DEL, thr->work_restart_notifier[0], NULL);
+	if (thr->notifier_epoll_mutex_request)
+	{
+		epoll_ctl(reactor->epfd, EPOLL_CTL_DEL, thr->mutex_request[0], NULL);
+		thr->notifier_epoll_mutex_request = false;
+	}
+	if (thr->poll_fd_epfd == reactor->epfd)
+	{
+		epoll_ctl(reactor->epfd, EPOLL_CTL_DEL, thr->poll_fd, NULL);
+		thr->poll_fd_epfd = -1;
+	}
+#endif
+}
+
+static
+void minerloop_reactor_wait(struct minerloop_reactor * const reactor, const int count, struct timeval * const tvp_timeout)
+{
+	struct thr_info *thr;
+	struct timeval tv_now;
+	int maxfd, i;
+	fd_set rfds;
 	
-	if (drv->thread_shutdown)
-		drv->thread_shutdown(mythr);
+#ifdef HAVE_SYS_EPOLL_H
+	if (reactor->epfd != -1)
+	{
+		struct epoll_event evs[MINERLOOP_REACTOR_MAX_EVENTS];
+		int n, j;
+		
+		n = epoll_wait(reactor->epfd, evs, MINERLOOP_REACTOR_MAX_EVENTS, notifier_epoll_timeout(tvp_timeout));
+		for (i = 0; i < n; ++i)
+		{
+			const int fd = evs[i].data.fd;
+			if (fd == reactor->notifier[0])
+			{
+				notifier_read(reactor->notifier);
+				continue;
+			}
+			for (j = 0; j < count; ++j)
+				if (notifier_handle_fd(reactor->thrs[j], fd))
+					break;
+		}
+		return;
+	}
+#endif
+	
+	FD_ZERO(&rfds);
+	maxfd = reactor->notifier[0];
+	FD_SET(reactor->notifier[0], &rfds);
+	for (i = 0; i < count; ++i)
+	{
+		thr = reactor->thrs[i];
+		notifier_select_add(thr, &rfds, &maxfd);
+	}
+	
+	timer_set_now(&tv_now);
+	if (select(maxfd + 1, &rfds, NULL, NULL, select_timeout(tvp_timeout, &tv_now)) >= 0)
+	{
+		if (FD_ISSET(reactor->notifier[0], &rfds))
+			notifier_read(reactor->notifier);
+		for (i = 0; i < count; ++i)
+			notifier_select_handle(reactor->thrs[i], &rfds);
+	}
+}
 
-	notifier_destroy(mythr->notifier);
+static
+void minerloop_reactor_run(struct minerloop_reactor * const reactor, struct thr_info * const ownthr)
+{
+	struct thr_info *thr, *gone[MINERLOOP_REACTOR_MAX_DEVICES];
+	struct timeval tv_now, tv_timeout;
+	int count, gone_count, i;
+	
+	mutex_lock(&minerloop_reactors_mutex);
+	while (true)
+	{
+		// Drop devices that have shut down; entries are only ever removed by this thread
+		gone_count = 0;
+		for (i = 0; i < reactor->thrs_count; )
+		{
+			thr = reactor->thrs[i];
+			if (likely(!thr->cgpu->shutdown))
+			{
+				++i;
+				continue;
+			}
+			reactor->thrs[i] = reactor->thrs[--reactor->thrs_count];
+			gone[gone_count++] = thr;
+		}
+		count = reactor->thrs_count;
+		if (!count)
+		{
+			LL_DELETE(minerloop_reactors, reactor);
+			mutex_unlock(&minerloop_reactors_mutex);
+			break;
+		}
+		mutex_unlock(&minerloop_reactors_mutex);
+		
+		// The thread running the reactor cleans up its own device when it returns
+		for (i = 0; i < gone_count; ++i)
+		{
+			minerloop_reactor_unwatch(reactor, gone[i]);
+			if (gone[i] != ownthr)
+				miner_thread_cleanup(gone[i]);
+		}
+		
+		tv_timeout.tv_sec = -1;
+		timer_set_now(&tv_now);
+		for (i = 0; i < count; ++i)
+		{
+			thr = reactor->thrs[i];
+			minerloop_async_once(thr, &tv_now, &tv_timeout);
+			minerloop_reactor_watch_mutex_request(reactor, thr);
+			notifier_watch_poll_fd(reactor->epfd, thr, &tv_timeout);
+		}
+		
+		minerloop_reactor_wait(reactor, count, &tv_timeout);
+		
+		mutex_lock(&minerloop_reactors_mutex);
+	}
+	
+	for (i = 0; i < gone_count; ++i)
+	{
+		minerloop_reactor_unwatch(reactor, gone[i]);
+		if (gone[i] != ownthr)
+			miner_thread_cleanup(gone[i]);
+	}
+#ifdef HAVE_SYS_EPOLL_H
+	if (reactor->epfd != -1)
+		close(reactor->epfd);
+#endif
+	notifier_destroy(reactor->notifier);
+	free(reactor);
+}
 
-	return NULL;
+static
+struct minerloop_reactor *minerloop_reactor_new(void)
+{
+	struct minerloop_reactor * const reactor = malloc(sizeof(*reactor));
+	
+	*reactor = (struct minerloop_reactor){
+		.pth = pthread_self(),
+		.epfd = -1,
+	};
+	notifier_init(reactor->notifier);
+#ifdef HAVE_SYS_EPOLL_H
+	reactor->epfd = epoll_create(MINERLOOP_REACTOR_MAX_EVENTS);
+	if (reactor->epfd != -1 && !notifier_epoll_add(reactor->epfd, reactor->notifier[0]))
+	{
+		close(reactor->epfd);
+		reactor->epfd = -1;
+	}
+#endif
+	if (reactor->epfd == -1 && !select_fd_fits(reactor->notifier[0]))
+	{
+		notifier_destroy(reactor->notifier);
+		free(reactor);
+		return NULL;
+	}
+	return reactor;
+}
+
+// Returns false if the device could not join a reactor, and should run its own minerloop
+static
+bool minerloop_reactor(struct thr_info * const mythr)
+{
+	struct cgpu_info * const cgpu = mythr->cgpu;
+	struct minerloop_reactor *reactor;
+	bool owner = false;
+	
+	// Any device that blocks would stall every other device in the reactor
+	if (!(cgpu->drv->minerloop_reactor_safe && mythr->mutex_request[1] == INVSOCK))
+	{
+		applog(LOG_DEBUG, "%"PRIpreprv": Driver may block, not sharing minerloop", cgpu->proc_repr);
+		return false;
+	}
+	
+	mutex_lock(&minerloop_reactors_mutex);
+	LL_FOREACH(minerloop_reactors, reactor)
+		if (reactor->thrs_count < MINERLOOP_REACTOR_MAX_DEVICES && minerloop_reactor_watch(reactor, mythr))
+			break;
+	if (!reactor)
+	{
+		reactor = minerloop_reactor_new();
+		if (!(reactor && minerloop_reactor_watch(reactor, mythr)))
+		{
+			mutex_unlock(&minerloop_reactors_mutex);
+			if (reactor)
+			{
+				if (reactor->epfd != -1)
+					close(reactor->epfd);
+				notifier_destroy(reactor->notifier);
+				free(reactor);
+			}
+			applog(LOG_WARNING, "%"PRIpreprv": Cannot wait on notifiers from a shared minerloop, running separately",
+			       mythr->cgpu->proc_repr);
+			return false;
+		}
+		LL_APPEND(minerloop_reactors, reactor);
+		owner = true;
+	}
+	reactor->thrs[reactor->thrs_count++] = mythr;
+	for (struct cgpu_info *proc = cgpu; proc; proc = proc->next_proc)
+		proc->thr[0]->minerloop_shared = true;
+	if (!owner)
+	{
+		/* This thread exits below, and its id may be reused, so control
+		 * requests and cancellation must go to the reactor's thread */
+		mythr->pth = reactor->pth;
+		mythr->has_pth = false;
+	}
+	applog(LOG_DEBUG, "%"PRIpreprv": %s shared minerloop (%d devices)",
+	       mythr->cgpu->proc_repr, owner ? "Running" : "Joined", reactor->thrs_count);
+	if (!owner)
+		notifier_wake(reactor->notifier);
+	mutex_unlock(&minerloop_reactors_mutex);
+	
+	if (owner)
+		minerloop_reactor_run(reactor, mythr);
+	else
+		// The reactor handles everything else for this device, including cleanup
+		pthread_exit(NULL);
+	return true;
 }
 
 static pthread_mutex_t _add_cgpu_mutex = PTHREAD_MUTEX_INITIALIZER;
@@ -931,6 +2289,85 @@ const char *proc_set_device_temp_target(struct cgpu_info * const proc, const cha
 	return NULL;
 }
 
+const char *proc_set_device_autotune(struct cgpu_info * const proc, const char * const optname, const char * const newvalue, char * const replybuf, enum bfg_set_device_replytype * const out_success)
+{
+	const struct bfg_set_device_definition *sdf;
+	struct cgpu_info *leader;
+	struct bfg_autotune *at = NULL;
+	int min, max, step = 1, n;
+	
+	*out_success = SDR_ERR;
+	if (!strcasecmp(newvalue, "off"))
+	{
+		// The tuner may be on an earlier processor sharing the option
+		for (leader = proc->device; leader && leader->device == proc->device; leader = leader->next_proc)
+		{
+			at = leader->autotune;
+			if (at && (leader == proc || (at->group && at->group(proc) == leader)))
+				break;
+			at = NULL;
+		}
+		if (at)
+		{
+			mutex_lock(&at->mutex);
+			at->enabled = false;
+			mutex_unlock(&at->mutex);
+		}
+		*out_success = SDR_OK;
+		return NULL;
+	}
+	
+	const char * const colon = strchr(newvalue, ':');
+	if (!colon)
+		return "Expected <option>:<min>-<max>[:<step>]";
+	const size_t optlen = colon - newvalue;
+	if (sscanf(&colon[1], "%d-%d%n", &min, &max, &n) < 2)
+		return "Invalid range";
+	if (colon[1 + n] == ':' && sscanf(&colon[2 + n], "%d", &step) < 1)
+		return "Invalid step";
+	if (step <= 0 || max < min || (max - min) / step >= BFG_AUTOTUNE_MAX_STEPS)
+		return "Invalid range or step";
+	
+	// Only options defined for the processor can be tuned
+	for (sdf = proc->set_device_funcs; sdf && sdf->optname; ++sdf)
+		if (strlen(sdf->optname) == optlen && !strncasecmp(sdf->optname, newvalue, optlen))
+			break;
+	if (!(sdf && sdf->optname))
+		return "Unknown option to tune";
+	
+	// Options shared by a chip or device get one tuner, on the first processor sharing them
+	leader = sdf->group ? sdf->group(proc) : proc;
+	at = leader->autotune;
+	if (!at)
+	{
+		at = malloc(sizeof(*at));
+		*at = (struct bfg_autotune){
+			.enabled = false,
+		};
+		mutex_init(&at->mutex);
+		leader->autotune = at;
+	}
+	mutex_lock(&at->mutex);
+	free(at->optname);
+	at->optname = strdup(sdf->optname);
+	at->group = sdf->group;
+	at->min = at->setting = min;
+	at->max = at->ceiling = max - ((max - min) % step);
+	at->step = step;
+	at->dir = 1;
+	at->probing = false;
+	at->hold = 0;
+	at->hold_next = 1;
+	memset(at->score, 0, sizeof(at->score));
+	at->history_next = at->history_count = 0;
+	at->started = false;
+	at->enabled = true;
+	mutex_unlock(&at->mutex);
+	
+	*out_success = SDR_OK;
+	return NULL;
+}
+
 static inline
 void _set_auto_sdr(enum bfg_set_device_replytype * const out_success, const char * const rv, const char * const optname)
 {
@@ -999,6 +2436,9 @@ const char *proc_set_device(struct cgpu_info * const proc, char * const optname,
 			else
 			if (!strcasecmp(optname, "temp-target") || !strcasecmp(optname, "temp_target"))
 				return proc_set_device_temp_target(proc, optname, newvalue, replybuf, out_success);
+			else
+			if (!strcasecmp(optname, "autotune"))
+				return proc_set_device_autotune(proc, optname, newvalue, replybuf, out_success);
 		default:
 			break;
 	}
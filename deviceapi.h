@@ -43,6 +43,7 @@ extern float common_scrypt_min_nonce_diff(struct cgpu_info *, const struct minin
 
 extern void request_work(struct thr_info *);
 extern struct work *get_work(struct thr_info *);
+extern struct work *try_get_work(struct thr_info *);
 extern bool hashes_done(struct thr_info *, int64_t hashes, struct timeval *tvp_hashes, uint32_t *max_nonce);
 extern bool hashes_done2(struct thr_info *, int64_t hashes, uint32_t *max_nonce);
 extern void mt_disable_start(struct thr_info *);
@@ -62,7 +63,14 @@ extern void mt_job_transition(struct thr_info *);
 extern void job_start_complete(struct thr_info *);
 extern void job_start_abort(struct thr_info *, bool failure);
 extern bool do_process_results(struct thr_info *, struct timeval *tvp_now, struct work *, bool stopping);
+extern void mt_timers_changed(struct thr_info *);
+// Has the minerloop call drv->poll as soon as fd is readable; -1 stops it. Call before closing fd
+extern void mt_poll_fd(struct thr_info *, int fd);
 extern void minerloop_async(struct thr_info *);
+// Like minerloop_async, but never shared with other devices, for drivers marked minerloop_reactor_safe whose device may still block
+extern void minerloop_async_unshared(struct thr_info *);
+// Run minerloop_async devices from shared threads
+extern bool opt_minerloop_reactor;
 
 extern void minerloop_queue(struct thr_info *);
 
@@ -73,6 +81,80 @@ extern void cgpu_release_control(struct cgpu_info *);
 
 extern void *miner_thread(void *);
 
+// Per-processor history, as a ring of samples covering fixed intervals
+#define BFG_TSERIES_SAMPLES   30
+#define BFG_TSERIES_INTERVAL  60  // seconds
+
+enum bfg_tseries_metric {
+	// Totalled for each sample
+	BTSM_HASHES,
+	BTSM_NONCES,
+	BTSM_HW_ERRORS,
+	// Averaged for each sample
+	BTSM_TEMP,         // sampled by the watchdog
+	BTSM_JOB_LATENCY,  // seconds
+	BTSM_COUNT,
+};
+
+struct bfg_tseries {
+	pthread_mutex_t mutex;
+	struct timeval tv_sample_start;
+	double cur[BTSM_COUNT];
+	unsigned cur_count[BTSM_COUNT];
+	float samples[BFG_TSERIES_SAMPLES][BTSM_COUNT];
+	unsigned next_sample;
+	unsigned samples_filled;
+};
+
+extern struct bfg_tseries *bfg_tseries_new(void);
+extern void bfg_tseries_add(struct cgpu_info *, enum bfg_tseries_metric, double value);
+extern struct api_data *bfg_tseries_api(struct api_data *, struct cgpu_info *);
+
+typedef struct cgpu_info *(*bfg_set_device_group_func_t)(struct cgpu_info *proc);
+
+/* Searches one of a processor's numeric set-device options (usually a
+ * clock or voltage) for the setting giving the best hashrate. An option
+ * shared by a chip or device is tuned once, on the total of the processors
+ * sharing it, by a tuner kept on the first of them. Enabled with the
+ * "autotune" option:
+ *   autotune=<option>:<min>-<max>[:<step>]
+ */
+#define BFG_AUTOTUNE_INTERVAL    300  // seconds measured per setting
+#define BFG_AUTOTUNE_MAX_STEPS   0x100
+#define BFG_AUTOTUNE_HISTORY     0x10
+#define BFG_AUTOTUNE_HYSTERESIS  0.03  // improvement needed to keep a change
+#define BFG_AUTOTUNE_MAX_HW_RATE 0.05  // higher settings are never retried
+
+struct bfg_autotune_sample {
+	time_t when;
+	int setting;
+	float score;
+	float hw_rate;
+};
+
+struct bfg_autotune {
+	pthread_mutex_t mutex;
+	bool enabled;
+	bool started;
+	char *optname;
+	bfg_set_device_group_func_t group;
+	int min, max, step;
+	int ceiling;
+	int setting;
+	int prev_setting;
+	int dir;
+	bool probing;
+	unsigned hold, hold_next;
+	struct timeval tv_sample_start;
+	double diff1_start, bad_diff1_start;
+	float score[BFG_AUTOTUNE_MAX_STEPS];
+	struct bfg_autotune_sample history[BFG_AUTOTUNE_HISTORY];
+	unsigned history_next, history_count;
+};
+
+extern void bfg_autotune_poll(struct cgpu_info *, const struct timeval *tvp_now);
+extern struct api_data *bfg_autotune_api(struct api_data *, struct cgpu_info *);
+
 extern void add_cgpu_live(void*);
 extern bool add_cgpu_slave(struct cgpu_info *, struct cgpu_info *master);
 
@@ -89,8 +171,13 @@ struct bfg_set_device_definition {
 	const char *optname;
 	bfg_set_device_func_t func;
 	const char *description;
+	// Returns the first processor sharing the option with proc; NULL if each processor has its own
+	bfg_set_device_group_func_t group;
 };
+extern struct cgpu_info *bfg_set_device_group_device(struct cgpu_info *);
+extern struct cgpu_info *bfg_set_device_group_chip(struct cgpu_info *);
 extern const char *proc_set_device(struct cgpu_info *proc, char *optname, char *newvalue, char *replybuf, enum bfg_set_device_replytype *out_success);
+extern const char *proc_set_device_autotune(struct cgpu_info *, const char *optname, const char *newvalue, char *replybuf, enum bfg_set_device_replytype *);
 #ifdef HAVE_CURSES
 extern const char *proc_set_device_tui_wrapper(struct cgpu_info *proc, char *optname, bfg_set_device_func_t, const char *prompt, const char *success_msg);
 #endif
@@ -22,6 +22,8 @@
 #include "util.h"
 
 #define AAN_DEFAULT_NONCE_PDIFF  8
+// Limited by the 16-bit mantissa of the compressed target
+#define AAN_MAX_NONCE_PDIFF  0x10000
 
 // WARNING: Do not just change this without fixing aan_freq2pll!
 #define AAN_MAX_FREQ  6132
@@ -351,9 +353,10 @@ bool aan_queue_append(struct thr_info * const thr, struct work * const work)
 	
 	applog(LOG_DEBUG, "%s: queue_append queues_empty=%d", proc->proc_repr, master_board->queues_empty-1);
 	
+	const float desired_nonce_pdiff = cgpu_auto_nonce_diff(proc, 1, work_mining_algorithm(work), chip->desired_nonce_pdiff, AAN_MAX_NONCE_PDIFF);
 	work->nonce_diff = work->work_difficulty;
-	if (work->nonce_diff > chip->desired_nonce_pdiff)
-		work->nonce_diff = chip->desired_nonce_pdiff;
+	if (work->nonce_diff > desired_nonce_pdiff)
+		work->nonce_diff = desired_nonce_pdiff;
 	chip->current_nonce_pdiff = work->nonce_diff;
 	
 	if (set_work(dev, proc->proc_id + 1, work))
@@ -518,7 +521,7 @@ badjob:
 		struct work * const work = chip->works[job_id - 1];
 		if (!work)
 			goto badjob;
-		submit_nonce(thr, work, nonce);
+		submit_nonce_async(thr, work, nonce);
 	}
 	
 	/* check for completed works */
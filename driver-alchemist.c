@@ -163,7 +163,7 @@ bool alchemist_write_global_reg(const int fd, const struct alchemist_chip * cons
 	//bin2hex(output, chip->global_reg, sizeof(chip->global_reg));
 	//applog(LOG_DEBUG, "GLOBAL REG %s", output);
 	
-	if (write(fd, buf, sizeof(buf)) != sizeof(buf))
+	if (serial_write(fd, buf, sizeof(buf)) != sizeof(buf))
 		return false;
 	return true;
 }
@@ -179,7 +179,7 @@ bool alchemist_write_cluster_reg(const int fd, const struct alchemist_chip * con
 	buf[111] = 0xfe;
 	buf[112] = chip->chipid;
 	//applog(LOG_DEBUG, " %u: %u: %u : %u", buf[106], buf[107], buf[108], buf[109]);
-	if (write(fd, buf, sizeof(buf)) != sizeof(buf))
+	if (serial_write(fd, buf, sizeof(buf)) != sizeof(buf))
 		return false;
 	return true;
 }
@@ -239,7 +239,7 @@ bool alchemist_send_golden(const int fd, const struct alchemist_chip * const chi
 	buf[112] = chip->chipid;
 	if (diag)
 		buf[112] |= 0x80;
-	if (write(fd, buf, sizeof(buf)) != sizeof(buf))
+	if (serial_write(fd, buf, sizeof(buf)) != sizeof(buf))
 		return false;
 	return true;
 }
@@ -271,7 +271,7 @@ bool alchemist_send_work(const struct thr_info * const thr, struct work * const
 	//bin2hex(output, cmd, sizeof(cmd));
 	//applog(LOG_DEBUG, "OUTPUT %s", output);
 	
-	if (write(device->device_fd, cmd, sizeof(cmd)) != sizeof(cmd))
+	if (serial_write(device->device_fd, cmd, sizeof(cmd)) != sizeof(cmd))
 		return false;
 	
 	work->blk.nonce = ALCHEMIST_MAX_NONCE;
@@ -204,7 +204,7 @@ static int avalon_send_task(int fd, const struct avalon_task *at,
 		bin2hex(x, buf, nr_len);
 		applog(LOG_DEBUG, "Avalon: Sent(%u): %s", (unsigned int)nr_len, x);
 	}
-	ret = write(fd, buf, nr_len);
+	ret = serial_write(fd, buf, nr_len);
 	if (unlikely(ret != nr_len))
 		return AVA_SEND_ERROR;
 
@@ -233,7 +233,7 @@ static inline int avalon_gets(int fd, uint8_t *buf, int read_count,
 
 	/* Read reply 1 byte at a time to get earliest tv_finish */
 	while (true) {
-		ret = read(fd, buf, 1);
+		ret = serial_read_some(fd, buf, 1);
 		if (ret < 0)
 		{
 			applog(LOG_ERR, "Avalon: Error on read in avalon_gets: %s", bfg_strerror(errno, BST_ERRNO));
@@ -548,7 +548,7 @@ static void avalon_clear_readbuf(int fd)
 		if (ret > 0)
 #endif
 			// Relies on serial timeout for Windows
-			ret = read(fd, buf, AVALON_FTDI_READSIZE);
+			ret = serial_read_some(fd, buf, AVALON_FTDI_READSIZE);
 	} while (ret > 0);
 }
 
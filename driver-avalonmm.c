@@ -78,7 +78,7 @@ bool avalonmm_write_cmd(const int fd, const enum avalonmm_cmd cmd, const void *d
 			memcpy(&pkt[5], data, copysz);
 		crc = crc16xmodem(&pkt[5], AVALONMM_PKT_DATA_SIZE);
 		pk_u16be(pkt, 5 + AVALONMM_PKT_DATA_SIZE, crc);
-		r = write(fd, pkt, sizeof(pkt));
+		r = serial_write(fd, pkt, sizeof(pkt));
 		if (opt_dev_protocol)
 		{
 			char hex[(sizeof(pkt) * 2) + 1];
@@ -771,9 +771,9 @@ const char *avalonmm_set_voltage(struct cgpu_info * const proc, const char * con
 }
 
 static const struct bfg_set_device_definition avalonmm_set_device_funcs[] = {
-	{"clock", avalonmm_set_clock, "clock frequency"},
+	{"clock", avalonmm_set_clock, "clock frequency", bfg_set_device_group_device},
 	{"fan", avalonmm_set_fan, "fan speed (0-100 percent)"},
-	{"voltage", avalonmm_set_voltage, "voltage (0 to 1.5 volts)"},
+	{"voltage", avalonmm_set_voltage, "voltage (0 to 1.5 volts)", bfg_set_device_group_device},
 	{NULL},
 };
 
@@ -170,6 +170,7 @@ struct device_drv bfsb_drv = {
 	.name = "BSB",
 	.drv_detect = bfsb_detect,
 	.minerloop = minerloop_async,
+	.minerloop_reactor_safe = true,
 	.job_prepare = bitfury_job_prepare,
 	.thread_init = bfsb_init,
 	.poll = bitfury_do_io,
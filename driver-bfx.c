@@ -304,6 +304,7 @@ struct device_drv bfx_drv = {
 	.thread_shutdown = bfx_shutdown,
 	
 	.minerloop = minerloop_async,
+	.minerloop_reactor_safe = true,
 	.job_prepare = bitfury_job_prepare,
 	.job_start = bitfury_noop_job_start,
 	.poll = bitfury_do_io,
@@ -41,7 +41,7 @@ ssize_t bifury_write(const struct cgpu_info * const dev, const void * const buf,
 		const int psz = (((const char*)buf)[count-1] == '\n') ? (count - 1) : count;
 		applog(LOG_DEBUG, "%s: DEVPROTO: SEND %.*s", dev->dev_repr, psz, (const char*)buf);
 	}
-	return write(fd, buf, count);
+	return serial_write(fd, buf, count);
 }
 
 static
@@ -60,7 +60,7 @@ parse:
 		bytes_shift(leftover, r + 1);
 		return ret;
 	}
-	if ( (r = read(fd, buf, sizeof(buf))) > 0)
+	if ( (r = serial_read_some(fd, buf, sizeof(buf))) > 0)
 	{
 		bytes_append(leftover, buf, r);
 		goto parse;
@@ -123,12 +123,12 @@ bool bifury_detect_one(const char * const devpath)
 	if (unlikely(fd == -1))
 		return false;
 	
-	while (read(fd, buf, sizeof(buf)) == sizeof(buf))
+	while (serial_read_some(fd, buf, sizeof(buf)) == sizeof(buf))
 	{}
 	
 	if (opt_dev_protocol)
 		applog(LOG_DEBUG, "%s fd=%d: DEVPROTO: SEND %s", bifury_drv.dname, fd, "version");
-	if (8 != write(fd, "version\n", 8))
+	if (8 != serial_write(fd, "version\n", 8))
 	{
 		applog(LOG_DEBUG, "%s: Error sending version request", bifury_drv.dname);
 		goto err;
@@ -312,6 +312,30 @@ void bifury_common_error(struct cgpu_info * const dev, const enum dev_reason rea
 	}
 }
 
+// Adds sent work to the device's list, pruning the oldest beyond max_queued
+static
+void bifury_work_list_add(const struct cgpu_info * const dev, struct work * const work)
+{
+	struct bifury_state * const state = dev->device_data;
+	struct thr_info * const master_thr = dev->thr[0];
+	struct work *old, *tmp;
+	
+	HASH_ADD(hh, master_thr->work_list, device_id, sizeof(work->device_id), work);
+	int prunequeue = HASH_COUNT(master_thr->work_list) - state->max_queued;
+	if (prunequeue > 0)
+	{
+		applog(LOG_DEBUG, "%s: Pruning %d old work item%s",
+		       dev->dev_repr, prunequeue, prunequeue == 1 ? "" : "s");
+		HASH_ITER(hh, master_thr->work_list, old, tmp)
+		{
+			HASH_DEL(master_thr->work_list, old);
+			free_work(old);
+			if (--prunequeue < 1)
+				break;
+		}
+	}
+}
+
 static
 bool bifury_queue_append(struct thr_info * const thr, struct work *work)
 {
@@ -320,7 +344,6 @@ bool bifury_queue_append(struct thr_info * const thr, struct work *work)
 	if (bifury_set_queue_full(dev, -1))
 		return false;
 	
-	struct thr_info * const master_thr = dev->thr[0];
 	char buf[5 + 0x98 + 1 + 8 + 1];
 	memcpy(buf, "work ", 5);
 	bin2hex(&buf[5], work->data, 0x4c);
@@ -332,21 +355,7 @@ bool bifury_queue_append(struct thr_info * const thr, struct work *work)
 		applog(LOG_ERR, "%s: Failed to send work", dev->dev_repr);
 		return false;
 	}
-	HASH_ADD(hh, master_thr->work_list, device_id, sizeof(work->device_id), work);
-	int prunequeue = HASH_COUNT(master_thr->work_list) - state->max_queued;
-	if (prunequeue > 0)
-	{
-		struct work *tmp;
-		applog(LOG_DEBUG, "%s: Pruning %d old work item%s",
-		       dev->dev_repr, prunequeue, prunequeue == 1 ? "" : "s");
-		HASH_ITER(hh, master_thr->work_list, work, tmp)
-		{
-			HASH_DEL(master_thr->work_list, work);
-			free_work(work);
-			if (--prunequeue < 1)
-				break;
-		}
-	}
+	bifury_work_list_add(dev, work);
 	bifury_set_queue_full(dev, state->needwork - 1);
 	return true;
 }
@@ -363,6 +372,30 @@ void bifury_queue_flush(struct thr_info * const thr)
 	bifury_set_queue_full(dev, dev->procs);
 }
 
+// Flushes and sends new work in one write, so the device is never left idle between them
+static
+bool bifury_queue_replace(struct thr_info * const thr, struct work * const work)
+{
+	const struct cgpu_info * const dev = thr->cgpu;
+	if (dev != dev->device || dev->device_fd == -1)
+		return false;
+	struct bifury_state * const state = dev->device_data;
+	char buf[6 + 5 + 0x98 + 1 + 8 + 1];
+	memcpy(buf, "flush\nwork ", 11);
+	bin2hex(&buf[11], work->data, 0x4c);
+	work->device_id = ++state->last_work_id;
+	sprintf(&buf[11 + 0x98], " %08x", work->device_id);
+	buf[11 + 0x98 + 1 + 8] = '\n';
+	if (sizeof(buf) != bifury_write(dev, buf, sizeof(buf)))
+	{
+		applog(LOG_ERR, "%s: Failed to send work", dev->dev_repr);
+		return false;
+	}
+	bifury_work_list_add(dev, work);
+	bifury_set_queue_full(dev, dev->procs - 1);
+	return true;
+}
+
 static
 void bifury_handle_cmd(struct cgpu_info * const dev, const char * const cmd)
 {
@@ -388,7 +421,7 @@ void bifury_handle_cmd(struct cgpu_info * const dev, const char * const cmd)
 		if (work)
 		{
 			const uint32_t work_ntime = be32toh(*(uint32_t*)&work->data[68]);
-			submit_noffset_nonce(thr, work, nonce, ntime - work_ntime);
+			submit_noffset_nonce_async(thr, work, nonce, ntime - work_ntime);
 			hashes_done2(thr, 0x100000000, NULL);
 		}
 		else
@@ -623,6 +656,7 @@ struct device_drv bifury_drv = {
 	.minerloop = minerloop_queue,
 	.queue_append = bifury_queue_append,
 	.queue_flush = bifury_queue_flush,
+	.queue_replace = bifury_queue_replace,
 	.poll = bifury_poll,
 	
 	.get_api_extra_device_status = bifury_api_device_status,
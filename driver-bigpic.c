@@ -51,7 +51,7 @@ static bool bigpic_detect_custom(const char *devpath, struct device_drv *api, st
 	char buf[sizeof(struct bigpic_identity)+1];
 	int len;
 
-	if (1 != write(fd, "I", 1))
+	if (1 != serial_write(fd, "I", 1))
 	{
 		applog(LOG_ERR, "%s: Failed writing id request to %s",
 		       bigpic_drv.dname, devpath);
@@ -76,7 +76,7 @@ static bool bigpic_detect_custom(const char *devpath, struct device_drv *api, st
 
 	char buf_state[sizeof(struct bigpic_state)+1];
 	len = 0;
-	if (1 != write(fd, "R", 1))
+	if (1 != serial_write(fd, "R", 1))
 	{
 		applog(LOG_ERR, "%s: Failed writing reset request to %s",
 		       bigpic_drv.dname, devpath);
@@ -250,7 +250,7 @@ void bigpic_job_start(struct thr_info *thr)
 		       board->proc_repr, hex);
 	}
 	
-	if (45 != write(board->device_fd, info->tx_buffer, 45))
+	if (45 != serial_write(board->device_fd, info->tx_buffer, 45))
 	{
 		applog(LOG_ERR, "%"PRIpreprv": Failed writing work task", board->proc_repr);
 		dev_error(board, REASON_DEV_COMMS_ERROR);
@@ -307,7 +307,7 @@ static void bigpic_shutdown(struct thr_info *thr)
 static bool bigpic_identify(struct cgpu_info *cgpu)
 {
 	char buf[] = "L";
-	if (sizeof(buf) != write(cgpu->device_fd, buf, sizeof(buf)))
+	if (sizeof(buf) != serial_write(cgpu->device_fd, buf, sizeof(buf)))
 		return false;
 	
 	return true;
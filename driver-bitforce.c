@@ -22,6 +22,10 @@
 #include <sys/time.h>
 #include <unistd.h>
 
+#ifndef WIN32
+#include <poll.h>
+#endif
+
 #include "compat.h"
 #include "deviceapi.h"
 #include "miner.h"
@@ -32,6 +36,7 @@
 #include "lowl-pci.h"
 #include "lowl-vcom.h"
 #include "util.h"
+#include "vcom-sim.h"
 
 #define BFL_PCI_VENDOR_ID 0x1cf9
 
@@ -104,6 +109,11 @@ struct bitforce_data {
 	const char *next_work_cmd;
 	char noncebuf[14 + ((BITFORCE_MAX_QRESULTS+1) * BITFORCE_QRESULT_LINE_LEN)];
 	int poll_func;
+	// Replies are read by bitforce_poll as they arrive, instead of waited for (see bitforce_async_cmd)
+	bool async;
+	// For async: the watchdog wants the temperature read before the next results
+	bool want_temp;
+	struct timeval tv_reply_timeout;
 	enum bitforce_proto proto;
 	enum bitforce_style style;
 	int queued;
@@ -113,6 +123,8 @@ struct bitforce_data {
 	bool missing_zwx;
 	bool already_have_results;
 	bool just_flushed;
+	// Simulated device, reporting nonces at VCOM_SIM_NONCE_PDIFF
+	bool simulated;
 	int max_queue_at_once;
 	int ready_to_queue;
 	bool want_to_send_queue;
@@ -154,40 +166,25 @@ void bitforce_vcom_close(struct cgpu_info * const dev)
 static
 ssize_t bitforce_vcom_read(void * const buf_p, size_t bufLen, struct cgpu_info * const dev)
 {
-	uint8_t *buf = buf_p;
-	const int fd = dev->device_fd;
-	ssize_t rv, ret = 0;
-	while (bufLen > 0)
-	{
-		rv = read(fd, buf, bufLen);
-		if (rv <= 0)
-		{
-			if (ret > 0)
-				return ret;
-			return rv;
-		}
-		buf += rv;
-		bufLen -= rv;
-		ret += rv;
-	}
-	return ret;
+	return serial_read(dev->device_fd, buf_p, bufLen);
 }
 
 static
 void bitforce_vcom_gets(char *buf, size_t bufLen, struct cgpu_info * const dev)
 {
 	const int fd = dev->device_fd;
-	while (likely(bufLen > 1 && read(fd, buf, 1) == 1 && (buf++)[0] != '\n'))
-	{}
-
-	buf[0] = '\0';
+	char eol = '\n';
+	ssize_t len = 0;
+	if (likely(bufLen > 1))
+		len = serial_read_line(fd, buf, bufLen - 1, eol);
+	buf[(len > 0) ? len : 0] = '\0';
 }
 
 static
 ssize_t bitforce_vcom_write(struct cgpu_info * const dev, const void *buf, ssize_t bufLen)
 {
 	const int fd = dev->device_fd;
-	if ((bufLen) != write(fd, buf, bufLen))
+	if ((bufLen) != serial_write(fd, buf, bufLen))
 		return 0;
 	else
 		return bufLen;
@@ -209,6 +206,24 @@ static struct bitforce_lowl_interface bfllif_vcom = {
 	.set_timeout = bitforce_vcom_set_timeout,
 };
 
+#if defined(NEED_BFG_LOWL_PCI) || !defined(WIN32)
+// Takes the next line out of getsbuf, where replies already read are kept
+static
+void bitforce_getsbuf_gets(char * const buf, size_t bufLen, struct cgpu_info * const dev)
+{
+	struct bitforce_data * const devdata = dev->device_data;
+	bytes_t *b = &devdata->getsbuf;
+	
+	ssize_t linelen = (bytes_find(b, '\n') + 1) ?: bytes_len(b);
+	if (linelen > --bufLen)
+		linelen = bufLen;
+	
+	memcpy(buf, bytes_buf(b), linelen);
+	bytes_shift(b, linelen);
+	buf[linelen] = '\0';
+}
+#endif
+
 #ifdef NEED_BFG_LOWL_PCI
 static
 bool bitforce_pci_open(struct cgpu_info * const dev)
@@ -294,17 +309,8 @@ ssize_t bitforce_pci_read(void * const buf, const size_t bufLen, struct cgpu_inf
 static
 void bitforce_pci_gets(char * const buf, size_t bufLen, struct cgpu_info * const dev)
 {
-	struct bitforce_data * const devdata = dev->device_data;
-	bytes_t *b = &devdata->getsbuf;
-	
 	_bitforce_pci_read(dev);
-	ssize_t linelen = (bytes_find(b, '\n') + 1) ?: bytes_len(b);
-	if (linelen > --bufLen)
-		linelen = bufLen;
-	
-	memcpy(buf, bytes_buf(b), linelen);
-	bytes_shift(b, linelen);
-	buf[linelen] = '\0';
+	bitforce_getsbuf_gets(buf, bufLen, dev);
 }
 
 static
@@ -501,6 +507,161 @@ void bitforce_zgx(struct cgpu_info * const proc, void *buf, size_t bufsz)
 		bitforce_cmd1b(proc, buf, bufsz, "ZGX", 3);
 }
 
+#ifndef WIN32
+// Whether getsbuf holds a whole reply, as bitforce_zox would read it: an optional INPROCESS line, then one line, or a COUNT line and results up to OK
+static
+bool bitforce_getsbuf_has_reply(struct bitforce_data * const devdata)
+{
+	bytes_t * const b = &devdata->getsbuf;
+	bool counting = false;
+	
+	if (!bytes_len(b))
+		return false;
+	const char *p = (const char *)bytes_buf(b), *eol;
+	const char * const end = &p[bytes_len(b)];
+	// Every line compared ends with a newline, so strncasecmp never runs past it
+	for ( ; (eol = memchr(p, '\n', end - p)); p = &eol[1])
+	{
+		if (counting)
+		{
+			if (!strncasecmp(p, "OK", 2))
+				return true;
+		}
+		else
+		if (!strncasecmp(p, "COUNT:", 6))
+			counting = true;
+		else
+		if (strncasecmp(p, "INPROCESS:", 10))
+			return true;
+	}
+	return false;
+}
+
+// Sends a command without waiting for the reply: bitforce_poll reads it as it arrives, and continues with poll_func once it is complete
+static
+void bitforce_async_cmd(struct thr_info * const thr, const void * const cmd, const size_t cmdsz, const int poll_func)
+{
+	struct cgpu_info * const bitforce = thr->cgpu;
+	struct cgpu_info * const dev = bitforce->device;
+	struct bitforce_data * const devdata = dev->device_data;
+	struct bitforce_data * const data = bitforce->device_data;
+	pthread_mutex_t * const mutexp = &dev->device_mutex;
+	
+	if (unlikely(opt_dev_protocol))
+	{
+		char hex[(cmdsz * 2) + 1];
+		bin2hex(hex, cmd, cmdsz);
+		applog(LOG_DEBUG, "DEVPROTO: %"PRIpreprv": ASYNC CMD: %s",
+		       bitforce->proc_repr, hex);
+	}
+	
+	mutex_lock(mutexp);
+	bytes_reset(&devdata->getsbuf);
+	bitforce_send(bitforce, cmd, cmdsz);
+	mutex_unlock(mutexp);
+	
+	data->poll_func = poll_func;
+	timer_set_delay_from_now(&data->tv_reply_timeout, (uint64_t)BITFORCE_VCOM_TIMEOUT_DSEC * 100000);
+	thr->tv_poll = data->tv_reply_timeout;
+	mt_poll_fd(thr, dev->device_fd);
+}
+
+// Reads what the device has sent of the reply, without waiting
+// Returns true once the reply is complete, or has timed out
+static
+bool bitforce_async_read(struct thr_info * const thr)
+{
+	struct cgpu_info * const bitforce = thr->cgpu;
+	struct cgpu_info * const dev = bitforce->device;
+	struct bitforce_data * const devdata = dev->device_data;
+	struct bitforce_data * const data = bitforce->device_data;
+	pthread_mutex_t * const mutexp = &dev->device_mutex;
+	bytes_t * const b = &devdata->getsbuf;
+	struct pollfd pfd = {
+		.fd = dev->device_fd,
+		.events = POLLIN,
+	};
+	ssize_t rv;
+	
+	mutex_lock(mutexp);
+	// Like gets, hand over a partial reply if the port fails or is closed
+	while (devdata->is_open && !bitforce_getsbuf_has_reply(devdata))
+	{
+		if (poll(&pfd, 1, 0) < 1)
+		{
+			mutex_unlock(mutexp);
+			return timer_passed(&data->tv_reply_timeout, NULL);
+		}
+		if (unlikely(!(pfd.revents & POLLIN)))
+			break;
+		rv = serial_read_some(pfd.fd, bytes_preappend(b, 0x100), 0x100);
+		if (unlikely(rv <= 0))
+			// Readable, but nothing to read: the device is gone
+			break;
+		bytes_postappend(b, rv);
+	}
+	mutex_unlock(mutexp);
+	return true;
+}
+
+static
+void bitforce_async_gets(char * const buf, const size_t bufLen, struct cgpu_info * const proc)
+{
+	struct cgpu_info * const dev = proc->device;
+	
+	bitforce_getsbuf_gets(buf, bufLen, dev);
+	
+	if (unlikely(opt_dev_protocol))
+		applog(LOG_DEBUG, "DEVPROTO: %s: GETS: %s", dev->dev_repr, buf);
+}
+
+// Drops whatever the device has sent, without waiting for more
+static
+void bitforce_async_drain(struct cgpu_info * const dev)
+{
+	struct bitforce_data * const devdata = dev->device_data;
+	struct pollfd pfd = {
+		.fd = dev->device_fd,
+		.events = POLLIN,
+	};
+	char buf[0x100];
+	
+	bytes_reset(&devdata->getsbuf);
+	while (poll(&pfd, 1, 0) > 0 && (pfd.revents & POLLIN) && serial_read_some(pfd.fd, buf, sizeof(buf)) > 0)
+	{}
+}
+
+// Sends the next command of a result fetch: identify and temperature requests from the watchdog go first, then ZFX
+static
+void bitforce_async_get_results(struct thr_info * const thr)
+{
+	struct cgpu_info * const bitforce = thr->cgpu;
+	struct bitforce_data * const data = bitforce->device_data;
+	
+	// Flash instead of Temp - doing both can be too slow
+	if (unlikely(bitforce->flash_led))
+	{
+		/* Once we've tried - don't do it until told to again */
+		bitforce->flash_led = false;
+		bitforce_async_cmd(thr, "ZMX", 3, 9);
+	}
+	else
+	if (data->want_temp)
+	{
+		data->want_temp = false;
+		if (data->style == BFS_FPGA)
+			bitforce_async_cmd(thr, "ZLX", 3, 8);
+		else
+		if (unlikely(!data->probed))
+			bitforce_async_cmd(thr, "Z9X", 3, 6);
+		else
+			bitforce_async_cmd(thr, "ZTX", 3, 7);
+	}
+	else
+		bitforce_async_cmd(thr, "ZFX", 3, 5);
+}
+#endif
+
 struct bitforce_init_data {
 	struct bitforce_lowl_interface *lowlif;
 	enum bitforce_style style;
@@ -775,6 +936,7 @@ void bitforce_comm_error(struct thr_info *thr)
 	applog(LOG_ERR, "%"PRIpreprv": Comms error", bitforce->proc_repr);
 	dev_error(bitforce, REASON_DEV_COMMS_ERROR);
 	inc_hw_errors_only(thr);
+	mt_poll_fd(thr, -1);
 	if (!bitforce_open(bitforce))
 	{
 		applog(LOG_ERR, "%s: Error reopening %s", bitforce->dev_repr, bitforce->device_path);
@@ -806,6 +968,12 @@ static void bitforce_clear_buffer(struct cgpu_info *bitforce)
 	if (devdata->is_open)
 	{
 		applog(LOG_DEBUG, "%"PRIpreprv": Clearing read buffer", bitforce->proc_repr);
+#ifndef WIN32
+		if (devdata->async)
+			// Reading until a gets times out would stall the minerloop
+			bitforce_async_drain(dev);
+		else
+#endif
 		__bitforce_clear_buffer(bitforce);
 	}
 	mutex_unlock(mutexp);
@@ -947,6 +1115,8 @@ void set_float_if_gt_zero(float *var, float value)
 		*var = value;
 }
 
+static bool bitforce_temp_reply(struct cgpu_info *, char *voltbuf, char *pdevbuf);
+
 static bool bitforce_get_temp(struct cgpu_info *bitforce)
 {
 	struct cgpu_info * const dev = bitforce->device;
@@ -955,12 +1125,17 @@ static bool bitforce_get_temp(struct cgpu_info *bitforce)
 	pthread_mutex_t *mutexp = &bitforce->device->device_mutex;
 	char pdevbuf[0x40];
 	char voltbuf[0x40];
-	char *s;
-	struct cgpu_info *chip_cgpu;
 
 	if (unlikely(!devdata->is_open))
 		return false;
 
+	if (data->async)
+	{
+		// The minerloop must not wait on the device here, so ask along with the next results
+		data->want_temp = true;
+		return true;
+	}
+
 	/* Do not try to get the temperature if we're polling for a result to
 	 * minimise the chance of interleaved results */
 	if (bitforce->polling)
@@ -994,6 +1169,16 @@ static bool bitforce_get_temp(struct cgpu_info *bitforce)
 	bitforce_cmd1b(bitforce, pdevbuf, sizeof(pdevbuf), "ZLX", 3);
 	mutex_unlock(mutexp);
 	
+	return bitforce_temp_reply(bitforce, voltbuf, pdevbuf);
+}
+
+// Handles the replies to ZTX (voltbuf, not read from FPGAs) and ZLX (pdevbuf)
+static bool bitforce_temp_reply(struct cgpu_info *bitforce, char *voltbuf, char *pdevbuf)
+{
+	struct bitforce_data *data = bitforce->device_data;
+	char *s;
+	struct cgpu_info *chip_cgpu;
+	
 	if (data->style != BFS_FPGA && likely(voltbuf[0]))
 	{
 		// Process voltage info
@@ -1092,6 +1277,8 @@ bool bitforce_job_prepare(struct thr_info *thr, struct work *work, __maybe_unuse
 		data->poll_func = 0;
 	}
 	
+	if (data->simulated)
+		work->nonce_diff = VCOM_SIM_NONCE_PDIFF;
 	memcpy(ob_ms, work->midstate, 32);
 	memcpy(ob_dt, work->data + 64, 12);
 	switch (data->proto)
@@ -1169,61 +1356,40 @@ void bitforce_change_mode(struct cgpu_info *bitforce, enum bitforce_proto proto)
 	bitforce->kname = protonames[proto];
 }
 
+static void bitforce_job_start(struct thr_info *);
+
+// Handles the device's reply to the job sent by bitforce_job_start
 static
-void bitforce_job_start(struct thr_info *thr)
+void bitforce_job_start_reply(struct thr_info * const thr, const char * const pdevbuf)
 {
 	struct cgpu_info *bitforce = thr->cgpu;
-	struct cgpu_info * const dev = bitforce->device;
-	struct bitforce_data * const devdata = dev->device_data;
 	struct bitforce_data *data = bitforce->device_data;
 	pthread_mutex_t *mutexp = &bitforce->device->device_mutex;
-	unsigned char *ob = data->next_work_obs;
-	char pdevbuf[0x100];
 	struct timeval tv_now;
-
-	data->result_busy_polled = 0;
 	
-	if (data->queued)
-	{
-		uint32_t delay;
-		
-		// get_results collected more accurate job start time
-		mt_job_transition(thr);
-		job_start_complete(thr);
-		data->queued = 0;
-		delay = (uint32_t)bitforce->sleep_ms * 1000;
-		if (unlikely(data->already_have_results))
-			delay = 0;
-		timer_set_delay(&thr->tv_morework, &bitforce->work_start_tv, delay);
-		return;
-	}
-
-	if (unlikely(!devdata->is_open))
-		goto commerr;
-re_send:
-	mutex_lock(mutexp);
-	bitforce_cmd2(bitforce, pdevbuf, sizeof(pdevbuf), data->next_work_cmd, ob, data->next_work_obsz);
 	if (!pdevbuf[0] || !strncasecmp(pdevbuf, "B", 1)) {
-		mutex_unlock(mutexp);
 		cgtime(&tv_now);
 		timer_set_delay(&thr->tv_poll, &tv_now, WORK_CHECK_INTERVAL_MS * 1000);
 		data->poll_func = 1;
 		return;
 	} else if (unlikely(strncasecmp(pdevbuf, "OK", 2))) {
-		mutex_unlock(mutexp);
 		switch (data->proto)
 		{
 			case BFP_RANGE:
 				applog(LOG_WARNING, "%"PRIpreprv": Does not support nonce range, disabling", bitforce->proc_repr);
 				bitforce_change_mode(bitforce, BFP_WORK);
-				goto re_send;
+				bitforce_job_start(thr);
+				return;
 			default:
 				;
 		}
 		applog(LOG_ERR, "%"PRIpreprv": Error: Send work reports: %s", bitforce->proc_repr, pdevbuf);
-		goto commerr;
+		bitforce_comm_error(thr);
+		job_start_abort(thr, true);
+		return;
 	}
 
+	mutex_lock(mutexp);
 	mt_job_transition(thr);
 	mutex_unlock(mutexp);
 
@@ -1235,6 +1401,50 @@ re_send:
 	timer_set_delay(&thr->tv_morework, &tv_now, bitforce->sleep_ms * 1000);
 	
 	job_start_complete(thr);
+}
+
+static
+void bitforce_job_start(struct thr_info *thr)
+{
+	struct cgpu_info *bitforce = thr->cgpu;
+	struct cgpu_info * const dev = bitforce->device;
+	struct bitforce_data * const devdata = dev->device_data;
+	struct bitforce_data *data = bitforce->device_data;
+	pthread_mutex_t *mutexp = &bitforce->device->device_mutex;
+	unsigned char *ob = data->next_work_obs;
+	char pdevbuf[0x100];
+
+	data->result_busy_polled = 0;
+	
+	if (data->queued)
+	{
+		uint32_t delay;
+		
+		// get_results collected more accurate job start time
+		mt_job_transition(thr);
+		job_start_complete(thr);
+		data->queued = 0;
+		delay = (uint32_t)bitforce->sleep_ms * 1000;
+		if (unlikely(data->already_have_results))
+			delay = 0;
+		timer_set_delay(&thr->tv_morework, &bitforce->work_start_tv, delay);
+		return;
+	}
+
+	if (unlikely(!devdata->is_open))
+		goto commerr;
+#ifndef WIN32
+	if (data->async)
+	{
+		// bitforce_poll sends the job itself once this is accepted
+		bitforce_async_cmd(thr, data->next_work_cmd, 3, 3);
+		return;
+	}
+#endif
+	mutex_lock(mutexp);
+	bitforce_cmd2(bitforce, pdevbuf, sizeof(pdevbuf), data->next_work_cmd, ob, data->next_work_obsz);
+	mutex_unlock(mutexp);
+	bitforce_job_start_reply(thr, pdevbuf);
 	return;
 
 commerr:
@@ -1244,22 +1454,20 @@ commerr:
 
 static char _discardedbuf[0x10];
 
+// Reads the rest of the reply to cmd, after its first line in noncebuf, using getsf
 static
-int bitforce_zox(struct thr_info *thr, const char *cmd, int * const out_inprog)
+int bitforce_zox_reply(struct thr_info *thr, const char *cmd, int * const out_inprog, void (* const getsf)(char *, size_t, struct cgpu_info *))
 {
 	struct cgpu_info *bitforce = thr->cgpu;
 	struct bitforce_data *data = bitforce->device_data;
-	pthread_mutex_t *mutexp = &bitforce->device->device_mutex;
 	char *pdevbuf = &data->noncebuf[0];
 	int count;
 	
-	mutex_lock(mutexp);
-	bitforce_cmd1b(bitforce, pdevbuf, sizeof(data->noncebuf), cmd, 3);
 	if (!strncasecmp(pdevbuf, "INPROCESS:", 10))
 	{
 		if (out_inprog)
 			*out_inprog = atoi(&pdevbuf[10]);
-		bitforce_gets(pdevbuf, sizeof(data->noncebuf), bitforce);
+		getsf(pdevbuf, sizeof(data->noncebuf), bitforce);
 	}
 	else
 	if (out_inprog)
@@ -1276,7 +1484,7 @@ int bitforce_zox(struct thr_info *thr, const char *cmd, int * const out_inprog)
 		
 		while (true)
 		{
-			bitforce_gets(pmorebuf, szleft, bitforce);
+			getsf(pmorebuf, szleft, bitforce);
 			if (!strncasecmp(pmorebuf, "OK", 2))
 			{
 				pmorebuf[0] = '\0';  // process expects only results
@@ -1301,12 +1509,119 @@ int bitforce_zox(struct thr_info *thr, const char *cmd, int * const out_inprog)
 	}
 	else
 		count = -1;
+	
+	return count;
+}
+
+static
+int bitforce_zox(struct thr_info *thr, const char *cmd, int * const out_inprog)
+{
+	struct cgpu_info *bitforce = thr->cgpu;
+	struct bitforce_data *data = bitforce->device_data;
+	pthread_mutex_t *mutexp = &bitforce->device->device_mutex;
+	int count;
+	
+	mutex_lock(mutexp);
+	bitforce_cmd1b(bitforce, data->noncebuf, sizeof(data->noncebuf), cmd, 3);
+	count = bitforce_zox_reply(thr, cmd, out_inprog, bitforce_gets);
 	mutex_unlock(mutexp);
 	
 	return count;
 }
 
 static inline char *next_line(char *);
+static void bitforce_job_results_done(struct thr_info *, int count, struct timeval elapsed);
+
+// Handles the reply to ZFX, once bitforce_job_get_results has read it
+static
+void bitforce_job_results_reply(struct thr_info * const thr, struct work * const work, int count, const bool stale)
+{
+	struct cgpu_info *bitforce = thr->cgpu;
+	struct bitforce_data *data = bitforce->device_data;
+	unsigned int delay_time_ms;
+	struct timeval elapsed;
+	struct timeval now;
+	char *pdevbuf = &data->noncebuf[0];
+
+	cgtime(&now);
+	timersub(&now, &bitforce->work_start_tv, &elapsed);
+
+	if (elapsed.tv_sec >= BITFORCE_LONG_TIMEOUT_S) {
+		applog(LOG_ERR, "%"PRIpreprv": took %lums - longer than %lums", bitforce->proc_repr,
+			tv_to_ms(elapsed), (unsigned long)BITFORCE_LONG_TIMEOUT_MS);
+		goto out;
+	}
+
+	if (count > 0)
+	{
+		// Check that queue results match the current work
+		// Also, if there are results from the next work, short-circuit this wait
+		unsigned char midstate[32], datatail[12];
+		char *p;
+		int i;
+		
+		p = pdevbuf;
+		for (i = 0; i < count; ++i)
+		{
+			p = next_line(p);
+			hex2bin(midstate, p, 32);
+			hex2bin(datatail, &p[65], 12);
+			if (!(memcmp(work->midstate, midstate, 32) || memcmp(&work->data[64], datatail, 12)))
+				break;
+		}
+		if (i == count)
+		{
+			// Didn't find the one we're waiting on
+			// Must be extra stuff in the queue results
+			char xmid[65];
+			char xdt[25];
+			bin2hex(xmid, work->midstate, 32);
+			bin2hex(xdt, &work->data[64], 12);
+			applog(LOG_WARNING, "%"PRIpreprv": Found extra garbage in queue results: %s",
+			       bitforce->proc_repr, pdevbuf);
+			applog(LOG_WARNING, "%"PRIpreprv": ...while waiting on: %s,%s",
+			       bitforce->proc_repr, xmid, xdt);
+			count = 0;
+		}
+		else
+		if (i == count - 1)
+			// Last one found is what we're looking for
+		{}
+		else
+			// We finished the next job too!
+			data->already_have_results = true;
+	}
+	
+	if (!count)
+		goto noqr;
+	if (pdevbuf[0] && strncasecmp(pdevbuf, "B", 1)) /* BFL does not respond during throttling */
+	{
+		bitforce_job_results_done(thr, count, elapsed);
+		return;
+	}
+
+	data->result_busy_polled = bitforce->wait_ms;
+	
+	if (stale)
+	{
+		applog(LOG_NOTICE, "%"PRIpreprv": Abandoning stale search to restart",
+		       bitforce->proc_repr);
+		goto out;
+	}
+
+noqr:
+	data->result_busy_polled = bitforce->wait_ms;
+	
+	/* if BFL is throttling, no point checking so quickly */
+	delay_time_ms = (pdevbuf[0] ? BITFORCE_CHECK_INTERVAL_MS : 2 * WORK_CHECK_INTERVAL_MS);
+	timer_set_delay(&thr->tv_poll, &now, delay_time_ms * 1000);
+	data->poll_func = 2;
+	return;
+
+out:
+	bitforce->polling = false;
+	job_results_fetched(thr);
+}
 
 static
 void bitforce_job_get_results(struct thr_info *thr, struct work *work)
@@ -1345,90 +1660,40 @@ void bitforce_job_get_results(struct thr_info *thr, struct work *work)
 		}
 	}
 
-	while (1) {
-		if (data->already_have_results)
-		{
-			data->already_have_results = false;
-			strcpy(pdevbuf, "COUNT:0");
-			count = 1;
-			break;
-		}
-		
-		const char * const cmd = "ZFX";
-		count = bitforce_zox(thr, cmd, NULL);
-
-		cgtime(&now);
-		timersub(&now, &bitforce->work_start_tv, &elapsed);
-
-		if (elapsed.tv_sec >= BITFORCE_LONG_TIMEOUT_S) {
-			applog(LOG_ERR, "%"PRIpreprv": took %lums - longer than %lums", bitforce->proc_repr,
-				tv_to_ms(elapsed), (unsigned long)BITFORCE_LONG_TIMEOUT_MS);
-			goto out;
-		}
-
-		if (count > 0)
-		{
-			// Check that queue results match the current work
-			// Also, if there are results from the next work, short-circuit this wait
-			unsigned char midstate[32], datatail[12];
-			char *p;
-			int i;
-			
-			p = pdevbuf;
-			for (i = 0; i < count; ++i)
-			{
-				p = next_line(p);
-				hex2bin(midstate, p, 32);
-				hex2bin(datatail, &p[65], 12);
-				if (!(memcmp(work->midstate, midstate, 32) || memcmp(&work->data[64], datatail, 12)))
-					break;
-			}
-			if (i == count)
-			{
-				// Didn't find the one we're waiting on
-				// Must be extra stuff in the queue results
-				char xmid[65];
-				char xdt[25];
-				bin2hex(xmid, work->midstate, 32);
-				bin2hex(xdt, &work->data[64], 12);
-				applog(LOG_WARNING, "%"PRIpreprv": Found extra garbage in queue results: %s",
-				       bitforce->proc_repr, pdevbuf);
-				applog(LOG_WARNING, "%"PRIpreprv": ...while waiting on: %s,%s",
-				       bitforce->proc_repr, xmid, xdt);
-				count = 0;
-			}
-			else
-			if (i == count - 1)
-				// Last one found is what we're looking for
-			{}
-			else
-				// We finished the next job too!
-				data->already_have_results = true;
-		}
-		
-		if (!count)
-			goto noqr;
-		if (pdevbuf[0] && strncasecmp(pdevbuf, "B", 1)) /* BFL does not respond during throttling */
-			break;
-
-		data->result_busy_polled = bitforce->wait_ms;
-		
-		if (stale)
-		{
-			applog(LOG_NOTICE, "%"PRIpreprv": Abandoning stale search to restart",
-			       bitforce->proc_repr);
-			goto out;
-		}
-
-noqr:
-		data->result_busy_polled = bitforce->wait_ms;
-		
-		/* if BFL is throttling, no point checking so quickly */
-		delay_time_ms = (pdevbuf[0] ? BITFORCE_CHECK_INTERVAL_MS : 2 * WORK_CHECK_INTERVAL_MS);
-		timer_set_delay(&thr->tv_poll, &now, delay_time_ms * 1000);
-		data->poll_func = 2;
+	if (data->already_have_results)
+	{
+		data->already_have_results = false;
+		strcpy(pdevbuf, "COUNT:0");
+		bitforce_job_results_done(thr, 1, elapsed);
 		return;
 	}
+	
+#ifndef WIN32
+	if (data->async)
+	{
+		// bitforce_poll continues with bitforce_job_results_reply once the reply is in
+		bitforce_async_get_results(thr);
+		return;
+	}
+#endif
+	count = bitforce_zox(thr, "ZFX", NULL);
+	bitforce_job_results_reply(thr, work, count, stale);
+	return;
+
+commerr:
+	bitforce_comm_error(thr);
+	bitforce->polling = false;
+	job_results_fetched(thr);
+}
+
+// Finishes getting results, with the final reply in noncebuf
+static
+void bitforce_job_results_done(struct thr_info * const thr, int count, struct timeval elapsed)
+{
+	struct cgpu_info *bitforce = thr->cgpu;
+	struct bitforce_data *data = bitforce->device_data;
+	unsigned int delay_time_ms;
+	char *pdevbuf = &data->noncebuf[0];
 
 	if (count < 0 && pdevbuf[0] == 'N')
 		count = strncasecmp(pdevbuf, "NONCE-FOUND", 11) ? 1 : 0;
@@ -1504,11 +1769,6 @@ noqr:
 out:
 	bitforce->polling = false;
 	job_results_fetched(thr);
-	return;
-
-commerr:
-	bitforce_comm_error(thr);
-	goto out;
 }
 
 static
@@ -1617,6 +1877,7 @@ int64_t bitforce_job_process_results(struct thr_info *thr, struct work *work, __
 static void bitforce_shutdown(struct thr_info *thr)
 {
 	struct cgpu_info *bitforce = thr->cgpu;
+	mt_poll_fd(thr, -1);
 	bitforce_close(bitforce);
 }
 
@@ -1691,7 +1952,12 @@ static bool bitforce_thread_init(struct thr_info *thr)
 			.parallel = abs(initdata->parallels[boardno]),
 			.parallel_protocol = (initdata->parallels[boardno] != -1),
 			.max_queueid = initdata->max_queueid,
+			.simulated = vcom_sim_path_p(bitforce->device_path),
 		};
+#ifndef WIN32
+		// Only a lone processor on a VCOM port has the fd to itself, and can read it without blocking
+		data->async = (initdata->lowlif == &bfllif_vcom && bitforce->drv == &bitforce_drv && bitforce->device->procs == 1);
+#endif
 		thr->cgpu_data = procdata = malloc(sizeof(*procdata));
 		*procdata = (struct bitforce_proc_data){
 			.handles_board = true,
@@ -1915,6 +2181,8 @@ void bitforce_wlogprint_status(struct cgpu_info *cgpu)
 
 static struct api_data *bitforce_drv_stats(struct cgpu_info *cgpu)
 {
+	struct cgpu_info * const dev = cgpu->device;
+	struct bitforce_data * const devdata = dev->device_data;
 	struct bitforce_data *data = cgpu->device_data;
 	struct api_data *root = NULL;
 
@@ -1923,6 +2191,15 @@ static struct api_data *bitforce_drv_stats(struct cgpu_info *cgpu)
 	// locking access to displaying API debug 'stats'
 	// If locking becomes an issue for any of them, use copy_data=true also
 	root = api_add_uint(root, "Sleep Time", &(cgpu->sleep_ms), false);
+	if (devdata->is_open && devdata->lowlif == &bfllif_vcom)
+	{
+		uint64_t reads, syscalls;
+		if (vcom_read_stats(dev->device_fd, &reads, &syscalls))
+		{
+			root = api_add_uint64(root, "Serial Reads", &reads, true);
+			root = api_add_uint64(root, "Serial Read Syscalls", &syscalls, true);
+		}
+	}
 	if (data->proto != BFP_BQUEUE && data->proto != BFP_PQUEUE)
 		root = api_add_uint(root, "Avg Wait", &(cgpu->avg_wait_d), false);
 	if (data->temp[0] > 0 && data->temp[1] > 0)
@@ -1943,6 +2220,76 @@ static struct api_data *bitforce_drv_stats(struct cgpu_info *cgpu)
 	return root;
 }
 
+#ifndef WIN32
+static
+void bitforce_async_job_start_reply(struct thr_info * const thr, const int poll)
+{
+	struct cgpu_info * const bitforce = thr->cgpu;
+	struct bitforce_data * const data = bitforce->device_data;
+	char pdevbuf[0x100];
+	
+	bitforce_async_gets(pdevbuf, sizeof(pdevbuf), bitforce);
+	// As bitforce_cmd2 does, only send the job once its command is accepted
+	if (poll == 3 && !strncasecmp(pdevbuf, "OK", 2))
+	{
+		bitforce_async_cmd(thr, data->next_work_obs, data->next_work_obsz, 4);
+		return;
+	}
+	bitforce_job_start_reply(thr, pdevbuf);
+}
+
+static
+void bitforce_async_job_results_reply(struct thr_info * const thr)
+{
+	struct cgpu_info * const bitforce = thr->cgpu;
+	struct bitforce_data * const data = bitforce->device_data;
+	struct work * const work = thr->work;
+	int count;
+	
+	bitforce_async_gets(data->noncebuf, sizeof(data->noncebuf), bitforce);
+	count = bitforce_zox_reply(thr, "ZFX", NULL, bitforce_async_gets);
+	bitforce_job_results_reply(thr, work, count, stale_work(work, true));
+}
+
+static
+void bitforce_async_temp_reply(struct thr_info * const thr, const int poll)
+{
+	struct cgpu_info * const bitforce = thr->cgpu;
+	struct bitforce_data * const data = bitforce->device_data;
+	char pdevbuf[0x40];
+	
+	switch (poll)
+	{
+		case 6:  // Z9X
+			bitforce_async_gets(pdevbuf, sizeof(pdevbuf), bitforce);
+			if (strncasecmp(pdevbuf, "ERR", 3))
+			{
+				data->supports_fanspeed = true;
+				bitforce->set_device_funcs = bitforce_set_device_funcs;
+			}
+			data->probed = true;
+			bitforce_async_cmd(thr, "ZTX", 3, 7);
+			return;
+		case 7:  // ZTX, kept in noncebuf until ZLX is in
+			bitforce_async_gets(data->noncebuf, sizeof(data->noncebuf), bitforce);
+			bitforce_async_cmd(thr, "ZLX", 3, 8);
+			return;
+		case 8:  // ZLX
+			bitforce_async_gets(pdevbuf, sizeof(pdevbuf), bitforce);
+			bitforce_temp_reply(bitforce, data->noncebuf, pdevbuf);
+			bitforce_async_get_results(thr);
+			return;
+		case 9:  // ZMX
+			bitforce_async_gets(pdevbuf, sizeof(pdevbuf), bitforce);
+			/* However, this stops anything else getting a reply
+			 * So best to delay any other access to the BFL */
+			timer_set_delay_from_now(&thr->tv_poll, 4000000);
+			data->poll_func = 2;
+			return;
+	}
+}
+#endif
+
 void bitforce_poll(struct thr_info *thr)
 {
 	struct cgpu_info *bitforce = thr->cgpu;
@@ -1950,6 +2297,22 @@ void bitforce_poll(struct thr_info *thr)
 	int poll = data->poll_func;
 	thr->tv_poll.tv_sec = -1;
 	data->poll_func = 0;
+#ifndef WIN32
+	if (poll >= 3)
+	{
+		if (!bitforce_async_read(thr))
+		{
+			// Keep waiting for the rest of the reply
+			data->poll_func = poll;
+			thr->tv_poll = data->tv_reply_timeout;
+			if (unlikely(thr->poll_fd == -1))
+				// The minerloop cannot wait on the fd, so check it every so often
+				timer_set_delay_from_now(&thr->tv_poll, BITFORCE_CHECK_INTERVAL_MS * 1000);
+			return;
+		}
+		mt_poll_fd(thr, -1);
+	}
+#endif
 	switch (poll)
 	{
 		case 1:
@@ -1958,6 +2321,21 @@ void bitforce_poll(struct thr_info *thr)
 		case 2:
 			bitforce_job_get_results(thr, thr->work);
 			break;
+#ifndef WIN32
+		case 3:  // Reply to the job command
+		case 4:  // Reply to the job itself
+			bitforce_async_job_start_reply(thr, poll);
+			break;
+		case 5:  // Reply to ZFX
+			bitforce_async_job_results_reply(thr);
+			break;
+		case 6:  // Replies to the watchdog's requests, sent before ZFX
+		case 7:
+		case 8:
+		case 9:
+			bitforce_async_temp_reply(thr, poll);
+			break;
+#endif
 		default:
 			applog(LOG_ERR, "%"PRIpreprv": Unexpected poll from device API!", thr->cgpu->proc_repr);
 	}
@@ -2011,11 +2389,23 @@ const char *bitforce_rpc_send_cmd1(struct cgpu_info * const proc, const char * c
 
 static const struct bfg_set_device_definition bitforce_set_device_funcs[] = {
 	{"fanmode", bitforce_set_fanmode, "range 0-5 (low to fast) or 9 (auto)"},
-	{"voltage", bitforce_set_voltage, "range 0.54-0.75 V"},
+	{"voltage", bitforce_set_voltage, "range 0.54-0.75 V", bfg_set_device_group_device},
 	{"_cmd1", bitforce_rpc_send_cmd1, NULL},
 	{NULL},
 };
 
+static
+void bitforce_minerloop(struct thr_info * const thr)
+{
+	struct bitforce_data * const data = thr->cgpu->device_data;
+	
+	// Devices that still wait for replies keep a thread to themselves
+	if (data->async)
+		minerloop_async(thr);
+	else
+		minerloop_async_unshared(thr);
+}
+
 struct device_drv bitforce_drv = {
 	.dname = "bitforce",
 	.name = "BFL",
@@ -2027,7 +2417,8 @@ struct device_drv bitforce_drv = {
 	.proc_tui_handle_choice = bitforce_tui_handle_choice,
 #endif
 	.get_api_stats = bitforce_drv_stats,
-	.minerloop = minerloop_async,
+	.minerloop = bitforce_minerloop,
+	.minerloop_reactor_safe = true,
 	.reinit_device = bitforce_reinit,
 	.get_stats = bitforce_get_stats,
 	.identify_device = bitforce_identify,
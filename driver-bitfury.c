@@ -30,6 +30,7 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <sha2.h>
+#include <time.h>
 
 #include "deviceapi.h"
 #include "driver-bitfury.h"
@@ -273,24 +274,30 @@ bool bitfury_job_prepare(struct thr_info *thr, struct work *work, __maybe_unused
 }
 
 static
-bool fudge_nonce(struct work * const work, uint32_t *nonce_p) {
-	static const uint32_t offsets[] = {0, 0xffc00000, 0xff800000, 0x02800000, 0x02C00000, 0x00400000};
-	uint32_t nonce;
+const struct bitfury_nonce_ctx *bitfury_nonce_ctx_for_work(struct bitfury_device * const bitfury, const struct work * const work)
+{
+	struct bitfury_nonce_ctx *ctx;
 	int i;
 	
+	for (i = 0; i < 2; ++i)
+		if (bitfury->nonce_ctx_work[i] == work && bitfury->nonce_ctx_work_id[i] == work->id)
+			return &bitfury->nonce_ctx[i];
+	
+	i = bitfury->nonce_ctx_next;
+	bitfury->nonce_ctx_next = !i;
+	ctx = &bitfury->nonce_ctx[i];
+	bitfury_nonce_ctx_init(ctx, work->midstate, *(uint32_t *)&work->data[0x40], *(uint32_t *)&work->data[0x44], *(uint32_t *)&work->data[0x48]);
+	bitfury->nonce_ctx_work[i] = work;
+	bitfury->nonce_ctx_work_id[i] = work->id;
+	return ctx;
+}
+
+static
+bool fudge_nonce(struct bitfury_device * const bitfury, struct work * const work, uint32_t *nonce_p) {
 	if (unlikely(!work))
 		return false;
 	
-	for (i = 0; i < 6; ++i)
-	{
-		nonce = *nonce_p + offsets[i];
-		if (test_nonce(work, nonce, false))
-		{
-			*nonce_p = nonce;
-			return true;
-		}
-	}
-	return false;
+	return bitfury_fudge_nonce_ctx(bitfury_nonce_ctx_for_work(bitfury, work), work->nonce_diff, nonce_p);
 }
 
 void bitfury_noop_job_start(struct thr_info __maybe_unused * const thr)
@@ -365,6 +372,40 @@ int bitfury_select_freq(struct bitfury_device *bitfury, struct cgpu_info *proc)
 	return 0;
 }
 
+#define BITFURY_POLL_STAT_WEIGHT  0.125
+
+static
+void bitfury_poll_stat_update(double * const avg, const double sample)
+{
+	if (*avg)
+		*avg += (sample - *avg) * BITFURY_POLL_STAT_WEIGHT;
+	else
+		*avg = sample;
+}
+
+// Returns 0 where per-thread CPU time is not available
+static
+long bitfury_thread_cpu_us()
+{
+#ifdef CLOCK_THREAD_CPUTIME_ID
+	struct timespec ts;
+	if (!clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts))
+		return (ts.tv_sec * 1000000L) + (ts.tv_nsec / 1000);
+#endif
+	return 0;
+}
+
+static
+void bitfury_do_io_txrx(struct spi_port * const spi)
+{
+	struct timeval tv_start;
+	
+	timer_set_now(&tv_start);
+	spi->poll_framesz = spi_getbufsz(spi);
+	spi_txrx(spi);
+	bitfury_poll_stat_update(&spi->poll_txrx_us, timer_elapsed_us(&tv_start, NULL));
+}
+
 void bitfury_do_io(struct thr_info * const master_thr)
 {
 	struct cgpu_info *proc;
@@ -375,19 +416,25 @@ void bitfury_do_io(struct thr_info * const master_thr)
 	int n, i, j;
 	bool newjob;
 	uint32_t nonce;
-	int n_chips = 0, lastchip = 0;
+	int n_chips = 0, lastchip = 0, n_ports = 0, port;
 	struct spi_port *spi = NULL;
 	bool should_be_running;
-	struct timeval tv_now;
+	struct timeval tv_now, tv_start, tv_mark;
 	uint32_t counter;
 	struct timeval *tvp_stat;
 	
+	timer_set_now(&tv_start);
+	const long cpu_start_us = bitfury_thread_cpu_us();
 	for (proc = master_thr->cgpu; proc; proc = proc->next_proc)
 		++n_chips;
 	
 	struct cgpu_info *procs[n_chips];
 	void *rxbuf[n_chips];
 	bitfury_inp_t rxbuf_copy[n_chips];
+	// Poll cycle time for each port: building its frame, its transfers, and parsing its results
+	struct spi_port *ports[n_chips];
+	long port_cycle_us[n_chips];
+	tv_mark = tv_start;
 	
 	// NOTE: This code assumes:
 	// 1) that chips on the same SPI bus are grouped together
@@ -405,8 +452,14 @@ void bitfury_do_io(struct thr_info * const master_thr)
 			if (spi != bitfury->spi)
 			{
 				if (spi)
-					spi_txrx(spi);
+				{
+					bitfury_do_io_txrx(spi);
+					port_cycle_us[n_ports - 1] += timer_elapsed_us(&tv_mark, NULL);
+					timer_set_now(&tv_mark);
+				}
 				spi = bitfury->spi;
+				ports[n_ports] = spi;
+				port_cycle_us[n_ports++] = 0;
 				spi_clear_buf(spi);
 				spi_emit_break(spi);
 				lastchip = 0;
@@ -427,19 +480,27 @@ void bitfury_do_io(struct thr_info * const master_thr)
 		return;
 	}
 	timer_set_now(&tv_now);
-	spi_txrx(spi);
+	bitfury_do_io_txrx(spi);
 	
 	for (j = 0; j < n_chips; ++j)
 	{
 		swap32tole(rxbuf_copy[j], rxbuf[j], 0x11);
 		rxbuf[j] = rxbuf_copy[j];
 	}
+	port_cycle_us[n_ports - 1] += timer_elapsed_us(&tv_mark, NULL);
+	timer_set_now(&tv_mark);
+	port = 0;
 	
 	for (j = 0; j < n_chips; ++j)
 	{
 		proc = procs[j];
 		thr = proc->thr[0];
 		bitfury = proc->device_data;
+		if (bitfury->spi != ports[port])
+		{
+			port_cycle_us[port++] += timer_elapsed_us(&tv_mark, NULL);
+			timer_set_now(&tv_mark);
+		}
 		tvp_stat = &bitfury->tv_stat;
 		c = &bitfury->chip_stat;
 		uint32_t * const newbuf = &bitfury->newbuf[0];
@@ -614,11 +675,11 @@ void bitfury_do_io(struct thr_info * const master_thr)
 						goto chipgen_detected;
 				}
 				else
-				if (fudge_nonce(thr->work, &nonce))
+				if (fudge_nonce(bitfury, thr->work, &nonce))
 				{
 					applog(LOG_DEBUG, "%"PRIpreprv": nonce %x = %08lx (work=%p)",
 					       proc->proc_repr, i, (unsigned long)nonce, thr->work);
-					submit_nonce(thr, thr->work, nonce);
+					submit_nonce_async(thr, thr->work, nonce);
 					bitfury->counter2 += 1;
 				}
 				else
@@ -626,11 +687,11 @@ void bitfury_do_io(struct thr_info * const master_thr)
 					applog(LOG_DEBUG, "%"PRIpreprv": Ignoring unrecognised nonce %08lx (no prev work)",
 					       proc->proc_repr, (unsigned long)be32toh(nonce));
 				else
-				if (fudge_nonce(thr->prev_work, &nonce))
+				if (fudge_nonce(bitfury, thr->prev_work, &nonce))
 				{
 					applog(LOG_DEBUG, "%"PRIpreprv": nonce %x = %08lx (prev work=%p)",
 					       proc->proc_repr, i, (unsigned long)nonce, thr->prev_work);
-					submit_nonce(thr, thr->prev_work, nonce);
+					submit_nonce_async(thr, thr->prev_work, nonce);
 					bitfury->counter2 += 1;
 				}
 				else
@@ -683,6 +744,20 @@ out:
 			copy_time(tvp_stat, &tv_now);
 	}
 	
+	port_cycle_us[port] += timer_elapsed_us(&tv_mark, NULL);
+	
+	{
+		const double cpu_per_chip_us = (double)(bitfury_thread_cpu_us() - cpu_start_us) / n_chips;
+		for (port = 0; port < n_ports; ++port)
+		{
+			spi = ports[port];
+			bitfury_poll_stat_update(&spi->poll_cycle_us, port_cycle_us[port]);
+			if (!timer_isset(&spi->tv_poll_cpu_start))
+				spi->tv_poll_cpu_start = tv_start;
+			spi->poll_cpu_per_chip_us += cpu_per_chip_us;
+		}
+	}
+	
 	timer_set_delay(&master_thr->tv_poll, &tv_now, 10000);
 }
 
@@ -722,6 +797,25 @@ struct api_data *bitfury_api_device_status(struct cgpu_info * const cgpu)
 	
 	root = api_add_int(root, "Clock Bits", &clock_bits, true);
 	root = api_add_freq(root, "Frequency", &bitfury->mhz, false);
+	if (bitfury->spi && bitfury->spi->poll_cycle_us)
+	{
+		const struct spi_port * const spi = bitfury->spi;
+		// Times are in milliseconds
+		double d;
+		uint64_t framesz = spi->poll_framesz;
+		d = spi->poll_cycle_us / 1e3;
+		root = api_add_double(root, "Poll Cycle Time", &d, true);
+		d = spi->poll_txrx_us / 1e3;
+		root = api_add_double(root, "SPI Transfer Time", &d, true);
+		root = api_add_uint64(root, "SPI Frame Size", &framesz, true);
+		const double elapsed_s = timer_elapsed_us(&spi->tv_poll_cpu_start, NULL) / 1e6;
+		if (spi->poll_cpu_per_chip_us && elapsed_s > 0)
+		{
+			// Milliseconds of host CPU used per chip per second
+			d = spi->poll_cpu_per_chip_us / 1e3 / elapsed_s;
+			root = api_add_double(root, "Host CPU Per Chip", &d, true);
+		}
+	}
 	
 	return root;
 }
@@ -840,6 +934,7 @@ struct device_drv bitfury_drv = {
 	.thread_shutdown = bitfury_shutdown,
 	
 	.minerloop = minerloop_async,
+	.minerloop_reactor_safe = true,
 	.job_prepare = bitfury_job_prepare,
 	.job_start = bitfury_noop_job_start,
 	.poll = bitfury_do_io,
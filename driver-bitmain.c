@@ -215,7 +215,7 @@ int btm_read(struct cgpu_info * const cgpu, void * const buf, const size_t bufsi
 			return -1;
 		return sz;
 	}
-	err = read(cgpu->device_fd, buf, bufsize);
+	err = serial_read_some(cgpu->device_fd, buf, bufsize);
 	return err;
 }
 
@@ -239,7 +239,7 @@ int btm_write(struct cgpu_info * const cgpu, void * const buf, const size_t bufs
 			return -1;
 		return upk_u32be(headbuf, 0);
 	}
-	err = write(cgpu->device_fd, buf, bufsize);
+	err = serial_write(cgpu->device_fd, buf, bufsize);
 	return err;
 }
 
@@ -75,7 +75,7 @@ static bool cairnsmore_send_cmd(int fd, uint8_t cmd, uint8_t data, bool probe)
 	pkt[32] = 0xda ^ cmd ^ data;
 	pkt[33] = data;
 	pkt[34] = cmd;
-	return write(fd, pkt, sizeof(pkt)) == sizeof(pkt);
+	return serial_write(fd, pkt, sizeof(pkt)) == sizeof(pkt);
 }
 
 bool cairnsmore_supports_dynclock(const char * const repr, const int fd)
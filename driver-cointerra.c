@@ -24,6 +24,7 @@ static const unsigned long cointerra_latest_result_usecs = (10 * 1000000);
 static const unsigned cointerra_max_nonce_diff = 0x20;
 
 #define COINTERRA_USB_TIMEOUT  500
+#define COINTERRA_USB_ASYNC_READS  4
 #define COINTERRA_PACKET_SIZE  0x40
 #define COINTERRA_START_SEQ  0x5a,0x5a
 #define COINTERRA_MSG_SIZE  (COINTERRA_PACKET_SIZE - sizeof(cointerra_startseq))
@@ -338,48 +339,6 @@ bool cointerra_lowl_match(const struct lowlevel_device_info * const info)
 	return lowlevel_match_lowlproduct(info, &lowl_usb, "GoldStrike");
 }
 
-/* This function will remove a work item from the hashtable if it matches the
- * id in work->subid and return a pointer to the work but it will not free the
- * work. It may return NULL if it cannot find matching work. */
-static struct work *take_work_by_id(struct cgpu_info *cgpu, uint16_t id)
-{
-	struct work *work, *tmp, *ret = NULL;
-
-	wr_lock(&cgpu->qlock);
-	HASH_ITER(hh, cgpu->queued_work, work, tmp) {
-		if (work->subid == id) {
-			ret = work;
-			break;
-		}
-	}
-	if (ret)
-		__work_completed(cgpu, ret);
-	wr_unlock(&cgpu->qlock);
-
-	return ret;
-}
-
-/* This function will look up a work item in the hashtable if it matches the
- * id in work->subid and return a cloned work item if it matches. It may return
- * NULL if it cannot find matching work. */
-static struct work *clone_work_by_id(struct cgpu_info *cgpu, uint16_t id)
-{
-	struct work *work, *tmp, *ret = NULL;
-
-	rd_lock(&cgpu->qlock);
-	HASH_ITER(hh, cgpu->queued_work, work, tmp) {
-		if (work->subid == id) {
-			ret = work;
-			break;
-		}
-	}
-	if (ret)
-		ret = copy_work(ret);
-	rd_unlock(&cgpu->qlock);
-
-	return ret;
-}
-
 static bool cta_send_msg(struct cgpu_info *cointerra, char *buf);
 
 static uint16_t hu16_from_msg(char *buf, int msg)
@@ -455,7 +414,7 @@ static void cta_parse_recvmatch(struct thr_info *thr, struct cgpu_info *cointerr
 	applog(LOG_DEBUG, "%s %d: Match message for id 0x%04x MCU id 0x%08x received",
 	       cointerra->drv->name, cointerra->device_id, retwork, mcu_tag);
 
-	work = clone_work_by_id(cointerra, retwork);
+	work = clone_queued_work_bysubid(cointerra, retwork);
 	if (likely(work)) {
 		unsigned char rhash[32];
 		char outhash[16];
@@ -552,7 +511,7 @@ static void cta_parse_wdone(struct thr_info *thr, struct cgpu_info *cointerra,
 			    struct cointerra_info *info, char *buf)
 {
 	uint16_t retwork = *(uint16_t *)(&buf[CTA_DRIVER_TAG]);
-	struct work *work = take_work_by_id(cointerra, retwork);
+	struct work *work = take_queued_work_bysubid(cointerra, retwork);
 	uint64_t hashes;
 
 	if (likely(work))
@@ -933,6 +892,7 @@ static bool cta_prepare(struct thr_info *thr)
 	cgtime(&info->core_hash_start);
 	
 	usb_ep_set_timeouts_ms(info->ep, COINTERRA_USB_TIMEOUT, COINTERRA_USB_TIMEOUT);
+	usb_ep_set_async(info->ep, COINTERRA_USB_ASYNC_READS);
 	timer_set_now(&thr->tv_poll);
 
 	return true;
@@ -968,15 +928,15 @@ bool cointerra_queue_append(struct thr_info * const thr, struct work * const wor
 	work->device_id = devstate->work_id;
 	
 	pk_u16be(buf, 0, work->device_id);
-	work->subid = htobe16(work->device_id);
 	swap32yes(&buf[   6],  work->midstate  , 0x20 / 4);
 	swap32yes(&buf[0x26], &work->data[0x40],  0xc / 4);
 	
 	pk_u16le(buf, 50, ntimeroll);
 	
-	// Use the real share difficulty up to cointerra_max_nonce_diff
-	if (work->work_difficulty >= cointerra_max_nonce_diff)
-		work->nonce_diff = cointerra_max_nonce_diff;
+	// Use the real share difficulty up to cointerra_max_nonce_diff, or --nonce-rate's choice
+	const float max_nonce_diff = cgpu_auto_nonce_diff(dev, dev->procs, work_mining_algorithm(work), cointerra_max_nonce_diff, cointerra_max_nonce_diff);
+	if (work->work_difficulty >= max_nonce_diff)
+		work->nonce_diff = max_nonce_diff;
 	else
 		work->nonce_diff = work->work_difficulty;
 	zerobits = log2(floor(work->nonce_diff));
@@ -987,12 +947,11 @@ bool cointerra_queue_append(struct thr_info * const thr, struct work * const wor
 	if (!cointerra_write_msg(devstate->ep, cointerra_drv.dname, CMTO_WORK, buf))
 		return false;
 	
-// 	HASH_ADD_INT(master_thr->work, device_id, work);
-	{
-		++dev->queued_count;
-		timer_set_now(&work->tv_work_start);
-		HASH_ADD_INT(dev->queued_work, id, work);
-	}
+	timer_set_now(&work->tv_work_start);
+	wr_lock(&dev->qlock);
+	__add_queued(dev, work);
+	__set_queued_work_subid(dev, work, htobe16(work->device_id));
+	wr_unlock(&dev->qlock);
 	++devstate->work_id;
 	if (!--devstate->requested)
 	{
@@ -57,7 +57,7 @@ bool drillbit_detect_one(const char * const devpath)
 	const int fd = serial_open(devpath, 0, 1, true);
 	if (fd == -1)
 		applogr(false, LOG_DEBUG, "%s: %s: Failed to open", __func__, devpath);
-	if (1 != write(fd, "I", 1))
+	if (1 != serial_write(fd, "I", 1))
 	{
 		applog(LOG_DEBUG, "%s: %s: Error writing 'I'", __func__, devpath);
 err:
@@ -187,7 +187,7 @@ bool drillbit_reset(struct cgpu_info * const dev)
 	if (unlikely(fd == -1))
 		return false;
 	
-	if (1 != write(fd, "R", 1))
+	if (1 != serial_write(fd, "R", 1))
 		problem(false, LOG_ERR, "%s: Error writing reset command", dev->dev_repr);
 	
 	return drillbit_check_response(dev->dev_repr, fd, dev, 'R');
@@ -229,7 +229,7 @@ bool drillbit_send_config(struct cgpu_info * const dev)
 		buf[6] = board->use_ext_clock ? 1 : 0;
 	}
 
-	if (sizeof(buf) != write(fd, buf, sizeof(buf)))
+	if (sizeof(buf) != serial_write(fd, buf, sizeof(buf)))
 		problem(false, LOG_ERR, "%s: Error sending config", dev->dev_repr);
 	
 	return drillbit_check_response(dev->dev_repr, fd, dev, 'C');
@@ -318,7 +318,7 @@ bool drillbit_job_prepare(struct thr_info * const thr, struct work * const work,
 	memcpy(&buf[3], work->midstate, 0x20);
 	memcpy(&buf[0x23], &work->data[0x40], 0xc);
 	
-	if (sizeof(buf) != write(fd, buf, sizeof(buf)))
+	if (sizeof(buf) != serial_write(fd, buf, sizeof(buf)))
 		problem(false, LOG_ERR, "%"PRIpreprv": Error sending work %d",
 		        proc->proc_repr, work->id);
 	
@@ -421,7 +421,7 @@ bool drillbit_get_work_results(struct cgpu_info * const dev)
 	int i, j;
 	
 	do {
-		if (1 != write(fd, "E", 1))
+		if (1 != serial_write(fd, "E", 1))
 			problem(false, LOG_ERR, "%s: Error sending request for work results", dev->dev_repr);
 	
 		if (sizeof(total) != serial_read(fd, &total, sizeof(total)))
@@ -460,13 +460,13 @@ bool drillbit_get_work_results(struct cgpu_info * const dev)
 			{
 				uint32_t nonce = bitfury_decnonce(*nonce_p);
 				if (bitfury_fudge_nonce2(thr->work, &nonce))
-					submit_nonce(thr, thr->work, nonce);
+					submit_nonce_async(thr, thr->work, nonce);
 				else
 					if (bitfury_fudge_nonce2(thr->next_work, &nonce))
 					{
 						applog(LOG_DEBUG, "%"PRIpreprv": Result for next work, transitioning",
 							proc->proc_repr);
-						submit_nonce(thr, thr->next_work, nonce);
+						submit_nonce_async(thr, thr->next_work, nonce);
 						mt_job_transition(thr);
 						job_start_complete(thr);
 					}
@@ -475,7 +475,7 @@ bool drillbit_get_work_results(struct cgpu_info * const dev)
 						{
 							applog(LOG_DEBUG, "%"PRIpreprv": Result for PREVIOUS work",
 								proc->proc_repr);
-							submit_nonce(thr, thr->prev_work, nonce);
+							submit_nonce_async(thr, thr->prev_work, nonce);
 						}
 						else
 							inc_hw_errors(thr, thr->work, nonce);
@@ -488,7 +488,10 @@ bool drillbit_get_work_results(struct cgpu_info * const dev)
 				job_start_complete(thr);
 			}
 			if (!thr->next_work)
+			{
 				timer_set_now(&thr->tv_morework);
+				mt_timers_changed(thr);
+			}
 		}
 	} while(total > 0);
 	
@@ -517,7 +520,7 @@ void drillbit_poll(struct thr_info * const master_thr)
 	{
 		const int fd = dev->device_fd;
 		applog(LOG_DEBUG, "%s: Sending identify command", dev->dev_repr);
-		if (1 != write(fd, "L", 1))
+		if (1 != serial_write(fd, "L", 1))
 			applog(LOG_ERR, "%s: Error writing identify command", dev->dev_repr);
 		drillbit_check_response(dev->dev_repr, fd, dev, 'L');
 		board->trigger_identify = false;
@@ -548,7 +551,7 @@ bool drillbit_get_stats(struct cgpu_info * const dev)
 	if (fd == -1)
 		return false;
 	
-	if (1 != write(fd, "T", 1))
+	if (1 != serial_write(fd, "T", 1))
 		problem(false, LOG_ERR, "%s: Error requesting temperature", dev->dev_repr);
 	
 	uint8_t buf[2];
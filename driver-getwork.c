@@ -13,6 +13,8 @@
 #include <winsock2.h>
 #endif
 
+#include <ctype.h>
+#include <stdbool.h>
 #include <stdint.h>
 #include <string.h>
 
@@ -65,9 +67,173 @@ int getwork_error(struct MHD_Connection *conn, int16_t errcode, const char *errm
 	return ret;
 }
 
+static
+const char *getwork_fast_skip_ws(const char *p)
+{
+	while (isspace((unsigned char)*p))
+		++p;
+	return p;
+}
+
+// Returns a pointer to the closing quote of a string without any escapes, or NULL
+static
+const char *getwork_fast_string_end(const char *p)
+{
+	if (*p != '"')
+		return NULL;
+	for (++p; *p != '"'; ++p)
+		if (*p == '\\' || (unsigned char)*p < 0x20)
+			return NULL;
+	return p;
+}
+
+static
+size_t getwork_fast_digits(const char * const p, const char * const end)
+{
+	size_t n = 0;
+	while (&p[n] < end && isdigit((unsigned char)p[n]))
+		++n;
+	return n;
+}
+
+// Only a literal or a well-formed JSON number can be echoed back as the id
+static
+bool getwork_fast_id_token(const char *p, const size_t len)
+{
+	const char * const end = &p[len];
+	size_t n;
+	
+	if (len == 4 && !(memcmp(p, "null", 4) && memcmp(p, "true", 4)))
+		return true;
+	if (len == 5 && !memcmp(p, "false", 5))
+		return true;
+	
+	if (p < end && *p == '-')
+		++p;
+	n = getwork_fast_digits(p, end);
+	if (!n || (n > 1 && *p == '0'))
+		return false;
+	p += n;
+	if (p < end && *p == '.')
+	{
+		n = getwork_fast_digits(++p, end);
+		if (!n)
+			return false;
+		p += n;
+	}
+	if (p < end && (*p == 'e' || *p == 'E'))
+	{
+		++p;
+		if (p < end && (*p == '+' || *p == '-'))
+			++p;
+		n = getwork_fast_digits(p, end);
+		if (!n)
+			return false;
+		p += n;
+	}
+	return p == end;
+}
+
+// Parses the common {"method":"getwork","params":["..."],"id":...} shape without a full JSON parser
+// Anything else (including other methods) returns false, and is left for jansson to handle
+static
+bool getwork_parse_fast(char * const buf, char ** const out_idstr, size_t * const out_idstr_sz, const char ** const out_submit)
+{
+	const char *p = buf, *e, *key, *id = NULL, *submit = NULL;
+	char *submit_end = NULL;
+	size_t keylen, idlen = 0;
+	
+	p = getwork_fast_skip_ws(p);
+	if (*p != '{')
+		return false;
+	p = getwork_fast_skip_ws(&p[1]);
+	while (*p != '}')
+	{
+		e = getwork_fast_string_end(p);
+		if (!e)
+			return false;
+		key = &p[1];
+		keylen = e - key;
+		p = getwork_fast_skip_ws(&e[1]);
+		if (*p != ':')
+			return false;
+		p = getwork_fast_skip_ws(&p[1]);
+		
+		if (keylen == 6 && !memcmp(key, "method", 6))
+		{
+			e = getwork_fast_string_end(p);
+			if (!(e && e - p == 8 && !memcmp(&p[1], "getwork", 7)))
+				return false;
+			p = &e[1];
+		}
+		else
+		if (keylen == 6 && !memcmp(key, "params", 6))
+		{
+			if (*p != '[')
+				return false;
+			p = getwork_fast_skip_ws(&p[1]);
+			if (*p != ']')
+			{
+				e = getwork_fast_string_end(p);
+				if (!e)
+					return false;
+				submit = &p[1];
+				submit_end = &buf[e - buf];
+				p = getwork_fast_skip_ws(&e[1]);
+				if (*p != ']')
+					return false;
+			}
+			++p;
+		}
+		else
+		if (keylen == 2 && !memcmp(key, "id", 2))
+		{
+			id = p;
+			if (*p == '"')
+			{
+				e = getwork_fast_string_end(p);
+				if (!e)
+					return false;
+				p = &e[1];
+			}
+			else
+			{
+				while (*p && !(isspace((unsigned char)*p) || *p == ',' || *p == '}'))
+					++p;
+				if (!getwork_fast_id_token(id, p - id))
+					return false;
+			}
+			idlen = p - id;
+		}
+		else
+			return false;
+		
+		p = getwork_fast_skip_ws(p);
+		if (*p == ',')
+			p = getwork_fast_skip_ws(&p[1]);
+		else
+		if (*p != '}')
+			return false;
+	}
+	if (*getwork_fast_skip_ws(&p[1]))
+		return false;
+	
+	if (submit)
+		*submit_end = '\0';
+	*out_submit = submit;
+	if (id)
+	{
+		*out_idstr = malloc(idlen + 1);
+		memcpy(*out_idstr, id, idlen);
+		(*out_idstr)[idlen] = '\0';
+		*out_idstr_sz = idlen;
+	}
+	return true;
+}
+
 int handle_getwork(struct MHD_Connection *conn, bytes_t *upbuf)
 {
-	struct proxy_client *client;
+	struct proxy_client *client = NULL;
 	struct MHD_Response *resp;
 	char *user, *idstr = NULL;
 	const char *submit = NULL;
@@ -81,9 +247,9 @@ int handle_getwork(struct MHD_Connection *conn, bytes_t *upbuf)
 	long long hashes_done = -1;
 	int ret;
 	
-	if (bytes_len(upbuf))
+	bytes_nullterminate(upbuf);
+	if (bytes_len(upbuf) && !getwork_parse_fast((char*)bytes_buf(upbuf), &idstr, &idstr_sz, &submit))
 	{
-		bytes_nullterminate(upbuf);
 		json = JSON_LOADS((char*)bytes_buf(upbuf), &jerr);
 		if (!json)
 		{
@@ -122,6 +288,7 @@ int handle_getwork(struct MHD_Connection *conn, bytes_t *upbuf)
 	}
 	cgpu = client->cgpu;
 	thr = cgpu->thr[0];
+	mutex_lock(&client->getwork_mutex);
 	
 	{
 		const char * const hashesdone = MHD_lookup_connection_value(conn, MHD_HEADER_KIND, "X-Hashes-Done");
@@ -138,7 +305,7 @@ int handle_getwork(struct MHD_Connection *conn, bytes_t *upbuf)
 		// NOTE: expecting hex2bin to fail since we only parse 80 of the 128
 		hex2bin(hdr, submit, 80);
 		nonce = le32toh(*(uint32_t *)&hdr[76]);
-		HASH_FIND(hh, client->work, hdr, 76, work);
+		work = proxy_worklog_find(client, hdr);
 		if (!work)
 		{
 			inc_hw_errors2(thr, NULL, &nonce);
@@ -156,6 +323,7 @@ int handle_getwork(struct MHD_Connection *conn, bytes_t *upbuf)
 			
 			if (hashes_done == -1)
 				hashes_done = (double)0x100000000 * work->nonce_diff;
+			free_work(work);
 		}
 		
 		reply = malloc(36 + idstr_sz);
@@ -213,7 +381,7 @@ int handle_getwork(struct MHD_Connection *conn, bytes_t *upbuf)
 #endif
 		
 		timer_set_now(&work->tv_work_start);
-		HASH_ADD_KEYPTR(hh, client->work, work->data, 76, work);
+		proxy_worklog_add(client, work);
 		
 		resp = MHD_create_response_from_buffer(replysz, reply, MHD_RESPMEM_MUST_FREE);
 		getwork_prepare_resp(resp, conn);
@@ -223,8 +391,12 @@ int handle_getwork(struct MHD_Connection *conn, bytes_t *upbuf)
 	}
 	
 out:
-	if (hashes_done != -1)
-		hashes_done2(thr, hashes_done, NULL);
+	if (client)
+	{
+		if (hashes_done != -1)
+			hashes_done2(thr, hashes_done, NULL);
+		mutex_unlock(&client->getwork_mutex);
+	}
 	
 	free(idstr);
 	if (json)
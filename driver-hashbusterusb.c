@@ -186,6 +186,7 @@ bool hashbusterusb_lowl_probe(const struct lowlevel_device_info * const info)
 	}
 	struct lowl_usb_endpoint * const ep = usb_open_ep_pair(h, 0x81, 64, 0x01, 64);
 	usb_ep_set_timeouts_ms(ep, 100, 0);
+	usb_ep_set_async(ep, 2);
 	
 	unsigned char OUTPacket[64] = { 0xfe };
 	unsigned char INPacket[64];
@@ -216,6 +217,8 @@ bool hashbusterusb_lowl_probe(const struct lowlevel_device_info * const info)
 	int chip_n;
 	
 	port = malloc(sizeof(*port));
+	/* Be careful, read lowl-spi.h comments for warnings */
+	memset(port, 0, sizeof(*port));
 	port->cgpu = &dummy_cgpu;
 	port->txrx = hashbusterusb_spi_txrx;
 	port->userp = ep;
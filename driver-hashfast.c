@@ -123,7 +123,7 @@ struct hashfast_parsed_msg {
 static
 ssize_t hashfast_write(const int fd, void * const buf, size_t bufsz)
 {
-	const ssize_t rv = write(fd, buf, bufsz);
+	const ssize_t rv = serial_write(fd, buf, bufsz);
 	if ((opt_debug && opt_dev_protocol) || unlikely(rv != bufsz))
 	{
 		const int e = errno;
@@ -365,8 +365,17 @@ const char *hashfast_set_clock_runtime(struct cgpu_info * const proc, const char
 	return NULL;
 }
 
+static
+struct cgpu_info *hashfast_chip_first_proc(struct cgpu_info * const proc)
+{
+	struct hashfast_dev_state * const devstate = proc->device_data;
+	struct hashfast_core_state * const cs = proc->thr[0]->cgpu_data;
+	
+	return devstate->chipstates[cs->chipaddr].coreprocs[0];
+}
+
 static const struct bfg_set_device_definition hashfast_set_device_funcs[] = {
-	{"clock", hashfast_set_clock_runtime, "clock frequency"},
+	{"clock", hashfast_set_clock_runtime, "clock frequency", hashfast_chip_first_proc},
 	{NULL},
 };
 
@@ -588,7 +597,7 @@ void hashfast_submit_nonce(struct thr_info * const thr, struct work * const work
 	applog(LOG_DEBUG, "%"PRIpreprv": Found nonce for seq %02x (last=%02x): %08lx%s",
 	       proc->proc_repr, (unsigned)work->device_id, (unsigned)cs->last_seq,
 	       (unsigned long)nonce, searched ? " (searched)" : "");
-	submit_nonce(thr, work, nonce);
+	submit_nonce_async(thr, work, nonce);
 }
 
 static
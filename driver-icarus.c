@@ -43,6 +43,7 @@
 #include <dirent.h>
 #include <unistd.h>
 #ifndef WIN32
+  #include <poll.h>
   #include <termios.h>
   #include <sys/stat.h>
   #include <fcntl.h>
@@ -62,6 +63,7 @@
 #include "dynclock.h"
 #include "driver-icarus.h"
 #include "lowl-vcom.h"
+#include "vcom-sim.h"
 
 // The serial I/O speed - Linux uses a define 'B115200' in bits/termios.h
 #define ICARUS_IO_SPEED 115200
@@ -175,10 +177,25 @@ int icarus_read(const char * const repr, uint8_t *buf, const int fd, struct time
 	// If there is no thr, then there's no work restart to watch..
 	
 #ifdef HAVE_EPOLL
+	struct icarus_state * const state = thr ? thr->cgpu_data : NULL;
 	bool watching_work_restart = !thr;
 	int epollfd;
 	struct epoll_event evr[2];
 	
+	if (state && state->epollfd != -1 && state->epoll_devfd == fd)
+	{
+		// Reuse the set from the thread's previous reads
+		epollfd = state->epollfd;
+		watching_work_restart = state->epoll_watching_work_restart;
+		goto epoll_ready;
+	}
+	if (state && state->epollfd != -1)
+	{
+		// Device was reopened
+		close(state->epollfd);
+		state->epollfd = -1;
+	}
+	
 	epollfd = epoll_create(2);
 	if (epollfd != -1) {
 		struct epoll_event ev = {
@@ -203,8 +220,16 @@ int icarus_read(const char * const repr, uint8_t *buf, const int fd, struct time
 	else
 		applog(LOG_DEBUG, "%s: Error creating epoll", repr);
 	
+	if (state && epollfd != -1)
+	{
+		state->epollfd = epollfd;
+		state->epoll_devfd = fd;
+		state->epoll_watching_work_restart = watching_work_restart;
+	}
+	
 	if (epollfd == -1 && (remaining_ms = timer_remaining_us(tvp_timeout, tvp_now)) < 100000)
 		applog(LOG_WARNING, "%s: Failed to use epoll, and very short read timeout (%ldms)", repr, remaining_ms);
+epoll_ready:
 #endif
 	
 	while (true) {
@@ -235,7 +260,7 @@ int icarus_read(const char * const repr, uint8_t *buf, const int fd, struct time
 					}
 					// fallthru to...
 				case 2:  // device has data
-					ret = read(fd, buf, read_size);
+					ret = serial_read_some(fd, buf, read_size);
 					break;
 				default:
 					return_via(out, rv = ICA_GETS_ERROR);
@@ -251,7 +276,7 @@ int icarus_read(const char * const repr, uint8_t *buf, const int fd, struct time
 				remaining_ms = 1;
 			vcom_set_timeout_ms(fd, remaining_ms);
 			// Read first byte alone to get earliest tv_finish
-			ret = read(fd, buf, first ? 1 : read_size);
+			ret = serial_read_some(fd, buf, first ? 1 : read_size);
 			timer_set_now(tvp_now);
 		}
 		if (first)
@@ -284,7 +309,7 @@ int icarus_read(const char * const repr, uint8_t *buf, const int fd, struct time
 
 out:
 #ifdef HAVE_EPOLL
-	if (epollfd != -1)
+	if (epollfd != -1 && !state)
 		close(epollfd);
 #endif
 	return rv;
@@ -300,7 +325,7 @@ int icarus_write(const char * const repr, int fd, const void *buf, size_t bufLen
 	if (unlikely(fd == -1))
 		return 1;
 	
-	ret = write(fd, buf, bufLen);
+	ret = serial_write(fd, buf, bufLen);
 	if (unlikely(ret != bufLen))
 		return 1;
 
@@ -312,9 +337,22 @@ int icarus_write(const char * const repr, int fd, const void *buf, size_t bufLen
 void do_icarus_close(struct thr_info *thr)
 {
 	struct cgpu_info *icarus = thr->cgpu;
+	struct icarus_state * const state = thr->cgpu_data;
 	const int fd = icarus->device_fd;
+#ifdef HAVE_EPOLL
+	// A reopened device may well get the same fd number, so always drop the epoll set
+	if (state && state->epollfd != -1)
+	{
+		close(state->epollfd);
+		state->epollfd = -1;
+	}
+#endif
 	if (fd == -1)
 		return;
+	mt_poll_fd(thr, -1);
+	if (state)
+		// A partial result is lost with the port
+		state->nonce_bin_len = 0;
 	icarus_close(fd);
 	icarus->device_fd = -1;
 }
@@ -464,7 +502,7 @@ int icarus_excess_nonce_size(int fd, struct ICARUS_INFO *info)
 	// Read excess_size from Icarus
 	struct timeval tv_now;
 	timer_set_now(&tv_now);
-	int bytes_read = read(fd, excess_bin, excess_size);
+	int bytes_read = serial_read_some(fd, excess_bin, excess_size);
 	// Number of bytes that were still available
 
 	return bytes_read;
@@ -706,6 +744,7 @@ static bool icarus_prepare(struct thr_info *thr)
 	struct icarus_state *state;
 	thr->cgpu_data = state = calloc(1, sizeof(*state));
 	state->firstrun = true;
+	state->epollfd = -1;
 
 #ifdef HAVE_EPOLL
 	int epollfd = epoll_create(2);
@@ -736,9 +775,11 @@ bool icarus_init(struct thr_info *thr)
 		return false;
 	}
 	applog(LOG_INFO, "%s: Opened %s", icarus->dev_repr, icarus->device_path);
+	info->simulated = vcom_sim_path_p(icarus->device_path);
 	
 	BFGINIT(info->job_start_func, icarus_job_start);
 	BFGINIT(state->ob_bin, calloc(1, info->ob_size));
+	BFGINIT(state->nonce_bin, calloc(1, info->read_size));
 	
 	if (!info->work_division)
 		info->work_division = icarus_probe_work_division(fd, icarus->dev_repr, info);
@@ -782,9 +823,17 @@ static
 bool icarus_job_prepare(struct thr_info *thr, struct work *work, __maybe_unused uint64_t max_nonce)
 {
 	struct cgpu_info * const icarus = thr->cgpu;
+	struct ICARUS_INFO * const info = icarus->device_data;
 	struct icarus_state * const state = thr->cgpu_data;
+	
+	// With the async minerloop, only the first processor runs jobs (see icarus_async_job_start)
+	if (unlikely(icarus != icarus->device))
+		return true;
+	
 	uint8_t * const ob_bin = state->ob_bin;
 	
+	if (info->simulated)
+		work->nonce_diff = VCOM_SIM_NONCE_PDIFF;
 	swab256(ob_bin, work->midstate);
 	bswap_96p(&ob_bin[0x34], &work->data[0x40]);
 	if (!(memcmp(&ob_bin[56], "\xff\xff\xff\xff", 4)
@@ -838,6 +887,22 @@ struct work *icarus_process_worknonce(const struct ICARUS_INFO * const info, str
 	return NULL;
 }
 
+// Time from when the device should have sent a nonce for the running job, to when we had read it
+static
+void icarus_note_wakeup(struct ICARUS_INFO * const info, const struct icarus_state * const state, const uint32_t nonce, const struct timeval * const tvp_now)
+{
+	const double hashes = (double)((nonce & info->nonce_mask) + 1) * info->fpga_count;
+	const double expected = hashes * info->Hs + ICARUS_READ_TIME(info->baud, info->read_size);
+	double latency = timer_elapsed(&state->tv_workstart, tvp_now) - expected;
+	// Hs is only an estimate, so a nonce may appear to arrive early
+	if (latency < 0)
+		latency = 0;
+	++info->read_wakeups;
+	info->read_wakeup_latency_total += latency;
+	if (latency > info->read_wakeup_latency_max)
+		info->read_wakeup_latency_max = latency;
+}
+
 static
 void handle_identify(struct thr_info * const thr, int ret, const bool was_first_run)
 {
@@ -879,7 +944,7 @@ void handle_identify(struct thr_info * const thr, int ret, const bool was_first_
 			{
 				memcpy(&nonce, nonce_bin, sizeof(nonce));
 				nonce = icarus_nonce32toh(info, nonce);
-				submit_nonce(icarus_proc_for_nonce(icarus, nonce)->thr[0], state->last_work, nonce);
+				submit_nonce_async(icarus_proc_for_nonce(icarus, nonce)->thr[0], state->last_work, nonce);
 			}
 		}
 	}
@@ -918,6 +983,219 @@ void icarus_transition_work(struct icarus_state *state, struct work *work)
 	state->last_work = copy_work(work);
 }
 
+// Hashes done by a job that ended without a good nonce, from how long it ran
+static
+int64_t icarus_estimate_hashes(const struct ICARUS_INFO * const info, const struct timeval * const tvp_elapsed, const bool was_hw_error)
+{
+	double estimate_hashes = tvp_elapsed->tv_sec;
+	estimate_hashes += ((double)tvp_elapsed->tv_usec) / 1000000.;
+	
+	if (was_hw_error)
+		estimate_hashes -= ICARUS_READ_TIME(info->baud, info->read_size);
+	estimate_hashes /= info->Hs;
+	
+	// If some Serial-USB delay allowed the full nonce range to
+	// complete it can't have done more than a full nonce
+	if (unlikely(estimate_hashes > 0xffffffff))
+		estimate_hashes = 0xffffffff;
+	if (unlikely(estimate_hashes < 0))
+		estimate_hashes = 0;
+	
+	return estimate_hashes;
+}
+
+// Feeds dynamic clocking with a job that found a nonce or ran its full time
+static
+void icarus_dclk_job_done(struct ICARUS_INFO * const info, const struct timeval * const tvp_elapsed, const bool was_hw_error)
+{
+	if (!info->dclk.freqM)
+		return;
+	int qsec = ((4 * tvp_elapsed->tv_sec) + (tvp_elapsed->tv_usec / 250000)) ?: 1;
+	for (int n = qsec; n; --n)
+		dclk_gotNonces(&info->dclk);
+	if (was_hw_error)
+		dclk_errorCount(&info->dclk, qsec);
+}
+
+// For jobs that returned a nonce: detects the device in default timing mode, and refines Hs from the timing history
+static
+void icarus_update_timing(struct cgpu_info * const icarus, const uint32_t nonce, const int64_t hash_count, const struct timeval * const tvp_start, const struct timeval * const tvp_elapsed, const bool was_hw_error)
+{
+	struct ICARUS_INFO * const info = icarus->device_data;
+	struct timeval tv_history_start, tv_history_finish;
+	double Ti, Xi;
+	int i;
+	
+	struct ICARUS_HISTORY *history0, *history;
+	int count;
+	double Hs, W, fullnonce;
+	int read_timeout_ms;
+	bool limited;
+	uint32_t values;
+	int64_t hash_count_range;
+	
+	if (info->do_default_detection && tvp_elapsed->tv_sec >= DEFAULT_DETECT_THRESHOLD) {
+		int MHs = (double)hash_count / ((double)tvp_elapsed->tv_sec * 1e6 + (double)tvp_elapsed->tv_usec);
+		--info->do_default_detection;
+		applog(LOG_DEBUG, "%s: Autodetect device speed: %d MH/s", icarus->dev_repr, MHs);
+		if (MHs <= 370 || MHs > 420) {
+			// Not a real Icarus: enable short timing
+			applog(LOG_WARNING, "%s: Seems too %s to be an Icarus; calibrating with short timing", icarus->dev_repr, MHs>380?"fast":"slow");
+			info->timing_mode = MODE_SHORT;
+			info->do_icarus_timing = true;
+			info->do_default_detection = 0;
+		}
+		else
+		if (MHs <= 380) {
+			// Real Icarus?
+			if (!info->do_default_detection) {
+				applog(LOG_DEBUG, "%s: Seems to be a real Icarus", icarus->dev_repr);
+				info->read_timeout_ms = info->fullnonce * 1000;
+				if (info->read_timeout_ms > 0)
+					--info->read_timeout_ms;
+			}
+		}
+		else
+		if (MHs <= 420) {
+			// Enterpoint Cairnsmore1
+			size_t old_repr_len = strlen(icarus->dev_repr);
+			char old_repr[old_repr_len + 1];
+			strcpy(old_repr, icarus->dev_repr);
+			convert_icarus_to_cairnsmore(icarus);
+			info->do_default_detection = 0;
+			applog(LOG_WARNING, "%s: Detected Cairnsmore1 device, upgrading driver to %s", old_repr, icarus->dev_repr);
+		}
+	}
+
+	// Ignore possible end condition values ... and hw errors
+	// TODO: set limitations on calculated values depending on the device
+	// to avoid crap values caused by CPU/Task Switching/Swapping/etc
+	if (info->do_icarus_timing
+	&&  !was_hw_error
+	&&  ((nonce & info->nonce_mask) > END_CONDITION)
+	&&  ((nonce & info->nonce_mask) < (info->nonce_mask & ~END_CONDITION))) {
+		cgtime(&tv_history_start);
+
+		history0 = &(info->history[0]);
+
+		if (history0->values == 0)
+			timeradd(tvp_start, &history_sec, &(history0->finish));
+
+		Ti = (double)(tvp_elapsed->tv_sec)
+			+ ((double)(tvp_elapsed->tv_usec))/((double)1000000)
+			- ((double)ICARUS_READ_TIME(info->baud, info->read_size));
+		Xi = (double)hash_count;
+		history0->sumXiTi += Xi * Ti;
+		history0->sumXi += Xi;
+		history0->sumTi += Ti;
+		history0->sumXi2 += Xi * Xi;
+
+		history0->values++;
+
+		if (history0->hash_count_max < hash_count)
+			history0->hash_count_max = hash_count;
+		if (history0->hash_count_min > hash_count || history0->hash_count_min == 0)
+			history0->hash_count_min = hash_count;
+
+		if (history0->values >= info->min_data_count
+		&&  timercmp(tvp_start, &(history0->finish), >)) {
+			for (i = INFO_HISTORY; i > 0; i--)
+				memcpy(&(info->history[i]),
+					&(info->history[i-1]),
+					sizeof(struct ICARUS_HISTORY));
+
+			// Initialise history0 to zero for summary calculation
+			memset(history0, 0, sizeof(struct ICARUS_HISTORY));
+
+			// We just completed a history data set
+			// So now recalc read_count based on the whole history thus we will
+			// initially get more accurate until it completes INFO_HISTORY
+			// total data sets
+			count = 0;
+			for (i = 1 ; i <= INFO_HISTORY; i++) {
+				history = &(info->history[i]);
+				if (history->values >= MIN_DATA_COUNT) {
+					count++;
+
+					history0->sumXiTi += history->sumXiTi;
+					history0->sumXi += history->sumXi;
+					history0->sumTi += history->sumTi;
+					history0->sumXi2 += history->sumXi2;
+					history0->values += history->values;
+
+					if (history0->hash_count_max < history->hash_count_max)
+						history0->hash_count_max = history->hash_count_max;
+					if (history0->hash_count_min > history->hash_count_min || history0->hash_count_min == 0)
+						history0->hash_count_min = history->hash_count_min;
+				}
+			}
+
+			// All history data
+			Hs = (history0->values*history0->sumXiTi - history0->sumXi*history0->sumTi)
+				/ (history0->values*history0->sumXi2 - history0->sumXi*history0->sumXi);
+			W = history0->sumTi/history0->values - Hs*history0->sumXi/history0->values;
+			hash_count_range = history0->hash_count_max - history0->hash_count_min;
+			values = history0->values;
+			
+			// Initialise history0 to zero for next data set
+			memset(history0, 0, sizeof(struct ICARUS_HISTORY));
+
+			fullnonce = W + Hs * (((double)0xffffffff) + 1);
+			read_timeout_ms = fullnonce * 1000;
+			if (read_timeout_ms > 0)
+				--read_timeout_ms;
+			if (info->read_count_limit > 0 && read_timeout_ms > info->read_count_limit * 100) {
+				read_timeout_ms = info->read_count_limit * 100;
+				limited = true;
+			} else
+				limited = false;
+
+			info->Hs = Hs;
+			info->read_timeout_ms = read_timeout_ms;
+
+			info->fullnonce = fullnonce;
+			info->count = count;
+			info->W = W;
+			info->values = values;
+			info->hash_count_range = hash_count_range;
+
+			if (info->min_data_count < MAX_MIN_DATA_COUNT)
+				info->min_data_count *= 2;
+			else if (info->timing_mode == MODE_SHORT)
+				info->do_icarus_timing = false;
+
+			applog(LOG_DEBUG, "%s Re-estimate: Hs=%e W=%e read_timeout_ms=%u%s fullnonce=%.3fs",
+					icarus->dev_repr,
+					Hs, W, read_timeout_ms,
+					limited ? " (limited)" : "", fullnonce);
+		}
+		info->history_count++;
+		cgtime(&tv_history_finish);
+
+		timersub(&tv_history_finish, &tv_history_start, &tv_history_finish);
+		timeradd(&tv_history_finish, &(info->history_time), &(info->history_time));
+	}
+}
+
+// Credits each processor an even share of hash_count; returns the rest, for the caller to credit
+static
+int64_t icarus_hashes_done_procs(struct cgpu_info * const icarus, int64_t hash_count)
+{
+	int hash_count_per_proc = hash_count / icarus->procs;
+	if (hash_count_per_proc > 0)
+	{
+		for_each_managed_proc(proc, icarus)
+		{
+			struct thr_info * const proc_thr = proc->thr[0];
+			
+			hashes_done2(proc_thr, hash_count_per_proc, NULL);
+			hash_count -= hash_count_per_proc;
+		}
+	}
+	
+	return hash_count;
+}
+
 static int64_t icarus_scanhash(struct thr_info *thr, struct work *work,
 				__maybe_unused int64_t max_nonce)
 {
@@ -930,20 +1208,10 @@ static int64_t icarus_scanhash(struct thr_info *thr, struct work *work,
 	struct work *nonce_work;
 	int64_t hash_count;
 	struct timeval tv_start = {.tv_sec=0}, elapsed;
-	struct timeval tv_history_start, tv_history_finish;
 	struct timeval tv_now, tv_timeout;
-	double Ti, Xi;
-	int i;
 	bool was_hw_error = false;
 	bool was_first_run;
-
-	struct ICARUS_HISTORY *history0, *history;
-	int count;
-	double Hs, W, fullnonce;
 	int read_timeout_ms;
-	bool limited;
-	uint32_t values;
-	int64_t hash_count_range;
 
 	elapsed.tv_sec = elapsed.tv_usec = 0;
 
@@ -1024,10 +1292,12 @@ keepwaiting:
 		nonce_work = icarus_process_worknonce(info, state, &nonce);
 		if (likely(nonce_work))
 		{
+			if (nonce_work == state->last_work)
+				icarus_note_wakeup(info, state, nonce, &tv_now);
 			if (nonce_work == state->last2_work)
 			{
 				// nonce was for the last job; submit and keep processing the current one
-				submit_nonce(icarus_proc_for_nonce(icarus, nonce)->thr[0], nonce_work, nonce);
+				submit_nonce_async(icarus_proc_for_nonce(icarus, nonce)->thr[0], nonce_work, nonce);
 				goto keepwaiting;
 			}
 			if (info->continue_search)
@@ -1035,7 +1305,7 @@ keepwaiting:
 				read_timeout_ms = info->read_timeout_ms - ((timer_elapsed_us(&state->tv_workstart, NULL) / 1000) + 1);
 				if (read_timeout_ms)
 				{
-					submit_nonce(icarus_proc_for_nonce(icarus, nonce)->thr[0], nonce_work, nonce);
+					submit_nonce_async(icarus_proc_for_nonce(icarus, nonce)->thr[0], nonce_work, nonce);
 					goto keepwaiting;
 				}
 			}
@@ -1046,13 +1316,8 @@ keepwaiting:
 	
 	// Handle dynamic clocking for "subclass" devices
 	// This needs to run before sending next job, since it hashes the command too
-	if (info->dclk.freqM && likely(ret == ICA_GETS_OK || ret == ICA_GETS_TIMEOUT)) {
-		int qsec = ((4 * elapsed.tv_sec) + (elapsed.tv_usec / 250000)) ?: 1;
-		for (int n = qsec; n; --n)
-			dclk_gotNonces(&info->dclk);
-		if (was_hw_error)
-			dclk_errorCount(&info->dclk, qsec);
-	}
+	if (likely(ret == ICA_GETS_OK || ret == ICA_GETS_TIMEOUT))
+		icarus_dclk_job_done(info, &elapsed, was_hw_error);
 	
 	// Force a USB close/reopen on any hw error (or on request, eg for baud change)
 	if (was_hw_error || info->reopen_now)
@@ -1090,7 +1355,7 @@ keepwaiting:
 	if (ret == ICA_GETS_OK && !was_hw_error)
 	{
 		const struct cgpu_info * const proc = icarus_proc_for_nonce(icarus, nonce);
-		submit_nonce(proc->thr[0], nonce_work, nonce);
+		submit_nonce_async(proc->thr[0], nonce_work, nonce);
 		
 		icarus_transition_work(state, work);
 		
@@ -1112,9 +1377,6 @@ keepwaiting:
 	}
 	else
 	{
-		double estimate_hashes = elapsed.tv_sec;
-		estimate_hashes += ((double)elapsed.tv_usec) / 1000000.;
-		
 		const char *repr = icarus->dev_repr;
 		if (ret == ICA_GETS_OK)
 		{
@@ -1122,27 +1384,17 @@ keepwaiting:
 			const struct cgpu_info * const proc = icarus_proc_for_nonce(icarus, nonce);
 			repr = proc->proc_repr;
 			inc_hw_errors(proc->thr[0], state->last_work, nonce);
-			estimate_hashes -= ICARUS_READ_TIME(info->baud, info->read_size);
 		}
 		
 		icarus_transition_work(state, work);
 		
-		estimate_hashes /= info->Hs;
-
-		// If some Serial-USB delay allowed the full nonce range to
-		// complete it can't have done more than a full nonce
-		if (unlikely(estimate_hashes > 0xffffffff))
-			estimate_hashes = 0xffffffff;
-		if (unlikely(estimate_hashes < 0))
-			estimate_hashes = 0;
+		hash_count = icarus_estimate_hashes(info, &elapsed, ret == ICA_GETS_OK);
 
 		applog(LOG_DEBUG, "%s %s nonce = 0x%08"PRIx64" hashes (%"PRId64".%06lus)",
 		       repr,
 		       (ret == ICA_GETS_OK) ? "bad" : "no",
-		       (uint64_t)estimate_hashes,
+		       (uint64_t)hash_count,
 		       (int64_t)elapsed.tv_sec, (unsigned long)elapsed.tv_usec);
-
-		hash_count = estimate_hashes;
 		
 		if (ret != ICA_GETS_OK)
 			goto out;
@@ -1150,165 +1402,266 @@ keepwaiting:
 
 	// Only ICA_GETS_OK gets here
 	
-	if (info->do_default_detection && elapsed.tv_sec >= DEFAULT_DETECT_THRESHOLD) {
-		int MHs = (double)hash_count / ((double)elapsed.tv_sec * 1e6 + (double)elapsed.tv_usec);
-		--info->do_default_detection;
-		applog(LOG_DEBUG, "%s: Autodetect device speed: %d MH/s", icarus->dev_repr, MHs);
-		if (MHs <= 370 || MHs > 420) {
-			// Not a real Icarus: enable short timing
-			applog(LOG_WARNING, "%s: Seems too %s to be an Icarus; calibrating with short timing", icarus->dev_repr, MHs>380?"fast":"slow");
-			info->timing_mode = MODE_SHORT;
-			info->do_icarus_timing = true;
-			info->do_default_detection = 0;
-		}
-		else
-		if (MHs <= 380) {
-			// Real Icarus?
-			if (!info->do_default_detection) {
-				applog(LOG_DEBUG, "%s: Seems to be a real Icarus", icarus->dev_repr);
-				info->read_timeout_ms = info->fullnonce * 1000;
-				if (info->read_timeout_ms > 0)
-					--info->read_timeout_ms;
-			}
-		}
-		else
-		if (MHs <= 420) {
-			// Enterpoint Cairnsmore1
-			size_t old_repr_len = strlen(icarus->dev_repr);
-			char old_repr[old_repr_len + 1];
-			strcpy(old_repr, icarus->dev_repr);
-			convert_icarus_to_cairnsmore(icarus);
-			info->do_default_detection = 0;
-			applog(LOG_WARNING, "%s: Detected Cairnsmore1 device, upgrading driver to %s", old_repr, icarus->dev_repr);
-		}
-	}
-
-	// Ignore possible end condition values ... and hw errors
-	// TODO: set limitations on calculated values depending on the device
-	// to avoid crap values caused by CPU/Task Switching/Swapping/etc
-	if (info->do_icarus_timing
-	&&  !was_hw_error
-	&&  ((nonce & info->nonce_mask) > END_CONDITION)
-	&&  ((nonce & info->nonce_mask) < (info->nonce_mask & ~END_CONDITION))) {
-		cgtime(&tv_history_start);
-
-		history0 = &(info->history[0]);
+	icarus_update_timing(icarus, nonce, hash_count, &tv_start, &elapsed, was_hw_error);
 
-		if (history0->values == 0)
-			timeradd(&tv_start, &history_sec, &(history0->finish));
-
-		Ti = (double)(elapsed.tv_sec)
-			+ ((double)(elapsed.tv_usec))/((double)1000000)
-			- ((double)ICARUS_READ_TIME(info->baud, info->read_size));
-		Xi = (double)hash_count;
-		history0->sumXiTi += Xi * Ti;
-		history0->sumXi += Xi;
-		history0->sumTi += Ti;
-		history0->sumXi2 += Xi * Xi;
-
-		history0->values++;
-
-		if (history0->hash_count_max < hash_count)
-			history0->hash_count_max = hash_count;
-		if (history0->hash_count_min > hash_count || history0->hash_count_min == 0)
-			history0->hash_count_min = hash_count;
-
-		if (history0->values >= info->min_data_count
-		&&  timercmp(&tv_start, &(history0->finish), >)) {
-			for (i = INFO_HISTORY; i > 0; i--)
-				memcpy(&(info->history[i]),
-					&(info->history[i-1]),
-					sizeof(struct ICARUS_HISTORY));
-
-			// Initialise history0 to zero for summary calculation
-			memset(history0, 0, sizeof(struct ICARUS_HISTORY));
-
-			// We just completed a history data set
-			// So now recalc read_count based on the whole history thus we will
-			// initially get more accurate until it completes INFO_HISTORY
-			// total data sets
-			count = 0;
-			for (i = 1 ; i <= INFO_HISTORY; i++) {
-				history = &(info->history[i]);
-				if (history->values >= MIN_DATA_COUNT) {
-					count++;
-
-					history0->sumXiTi += history->sumXiTi;
-					history0->sumXi += history->sumXi;
-					history0->sumTi += history->sumTi;
-					history0->sumXi2 += history->sumXi2;
-					history0->values += history->values;
-
-					if (history0->hash_count_max < history->hash_count_max)
-						history0->hash_count_max = history->hash_count_max;
-					if (history0->hash_count_min > history->hash_count_min || history0->hash_count_min == 0)
-						history0->hash_count_min = history->hash_count_min;
-				}
-			}
-
-			// All history data
-			Hs = (history0->values*history0->sumXiTi - history0->sumXi*history0->sumTi)
-				/ (history0->values*history0->sumXi2 - history0->sumXi*history0->sumXi);
-			W = history0->sumTi/history0->values - Hs*history0->sumXi/history0->values;
-			hash_count_range = history0->hash_count_max - history0->hash_count_min;
-			values = history0->values;
-			
-			// Initialise history0 to zero for next data set
-			memset(history0, 0, sizeof(struct ICARUS_HISTORY));
-
-			fullnonce = W + Hs * (((double)0xffffffff) + 1);
-			read_timeout_ms = fullnonce * 1000;
-			if (read_timeout_ms > 0)
-				--read_timeout_ms;
-			if (info->read_count_limit > 0 && read_timeout_ms > info->read_count_limit * 100) {
-				read_timeout_ms = info->read_count_limit * 100;
-				limited = true;
-			} else
-				limited = false;
+out:
+	if (unlikely(state->identify))
+		handle_identify(thr, ret, was_first_run);
+	
+	return icarus_hashes_done_procs(icarus, hash_count);
+}
 
-			info->Hs = Hs;
-			info->read_timeout_ms = read_timeout_ms;
+#ifndef WIN32
+// Records the hashes of the running job for job_process_results; noncep is its result, if it returned one
+// Returns true if it ran for its whole read timeout
+static
+bool icarus_async_job_end(struct thr_info * const thr, const struct timeval * const tvp_finish, const uint32_t * const noncep, const bool was_hw_error)
+{
+	struct cgpu_info * const icarus = thr->cgpu;
+	struct ICARUS_INFO * const info = icarus->device_data;
+	struct icarus_state * const state = thr->cgpu_data;
+	struct timeval elapsed;
+	int64_t hash_count;
+	bool timed_out;
+	
+	state->job_running = false;
+	timersub(tvp_finish, &state->tv_workstart, &elapsed);
+	timed_out = (timer_elapsed_us(&state->tv_workstart, tvp_finish) / 1000 >= info->read_timeout_ms);
+	if (noncep && !was_hw_error)
+	{
+		hash_count = (*noncep & info->nonce_mask);
+		hash_count++;
+		hash_count *= info->fpga_count;
+	}
+	else
+		hash_count = icarus_estimate_hashes(info, &elapsed, was_hw_error);
+	applog(LOG_DEBUG, "%s %s nonce = 0x%08"PRIx64" hashes (%"PRId64".%06lus)",
+	       icarus->dev_repr,
+	       noncep ? (was_hw_error ? "bad" : "good") : "no",
+	       (uint64_t)hash_count,
+	       (int64_t)elapsed.tv_sec, (unsigned long)elapsed.tv_usec);
+	
+	// Jobs cut short by a work restart say nothing about the clock
+	if (noncep || timed_out)
+		icarus_dclk_job_done(info, &elapsed, was_hw_error);
+	if (noncep)
+		icarus_update_timing(icarus, *noncep, hash_count, &state->tv_workstart, &elapsed, was_hw_error);
+	state->hashes += hash_count;
+	return timed_out;
+}
 
-			info->fullnonce = fullnonce;
-			info->count = count;
-			info->W = W;
-			info->values = values;
-			info->hash_count_range = hash_count_range;
+static
+void icarus_async_comms_error(struct thr_info * const thr)
+{
+	struct cgpu_info * const icarus = thr->cgpu;
+	struct icarus_state * const state = thr->cgpu_data;
+	
+	do_icarus_close(thr);
+	applog(LOG_ERR, "%s: Comms error (rerr)", icarus->dev_repr);
+	dev_error(icarus, REASON_DEV_COMMS_ERROR);
+	// Like scanhash, count no hashes for the job, and reopen to start the next one right away
+	state->job_running = false;
+	timer_set_now(&thr->tv_morework);
+}
 
-			if (info->min_data_count < MAX_MIN_DATA_COUNT)
-				info->min_data_count *= 2;
-			else if (info->timing_mode == MODE_SHORT)
-				info->do_icarus_timing = false;
+// Reads what the device has sent, without waiting; called whenever the minerloop sees its fd readable
+static
+void icarus_async_poll(struct thr_info * const thr)
+{
+	struct cgpu_info * const icarus = thr->cgpu;
+	struct ICARUS_INFO * const info = icarus->device_data;
+	struct icarus_state * const state = thr->cgpu_data;
+	const int fd = icarus->device_fd;
+	struct pollfd pfd = {
+		.fd = fd,
+		.events = POLLIN,
+	};
+	struct timeval tv_now;
+	struct work *nonce_work;
+	uint32_t nonce;
+	ssize_t ret;
+	
+	timer_unset(&thr->tv_poll);
+	if (unlikely(fd == -1))
+		return;
+	if (unlikely(thr->poll_fd == -1 && state->job_running))
+		// The minerloop cannot wait on the fd, so check it every read fault timeout
+		timer_set_delay_from_now(&thr->tv_poll, ICARUS_READ_FAULT_DECISECONDS * 100000);
+	
+	if (poll(&pfd, 1, 0) < 1)
+		return;
+	if (unlikely(!(pfd.revents & POLLIN)))
+		goto comms_error;
+	ret = serial_read_some(fd, &state->nonce_bin[state->nonce_bin_len], info->read_size - state->nonce_bin_len);
+	timer_set_now(&tv_now);
+	if (unlikely(ret <= 0))
+		// Readable, but nothing to read: the device is gone
+		goto comms_error;
+	if (opt_dev_protocol && opt_debug)
+		icarus_log_protocol(icarus->dev_repr, &state->nonce_bin[state->nonce_bin_len], ret, "RECV");
+	if (!state->nonce_bin_len)
+		state->tv_workfinish = tv_now;
+	state->nonce_bin_len += ret;
+	if (state->nonce_bin_len < info->read_size)
+		return;
+	state->nonce_bin_len = 0;
+	
+	memcpy(&nonce, state->nonce_bin, sizeof(nonce));
+	nonce_work = icarus_process_worknonce(info, state, &nonce);
+	if (unlikely(!nonce_work))
+	{
+		// We can't be sure which processor got the error, but at least this is a decent guess
+		inc_hw_errors(icarus_proc_for_nonce(icarus, nonce)->thr[0], state->last_work, nonce);
+		if (!state->job_running)
+			return;
+		// Force a reopen before the next job
+		icarus_async_job_end(thr, &state->tv_workfinish, &nonce, true);
+		state->was_hw_error = true;
+		timer_set_now(&thr->tv_morework);
+		return;
+	}
+	if (nonce_work == state->last_work)
+		icarus_note_wakeup(info, state, nonce, &tv_now);
+	submit_nonce_async(icarus_proc_for_nonce(icarus, nonce)->thr[0], nonce_work, nonce);
+	// Nonces for the last job, or found while continuing the search, leave the current job running
+	if (nonce_work != state->last_work || !state->job_running || info->continue_search)
+		return;
+	// The device stopped at this nonce, so start the next job right away
+	icarus_async_job_end(thr, &state->tv_workfinish, &nonce, false);
+	timer_set_now(&thr->tv_morework);
+	return;
 
-			applog(LOG_DEBUG, "%s Re-estimate: Hs=%e W=%e read_timeout_ms=%u%s fullnonce=%.3fs",
-					icarus->dev_repr,
-					Hs, W, read_timeout_ms,
-					limited ? " (limited)" : "", fullnonce);
-		}
-		info->history_count++;
-		cgtime(&tv_history_finish);
+comms_error:
+	icarus_async_comms_error(thr);
+}
 
-		timersub(&tv_history_finish, &tv_history_start, &tv_history_finish);
-		timeradd(&tv_history_finish, &(info->history_time), &(info->history_time));
+static
+void icarus_async_job_start(struct thr_info * const thr)
+{
+	struct cgpu_info * const icarus = thr->cgpu;
+	struct ICARUS_INFO * const info = icarus->device_data;
+	struct icarus_state * const state = thr->cgpu_data;
+	struct timeval tv_now, tv_idle;
+	bool was_running, timed_out = false, reopen = false;
+	int fd;
+	
+	if (icarus != icarus->device)
+	{
+		// Only the first processor runs jobs; the others are credited a share of its hashes
+		mt_job_transition(thr);
+		job_start_complete(thr);
+		return;
 	}
-
-out:
-	if (unlikely(state->identify))
-		handle_identify(thr, ret, was_first_run);
 	
-	int hash_count_per_proc = hash_count / icarus->procs;
-	if (hash_count_per_proc > 0)
+	// Take any result that came in since the last poll
+	icarus_async_poll(thr);
+	timer_set_now(&tv_now);
+	was_running = state->job_running;
+	if (was_running)
+		timed_out = icarus_async_job_end(thr, &tv_now, NULL, false);
+	
+	// Force a USB close/reopen on any hw error (or on request, eg for baud change)
+	if (state->was_hw_error || info->reopen_now)
 	{
-		for_each_managed_proc(proc, icarus)
+		state->was_hw_error = info->reopen_now = false;
+		// With IRM_CYCLE, we reopen after sending the job anyway
+		if (info->reopen_mode != IRM_CYCLE)
+			reopen = true;
+	}
+	if (timed_out && info->reopen_mode == IRM_TIMEOUT)
+		reopen = true;
+	fd = icarus->device_fd;
+	if ((reopen || fd == -1) && !icarus_reopen(icarus, state, &fd))
+	{
+		job_start_abort(thr, true);
+		return;
+	}
+	
+	if (unlikely(state->identify))
+	{
+		// Leave the device idle until it has finished its last job, and 3 seconds more
+		// The job is not sent, so unless it goes stale, it is started afterward
+		state->identify = false;
+		tv_idle = tv_now;
+		if (was_running)
 		{
-			struct thr_info * const proc_thr = proc->thr[0];
-			
-			hashes_done2(proc_thr, hash_count_per_proc, NULL);
-			hash_count -= hash_count_per_proc;
+			timer_set_delay(&tv_idle, &state->tv_workstart, (uint64_t)(info->fullnonce * 1000000));
+			if (timercmp(&tv_idle, &tv_now, <))
+				tv_idle = tv_now;
 		}
+		applog(LOG_DEBUG, "%s: Identify: Leaving idle for 3 seconds after its current job", icarus->dev_repr);
+		mt_job_transition(thr);
+		timer_set_delay(&thr->tv_morework, &tv_idle, 3000000);
+		job_start_complete(thr);
+		return;
 	}
 	
-	return hash_count;
+	tcflush(fd, TCOFLUSH);
+	if (likely(info->job_start_func(thr)))
+	{
+		state->firstrun = false;
+		state->job_running = true;
+		if (info->reopen_mode == IRM_CYCLE && !icarus_reopen(icarus, state, &fd))
+			state->firstrun = true;
+	}
+	else
+		state->firstrun = true;
+	if (unlikely(state->firstrun))
+		// Closed on error, so the next job reopens it right away (or fails)
+		state->job_running = false;
+	
+	mt_job_transition(thr);
+	thr->work->blk.nonce = 0xffffffff;
+	icarus_transition_work(state, thr->work);
+	if (state->job_running)
+	{
+		timer_set_delay(&thr->tv_morework, &state->tv_workstart, info->read_timeout_ms * 1000);
+		mt_poll_fd(thr, fd);
+	}
+	else
+		timer_set_now(&thr->tv_morework);
+	job_start_complete(thr);
+}
+
+static
+int64_t icarus_async_job_process_results(struct thr_info * const thr, struct work * const work, const bool stopping)
+{
+	struct cgpu_info * const icarus = thr->cgpu;
+	struct icarus_state * const state = thr->cgpu_data;
+	struct timeval tv_now;
+	int64_t hash_count;
+	
+	if (icarus != icarus->device)
+		return 0;
+	if (stopping && state->job_running)
+	{
+		timer_set_now(&tv_now);
+		icarus_async_job_end(thr, &tv_now, NULL, false);
+	}
+	hash_count = state->hashes;
+	state->hashes = 0;
+	return icarus_hashes_done_procs(icarus, hash_count);
+}
+#endif
+
+/* scanhash blocks its thread waiting on the device, so where the job start
+ * cannot block either, the async minerloop is used instead, which
+ * --minerloop-reactor can share with other devices. Custom job starts may
+ * sleep, and other job_prepare functions do not skip the extra processors. */
+static
+void icarus_minerloop(struct thr_info * const thr)
+{
+#ifndef WIN32
+	struct cgpu_info * const icarus = thr->cgpu;
+	struct ICARUS_INFO * const info = icarus->device_data;
+	
+	if (info->job_start_func == icarus_job_start && (icarus->procs == 1 || icarus->drv->job_prepare == icarus_job_prepare))
+	{
+		minerloop_async(thr);
+		return;
+	}
+#endif
+	minerloop_scanhash(thr);
 }
 
 static struct api_data *icarus_drv_stats(struct cgpu_info *cgpu)
@@ -1340,6 +1693,11 @@ static struct api_data *icarus_drv_stats(struct cgpu_info *cgpu)
 	root = api_add_int(root, "baud", &(info->baud), false);
 	root = api_add_int(root, "work_division", &(info->work_division), false);
 	root = api_add_int(root, "fpga_count", &(info->fpga_count), false);
+	root = api_add_uint(root, "read_wakeups", &(info->read_wakeups), false);
+	const double latency_avg_ms = info->read_wakeups ? (info->read_wakeup_latency_total * 1e3 / info->read_wakeups) : 0;
+	const double latency_max_ms = info->read_wakeup_latency_max * 1e3;
+	root = api_add_double(root, "read_wakeup_latency_avg_ms", &latency_avg_ms, true);
+	root = api_add_double(root, "read_wakeup_latency_max_ms", &latency_max_ms, true);
 
 	return root;
 }
@@ -1417,8 +1775,11 @@ const char *icarus_set_reopen(struct cgpu_info * const proc, const char * const
 
 static void icarus_shutdown(struct thr_info *thr)
 {
+	struct icarus_state * const state = thr->cgpu_data;
+	
 	do_icarus_close(thr);
-	free(thr->cgpu_data);
+	free(state->nonce_bin);
+	free(state);
 }
 
 const struct bfg_set_device_definition icarus_set_device_funcs[] = {
@@ -1449,8 +1810,15 @@ struct device_drv icarus_drv = {
 	.get_api_stats = icarus_drv_stats,
 	.thread_prepare = icarus_prepare,
 	.thread_init = icarus_init,
+	.minerloop = icarus_minerloop,
 	.scanhash = icarus_scanhash,
 	.job_prepare = icarus_job_prepare,
-	.thread_disable = close_device_fd,
+#ifndef WIN32
+	.minerloop_reactor_safe = true,
+	.job_start = icarus_async_job_start,
+	.poll = icarus_async_poll,
+	.job_process_results = icarus_async_job_process_results,
+#endif
+	.thread_disable = do_icarus_close,
 	.thread_shutdown = icarus_shutdown,
 };
@@ -125,6 +125,8 @@ struct ICARUS_INFO {
 	bool nonce_littleendian;
 	// Don't check the golden nonce returned when probing
 	bool ignore_golden_nonce;
+	// Simulated device, reporting nonces at VCOM_SIM_NONCE_PDIFF
+	bool simulated;
 	
 	// Custom driver functions
 	bool (*detect_init_func)(const char *devpath, int fd, struct ICARUS_INFO *);
@@ -143,6 +145,10 @@ struct ICARUS_INFO {
 	uint16_t freq;
 	uint16_t chips;
 #endif
+	// Time from when a nonce for the running job was due, to having read it
+	unsigned read_wakeups;
+	double read_wakeup_latency_total;
+	double read_wakeup_latency_max;
 };
 
 struct icarus_state {
@@ -155,9 +161,26 @@ struct icarus_state {
 	bool identify;
 	
 	uint8_t *ob_bin;
+	
+	// Long-lived epoll set for icarus_read, watching epoll_devfd and the work restart notifier
+	int epollfd;
+	int epoll_devfd;
+	bool epoll_watching_work_restart;
+	
+	// Used with minerloop_async instead of scanhash (see icarus_minerloop):
+	// A job is hashing on the device, and has not returned its nonce yet
+	bool job_running;
+	// The running job ended on a nonce for no known work
+	bool was_hw_error;
+	// Hashes done by jobs that ended, for job_process_results
+	int64_t hashes;
+	// Result read so far
+	uint8_t *nonce_bin;
+	int nonce_bin_len;
 };
 
 extern struct cgpu_info *icarus_detect_custom(const char *devpath, struct device_drv *, struct ICARUS_INFO *);
+// If thr is provided, it must be an icarus_prepare'd thread (to keep its epoll set)
 extern int icarus_read(const char *repr, uint8_t *buf, int fd, struct timeval *tvp_finish, struct thr_info *, const struct timeval *tvp_timeout, struct timeval *tvp_now, int read_size);
 extern int icarus_write(const char * const repr, int fd, const void *buf, size_t bufLen);
 extern bool icarus_init(struct thr_info *);
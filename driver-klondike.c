@@ -988,7 +988,7 @@ bool klondike_lowl_probe(const struct lowlevel_device_info * const info)
 static void klondike_check_nonce(struct cgpu_info *klncgpu, KLIST *kitem)
 {
 	struct klondike_info *klninfo = (struct klondike_info *)(klncgpu->device_data);
-	struct work *work, *look, *tmp;
+	struct work *work, *look;
 	KLINE *kline = &(kitem->kline);
 	struct cgpu_info * const proc = klondike_get_proc(klncgpu, kline->wr.dev);
 	struct thr_info * const thr = proc->thr[0];
@@ -1003,20 +1003,18 @@ static void klondike_check_nonce(struct cgpu_info *klncgpu, KLIST *kitem)
 	work = NULL;
 	cgtime(&tv_now);
 	rd_lock(&(klncgpu->qlock));
-	HASH_ITER(hh, klncgpu->queued_work, look, tmp) {
-		if (ms_tdiff(&tv_now, &(look->tv_stamp)) < klninfo->old_work_ms &&
-		    (look->subid == (kline->wr.dev*256 + kline->wr.workid))) {
-			work = look;
-			break;
-		}
-	}
+	look = __find_queued_work_bysubid(klncgpu, kline->wr.dev*256 + kline->wr.workid);
+	if (look && ms_tdiff(&tv_now, &(look->tv_stamp)) < klninfo->old_work_ms)
+		work = look;
 	rd_unlock(&(klncgpu->qlock));
 
 	if (work) {
 		if (unlikely(!klninfo->nonce_offset))
 		{
-			bool test_c0  = test_nonce(work, nonce -  0xc0, false);
-			bool test_180 = test_nonce(work, nonce - 0x180, false);
+			const uint32_t candidates[2] = { nonce - 0xc0, nonce - 0x180 };
+			bool good[2];
+			test_nonce_candidates(work, candidates, good, 2);
+			const bool test_c0 = good[0], test_180 = good[1];
 			if (test_c0)
 			{
 				if (unlikely(test_180))
@@ -1405,8 +1403,8 @@ static bool klondike_send_work(struct cgpu_info *klncgpu, int dev, struct work *
 	memcpy(kline.wt.midstate, work->midstate, MIDSTATE_BYTES);
 	memcpy(kline.wt.merkle, work->data + MERKLE_OFFSET, MERKLE_BYTES);
 	kline.wt.workid = (uint8_t)(klninfo->devinfo[dev].nextworkid++ & 0xFF);
-	work->subid = dev*256 + kline.wt.workid;
 	cgtime(&work->tv_stamp);
+	set_queued_work_subid(klncgpu, work, dev*256 + kline.wt.workid);
 
 	if (opt_log_level <= LOG_DEBUG) {
 		char hexdata[(sizeof(kline.wt) * 2) + 1];
@@ -45,7 +45,7 @@ ssize_t keep_reading(int prio, int fd, void *buf, size_t count)
 	
 	while (count)
 	{
-		r = read(fd, buf, count);
+		r = serial_read_some(fd, buf, count);
 		if (unlikely(r <= 0))
 		{
 			applog(prio, "Read of fd %d returned %d", fd, (int)r);
@@ -86,7 +86,7 @@ bool bitfury_do_packet(int prio, const char *repr, const int fd, void * const bu
 			bin2hex(hex, pkt, sz);
 			applog(LOG_DEBUG, "%s: DEVPROTO: SEND %s", repr, hex);
 		}
-		r = write(fd, pkt, sz);
+		r = serial_write(fd, pkt, sz);
 		if (sz != r)
 		{
 			applog(prio, "%s: Failed to write packet (%d bytes succeeded)", repr, (int)r);
@@ -532,6 +532,7 @@ struct device_drv littlefury_drv = {
 	.thread_shutdown = littlefury_shutdown,
 	
 	.minerloop = minerloop_async,
+	.minerloop_reactor_safe = true,
 	.job_prepare = bitfury_job_prepare,
 	.job_start = bitfury_noop_job_start,
 	.poll = littlefury_poll,
@@ -233,6 +233,7 @@ struct device_drv metabank_drv = {
 	.thread_disable = bitfury_disable,
 	
 	.minerloop = minerloop_async,
+	.minerloop_reactor_safe = true,
 	.job_prepare = bitfury_job_prepare,
 	.job_start = bitfury_noop_job_start,
 	.poll = bitfury_do_io,
@@ -400,8 +400,9 @@ bool minergate_queue_append(struct thr_info * const thr, struct work * const wor
 	memcpy(&my_buf[0x0c], &work->data[0x40], 4);  // merkle-tail
 	memcpy(&my_buf[0x10], work->midstate, 0x20);
 	
-	if (work->work_difficulty >= MINERGATE_MAX_NONCE_DIFF)
-		work->nonce_diff = MINERGATE_MAX_NONCE_DIFF;
+	const float max_nonce_diff = cgpu_auto_nonce_diff(dev, dev->procs, work_mining_algorithm(work), MINERGATE_MAX_NONCE_DIFF, MINERGATE_MAX_NONCE_DIFF);
+	if (work->work_difficulty >= max_nonce_diff)
+		work->nonce_diff = max_nonce_diff;
 	else
 		work->nonce_diff = work->work_difficulty;
 	const uint16_t zerobits = log2(floor(work->nonce_diff * 4294967296));
@@ -456,7 +457,7 @@ bool minergate_submit(struct thr_info * const thr, struct work * const work, con
 	
 	if (likely(work))
 	{
-		submit_noffset_nonce(thr, work, nonce, ntime_offset);
+		submit_noffset_nonce_async(thr, work, nonce, ntime_offset);
 		
 		struct cgpu_info * const dev = thr->cgpu;
 		struct minergate_config * const mgcfg = dev->device_data;
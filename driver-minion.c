@@ -629,7 +629,7 @@ const char *minion_set_clock(struct cgpu_info * const proc, const char * const o
 }
 
 static const struct bfg_set_device_definition minion_set_device_funcs[] = {
-	{"clock", minion_set_clock, "clock frequency"},
+	{"clock", minion_set_clock, "clock frequency", bfg_set_device_group_chip},
 	{NULL},
 };
 
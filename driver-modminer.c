@@ -120,11 +120,11 @@ modminer_detect_one(const char *devpath)
 
 	// Sending a "ping" first, to workaround bug in new firmware betas (see issue #62)
 	// Sending 45 noops, just in case the device was left in "start job" reading
-	(void)(write(fd, NOOP, sizeof(NOOP)) ?:0);
+	(void)(serial_write(fd, NOOP, sizeof(NOOP)) ?:0);
 	while (serial_read(fd, buf, sizeof(buf)) > 0)
 		;
 
-	if (1 != write(fd, MODMINER_GET_VERSION, 1))
+	if (1 != serial_write(fd, MODMINER_GET_VERSION, 1))
 		bailout(LOG_DEBUG, "ModMiner detect: write failed on %s (get version)", devpath);
 	len = serial_read(fd, buf, sizeof(buf)-1);
 	if (len < 1)
@@ -141,9 +141,9 @@ modminer_detect_one(const char *devpath)
 	}
 	
 	char*devname = strdup(buf);
-	if (1 != write(fd, MODMINER_FPGA_COUNT, 1))
+	if (1 != serial_write(fd, MODMINER_FPGA_COUNT, 1))
 		bailout(LOG_DEBUG, "ModMiner detect: write failed on %s (get FPGA count)", devpath);
-	len = read(fd, buf, 1);
+	len = serial_read_some(fd, buf, 1);
 	if (len < 1)
 		bailout(LOG_ERR, "ModMiner detect: timeout waiting for FPGA count from %s", devpath);
 	if (!buf[0])
@@ -221,7 +221,7 @@ modminer_reopen(struct cgpu_info*modminer)
 FD_ZERO(&fds); \
 FD_SET(fd, &fds);  \
 select(fd+1, &fds, NULL, NULL, NULL);  \
-	if (1 != read(fd, buf, 1))  \
+	if (1 != serial_read_some(fd, buf, 1))  \
 		bailout2(LOG_ERR, "%s: Error programming %s (" eng ")", modminer->dev_repr, modminer->device_path);  \
 	if (buf[0] != 1)  \
 		bailout2(LOG_ERR, "%s: Wrong " eng " programming %s", modminer->dev_repr, modminer->device_path);  \
@@ -249,7 +249,7 @@ modminer_fpga_upload_bitstream(struct cgpu_info*modminer)
 	buf[3] = (len >>  8) & 0xff;
 	buf[4] = (len >> 16) & 0xff;
 	buf[5] = (len >> 24) & 0xff;
-	if (6 != write(fd, buf, 6))
+	if (6 != serial_write(fd, buf, 6))
 		bailout2(LOG_ERR, "%s: Error programming %s (cmd)", modminer->dev_repr, modminer->device_path);
 	status_read("cmd reply");
 	ssize_t buflen;
@@ -258,7 +258,7 @@ modminer_fpga_upload_bitstream(struct cgpu_info*modminer)
 		buflen = len < 32 ? len : 32;
 		if (fread(buf, buflen, 1, f) != 1)
 			bailout2(LOG_ERR, "%s: File underrun programming %s (%lu bytes left)", modminer->dev_repr, modminer->device_path, len);
-		if (write(fd, buf, buflen) != buflen)
+		if (serial_write(fd, buf, buflen) != buflen)
 			bailout2(LOG_ERR, "%s: Error programming %s (data)", modminer->dev_repr,  modminer->device_path);
 		state->pdone = 100 - ((len * 100) / flen);
 		if (state->pdone >= nextstatus)
@@ -333,7 +333,7 @@ modminer_change_clock(struct thr_info*thr, bool needlock, signed char delta)
 	if (needlock)
 		mutex_lock(mutexp);
 	fd = modminer->device->device_fd;
-	if (6 != write(fd, cmd, 6))
+	if (6 != serial_write(fd, cmd, 6))
 		bailout2(LOG_ERR, "%s: Error writing (set frequency)", modminer->proc_repr);
 	if (serial_read(fd, &buf, 1) != 1)
 		bailout2(LOG_ERR, "%s: Error reading (set frequency)", modminer->proc_repr);
@@ -377,7 +377,7 @@ static bool _modminer_get_nonce(struct cgpu_info*modminer, char fpgaid, uint32_t
 	int fd = modminer->device->device_fd;
 	char cmd[2] = {MODMINER_CHECK_WORK, fpgaid};
 	
-	if (write(fd, cmd, 2) != 2) {
+	if (serial_write(fd, cmd, 2) != 2) {
 		applog(LOG_ERR, "%s: Error writing (get nonce)", modminer->proc_repr);
 		return false;
 	}
@@ -411,7 +411,7 @@ modminer_fpga_init(struct thr_info *thr)
 
 	cmd[0] = MODMINER_GET_USERCODE;
 	cmd[1] = fpgaid;
-	if (write(fd, cmd, 2) != 2)
+	if (serial_write(fd, cmd, 2) != 2)
 		bailout2(LOG_ERR, "%s: Error writing (read USER code)", modminer->proc_repr);
 	if (serial_read(fd, buf, 4) != 4)
 		bailout2(LOG_ERR, "%s: Error reading (read USER code)", modminer->proc_repr);
@@ -487,7 +487,7 @@ static void modminer_get_temperature(struct cgpu_info *modminer, struct thr_info
 	char cmd[2] = {MODMINER_TEMP1, fpgaid};
 	char temperature;
 
-	if (2 == write(fd, cmd, 2) && read(fd, &temperature, 1) == 1)
+	if (2 == serial_write(fd, cmd, 2) && serial_read_some(fd, &temperature, 1) == 1)
 	{
 		state->temp = temperature;
 		if (temperature > modminer->targettemp + opt_hysteresis) {
@@ -598,7 +598,7 @@ fd_set fds;
 		fd = modminer->device->device_fd;
 	}
 
-	if (46 != write(fd, state->next_work_cmd, 46))
+	if (46 != serial_write(fd, state->next_work_cmd, 46))
 		bailout2(LOG_ERR, "%s: Error writing (start work)", modminer->proc_repr);
 	timer_set_now(&state->tv_workstart);
 	state->hashes = 0;
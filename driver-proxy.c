@@ -28,58 +28,106 @@ struct proxy_client *proxy_clients;
 static
 pthread_mutex_t proxy_clients_mutex = PTHREAD_MUTEX_INITIALIZER;
 
+// Work handed out to getwork clients, indexed by the first 76 bytes of the header
+struct proxy_worklog_entry {
+	struct work *work;
+	struct proxy_client *client;
+	struct proxy_worklog_entry *bucket_next;
+	UT_hash_handle hh;
+};
+
+// Entries are grouped by the time they were handed out, so expiry only ever
+// touches the oldest bucket(s) instead of scanning every client's work
+#define PROXY_WORKLOG_BUCKET_SECS  10
+
+struct proxy_worklog_bucket {
+	struct timeval tv_start;
+	struct proxy_worklog_entry *entries;
+	struct proxy_worklog_bucket *next;
+};
+
 static
-void prune_worklog()
+struct proxy_worklog_entry *proxy_worklog;
+static
+struct proxy_worklog_bucket *proxy_worklog_oldest, *proxy_worklog_newest;
+static
+pthread_mutex_t proxy_worklog_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Must be called with proxy_worklog_mutex held
+static
+void prune_worklog(const struct timeval * const tv_now)
 {
-	struct proxy_client *client, *tmp;
-	struct work *work, *tmp2;
-	struct timeval tv_now;
-	
-	timer_set_now(&tv_now);
+	struct proxy_worklog_bucket *bucket;
+	struct proxy_worklog_entry *entry, *next;
 	
-	mutex_lock(&proxy_clients_mutex);
-	HASH_ITER(hh, proxy_clients, client, tmp)
+	while ( (bucket = proxy_worklog_oldest) )
 	{
-		HASH_ITER(hh, client->work, work, tmp2)
+		// Only drop a bucket once even its newest entry has expired
+		if (timer_elapsed(&bucket->tv_start, tv_now) <= opt_expiry + PROXY_WORKLOG_BUCKET_SECS)
+			break;
+		for (entry = bucket->entries; entry; entry = next)
 		{
-			if (timer_elapsed(&work->tv_work_start, &tv_now) <= opt_expiry)
-				break;
-			HASH_DEL(client->work, work);
-			free_work(work);
+			next = entry->bucket_next;
+			HASH_DEL(proxy_worklog, entry);
+			free_work(entry->work);
+			free(entry);
 		}
+		proxy_worklog_oldest = bucket->next;
+		if (!proxy_worklog_oldest)
+			proxy_worklog_newest = NULL;
+		free(bucket);
 	}
-	mutex_unlock(&proxy_clients_mutex);
 }
 
-static
-pthread_t prune_worklog_pth;
-
-static
-void *prune_worklog_thread(void *userdata)
+void proxy_worklog_add(struct proxy_client * const client, struct work * const work)
 {
-	struct cgpu_info *cgpu = userdata;
+	struct proxy_worklog_entry * const entry = malloc(sizeof(*entry));
+	struct proxy_worklog_bucket *bucket;
 	
-	pthread_detach(pthread_self());
-	RenameThread("PXY_pruner");
+	*entry = (struct proxy_worklog_entry){
+		.work = work,
+		.client = client,
+	};
 	
-	while (!cgpu->shutdown)
+	mutex_lock(&proxy_worklog_mutex);
+	prune_worklog(&work->tv_work_start);
+	bucket = proxy_worklog_newest;
+	if ((!bucket) || timer_elapsed(&bucket->tv_start, &work->tv_work_start) >= PROXY_WORKLOG_BUCKET_SECS)
 	{
-		prune_worklog();
-		sleep(60);
+		bucket = malloc(sizeof(*bucket));
+		*bucket = (struct proxy_worklog_bucket){
+			.tv_start = work->tv_work_start,
+		};
+		if (proxy_worklog_newest)
+			proxy_worklog_newest->next = bucket;
+		else
+			proxy_worklog_oldest = bucket;
+		proxy_worklog_newest = bucket;
 	}
-	return NULL;
+	entry->bucket_next = bucket->entries;
+	bucket->entries = entry;
+	HASH_ADD_KEYPTR(hh, proxy_worklog, work->data, 76, entry);
+	mutex_unlock(&proxy_worklog_mutex);
 }
 
-static
-float proxy_min_nonce_diff(struct cgpu_info * const proc, const struct mining_algorithm * const malgo)
+// Returns a copy of the work, since the original may expire at any time once the lock is released
+struct work *proxy_worklog_find(struct proxy_client * const client, const void * const hdr)
 {
-	return minimum_pdiff;
+	struct proxy_worklog_entry *entry;
+	struct work *work = NULL;
+	
+	mutex_lock(&proxy_worklog_mutex);
+	HASH_FIND(hh, proxy_worklog, hdr, 76, entry);
+	if (entry && entry->client == client)
+		work = copy_work(entry->work);
+	mutex_unlock(&proxy_worklog_mutex);
+	return work;
 }
 
 static
-void proxy_first_client(struct cgpu_info *cgpu)
+float proxy_min_nonce_diff(struct cgpu_info * const proc, const struct mining_algorithm * const malgo)
 {
-	pthread_create(&prune_worklog_pth, NULL, prune_worklog_thread, cgpu);
+	return minimum_pdiff;
 }
 
 struct proxy_client *proxy_find_or_create_client(const char *username)
@@ -87,7 +135,6 @@ struct proxy_client *proxy_find_or_create_client(const char *username)
 	struct proxy_client *client;
 	struct cgpu_info *cgpu;
 	char *user;
-	int b;
 	
 	if (!username)
 		return NULL;
@@ -119,14 +166,11 @@ struct proxy_client *proxy_find_or_create_client(const char *username)
 			.cgpu = cgpu,
 			.desired_share_pdiff = 0.,
 		};
+		mutex_init(&client->getwork_mutex);
 		
-		b = HASH_COUNT(proxy_clients);
 		HASH_ADD_KEYPTR(hh, proxy_clients, client->username, strlen(user), client);
 		mutex_unlock(&proxy_clients_mutex);
 		
-		if (!b)
-			proxy_first_client(cgpu);
-		
 		cgpu_set_defaults(cgpu);
 	}
 	else
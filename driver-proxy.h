@@ -14,9 +14,10 @@ extern struct device_drv proxy_drv;
 struct proxy_client {
 	char *username;
 	struct cgpu_info *cgpu;
-	struct work *work;
 	struct timeval tv_hashes_done;
 	float desired_share_pdiff;
+	// getwork requests may be handled concurrently, but share cgpu->thr[0]
+	pthread_mutex_t getwork_mutex;
 	
 #ifdef USE_LIBEVENT
 	struct stratumsrv_conn_userlist *stratumsrv_connlist;
@@ -27,6 +28,9 @@ struct proxy_client {
 
 extern struct proxy_client *proxy_find_or_create_client(const char *user);
 
+extern void proxy_worklog_add(struct proxy_client *, struct work *);
+extern struct work *proxy_worklog_find(struct proxy_client *, const void *hdr);
+
 #ifdef USE_LIBEVENT
 extern void stratumsrv_client_changed_diff(struct proxy_client *);
 #endif
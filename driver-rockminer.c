@@ -70,7 +70,7 @@ void rockminer_log_protocol(int fd, const void *buf, size_t bufLen, const char *
 static
 int rockminer_read(int fd, void *buf, size_t bufLen)
 {
-	int result = read(fd, buf, bufLen);
+	int result = serial_read_some(fd, buf, bufLen);
 	
 	if (result < 0)
 		applog(LOG_ERR, "%s: %s fd %d", rockminer_drv.dname, "Failed to read", fd);
@@ -86,7 +86,7 @@ int rockminer_write(int fd, const void *buf, size_t bufLen)
 	if (opt_dev_protocol && opt_debug)
 		rockminer_log_protocol(fd, buf, bufLen, "SEND");
 
-	return write(fd, buf, bufLen);
+	return serial_write(fd, buf, bufLen);
 }
 
 static
@@ -46,12 +46,12 @@ bool twinfury_send_command(const int fd, const void * const tx, const uint16_t t
 		applog(LOG_DEBUG, "%s fd=%d: DEVPROTO: SEND: %s", twinfury_drv.dname, fd, hex);
 	}
 	
-	if(4 != write(fd, PREAMBLE, 4))
+	if(4 != serial_write(fd, PREAMBLE, 4))
 	{
 		return false;
 	}
 
-	if(tx_size != write(fd, tx, tx_size))
+	if(tx_size != serial_write(fd, tx, tx_size))
 	{
 		return false;
 	}
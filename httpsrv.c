@@ -33,6 +33,8 @@
 
 static struct MHD_Daemon *httpsrv;
 
+int httpsrv_threads = 1;
+
 extern int handle_getwork(struct MHD_Connection *, bytes_t *);
 
 void httpsrv_prepare_resp(struct MHD_Response *resp)
@@ -98,15 +100,27 @@ void httpsrv_log(void *arg, const char *fmt, va_list ap)
 
 void httpsrv_start(unsigned short port)
 {
+	unsigned int flags = MHD_USE_SELECT_INTERNALLY | MHD_USE_DEBUG;
+	const char *mode = "select";
+	
+#if MHD_VERSION >= 0x00093500
+	if (MHD_is_feature_supported(MHD_FEATURE_EPOLL) == MHD_YES)
+	{
+		flags |= MHD_USE_EPOLL_LINUX_ONLY;
+		mode = "epoll";
+	}
+#endif
+	
 	httpsrv = MHD_start_daemon(
-		MHD_USE_SELECT_INTERNALLY | MHD_USE_DEBUG,
+		flags,
 		port, NULL, NULL,
 		&httpsrv_handle_access, NULL,
 		MHD_OPTION_NOTIFY_COMPLETED, &httpsrv_cleanup_request, NULL,
 		MHD_OPTION_EXTERNAL_LOGGER, &httpsrv_log, NULL,
+		MHD_OPTION_THREAD_POOL_SIZE, (unsigned int)(httpsrv_threads > 1 ? httpsrv_threads : 0),
 	MHD_OPTION_END);
 	if (httpsrv)
-		applog(LOG_NOTICE, "HTTP server listening on port %d", (int)port);
+		applog(LOG_NOTICE, "HTTP server listening on port %d (%s, %d thread%s)", (int)port, mode, httpsrv_threads, (httpsrv_threads == 1) ? "" : "s");
 	else
 		applog(LOG_ERR, "Failed to start HTTP server on port %d", (int)port);
 }
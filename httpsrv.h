@@ -3,6 +3,8 @@
 
 #include <microhttpd.h>
 
+extern int httpsrv_threads;
+
 extern void httpsrv_start(unsigned short port);
 extern void httpsrv_prepare_resp(struct MHD_Response *);
 extern void httpsrv_stop();
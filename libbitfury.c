@@ -36,6 +36,7 @@
 #include "lowl-spi.h"
 #include "sha2.h"
 
+#include <math.h>
 #include <time.h>
 
 #define BITFURY_REFRESH_DELAY 100
@@ -321,63 +322,129 @@ uint32_t bitfury_decnonce(uint32_t in)
 	return out;
 }
 
+// Corrections for the chip's nonce pipeline offset; the first must be 0
+static const uint32_t bitfury_fudge_offsets[BITFURY_FUDGE_CANDIDATES] = {0, 0xffc00000, 0xff800000, 0x02800000, 0x02C00000, 0x00400000};
+
+#define BITFURY_SHA_ROUND(a, b, c, d, e, f, g, h, k, w)  do{  \
+	const uint32_t _t1 = (h) + S1(e) + Ch(e, f, g) + (k) + (w);  \
+	const uint32_t _t2 = S0(a) + Maj(a, b, c);  \
+	(h) = (g); (g) = (f); (f) = (e); (e) = (d) + _t1;  \
+	(d) = (c); (c) = (b); (b) = (a); (a) = _t1 + _t2;  \
+}while(0)
+
+// Everything in the SHA256d of a header which does not depend on the nonce is done once here
+void bitfury_nonce_ctx_init(struct bitfury_nonce_ctx * const ctx, const void * const midstate, const uint32_t m7, const uint32_t ntime, const uint32_t nbits)
+{
+	uint32_t * const w = ctx->w;
+	uint32_t a, b, c, d, e, f, g, h;
+	int i;
+	
+	memcpy(ctx->midstate, midstate, sizeof(ctx->midstate));
+	memset(w, 0, sizeof(ctx->w));
+	w[0] = m7;
+	w[1] = ntime;
+	w[2] = nbits;
+	w[4] = 0x80000000;
+	w[15] = 0x280;
+	w[16] = s1(w[14]) + w[9] + s0(w[1]) + w[0];
+	w[17] = s1(w[15]) + w[10] + s0(w[2]) + w[1];
+	
+	a = ctx->midstate[0]; b = ctx->midstate[1]; c = ctx->midstate[2]; d = ctx->midstate[3];
+	e = ctx->midstate[4]; f = ctx->midstate[5]; g = ctx->midstate[6]; h = ctx->midstate[7];
+	for (i = 0; i < 3; ++i)
+		BITFURY_SHA_ROUND(a, b, c, d, e, f, g, h, SHA_K[i], w[i]);
+	ctx->ms3[0] = a; ctx->ms3[1] = b; ctx->ms3[2] = c; ctx->ms3[3] = d;
+	ctx->ms3[4] = e; ctx->ms3[5] = f; ctx->ms3[6] = g; ctx->ms3[7] = h;
+}
+
+/* Computes the final word (H7) of SHA256d for BITFURY_NONCE_LANES nonces at once
+   Every loop runs across lanes innermost, with no branches, so compilers can vectorise it (SSE2/NEON) */
 static
-int libbitfury_rehash(const void *midstate, const uint32_t m7, const uint32_t ntime, const uint32_t nbits, uint32_t nnonce) {
-	uint8_t in[16];
-	uint32_t *in32 = (uint32_t *)in;
-	const uint32_t *mid32 = midstate;
-	uint32_t out32[8];
-	uint8_t *out = (uint8_t *) out32;
-#ifdef BITFURY_REHASH_DEBUG
-	static uint32_t history[512];
-	static uint32_t history_p;
-#endif
-	sha256_ctx ctx;
-
-
-	memset( &ctx, 0, sizeof( sha256_ctx ) );
-	memcpy(ctx.h, mid32, 8*4);
-	ctx.tot_len = 64;
-	ctx.len = 0;
-
-	in32[0] = bswap_32(m7);
-	in32[1] = bswap_32(ntime);
-	in32[2] = bswap_32(nbits);
-	in32[3] = bswap_32(nnonce);
-
-	sha256_update(&ctx, in, 16);
-	sha256_final(&ctx, out);
-	sha256(out, 32, out);
-
-	if (out32[7] == 0) {
-#ifdef BITFURY_REHASH_DEBUG
-		char hex[65];
-		bin2hex(hex, out, 32);
-		applog(LOG_INFO, "! MS0: %08x, m7: %08x, ntime: %08x, nbits: %08x, nnonce: %08x", mid32[0], m7, ntime, nbits, nnonce);
-		applog(LOG_INFO, " out: %s", hex);
-		history[history_p] = nnonce;
-		history_p++; history_p &= 512 - 1;
-#endif
-		return 1;
+void bitfury_nonce_ctx_h7(const struct bitfury_nonce_ctx * const ctx, const uint32_t * const nonces, uint32_t * const h7)
+{
+	static const uint32_t sha_iv[8] = {
+		0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+	};
+	uint32_t W[64][BITFURY_NONCE_LANES];
+	uint32_t st[8][BITFURY_NONCE_LANES];
+	int i, t, k;
+	
+	// First hash, second block: only W[3] (the nonce) varies
+	for (t = 0; t < 18; ++t)
+		for (k = 0; k < BITFURY_NONCE_LANES; ++k)
+			W[t][k] = ctx->w[t];
+	for (k = 0; k < BITFURY_NONCE_LANES; ++k)
+		W[3][k] = nonces[k];
+	for (t = 18; t < 64; ++t)
+		for (k = 0; k < BITFURY_NONCE_LANES; ++k)
+			W[t][k] = s1(W[t-2][k]) + W[t-7][k] + s0(W[t-15][k]) + W[t-16][k];
+	for (i = 0; i < 8; ++i)
+		for (k = 0; k < BITFURY_NONCE_LANES; ++k)
+			st[i][k] = ctx->ms3[i];
+	for (t = 3; t < 64; ++t)
+		for (k = 0; k < BITFURY_NONCE_LANES; ++k)
+			BITFURY_SHA_ROUND(st[0][k], st[1][k], st[2][k], st[3][k], st[4][k], st[5][k], st[6][k], st[7][k], SHA_K[t], W[t][k]);
+	
+	// Second hash, of the 32-byte first hash
+	for (i = 0; i < 8; ++i)
+		for (k = 0; k < BITFURY_NONCE_LANES; ++k)
+			W[i][k] = ctx->midstate[i] + st[i][k];
+	for (k = 0; k < BITFURY_NONCE_LANES; ++k)
+	{
+		W[8][k] = 0x80000000;
+		for (t = 9; t < 15; ++t)
+			W[t][k] = 0;
+		W[15][k] = 0x100;
 	}
-	return 0;
+	for (t = 16; t < 61; ++t)
+		for (k = 0; k < BITFURY_NONCE_LANES; ++k)
+			W[t][k] = s1(W[t-2][k]) + W[t-7][k] + s0(W[t-15][k]) + W[t-16][k];
+	for (i = 0; i < 8; ++i)
+		for (k = 0; k < BITFURY_NONCE_LANES; ++k)
+			st[i][k] = sha_iv[i];
+	// H7 is final only after round 60 shifts e into h, so the last 3 rounds are unnecessary
+	for (t = 0; t < 61; ++t)
+		for (k = 0; k < BITFURY_NONCE_LANES; ++k)
+			BITFURY_SHA_ROUND(st[0][k], st[1][k], st[2][k], st[3][k], st[4][k], st[5][k], st[6][k], st[7][k], SHA_K[t], W[t][k]);
+	for (k = 0; k < BITFURY_NONCE_LANES; ++k)
+		h7[k] = st[4][k] + sha_iv[7];
+}
+
+// Returns the index of the first fudge offset whose nonce meets diff, or -1
+static
+int bitfury_nonce_ctx_search(const struct bitfury_nonce_ctx * const ctx, const uint32_t nonce, const float diff)
+{
+	uint32_t nonces[BITFURY_NONCE_LANES], h7[BITFURY_NONCE_LANES];
+	uint32_t htarg = 0;
+	int k;
+	
+	for (k = 0; k < BITFURY_NONCE_LANES; ++k)
+		nonces[k] = nonce + bitfury_fudge_offsets[(k < BITFURY_FUDGE_CANDIDATES) ? k : 0];
+	bitfury_nonce_ctx_h7(ctx, nonces, h7);
+	
+	// Same test as test_hash, but on the H7 word rather than the hash bytes
+	if (diff < 1.)
+		htarg = (uint32_t)ceil((1. / diff) - 1);
+	for (k = 0; k < BITFURY_FUDGE_CANDIDATES; ++k)
+		if (diff < 1. ? (bswap_32(h7[k]) <= htarg) : !h7[k])
+			return k;
+	return -1;
+}
+
+bool bitfury_fudge_nonce_ctx(const struct bitfury_nonce_ctx * const ctx, const float diff, uint32_t * const nonce_p)
+{
+	const int i = bitfury_nonce_ctx_search(ctx, *nonce_p, diff);
+	if (i < 0)
+		return false;
+	*nonce_p += bitfury_fudge_offsets[i];
+	return true;
 }
 
 bool bitfury_fudge_nonce(const void *midstate, const uint32_t m7, const uint32_t ntime, const uint32_t nbits, uint32_t *nonce_p) {
-	static const uint32_t offsets[] = {0, 0xffc00000, 0xff800000, 0x02800000, 0x02C00000, 0x00400000};
-	uint32_t nonce;
-	int i;
+	struct bitfury_nonce_ctx ctx;
 	
-	for (i = 0; i < 6; ++i)
-	{
-		nonce = *nonce_p + offsets[i];
-		if (libbitfury_rehash(midstate, m7, ntime, nbits, nonce))
-		{
-			*nonce_p = nonce;
-			return true;
-		}
-	}
-	return false;
+	bitfury_nonce_ctx_init(&ctx, midstate, m7, ntime, nbits);
+	return bitfury_fudge_nonce_ctx(&ctx, 1., nonce_p);
 }
 
 void work_to_bitfury_payload(struct bitfury_payload *p, struct work *w) {
@@ -20,6 +20,16 @@ struct bitfury_payload {
 	uint32_t nnonce;
 };
 
+#define BITFURY_FUDGE_CANDIDATES  6
+#define BITFURY_NONCE_LANES  8
+
+// Nonce-independent SHA256d state for one work, see bitfury_nonce_ctx_init
+struct bitfury_nonce_ctx {
+	uint32_t midstate[8];
+	uint32_t ms3[8];
+	uint32_t w[18];
+};
+
 struct freq_stat {
 	double *mh;
 	double *s;
@@ -56,6 +66,12 @@ struct bitfury_device {
 	int desync_counter;
 	int sample_hwe;
 	int sample_tot;
+	
+	// Cached nonce search state for the current and previous work
+	struct bitfury_nonce_ctx nonce_ctx[2];
+	const struct work *nonce_ctx_work[2];
+	int nonce_ctx_work_id[2];
+	int nonce_ctx_next;
 };
 
 extern void work_to_bitfury_payload(struct bitfury_payload *, struct work *);
@@ -66,5 +82,7 @@ extern void bitfury_send_freq(struct spi_port *, int slot, int chip_n, int bits)
 extern int libbitfury_detectChips1(struct spi_port *);
 extern uint32_t bitfury_decnonce(uint32_t);
 extern bool bitfury_fudge_nonce(const void *midstate, const uint32_t m7, const uint32_t ntime, const uint32_t nbits, uint32_t *nonce_p);
+extern void bitfury_nonce_ctx_init(struct bitfury_nonce_ctx *, const void *midstate, uint32_t m7, uint32_t ntime, uint32_t nbits);
+extern bool bitfury_fudge_nonce_ctx(const struct bitfury_nonce_ctx *, float diff, uint32_t *nonce_p);
 
 #endif /* __LIBBITFURY_H__ */
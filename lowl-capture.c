@@ -0,0 +1,259 @@
+/*
+ * Copyright 2026 BFGMiner contributors
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.  See COPYING for more details.
+ */
+
+#include "config.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "logging.h"
+#include "lowl-capture.h"
+#include "miner.h"
+#include "util.h"
+
+#define BFG_CAPTURE_HEADER  "# BFGMiner device capture v1\n"
+
+char *opt_capture_dir;
+
+struct bfg_capture {
+	pthread_mutex_t mutex;
+
+	// Recording
+	FILE *F;
+	struct timeval tv_start;
+	// Reused for each record's hex, under mutex
+	char *hexbuf;
+	size_t hexbufsz;
+
+	// Replay
+	struct bfg_capture_rec *recs;
+	size_t recs_count;
+	size_t pos;
+	int64_t last_us;
+};
+
+static
+struct bfg_capture *bfg_capture_new(void)
+{
+	struct bfg_capture * const cap = malloc(sizeof(*cap));
+	*cap = (struct bfg_capture){
+		.F = NULL,
+	};
+	mutex_init(&cap->mutex);
+	return cap;
+}
+
+struct bfg_capture *bfg_capture_create(const char * const kind, const char * const name)
+{
+	if (!opt_capture_dir)
+		return NULL;
+
+	const size_t filenamesz = strlen(opt_capture_dir) + 1 + strlen(kind) + 1 + strlen(name) + 5;
+	char filename[filenamesz];
+	char *p;
+	snprintf(filename, filenamesz, "%s/%s-", opt_capture_dir, kind);
+	// Device paths are flattened into a single filename component
+	p = &filename[strlen(filename)];
+	for (const char *s = name; *s; ++s)
+		*(p++) = (isalnum((unsigned char)*s) || *s == '-' || *s == '.') ? *s : '_';
+	strcpy(p, ".cap");
+
+	FILE * const F = fopen(filename, "w");
+	if (!F)
+	{
+		applog(LOG_ERR, "Failed to create capture file %s: %s",
+		       filename, bfg_strerror(errno, BST_ERRNO));
+		return NULL;
+	}
+	fputs(BFG_CAPTURE_HEADER, F);
+
+	struct bfg_capture * const cap = bfg_capture_new();
+	cap->F = F;
+	timer_set_now(&cap->tv_start);
+	applog(LOG_DEBUG, "Capturing %s %s traffic to %s", kind, name, filename);
+	return cap;
+}
+
+void bfg_capture_record(struct bfg_capture * const cap, const enum bfg_capture_dir dir, const void * const buf, const size_t len)
+{
+	struct timeval tv_now;
+	const size_t hexsz = (len * 2) + 1;
+
+	if (!(cap && cap->F))
+		return;
+
+	mutex_lock(&cap->mutex);
+	timer_set_now(&tv_now);
+	if (cap->hexbufsz < hexsz)
+	{
+		free(cap->hexbuf);
+		cap->hexbuf = malloc(hexsz);
+		cap->hexbufsz = cap->hexbuf ? hexsz : 0;
+		if (unlikely(!cap->hexbuf))
+		{
+			mutex_unlock(&cap->mutex);
+			return;
+		}
+	}
+	bin2hex(cap->hexbuf, buf, len);
+	fprintf(cap->F, "%ld %c %s\n", timer_elapsed_us(&cap->tv_start, &tv_now), (char)dir, cap->hexbuf);
+	mutex_unlock(&cap->mutex);
+}
+
+// Reads a whole line of any length; returns NULL at EOF
+static
+char *bfg_capture_getline(FILE * const F, char ** const bufp, size_t * const bufszp)
+{
+	size_t len = 0;
+
+	while (true)
+	{
+		if (*bufszp - len < 0x100)
+		{
+			*bufszp = (*bufszp ?: 0x100) * 2;
+			*bufp = realloc(*bufp, *bufszp);
+		}
+		if (!fgets(&(*bufp)[len], *bufszp - len, F))
+			return len ? *bufp : NULL;
+		len += strlen(&(*bufp)[len]);
+		if (len && (*bufp)[len - 1] == '\n')
+			return *bufp;
+	}
+}
+
+struct bfg_capture *bfg_capture_load(const char * const filename)
+{
+	FILE * const F = fopen(filename, "r");
+	char *line = NULL;
+	size_t linesz = 0, recs_alloc = 0;
+	unsigned lineno = 0;
+
+	if (!F)
+	{
+		applog(LOG_ERR, "Failed to open capture file %s: %s",
+		       filename, bfg_strerror(errno, BST_ERRNO));
+		return NULL;
+	}
+
+	struct bfg_capture * const cap = bfg_capture_new();
+	while (bfg_capture_getline(F, &line, &linesz))
+	{
+		long long us;
+		char dir;
+		int hexpos;
+
+		++lineno;
+		if (line[0] == '#' || line[0] == '\n')
+			continue;
+		if (sscanf(line, "%lld %c %n", &us, &dir, &hexpos) < 2 || (dir != BCD_TX && dir != BCD_RX))
+		{
+			applog(LOG_WARNING, "%s:%u: Malformed capture record", filename, lineno);
+			continue;
+		}
+
+		const char * const hex = &line[hexpos];
+		size_t hexlen = strlen(hex);
+		while (hexlen && isspace(hex[hexlen - 1]))
+			--hexlen;
+		if (hexlen % 2)
+		{
+			applog(LOG_WARNING, "%s:%u: Odd-length capture data", filename, lineno);
+			continue;
+		}
+
+		if (cap->recs_count == recs_alloc)
+		{
+			recs_alloc = (recs_alloc ?: 0x40) * 2;
+			cap->recs = realloc(cap->recs, sizeof(*cap->recs) * recs_alloc);
+		}
+		struct bfg_capture_rec * const rec = &cap->recs[cap->recs_count];
+		*rec = (struct bfg_capture_rec){
+			.dir = dir,
+			.us = us,
+			.len = hexlen / 2,
+			.data = malloc((hexlen / 2) ?: 1),
+		};
+		if (!hex2bin(rec->data, hex, rec->len))
+		{
+			applog(LOG_WARNING, "%s:%u: Invalid hex in capture data", filename, lineno);
+			free(rec->data);
+			continue;
+		}
+		++cap->recs_count;
+	}
+	free(line);
+	fclose(F);
+
+	if (!cap->recs_count)
+	{
+		applog(LOG_ERR, "Capture file %s contains no records", filename);
+		bfg_capture_free(cap);
+		return NULL;
+	}
+	applog(LOG_DEBUG, "Loaded %lu records from capture file %s",
+	       (unsigned long)cap->recs_count, filename);
+	return cap;
+}
+
+const struct bfg_capture_rec *bfg_capture_next(struct bfg_capture * const cap, const enum bfg_capture_dir dir, int64_t * const out_delta_us)
+{
+	const struct bfg_capture_rec *rec = NULL;
+
+	mutex_lock(&cap->mutex);
+	for (size_t i = 0; i < cap->recs_count; ++i)
+	{
+		const struct bfg_capture_rec * const cand = &cap->recs[cap->pos];
+		if (++cap->pos >= cap->recs_count)
+			cap->pos = 0;
+		if (cand->dir != dir)
+			continue;
+		rec = cand;
+		break;
+	}
+	if (rec)
+	{
+		if (out_delta_us)
+			// After looping, the delay is measured from the start of the capture
+			*out_delta_us = (rec->us >= cap->last_us) ? (rec->us - cap->last_us) : rec->us;
+		cap->last_us = rec->us;
+	}
+	mutex_unlock(&cap->mutex);
+	return rec;
+}
+
+const struct bfg_capture_rec *bfg_capture_peek(struct bfg_capture * const cap)
+{
+	const struct bfg_capture_rec *rec;
+
+	mutex_lock(&cap->mutex);
+	rec = &cap->recs[cap->pos];
+	mutex_unlock(&cap->mutex);
+	return rec;
+}
+
+void bfg_capture_free(struct bfg_capture * const cap)
+{
+	if (!cap)
+		return;
+	if (cap->F)
+		fclose(cap->F);
+	free(cap->hexbuf);
+	for (size_t i = 0; i < cap->recs_count; ++i)
+		free(cap->recs[i].data);
+	free(cap->recs);
+	mutex_destroy(&cap->mutex);
+	free(cap);
+}
@@ -0,0 +1,51 @@
+/*
+ * Copyright 2026 BFGMiner contributors
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.  See COPYING for more details.
+ */
+
+#ifndef BFG_LOWL_CAPTURE_H
+#define BFG_LOWL_CAPTURE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Captured device traffic is stored as text, one transfer per line:
+ *   <microseconds since capture start> <T|R> <hex data>
+ * T is host-to-device, R is device-to-host. Lines beginning with '#' are
+ * comments. Replay loops back to the start when the end is reached.
+ */
+
+enum bfg_capture_dir {
+	BCD_TX = 'T',
+	BCD_RX = 'R',
+};
+
+struct bfg_capture_rec {
+	enum bfg_capture_dir dir;
+	int64_t us;
+	size_t len;
+	uint8_t *data;
+};
+
+struct bfg_capture;
+
+extern char *opt_capture_dir;
+
+// Creates <opt_capture_dir>/<kind>-<name>.cap, or returns NULL if capturing is disabled or fails
+extern struct bfg_capture *bfg_capture_create(const char *kind, const char *name);
+extern void bfg_capture_record(struct bfg_capture *, enum bfg_capture_dir, const void *, size_t);
+
+extern struct bfg_capture *bfg_capture_load(const char *filename);
+// Returns the next record of the given direction, and the time elapsed since the previous record returned
+extern const struct bfg_capture_rec *bfg_capture_next(struct bfg_capture *, enum bfg_capture_dir, int64_t *out_delta_us);
+// Returns the record bfg_capture_next would consider next, regardless of direction
+extern const struct bfg_capture_rec *bfg_capture_peek(struct bfg_capture *);
+
+extern void bfg_capture_free(struct bfg_capture *);
+
+#endif
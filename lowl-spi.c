@@ -33,6 +33,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <getopt.h>
 
 #ifdef HAVE_LINUX_SPI
@@ -49,6 +50,7 @@
 #endif
 
 #include "logging.h"
+#include "lowl-capture.h"
 #include "lowl-spi.h"
 #include "miner.h"
 #include "util.h"
@@ -59,9 +61,71 @@ static volatile unsigned *gpio;
 #endif
 
 struct spi_port *sys_spi;
+char *opt_spi_transport;
+
+// Replaces the system SPI port with a software transport; returns false if the spec is invalid
+static
+bool spi_init_transport(const char * const spec)
+{
+	struct spi_port * const port = malloc(sizeof(*port));
+	*port = (struct spi_port){
+		.repr = "spi",
+		.fd = -1,
+	};
+	
+	if (!strcasecmp(spec, "loopback"))
+		port->txrx = spi_loopback_txrx;
+	else
+	if (!strncasecmp(spec, "replay:", 7))
+	{
+		const char * const filename = &spec[7];
+		const char * const colon = strrchr(filename, ':');
+		char *endptr;
+		size_t filenamelen = strlen(filename);
+		
+		port->replay_speed = 1;
+		if (colon)
+		{
+			const float speed = strtof(&colon[1], &endptr);
+			if (colon[1] && !*endptr)
+			{
+				port->replay_speed = speed;
+				filenamelen = colon - filename;
+			}
+		}
+		char filename2[filenamelen + 1];
+		memcpy(filename2, filename, filenamelen);
+		filename2[filenamelen] = '\0';
+		
+		port->replay = bfg_capture_load(filename2);
+		if (!port->replay)
+			goto err;
+		port->txrx = spi_replay_txrx;
+	}
+	else
+	{
+		applog(LOG_ERR, "Unknown SPI transport: %s", spec);
+		goto err;
+	}
+	
+	applog(LOG_DEBUG, "Using SPI transport: %s", spec);
+	sys_spi = port;
+	return true;
+
+err:
+	free(port);
+	return false;
+}
 
 void spi_init(void)
 {
+	if (opt_spi_transport)
+	{
+		// Several drivers call this; only load the transport once
+		if (!sys_spi)
+			spi_init_transport(opt_spi_transport);
+		return;
+	}
 #ifdef HAVE_LINUX_SPI
 	int fd;
 	fd = open("/dev/mem",O_RDWR|O_SYNC);
@@ -171,71 +235,136 @@ int spi_reset(int a)
 	return false;  \
 }while(0)
 
+// The spidev fd and its settings are kept across frames, rather than reopened for every poll
+static pthread_mutex_t sys_spi_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int sys_spi_fd = -1;
+static int sys_spi_fd_speed;
+static size_t sys_spi_bufsiz;
+static bool sys_spi_bufsiz_warned;
+
+// spidev rejects (EMSGSIZE) any message whose transfers add up to more than its bufsiz module parameter
+static
+size_t sys_spi_get_bufsiz(void)
+{
+	if (!sys_spi_bufsiz)
+	{
+		FILE * const F = fopen("/sys/module/spidev/parameters/bufsiz", "r");
+		unsigned long bufsiz = 0;
+		if (F)
+		{
+			if (fscanf(F, "%lu", &bufsiz) != 1)
+				bufsiz = 0;
+			fclose(F);
+		}
+		sys_spi_bufsiz = bufsiz ?: 4096;
+	}
+	return sys_spi_bufsiz;
+}
+
+static
+bool sys_spi_setup(const int speed)
+{
+	int fd = sys_spi_fd;
+	int mode = 0, bits = 8;
+	
+	if (fd == -1)
+	{
+		fd = open("/dev/spidev0.0", O_RDWR);
+		if (fd < 0) {
+			perror("Unable to open SPI device");
+			return false;
+		}
+		if (ioctl(fd, SPI_IOC_WR_MODE, &mode) < 0)
+			BAILOUT("Unable to set WR MODE");
+		if (ioctl(fd, SPI_IOC_RD_MODE, &mode) < 0)
+			BAILOUT("Unable to set RD MODE");
+		if (ioctl(fd, SPI_IOC_WR_BITS_PER_WORD, &bits) < 0)
+			BAILOUT("Unable to set WR_BITS_PER_WORD");
+		if (ioctl(fd, SPI_IOC_RD_BITS_PER_WORD, &bits) < 0)
+			BAILOUT("Unable to set RD_BITS_PER_WORD");
+		sys_spi_fd = fd;
+		sys_spi_fd_speed = 0;
+	}
+	if (speed != sys_spi_fd_speed)
+	{
+		if (ioctl(fd, SPI_IOC_WR_MAX_SPEED_HZ, &speed) < 0
+		 || ioctl(fd, SPI_IOC_RD_MAX_SPEED_HZ, &speed) < 0)
+		{
+			perror("Unable to set MAX_SPEED_HZ");
+			close(fd);
+			sys_spi_fd = -1;
+			return false;
+		}
+		sys_spi_fd_speed = speed;
+	}
+	return true;
+}
+
 bool sys_spi_txrx(struct spi_port *port)
 {
 	const void *wrbuf = spi_gettxbuf(port);
 	void *rdbuf = spi_getrxbuf(port);
 	size_t bufsz = spi_getbufsz(port);
-	int fd;
-	int mode, bits, speed, rv, i, j;
-	struct spi_ioc_transfer tr[16];
-
-	memset(&tr,0,sizeof(tr));
-	mode = 0; bits = 8; speed = 4000000;
+	const int bits = 8;
+	int speed = 4000000;
+	int n = 0, i, per_msg;
+	size_t chunksz;
+	bool rv = true;
+	
 	if (port->speed)
 		speed = port->speed;
-
+	
+	mutex_lock(&sys_spi_mutex);
+	// Split into 4 KB transfers, and submit as many together as spidev's bufsiz allows
+	chunksz = sys_spi_get_bufsiz();
+	if (chunksz > 4096)
+		chunksz = 4096;
+	per_msg = sys_spi_get_bufsiz() / chunksz;
+	if (unlikely(bufsz > sys_spi_get_bufsiz() && !sys_spi_bufsiz_warned))
+	{
+		// Suggest a bufsiz that fits the whole frame, rounded up to a page
+		const size_t want = (bufsz + 4095) & ~(size_t)4095;
+		applog(LOG_WARNING, "SPI frames of %lu bytes exceed spidev's bufsiz of %lu, so each takes %d transfers; load spidev with bufsiz=%lu (spidev.bufsiz=%lu on the kernel command line) to send them in one",
+		       (unsigned long)bufsz, (unsigned long)sys_spi_get_bufsiz(),
+		       (int)((bufsz + sys_spi_get_bufsiz() - 1) / sys_spi_get_bufsiz()),
+		       (unsigned long)want, (unsigned long)want);
+		sys_spi_bufsiz_warned = true;
+	}
+	
+	struct spi_ioc_transfer tr[(bufsz + chunksz - 1) / chunksz + 1];
+	memset(&tr,0,sizeof(tr));
+	while (bufsz > 0) {
+		const size_t len = (bufsz > chunksz) ? chunksz : bufsz;
+		tr[n].tx_buf = (uintptr_t) wrbuf;
+		tr[n].rx_buf = (uintptr_t) rdbuf;
+		tr[n].len = (unsigned)len;
+		tr[n].delay_usecs = 1;
+		tr[n].speed_hz = speed;
+		tr[n].bits_per_word = bits;
+		bufsz -= len;
+		wrbuf += len; rdbuf += len; ++n;
+	}
+	
 	spi_reset(1234);
-	fd = open("/dev/spidev0.0", O_RDWR);
-	if (fd < 0) {
-		perror("Unable to open SPI device");
-		return false;
+	if (!sys_spi_setup(speed))
+		rv = false;
+	else
+	for (i = 0; i < n; i += per_msg)
+	{
+		const int count = (n - i < per_msg) ? (n - i) : per_msg;
+		if (ioctl(sys_spi_fd, SPI_IOC_MESSAGE(count), &tr[i]) < 0)
+		{
+			perror("SPI_IOC_MESSAGE");
+			close(sys_spi_fd);
+			sys_spi_fd = -1;
+			rv = false;
+			break;
+		}
 	}
-	if (ioctl(fd, SPI_IOC_WR_MODE, &mode) < 0)
-		BAILOUT("Unable to set WR MODE");
-	if (ioctl(fd, SPI_IOC_RD_MODE, &mode) < 0)
-		BAILOUT("Unable to set RD MODE");
-	if (ioctl(fd, SPI_IOC_WR_BITS_PER_WORD, &bits) < 0)
-		BAILOUT("Unable to set WR_BITS_PER_WORD");
-	if (ioctl(fd, SPI_IOC_RD_BITS_PER_WORD, &bits) < 0)
-		BAILOUT("Unable to set RD_BITS_PER_WORD");
-	if (ioctl(fd, SPI_IOC_WR_MAX_SPEED_HZ, &speed) < 0)
-		BAILOUT("Unable to set WR_MAX_SPEED_HZ");
-	if (ioctl(fd, SPI_IOC_RD_MAX_SPEED_HZ, &speed) < 0)
-		BAILOUT("Unable to set RD_MAX_SPEED_HZ");
-
-	rv = 0;
-	while (bufsz >= 4096) {
-                tr[rv].tx_buf = (uintptr_t) wrbuf;
-                tr[rv].rx_buf = (uintptr_t) rdbuf;
-                tr[rv].len = 4096;
-                tr[rv].delay_usecs = 1;
-                tr[rv].speed_hz = speed;
-                tr[rv].bits_per_word = bits;
-                bufsz -= 4096;
-                wrbuf += 4096; rdbuf += 4096; rv ++;
-        }
-        if (bufsz > 0) {
-                tr[rv].tx_buf = (uintptr_t) wrbuf;
-                tr[rv].rx_buf = (uintptr_t) rdbuf;
-                tr[rv].len = (unsigned)bufsz;
-                tr[rv].delay_usecs = 1;
-                tr[rv].speed_hz = speed;
-                tr[rv].bits_per_word = bits;
-                rv ++;
-        }
-
-        i = rv;
-        for (j = 0; j < i; j++) {
-                rv = (int)ioctl(fd, SPI_IOC_MESSAGE(1), (intptr_t)&tr[j]);
-		if (rv < 0)
-			BAILOUT("WTF!");
-        }
-
-	close(fd);
 	spi_reset(4321);
-
-	return true;
+	mutex_unlock(&sys_spi_mutex);
+	
+	return rv;
 }
 
 bool linux_spi_txrx(struct spi_port * const spi)
@@ -284,18 +413,82 @@ bool linux_spi_txrx2(struct spi_port * const spi)
 
 #endif
 
+// Echoes the transmitted frame back, for exercising drivers without hardware
+bool spi_loopback_txrx(struct spi_port * const port)
+{
+	memcpy(spi_getrxbuf(port), spi_gettxbuf(port), spi_getbufsz(port));
+	return true;
+}
+
+// Plays back device responses from a capture, at the recorded pace scaled by replay_speed (0 for no delay)
+bool spi_replay_txrx(struct spi_port * const port)
+{
+	const size_t bufsz = spi_getbufsz(port);
+	uint8_t * const rxbuf = spi_getrxbuf(port);
+	const struct bfg_capture_rec *rec;
+	int64_t delta_us;
+	
+	rec = bfg_capture_next(port->replay, BCD_TX, NULL);
+	if (rec && rec->len != bufsz)
+		applog(LOG_DEBUG, "%s: Replay frame size mismatch (%lu bytes sent, %lu captured)",
+		       port->repr, (unsigned long)bufsz, (unsigned long)rec->len);
+	rec = bfg_capture_next(port->replay, BCD_RX, &delta_us);
+	if (unlikely(!rec))
+		return false;
+	
+	const size_t copysz = (rec->len < bufsz) ? rec->len : bufsz;
+	memcpy(rxbuf, rec->data, copysz);
+	memset(&rxbuf[copysz], 0, bufsz - copysz);
+	
+	if (port->replay_speed > 0 && delta_us > 0)
+		cgsleep_us(delta_us / port->replay_speed);
+	return true;
+}
+
+bool spi_txrx_capture(struct spi_port * const port)
+{
+	static pthread_mutex_t seq_mutex = PTHREAD_MUTEX_INITIALIZER;
+	static unsigned seq;
+	const size_t bufsz = spi_getbufsz(port);
+	
+	if (port->capture_port != port)
+	{
+		char name[0x40];
+		mutex_lock(&seq_mutex);
+		snprintf(name, sizeof(name), "%u%s%s", seq++, port->repr ? "-" : "", port->repr ?: "");
+		mutex_unlock(&seq_mutex);
+		port->capture = bfg_capture_create("spi", name);
+		port->capture_port = port;
+	}
+	
+	bfg_capture_record(port->capture, BCD_TX, spi_gettxbuf(port), bufsz);
+	const bool rv = port->txrx(port);
+	if (likely(rv))
+		bfg_capture_record(port->capture, BCD_RX, spi_getrxbuf(port), bufsz);
+	return rv;
+}
+
 static
 void *spi_emit_buf_reverse(struct spi_port *port, const void *p, size_t sz)
 {
 	const unsigned char *str = p;
 	void * const rv = &port->spibuf_rx[port->spibufsz];
+	size_t i = 0;
 	if (port->spibufsz + sz >= SPIMAXSZ)
 		return NULL;
-	for (size_t i = 0; i < sz; ++i)
+	// Reverse bit order in each byte, 4 bytes at a time
+	for ( ; i + 4 <= sz; i += 4)
 	{
-		// Reverse bit order in each byte!
-		port->spibuf[port->spibufsz++] = bitflip8(str[i]);
+		uint32_t w;
+		memcpy(&w, &str[i], 4);
+		w = ((w & 0xaaaaaaaa) >> 1) | ((w & 0x55555555) << 1);
+		w = ((w & 0xcccccccc) >> 2) | ((w & 0x33333333) << 2);
+		w = ((w & 0xf0f0f0f0) >> 4) | ((w & 0x0f0f0f0f) << 4);
+		memcpy(&port->spibuf[port->spibufsz], &w, 4);
+		port->spibufsz += 4;
 	}
+	for ( ; i < sz; ++i)
+		port->spibuf[port->spibufsz++] = bitflip8(str[i]);
 	return rv;
 }
 
@@ -3,13 +3,18 @@
 
 #include <stdbool.h>
 #include <stdint.h>
+#include <sys/time.h>
 #include <unistd.h>
 
 #define SPIMAXSZ (256*1024)
 
+struct bfg_capture;
+
 /* Initialize SPI using this function */
 void spi_init(void);
 
+extern char *opt_spi_transport;
+
 #ifdef HAVE_LINUX_SPI_SPIDEV_H
 extern void bfg_gpio_setpin_output(unsigned pin);
 extern void bfg_gpio_set_high(unsigned mask);
@@ -38,6 +43,21 @@ struct spi_port {
 	uint8_t bits;
 	int chipselect;
 	int *chipselect_current;
+	
+	// Moving averages maintained by bitfury_do_io, in microseconds
+	double poll_cycle_us;
+	double poll_txrx_us;
+	size_t poll_framesz;
+	// Cumulative host CPU time per chip, since tv_poll_cpu_start
+	double poll_cpu_per_chip_us;
+	struct timeval tv_poll_cpu_start;
+	
+	// Traffic capture (--capture-dir); copies of a port open their own
+	struct bfg_capture *capture;
+	struct spi_port *capture_port;
+	// Replay transport (--spi-transport replay:...)
+	struct bfg_capture *replay;
+	float replay_speed;
 };
 
 extern struct spi_port *sys_spi;
@@ -82,9 +102,14 @@ extern void spi_emit_nop(struct spi_port *port, int n);
    transmission quantum is 32 bits */
 extern void *spi_emit_data(struct spi_port *port, uint16_t addr, const void *buf, size_t len);
 
+extern char *opt_capture_dir;
+extern bool spi_txrx_capture(struct spi_port *);
+
 static inline
 bool spi_txrx(struct spi_port *port)
 {
+	if (opt_capture_dir)
+		return spi_txrx_capture(port);
 	return port->txrx(port);
 }
 
@@ -92,6 +117,8 @@ extern int spi_open(struct spi_port *, const char *);
 extern bool sys_spi_txrx(struct spi_port *);
 extern bool linux_spi_txrx(struct spi_port *);
 extern bool linux_spi_txrx2(struct spi_port *);
+extern bool spi_loopback_txrx(struct spi_port *);
+extern bool spi_replay_txrx(struct spi_port *);
 
 void spi_bfsb_select_bank(int bank);
 
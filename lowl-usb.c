@@ -9,6 +9,8 @@
 
 #include "config.h"
 
+#include <errno.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
@@ -23,6 +25,9 @@
 #include "miner.h"
 #include "util.h"
 
+// Each asynchronous read transfer covers this many packets
+#define LOWL_USB_ASYNC_READ_PACKETS  4
+
 static
 char *lowl_libusb_dup_string(libusb_device_handle * const handle, const uint8_t idx, const char * const idxname, const char * const fname, const char * const devid)
 {
@@ -51,16 +56,52 @@ void usb_devinfo_free(struct lowlevel_device_info * const info)
 		libusb_unref_device(dev);
 }
 
+static
+struct lowlevel_device_info *usb_devinfo_new(libusb_device * const dev)
+{
+	struct libusb_device_descriptor desc;
+	libusb_device_handle *handle;
+	struct lowlevel_device_info *info;
+	int err;
+	
+	err = libusb_get_device_descriptor(dev, &desc);
+	if (unlikely(err)) {
+		applog(LOG_ERR, "%s: Error getting device descriptor: %s",
+		       __func__, bfg_strerror(err, BST_LIBUSB));
+		return NULL;
+	}
+
+	info = malloc(sizeof(struct lowlevel_device_info));
+	*info = (struct lowlevel_device_info){
+		.lowl = &lowl_usb,
+		.devid = bfg_make_devid_libusb(dev),
+		.lowl_data = libusb_ref_device(dev),
+		.vid = desc.idVendor,
+		.pid = desc.idProduct,
+	};
+	
+	err = libusb_open(dev, &handle);
+	if (unlikely(err))
+		applog(LOG_DEBUG, "%s: Error opening device %s: %s",
+		       __func__, info->devid, bfg_strerror(err, BST_LIBUSB));
+	else
+	{
+		info->manufacturer = lowl_libusb_dup_string(handle, desc.iManufacturer, "iManufacturer", __func__, info->devid);
+		info->product = lowl_libusb_dup_string(handle, desc.iProduct, "iProduct", __func__, info->devid);
+		info->serial = lowl_libusb_dup_string(handle, desc.iSerialNumber, "iSerialNumber", __func__, info->devid);
+		libusb_close(handle);
+	}
+	
+	return info;
+}
+
 static
 struct lowlevel_device_info *usb_devinfo_scan()
 {
 	struct lowlevel_device_info *devinfo_list = NULL;
 	ssize_t count, i;
 	libusb_device **list;
-	struct libusb_device_descriptor desc;
-	libusb_device_handle *handle;
 	struct lowlevel_device_info *info;
-	int err;
 
 	if (unlikely(!have_libusb))
 		return NULL;
@@ -73,35 +114,9 @@ struct lowlevel_device_info *usb_devinfo_scan()
 	}
 
 	for (i = 0; i < count; ++i) {
-		err = libusb_get_device_descriptor(list[i], &desc);
-		if (unlikely(err)) {
-			applog(LOG_ERR, "%s: Error getting device descriptor: %s",
-			       __func__, bfg_strerror(err, BST_LIBUSB));
-			continue;
-		}
-
-		info = malloc(sizeof(struct lowlevel_device_info));
-		*info = (struct lowlevel_device_info){
-			.lowl = &lowl_usb,
-			.devid = bfg_make_devid_libusb(list[i]),
-			.lowl_data = libusb_ref_device(list[i]),
-			.vid = desc.idVendor,
-			.pid = desc.idProduct,
-		};
-		
-		err = libusb_open(list[i], &handle);
-		if (unlikely(err))
-			applog(LOG_DEBUG, "%s: Error opening device %s: %s",
-			       __func__, info->devid, bfg_strerror(err, BST_LIBUSB));
-		else
-		{
-			info->manufacturer = lowl_libusb_dup_string(handle, desc.iManufacturer, "iManufacturer", __func__, info->devid);
-			info->product = lowl_libusb_dup_string(handle, desc.iProduct, "iProduct", __func__, info->devid);
-			info->serial = lowl_libusb_dup_string(handle, desc.iSerialNumber, "iSerialNumber", __func__, info->devid);
-			libusb_close(handle);
-		}
-
-		LL_PREPEND(devinfo_list, info);
+		info = usb_devinfo_new(list[i]);
+		if (info)
+			LL_PREPEND(devinfo_list, info);
 	}
 
 	libusb_free_device_list(list, 1);
@@ -109,6 +124,40 @@ struct lowlevel_device_info *usb_devinfo_scan()
 	return devinfo_list;
 }
 
+// target is a devid from bfg_make_devid_usb
+static
+struct lowlevel_device_info *usb_devinfo_scan_one(const char * const target)
+{
+	struct lowlevel_device_info *info = NULL;
+	unsigned usbbus, usbaddr;
+	ssize_t count, i;
+	libusb_device **list;
+	
+	if (unlikely(!have_libusb))
+		return NULL;
+	if (2 != sscanf(target, "usb:%u:%u", &usbbus, &usbaddr))
+		return NULL;
+	
+	count = libusb_get_device_list(NULL, &list);
+	if (unlikely(count < 0)) {
+		applog(LOG_ERR, "%s: Error getting USB device list: %s",
+		       __func__, bfg_strerror(count, BST_LIBUSB));
+		return NULL;
+	}
+	
+	// Only the matching device gets opened to read its strings
+	for (i = 0; i < count; ++i)
+		if (libusb_get_bus_number(list[i]) == usbbus && libusb_get_device_address(list[i]) == usbaddr)
+		{
+			info = usb_devinfo_new(list[i]);
+			break;
+		}
+	
+	libusb_free_device_list(list, 1);
+	
+	return info;
+}
+
 bool lowl_usb_attach_kernel_driver(const struct lowlevel_device_info * const info)
 {
 	libusb_device * const dev = info->lowl_data;
@@ -175,12 +224,30 @@ struct lowl_usb_endpoint {
 	unsigned char endpoint_w;
 	int packetsz_w;
 	unsigned timeout_ms_w;
+	
+	// Asynchronous mode: _buf_r is filled by completions, under async_mutex
+	bool async;
+	pthread_mutex_t async_mutex;
+	pthread_cond_t async_cond;
+	struct libusb_transfer **xfers_r;
+	int xfers_r_count;
+	// Writes still in flight, so they can be cancelled on close
+	struct libusb_transfer **xfers_w;
+	int xfers_w_count;
+	int xfers_w_alloc;
+	// All transfers in flight, and how many of them are reads
+	int xfers_active;
+	int xfers_r_active;
+	int async_errno;
+	bool closing;
 };
 
 struct lowl_usb_endpoint *usb_open_ep(struct libusb_device_handle * const devh, const uint8_t epid, const int pktsz)
 {
 	struct lowl_usb_endpoint * const ep = malloc(sizeof(*ep));
-	ep->devh = devh;
+	*ep = (struct lowl_usb_endpoint){
+		.devh = devh,
+	};
 	if (epid & 0x80)
 	{
 		// Read endpoint
@@ -218,10 +285,257 @@ void usb_ep_set_timeouts_ms(struct lowl_usb_endpoint * const ep, const unsigned
 	ep->timeout_ms_w = timeout_ms_w;
 }
 
+static pthread_once_t usb_async_thread_once = PTHREAD_ONCE_INIT;
+static pthread_t usb_async_pth;
+static bool usb_async_running;
+static volatile bool usb_async_stopping;
+
+static
+void *usb_async_thread(__maybe_unused void * const userp)
+{
+	// Bounds how long usb_async_thread_stop waits for the thread to notice
+	struct timeval tv_timeout = { .tv_sec = 0, .tv_usec = 200000, };
+	
+	RenameThread("usb_events");
+	while (!usb_async_stopping)
+		libusb_handle_events_timeout_completed(NULL, &tv_timeout, NULL);
+	return NULL;
+}
+
+static
+void usb_async_thread_start(void)
+{
+	if (unlikely(pthread_create(&usb_async_pth, NULL, usb_async_thread, NULL)))
+		quit(1, "Failed to create USB event thread");
+	usb_async_running = true;
+}
+
+void usb_async_thread_stop(void)
+{
+	if (!usb_async_running)
+		return;
+	usb_async_stopping = true;
+	pthread_join(usb_async_pth, NULL);
+	usb_async_running = false;
+}
+
+static
+int usb_async_transfer_errno(const enum libusb_transfer_status status)
+{
+	switch (status)
+	{
+		case LIBUSB_TRANSFER_STALL:
+		case LIBUSB_TRANSFER_NO_DEVICE:
+			return EPIPE;
+		default:
+			return EIO;
+	}
+}
+
+// Called with async_mutex held, when a transfer will not be resubmitted
+static
+void usb_async_transfer_done(struct lowl_usb_endpoint * const ep, const bool read)
+{
+	--ep->xfers_active;
+	if (read)
+		--ep->xfers_r_active;
+	pthread_cond_broadcast(&ep->async_cond);
+}
+
+static
+void usb_async_read_cb(struct libusb_transfer * const xfer)
+{
+	struct lowl_usb_endpoint * const ep = xfer->user_data;
+	
+	mutex_lock(&ep->async_mutex);
+	switch (xfer->status)
+	{
+		case LIBUSB_TRANSFER_COMPLETED:
+		case LIBUSB_TRANSFER_TIMED_OUT:
+			if (xfer->actual_length)
+			{
+				bytes_append(&ep->_buf_r, xfer->buffer, xfer->actual_length);
+				pthread_cond_broadcast(&ep->async_cond);
+			}
+			// Put it right back, so a read is always waiting on the device
+			if (likely(!ep->closing) && likely(!libusb_submit_transfer(xfer)))
+			{
+				mutex_unlock(&ep->async_mutex);
+				return;
+			}
+			break;
+		case LIBUSB_TRANSFER_CANCELLED:
+			break;
+		default:
+			ep->async_errno = usb_async_transfer_errno(xfer->status);
+	}
+	usb_async_transfer_done(ep, true);
+	mutex_unlock(&ep->async_mutex);
+}
+
+static
+void usb_async_write_cb(struct libusb_transfer * const xfer)
+{
+	struct lowl_usb_endpoint * const ep = xfer->user_data;
+	
+	mutex_lock(&ep->async_mutex);
+	for (int i = 0; i < ep->xfers_w_count; ++i)
+		if (ep->xfers_w[i] == xfer)
+		{
+			ep->xfers_w[i] = ep->xfers_w[--ep->xfers_w_count];
+			break;
+		}
+	if (xfer->status != LIBUSB_TRANSFER_COMPLETED && xfer->status != LIBUSB_TRANSFER_CANCELLED)
+		ep->async_errno = usb_async_transfer_errno(xfer->status);
+	else
+	if (xfer->actual_length != xfer->length && xfer->status == LIBUSB_TRANSFER_COMPLETED)
+		ep->async_errno = EIO;
+	usb_async_transfer_done(ep, false);
+	mutex_unlock(&ep->async_mutex);
+	// LIBUSB_TRANSFER_FREE_BUFFER takes care of our copy of the data
+	libusb_free_transfer(xfer);
+}
+
+bool usb_ep_set_async(struct lowl_usb_endpoint * const ep, const int reads)
+{
+	const int xfersz = ep->packetsz_r * LOWL_USB_ASYNC_READ_PACKETS;
+	struct libusb_transfer *xfer;
+	
+	if (ep->async || ep->packetsz_r == -1 || reads < 1)
+		return false;
+	
+	pthread_once(&usb_async_thread_once, usb_async_thread_start);
+	mutex_init(&ep->async_mutex);
+	if (unlikely(pthread_cond_init(&ep->async_cond, NULL)))
+		quit(1, "Failed to pthread_cond_init in %s", __func__);
+	ep->xfers_r = malloc(sizeof(*ep->xfers_r) * reads);
+	ep->async = true;
+	
+	mutex_lock(&ep->async_mutex);
+	for (int i = 0; i < reads; ++i)
+	{
+		xfer = libusb_alloc_transfer(0);
+		if (unlikely(!xfer))
+			break;
+		libusb_fill_bulk_transfer(xfer, ep->devh, ep->endpoint_r, malloc(xfersz), xfersz, usb_async_read_cb, ep, 0);
+		if (unlikely(libusb_submit_transfer(xfer)))
+		{
+			free(xfer->buffer);
+			libusb_free_transfer(xfer);
+			break;
+		}
+		ep->xfers_r[ep->xfers_r_count++] = xfer;
+		++ep->xfers_active;
+		++ep->xfers_r_active;
+	}
+	mutex_unlock(&ep->async_mutex);
+	
+	if (unlikely(!ep->xfers_r_count))
+	{
+		// Stay synchronous
+		ep->async = false;
+		free(ep->xfers_r);
+		pthread_cond_destroy(&ep->async_cond);
+		mutex_destroy(&ep->async_mutex);
+		applogr(false, LOG_WARNING, "%s: Failed to submit any asynchronous USB reads", __func__);
+	}
+	return true;
+}
+
+static
+ssize_t usb_read_async(struct lowl_usb_endpoint * const ep, void * const data, const size_t datasz)
+{
+	struct timeval tv_timeout;
+	struct timespec ts_timeout;
+	ssize_t rv = datasz;
+	
+	if (ep->timeout_ms_r)
+	{
+		bfg_gettimeofday(&tv_timeout);
+		timer_set_delay(&tv_timeout, &tv_timeout, (long)ep->timeout_ms_r * 1000);
+		timeval_to_spec(&ts_timeout, &tv_timeout);
+	}
+	
+	mutex_lock(&ep->async_mutex);
+	while (bytes_len(&ep->_buf_r) < datasz)
+	{
+		// Pending writes do not keep a dead read endpoint alive
+		if (ep->async_errno || !ep->xfers_r_active)
+		{
+			errno = ep->async_errno ?: EPIPE;
+			rv = -1;
+			goto out;
+		}
+		if (!ep->timeout_ms_r)
+			pthread_cond_wait(&ep->async_cond, &ep->async_mutex);
+		else
+		if (pthread_cond_timedwait(&ep->async_cond, &ep->async_mutex, &ts_timeout) == ETIMEDOUT)
+		{
+			// Like the synchronous path, keep anything partial for next time
+			rv = 0;
+			goto out;
+		}
+	}
+	memcpy(data, bytes_buf(&ep->_buf_r), datasz);
+	bytes_shift(&ep->_buf_r, datasz);
+out:
+	mutex_unlock(&ep->async_mutex);
+	return rv;
+}
+
+// Queues the data and returns immediately; errors are reported by later calls
+static
+ssize_t usb_write_async(struct lowl_usb_endpoint * const ep, const void * const data, const size_t datasz)
+{
+	struct libusb_transfer * const xfer = libusb_alloc_transfer(0);
+	void * const buf = malloc(datasz);
+	int e;
+	
+	if (unlikely(!(xfer && buf)))
+	{
+		libusb_free_transfer(xfer);
+		free(buf);
+		errno = ENOMEM;
+		return -1;
+	}
+	memcpy(buf, data, datasz);
+	libusb_fill_bulk_transfer(xfer, ep->devh, ep->endpoint_w, buf, datasz, usb_async_write_cb, ep, ep->timeout_ms_w);
+	xfer->flags |= LIBUSB_TRANSFER_FREE_BUFFER;
+	
+	mutex_lock(&ep->async_mutex);
+	if (unlikely(ep->async_errno))
+	{
+		errno = ep->async_errno;
+		goto err;
+	}
+	if (ep->xfers_w_count == ep->xfers_w_alloc)
+	{
+		ep->xfers_w_alloc = ep->xfers_w_alloc ? (ep->xfers_w_alloc * 2) : 4;
+		ep->xfers_w = realloc(ep->xfers_w, sizeof(*ep->xfers_w) * ep->xfers_w_alloc);
+	}
+	if (unlikely(e = libusb_submit_transfer(xfer)))
+	{
+		errno = (e == LIBUSB_ERROR_NO_DEVICE || e == LIBUSB_ERROR_PIPE) ? EPIPE : EIO;
+		goto err;
+	}
+	ep->xfers_w[ep->xfers_w_count++] = xfer;
+	++ep->xfers_active;
+	mutex_unlock(&ep->async_mutex);
+	errno = 0;
+	return datasz;
+
+err:
+	mutex_unlock(&ep->async_mutex);
+	libusb_free_transfer(xfer);
+	return -1;
+}
+
 ssize_t usb_read(struct lowl_usb_endpoint * const ep, void * const data, size_t datasz)
 {
 	unsigned timeout;
 	size_t xfer;
+	if (ep->async)
+		return usb_read_async(ep, data, datasz);
 	if ( (xfer = bytes_len(&ep->_buf_r)) < datasz)
 	{
 		bytes_extend_buf(&ep->_buf_r, datasz + ep->packetsz_r - 1);
@@ -269,6 +583,8 @@ ssize_t usb_write(struct lowl_usb_endpoint * const ep, const void * const data,
 	unsigned char *p = (void*)data;
 	size_t rem = datasz;
 	int pxfer;
+	if (ep->async)
+		return usb_write_async(ep, data, datasz);
 	while (rem > 0)
 	{
 		switch (libusb_bulk_transfer(ep->devh, ep->endpoint_w, p, rem, &pxfer, timeout))
@@ -294,6 +610,29 @@ ssize_t usb_write(struct lowl_usb_endpoint * const ep, const void * const data,
 
 void usb_close_ep(struct lowl_usb_endpoint * const ep)
 {
+	if (ep->async)
+	{
+		// Transfers must all be finished before the handle can be closed
+		mutex_lock(&ep->async_mutex);
+		ep->closing = true;
+		for (int i = 0; i < ep->xfers_r_count; ++i)
+			libusb_cancel_transfer(ep->xfers_r[i]);
+		// Writes may have no timeout, and would otherwise hold up the close indefinitely
+		for (int i = 0; i < ep->xfers_w_count; ++i)
+			libusb_cancel_transfer(ep->xfers_w[i]);
+		while (ep->xfers_active)
+			pthread_cond_wait(&ep->async_cond, &ep->async_mutex);
+		mutex_unlock(&ep->async_mutex);
+		for (int i = 0; i < ep->xfers_r_count; ++i)
+		{
+			free(ep->xfers_r[i]->buffer);
+			libusb_free_transfer(ep->xfers_r[i]);
+		}
+		free(ep->xfers_r);
+		free(ep->xfers_w);
+		pthread_cond_destroy(&ep->async_cond);
+		mutex_destroy(&ep->async_mutex);
+	}
 	if (ep->packetsz_r != -1)
 		bytes_free(&ep->_buf_r);
 	free(ep);
@@ -302,5 +641,6 @@ void usb_close_ep(struct lowl_usb_endpoint * const ep)
 struct lowlevel_driver lowl_usb = {
 	.dname = "usb",
 	.devinfo_scan = usb_devinfo_scan,
+	.devinfo_scan_one = usb_devinfo_scan_one,
 	.devinfo_free = usb_devinfo_free,
 };
@@ -17,8 +17,12 @@ struct lowl_usb_endpoint;
 extern struct lowl_usb_endpoint *usb_open_ep(struct libusb_device_handle *, uint8_t epid, int pktsz);
 extern struct lowl_usb_endpoint *usb_open_ep_pair(struct libusb_device_handle *, uint8_t epid_r, int pktsz_r, uint8_t epid_w, int pktsz_w);
 extern void usb_ep_set_timeouts_ms(struct lowl_usb_endpoint *, unsigned timeout_ms_r, unsigned timeout_ms_w);
+// Keeps this many reads always posted, and makes writes return without waiting for completion
+extern bool usb_ep_set_async(struct lowl_usb_endpoint *, int reads);
 extern ssize_t usb_read(struct lowl_usb_endpoint *, void *, size_t);
 extern ssize_t usb_write(struct lowl_usb_endpoint *, const void *, size_t);
 extern void usb_close_ep(struct lowl_usb_endpoint *);
+// Must be called before libusb_exit, once all asynchronous endpoints are closed
+extern void usb_async_thread_stop(void);
 
 #endif
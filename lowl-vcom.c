@@ -31,6 +31,7 @@
 #endif
 
 #include "miner.h"
+#include "vcom-sim.h"
 
 #ifndef WIN32
 #include <errno.h>
@@ -161,6 +162,14 @@ char *_decode_udev_enc_dup(const char *s)
 	return o;
 }
 
+static
+void _vcom_devinfo_udev_strings(struct lowlevel_device_info * const devinfo, struct udev_device * const device)
+{
+	BFGINIT(devinfo->manufacturer, _decode_udev_enc_dup(udev_device_get_property_value(device, "ID_VENDOR_ENC")));
+	BFGINIT(devinfo->product, _decode_udev_enc_dup(udev_device_get_property_value(device, "ID_MODEL_ENC")));
+	BFGINIT(devinfo->serial, _decode_udev_enc_dup(udev_device_get_property_value(device, "ID_SERIAL_SHORT")));
+}
+
 static
 void _vcom_devinfo_scan_udev(struct lowlevel_device_info ** const devinfo_list)
 {
@@ -183,15 +192,34 @@ void _vcom_devinfo_scan_udev(struct lowlevel_device_info ** const devinfo_list)
 		const char * const devpath = udev_device_get_devnode(device);
 		devinfo = _vcom_devinfo_findorcreate(devinfo_list, devpath);
 		
-		BFGINIT(devinfo->manufacturer, _decode_udev_enc_dup(udev_device_get_property_value(device, "ID_VENDOR_ENC")));
-		BFGINIT(devinfo->product, _decode_udev_enc_dup(udev_device_get_property_value(device, "ID_MODEL_ENC")));
-		BFGINIT(devinfo->serial, _decode_udev_enc_dup(udev_device_get_property_value(device, "ID_SERIAL_SHORT")));
+		_vcom_devinfo_udev_strings(devinfo, device);
 		
 		udev_device_unref(device);
 	}
 	udev_enumerate_unref(enumerate);
 	udev_unref(udev);
 }
+
+static
+void _vcom_devinfo_scan_one_udev(struct lowlevel_device_info * const devinfo)
+{
+	struct udev *udev;
+	struct udev_device *device;
+	struct stat my_stat;
+	
+	if (stat(devinfo->path, &my_stat) || !S_ISCHR(my_stat.st_mode))
+		return;
+	udev = udev_new();
+	if (!udev)
+		return;
+	device = udev_device_new_from_devnum(udev, 'c', my_stat.st_rdev);
+	if (device)
+	{
+		_vcom_devinfo_udev_strings(devinfo, device);
+		udev_device_unref(device);
+	}
+	udev_unref(udev);
+}
 #endif
 
 #ifdef __APPLE__
@@ -782,6 +810,13 @@ void _vcom_devinfo_scan_user(struct lowlevel_device_info ** const devinfo_list)
 			dev = dname;
 		else
 			dev = &colon[1];
+#ifndef WIN32
+		if (vcom_sim_spec_p(dev))
+		{
+			vcom_sim_devinfo_scan(devinfo_list, dev);
+			continue;
+		}
+#endif
 		if (!access(dev, F_OK))
 			_vcom_devinfo_findorcreate(devinfo_list, dev);
 	}
@@ -904,6 +939,32 @@ struct lowlevel_device_info *vcom_devinfo_scan()
 	return devinfo_list;
 }
 
+// target is the devnode of a hotplugged tty
+static
+struct lowlevel_device_info *vcom_devinfo_scan_one(const char * const target)
+{
+#ifdef WIN32
+	return NULL;
+#else
+	struct lowlevel_device_info *devinfo_hash = NULL;
+	struct lowlevel_device_info *devinfo;
+	
+	if (target[0] != '/')
+		return NULL;
+	
+	devinfo = _vcom_devinfo_findorcreate(&devinfo_hash, target);
+	if (!devinfo)
+		return NULL;
+	HASH_CLEAR(hh, devinfo_hash);
+	
+#ifdef HAVE_LIBUDEV
+	_vcom_devinfo_scan_one_udev(devinfo);
+#endif
+	
+	return devinfo;
+#endif
+}
+
 
 struct device_drv *bfg_claim_serial(struct device_drv * const api, const bool verbose, const char * const devpath)
 {
@@ -1073,6 +1134,98 @@ bool vcom_set_timeout_ms(const int fdDev, const unsigned timeout_ms)
 #endif
 }
 
+// Line reads fetch whatever is available in one syscall, and keep anything
+// past the end of the line here for the next read on the same fd
+struct vcom_readbuf {
+	char buf[0x100];
+	size_t off;
+	size_t len;
+	uint64_t reads;
+	uint64_t syscalls;
+	struct bfg_capture *capture;
+};
+
+/* Indexed by fd number, in pages which are allocated as needed and never
+ * freed. Each fd number holds at most one buffer, which is replaced when the
+ * number is reused by serial_open, so fds closed without serial_close cannot
+ * accumulate buffers. */
+#define VCOM_READBUF_PAGE_FDS  0x100
+#define VCOM_READBUF_PAGES     0x1000
+static struct vcom_readbuf **vcom_readbufs[VCOM_READBUF_PAGES];
+static pthread_mutex_t vcom_readbufs_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Must hold vcom_readbufs_mutex, unless fd is owned by the calling thread and already has a buffer
+static
+struct vcom_readbuf **vcom_readbuf_slot(const int fd, const bool create)
+{
+	if (unlikely(fd < 0 || fd >= VCOM_READBUF_PAGES * VCOM_READBUF_PAGE_FDS))
+		return NULL;
+	struct vcom_readbuf *** const pagep = &vcom_readbufs[fd / VCOM_READBUF_PAGE_FDS];
+	if (!*pagep)
+	{
+		if (!create)
+			return NULL;
+		*pagep = calloc(VCOM_READBUF_PAGE_FDS, sizeof(**pagep));
+		if (unlikely(!*pagep))
+			return NULL;
+	}
+	return &(*pagep)[fd % VCOM_READBUF_PAGE_FDS];
+}
+
+/* Only the thread using the fd touches the buffer, and serial_open created
+ * it before the fd was handed over, so the common case takes no lock.
+ * Returns NULL only for fd numbers too large to index. */
+static
+struct vcom_readbuf *vcom_readbuf_get(const int fd)
+{
+	struct vcom_readbuf **slot = vcom_readbuf_slot(fd, false), *rb;
+	
+	if (likely(slot && *slot))
+		return *slot;
+	mutex_lock(&vcom_readbufs_mutex);
+	slot = vcom_readbuf_slot(fd, true);
+	if (slot && !(rb = *slot))
+	{
+		rb = malloc(sizeof(*rb));
+		*rb = (struct vcom_readbuf){
+			.len = 0,
+		};
+		*slot = rb;
+	}
+	mutex_unlock(&vcom_readbufs_mutex);
+	return slot ? rb : NULL;
+}
+
+static
+void vcom_readbuf_drop(const int fd)
+{
+	struct vcom_readbuf **slot, *rb = NULL;
+	
+	mutex_lock(&vcom_readbufs_mutex);
+	slot = vcom_readbuf_slot(fd, false);
+	if (slot)
+	{
+		rb = *slot;
+		*slot = NULL;
+	}
+	mutex_unlock(&vcom_readbufs_mutex);
+	if (rb)
+		bfg_capture_free(rb->capture);
+	free(rb);
+}
+
+// The fd number may have been used by a device closed without serial_close
+static
+void vcom_fd_opened(const int fd, const char * const devpath)
+{
+	struct vcom_readbuf *rb;
+	
+	vcom_readbuf_drop(fd);
+	rb = vcom_readbuf_get(fd);
+	if (rb && opt_capture_dir)
+		rb->capture = bfg_capture_create("serial", devpath);
+}
+
 /* NOTE: Linux only supports uint8_t (decisecond) timeouts; limiting it in
  *       this interface buys us warnings when bad constants are passed in.
  */
@@ -1133,7 +1286,9 @@ int serial_open(const char *devpath, unsigned long baud, uint8_t timeout, bool p
 			applog(LOG_WARNING, "%s: %s failed: %s", devpath, "PURGE_TXCLEAR", bfg_strerror(GetLastError(), BST_SYSTEM));
 	}
 
-	return _open_osfhandle((intptr_t)hSerial, 0);
+	const int fd = _open_osfhandle((intptr_t)hSerial, 0);
+	vcom_fd_opened(fd, devpath);
+	return fd;
 #else
 	int fdDev = open(devpath, O_RDWR | O_CLOEXEC | O_NOCTTY);
 
@@ -1220,34 +1375,115 @@ int serial_open(const char *devpath, unsigned long baud, uint8_t timeout, bool p
 		if (tcflush(fdDev, TCIOFLUSH))
 			applog(LOG_WARNING, "%s: %s failed: %s", devpath, "tcflush", bfg_strerror(errno, BST_ERRNO));
 	}
+	vcom_fd_opened(fdDev, devpath);
 	return fdDev;
 #endif
 }
 
 int serial_close(const int fd)
 {
+	vcom_readbuf_drop(fd);
 #if defined(LOCK_EX) && defined(LOCK_NB) && defined(LOCK_UN)
 	flock(fd, LOCK_UN);
 #endif
 	return close(fd);
 }
 
+ssize_t serial_read_some(const int fd, void * const buf, const size_t count)
+{
+	struct vcom_readbuf rb_unbuffered = { .len = 0, };
+	struct vcom_readbuf * const rb = vcom_readbuf_get(fd) ?: &rb_unbuffered;
+	ssize_t rv;
+	
+	++rb->reads;
+	if (rb->len)
+	{
+		// Left over from a line read
+		rv = (rb->len < count) ? rb->len : count;
+		memcpy(buf, &rb->buf[rb->off], rv);
+		rb->off += rv;
+		rb->len -= rv;
+		return rv;
+	}
+	rv = read(fd, buf, count);
+	++rb->syscalls;
+	if (rv > 0)
+		bfg_capture_record(rb->capture, BCD_RX, buf, rv);
+	return rv;
+}
+
+ssize_t serial_write(const int fd, const void * const buf, const size_t count)
+{
+	const ssize_t rv = write(fd, buf, count);
+	struct vcom_readbuf *rb;
+	if (opt_capture_dir && rv > 0 && (rb = vcom_readbuf_get(fd)))
+		bfg_capture_record(rb->capture, BCD_TX, buf, rv);
+	return rv;
+}
+
 ssize_t _serial_read(int fd, char *buf, size_t bufsiz, char *eol)
 {
+	// Anything read past a line end is lost if the fd cannot have a buffer
+	struct vcom_readbuf rb_unbuffered = { .len = 0, };
+	struct vcom_readbuf * const rb = vcom_readbuf_get(fd) ?: &rb_unbuffered;
 	ssize_t len, tlen = 0;
-	while (bufsiz) {
-		len = read(fd, buf, eol ? 1 : bufsiz);
-		if (len < 1)
-			break;
-		tlen += len;
-		if (eol && *eol == buf[0])
-			break;
-		buf += len;
-		bufsiz -= len;
+	const char *p = NULL;
+	size_t n;
+	
+	++rb->reads;
+	while (bufsiz && !p) {
+		if (!rb->len)
+		{
+			if (!eol)
+			{
+				// Nothing to scan for, so read straight into the caller's buffer
+				len = read(fd, buf, bufsiz);
+				++rb->syscalls;
+				if (len < 1)
+					break;
+				bfg_capture_record(rb->capture, BCD_RX, buf, len);
+				tlen += len;
+				buf += len;
+				bufsiz -= len;
+				continue;
+			}
+			len = read(fd, rb->buf, sizeof(rb->buf));
+			++rb->syscalls;
+			if (len < 1)
+				break;
+			bfg_capture_record(rb->capture, BCD_RX, rb->buf, len);
+			rb->off = 0;
+			rb->len = len;
+		}
+		n = (rb->len < bufsiz) ? rb->len : bufsiz;
+		if (eol && (p = memchr(&rb->buf[rb->off], *eol, n)))
+			n = (p - &rb->buf[rb->off]) + 1;
+		memcpy(buf, &rb->buf[rb->off], n);
+		rb->off += n;
+		rb->len -= n;
+		tlen += n;
+		buf += n;
+		bufsiz -= n;
 	}
 	return tlen;
 }
 
+bool vcom_read_stats(const int fd, uint64_t * const out_reads, uint64_t * const out_syscalls)
+{
+	struct vcom_readbuf **slot, *rb;
+	
+	mutex_lock(&vcom_readbufs_mutex);
+	slot = vcom_readbuf_slot(fd, false);
+	rb = slot ? *slot : NULL;
+	if (rb)
+	{
+		*out_reads = rb->reads;
+		*out_syscalls = rb->syscalls;
+	}
+	mutex_unlock(&vcom_readbufs_mutex);
+	return rb;
+}
+
 #ifndef WIN32
 
 enum bfg_gpio_value get_serial_cts(int fd)
@@ -1349,4 +1585,5 @@ _set_serial_cmflag2(rts, fRtsControl, RTS_CONTROL_ENABLE, RTS_CONTROL_DISABLE)
 struct lowlevel_driver lowl_vcom = {
 	.dname = "vcom",
 	.devinfo_scan = vcom_devinfo_scan,
+	.devinfo_scan_one = vcom_devinfo_scan_one,
 };
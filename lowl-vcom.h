@@ -7,6 +7,7 @@
 #include <unistd.h>
 
 #include "deviceapi.h"
+#include "lowl-capture.h"
 #include "util.h"
 
 struct device_drv;
@@ -37,7 +38,11 @@ extern ssize_t _serial_read(int fd, char *buf, size_t buflen, char *eol);
 	_serial_read(fd, (char*)(buf), count, NULL)
 #define serial_read_line(fd, buf, bufsiz, eol)  \
 	_serial_read(fd, buf, bufsiz, &eol)
+// Like read(2) and write(2) (a single syscall, -1 on error), but recorded to the fd's --capture-dir file as serial_read is
+extern ssize_t serial_read_some(int fd, void *buf, size_t count);
+extern ssize_t serial_write(int fd, const void *buf, size_t count);
 extern int serial_close(int fd);
+extern bool vcom_read_stats(int fd, uint64_t *out_reads, uint64_t *out_syscalls);
 
 // NOTE: timeout_ms=0 means it never times out
 extern bool vcom_set_timeout_ms(int fd, unsigned timeout_ms);
@@ -83,6 +83,8 @@ void lowlevel_scan_free()
 	}
 }
 
+static struct lowlevel_device_info *lowlevel_scan_group();
+
 struct lowlevel_device_info *lowlevel_scan()
 {
 	struct lowlevel_device_info *devinfo_mid_list;
@@ -124,6 +126,34 @@ struct lowlevel_device_info *lowlevel_scan()
 	LL_CONCAT(devinfo_list, devinfo_mid_list);
 #endif
 	
+	return lowlevel_scan_group();
+}
+
+// Like lowlevel_scan, but only looks for a single hotplugged device, avoiding the cost of opening every other device on the system
+// Only lowlevel drivers implementing devinfo_scan_one are consulted; the caller should fall back to a full scan if nothing useful is found
+struct lowlevel_device_info *lowlevel_scan_one(const char * const target)
+{
+	struct lowlevel_device_info *devinfo_mid_list;
+	
+	lowlevel_scan_free();
+	
+#ifdef HAVE_LIBUSB
+	devinfo_mid_list = lowl_usb.devinfo_scan_one(target);
+	LL_CONCAT(devinfo_list, devinfo_mid_list);
+#endif
+	
+#ifdef NEED_BFG_LOWL_VCOM
+	devinfo_mid_list = lowl_vcom.devinfo_scan_one(target);
+	LL_CONCAT(devinfo_list, devinfo_mid_list);
+#endif
+	
+	return lowlevel_scan_group();
+}
+
+static
+struct lowlevel_device_info *lowlevel_scan_group()
+{
+	struct lowlevel_device_info *devinfo_mid_list;
 	struct lowlevel_device_info *devinfo_same_prev_ht = NULL, *devinfo_same_list;
 	LL_FOREACH(devinfo_list, devinfo_mid_list)
 	{
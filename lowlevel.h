@@ -18,6 +18,8 @@ struct lowlevel_driver {
 	bool exclude_from_all;
 	
 	struct lowlevel_device_info *(*devinfo_scan)();
+	// Optional; scans only a single hotplugged device, given its devnode or USB devid
+	struct lowlevel_device_info *(*devinfo_scan_one)(const char *target);
 	void (*devinfo_free)(struct lowlevel_device_info *);
 };
 
@@ -36,13 +38,13 @@ struct lowlevel_device_info {
 	struct lowlevel_device_info *next;
 	struct lowlevel_device_info *same_devid_next;
 	UT_hash_handle hh;
-	pthread_t probe_pth;
 	int ref;
 };
 
 extern char *bfg_make_devid_usb(uint8_t usbbus, uint8_t usbaddr);
 
 extern struct lowlevel_device_info *lowlevel_scan();
+extern struct lowlevel_device_info *lowlevel_scan_one(const char *target);
 extern bool _lowlevel_match_product(const struct lowlevel_device_info *, const char **);
 #define lowlevel_match_product(info, ...)  \
 	_lowlevel_match_product(info, (const char *[]){__VA_ARGS__, NULL})
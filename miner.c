@@ -73,6 +73,7 @@
 #include <blktemplate.h>
 #include <libbase58.h>
 
+#include "binlog.h"
 #include "compat.h"
 #include "deviceapi.h"
 #include "logging.h"
@@ -90,6 +91,16 @@
 #include "lowlevel.h"
 #endif
 
+#include "lowl-capture.h"
+
+#ifdef HAVE_LIBUSB
+#include "lowl-usb.h"
+#endif
+
+#ifdef NEED_BFG_LOWL_SPI
+#include "lowl-spi.h"
+#endif
+
 #if defined(unix) || defined(__APPLE__)
 	#include <errno.h>
 	#include <fcntl.h>
@@ -127,6 +138,7 @@ bool opt_dev_protocol;
 static bool opt_benchmark, opt_benchmark_intense;
 static bool want_longpoll = true;
 static bool want_gbt = true;
+static bool want_gbt_localgen = true;
 static bool want_getwork = true;
 #if BLKMAKER_VERSION > 1
 static bool opt_load_bitcoin_conf = true;
@@ -196,6 +208,8 @@ int hotplug_delay_ms = 100;
 const bool opt_hotplug;
 #endif
 struct string_elist *scan_devices;
+char *opt_probe_cache;
+int opt_probe_threads = 8;
 static struct string_elist *opt_set_device_list;
 bool opt_force_dev_init;
 static struct string_elist *opt_devices_enabled_list;
@@ -221,6 +235,8 @@ bool have_libusb;
 static bool opt_submit_stale = true;
 static float opt_shares;
 static int opt_submit_threads = 0x40;
+int opt_verify_threads;
+float opt_nonce_rate;
 bool opt_fail_only;
 int opt_fail_switch_delay = 300;
 bool opt_autofan;
@@ -306,6 +322,10 @@ unsigned int found_blocks;
 
 unsigned int local_work;
 unsigned int total_go, total_ro;
+unsigned int total_pop_rolled, total_pop_fresh;
+// Time from a nonce being found to the submit thread picking up the share, in seconds
+double total_submit_latency, max_submit_latency;
+unsigned int total_submit_latency_count;
 
 struct pool **pools;
 static struct pool *currentpool = NULL;
@@ -521,6 +541,86 @@ float drv_min_nonce_diff(const struct device_drv * const drv, struct cgpu_info *
 #endif
 }
 
+#define AUTO_NONCE_DIFF_INTERVAL_US  15000000
+
+static
+void cgpu_auto_nonce_restart(struct cgpu_info * const cgpu, const int procs, const struct timeval * const tvp_now)
+{
+	struct cgpu_info *proc = cgpu;
+	
+	cgpu->tv_auto_nonce_start = *tvp_now;
+	cgpu->auto_nonce_diff1_start = 0;
+	cgpu->auto_nonces_start = 0;
+	for (int i = 0; i < procs && proc; ++i, proc = proc->next_proc)
+	{
+		cgpu->auto_nonce_diff1_start += proc->diff1 + proc->bad_diff1;
+		cgpu->auto_nonces_start += proc->nonces_found;
+	}
+}
+
+/* Chooses the nonce difficulty for drivers which can have their devices
+ * report nonces at any power of two difficulty up to max_nonce_diff, aiming
+ * for --nonce-rate nonces per second from the first procs processors of cgpu.
+ * default_nonce_diff is used when the option is disabled, and as the starting
+ * point. Callers must still limit it to the work difficulty. */
+float cgpu_auto_nonce_diff(struct cgpu_info * const cgpu, const int procs, const struct mining_algorithm * const malgo, const float default_nonce_diff, const float max_nonce_diff)
+{
+	struct cgpu_info *proc;
+	struct timeval tv_now;
+	double diff1 = 0;
+	unsigned long nonces = 0;
+	float rv;
+	
+	if (!opt_nonce_rate)
+		return default_nonce_diff;
+	const float min_nonce_diff = drv_min_nonce_diff(cgpu->drv, cgpu, malgo);
+	if (min_nonce_diff < 0)
+		return default_nonce_diff;
+	
+	timer_set_now(&tv_now);
+	mutex_lock(&stats_lock);
+	if (!cgpu->auto_nonce_diff)
+	{
+		cgpu->auto_nonce_diff = default_nonce_diff;
+		cgpu_auto_nonce_restart(cgpu, procs, &tv_now);
+	}
+	const long elapsed_us = timer_elapsed_us(&cgpu->tv_auto_nonce_start, &tv_now);
+	if (elapsed_us >= AUTO_NONCE_DIFF_INTERVAL_US)
+	{
+		proc = cgpu;
+		for (int i = 0; i < procs && proc; ++i, proc = proc->next_proc)
+		{
+			diff1 += proc->diff1 + proc->bad_diff1;
+			nonces += proc->nonces_found;
+		}
+		const double elapsed = elapsed_us / 1e6;
+		cgpu->auto_nonce_rate = (nonces - cgpu->auto_nonces_start) / elapsed;
+		
+		// At difficulty D, nonces arrive at (diff1 per second) / D
+		const double ideal = (diff1 - cgpu->auto_nonce_diff1_start) / elapsed / opt_nonce_rate;
+		const float old_diff = cgpu->auto_nonce_diff;
+		// Stats may have been zeroed during the interval
+		if (ideal >= 0 && (ideal >= old_diff * 2 || ideal < old_diff / 2))
+		{
+			float diff = pow(2, floor(log2(ideal)));
+			if (diff > max_nonce_diff)
+				diff = max_nonce_diff;
+			if (diff < min_nonce_diff)
+				diff = min_nonce_diff;
+			if (diff != old_diff)
+			{
+				applog(LOG_DEBUG, "%"PRIpreprv": %.2f nonces/s, changing nonce difficulty from %g to %g",
+				       cgpu->proc_repr, cgpu->auto_nonce_rate, old_diff, diff);
+				cgpu->auto_nonce_diff = diff;
+			}
+		}
+		cgpu_auto_nonce_restart(cgpu, procs, &tv_now);
+	}
+	rv = cgpu->auto_nonce_diff;
+	mutex_unlock(&stats_lock);
+	return rv;
+}
+
 char *devpath_to_devid(const char *devpath)
 {
 #ifndef WIN32
@@ -892,6 +992,9 @@ int cgpu_search(const char * const pattern, const int first)
 
 static pthread_mutex_t sharelog_lock;
 static FILE *sharelog_file = NULL;
+static struct bfg_binlog *sharelog_binlog;
+
+#define BINLOG_SEGMENT_SZ  0x4000000
 
 struct thr_info *get_thread(int thr_id)
 {
@@ -924,6 +1027,17 @@ struct cgpu_info *get_devices(int id)
 
 static pthread_mutex_t noncelog_lock = PTHREAD_MUTEX_INITIALIZER;
 static FILE *noncelog_file = NULL;
+static struct bfg_binlog *noncelog_binlog;
+
+static
+void binlog_rechdr(uint8_t * const buf, const enum binlog_rectype type, const time_t t, const int thr_id, const struct cgpu_info * const proc)
+{
+	memset(buf, 0, BINLOG_RECHDR_SZ);
+	pk_u8(buf, 4, type);
+	pk_u64le(buf, 8, t);
+	pk_u32le(buf, 0x10, thr_id);
+	strncpy((char*)&buf[0x14], proc->proc_repr_ns, BINLOG_PROCNAME_SZ - 1);
+}
 
 static
 void noncelog(const struct work * const work)
@@ -934,6 +1048,19 @@ void noncelog(const struct work * const work)
 	int rv;
 	size_t ret;
 	
+	if (noncelog_binlog)
+	{
+		uint8_t * const rec = (void*)buf;
+		binlog_rechdr(rec, BLRT_NONCE, time(NULL), thr_id, proc);
+		memcpy(&rec[0x20], work->hash, 32);
+		memcpy(&rec[0x40], work->data, 80);
+		memcpy(&rec[0x90], work->midstate, 32);
+		bfg_binlog_append(noncelog_binlog, rec, BINLOG_NONCE_SZ);
+	}
+	// Both logs are written if both were asked for
+	if (!noncelog_file)
+		return;
+	
 	bin2hex(hash, work->hash, 32);
 	bin2hex(data, work->data, 80);
 	bin2hex(midstate, work->midstate, 32);
@@ -970,13 +1097,34 @@ static void sharelog(const char*disposition, const struct work*work)
 	char s[1024];
 	size_t ret;
 
-	if (!sharelog_file)
+	if (!(sharelog_file || sharelog_binlog))
 		return;
 
 	thr_id = work->thr_id;
 	cgpu = get_thr_cgpu(thr_id);
 	pool = work->pool;
 	t = work->ts_getwork + timer_elapsed(&work->tv_getwork, &work->tv_work_found);
+	
+	if (sharelog_binlog)
+	{
+		const size_t displen = strnlen(disposition, 0xff);
+		const size_t urllen = strnlen(pool->rpc_url, 0xffff);
+		const size_t reclen = BINLOG_SHARE_FIXED_SZ + displen + urllen;
+		uint8_t rec[reclen];
+		binlog_rechdr(rec, BLRT_SHARE, t, thr_id, cgpu);
+		pk_u8(rec, 5, displen);
+		pk_u16le(rec, 6, urllen);
+		memcpy(&rec[0x20], work->target, 32);
+		memcpy(&rec[0x40], work->hash, 32);
+		memcpy(&rec[0x60], work->data, 128);
+		memcpy(&rec[BINLOG_SHARE_FIXED_SZ], disposition, displen);
+		memcpy(&rec[BINLOG_SHARE_FIXED_SZ + displen], pool->rpc_url, urllen);
+		bfg_binlog_append(sharelog_binlog, rec, reclen);
+	}
+	// Both logs are written if both were asked for
+	if (!sharelog_file)
+		return;
+	
 	bin2hex(target, work->target, sizeof(work->target));
 	bin2hex(hash, work->hash, sizeof(work->hash));
 	bin2hex(data, work->data, sizeof(work->data));
@@ -2079,6 +2227,27 @@ static char *set_sharelog(char *arg)
 	return _bfgopt_set_file(arg, &sharelog_file, "a", "share log");
 }
 
+static
+char *_bfgopt_set_binlog(const char * const arg, struct bfg_binlog ** const blp, const char * const purpose)
+{
+	if (*blp)
+		bfg_binlog_close(*blp);
+	*blp = bfg_binlog_open(arg, BINLOG_SEGMENT_SZ, purpose);
+	if (!*blp)
+		return "Failed to open binary log";
+	return NULL;
+}
+
+static char *set_noncelog_binary(char *arg)
+{
+	return _bfgopt_set_binlog(arg, &noncelog_binlog, "binary nonce log");
+}
+
+static char *set_sharelog_binary(char *arg)
+{
+	return _bfgopt_set_binlog(arg, &sharelog_binlog, "binary share log");
+}
+
 static
 void _add_set_device_option(const char * const func, const char * const buf)
 {
@@ -2359,6 +2528,9 @@ static struct opt_table opt_config_table[] = {
 			opt_set_bool, &opt_bfl_noncerange,
 			"Use nonce range on bitforce devices if supported"),
 #endif
+	OPT_WITH_ARG("--capture-dir",
+	             opt_set_charp, NULL, &opt_capture_dir,
+	             "Record raw SPI and serial device traffic to files in this directory, for replay"),
 #ifdef HAVE_CHROOT
         OPT_WITH_ARG("--chroot-dir",
                      opt_set_charp, NULL, &chroot_dir,
@@ -2413,6 +2585,9 @@ static struct opt_table opt_config_table[] = {
 	OPT_WITH_ARG("--http-port",
 	             opt_set_intval, opt_show_intval, &httpsrv_port,
 	             "Port number to listen on for HTTP getwork miners (-1 means disabled)"),
+	OPT_WITH_ARG("--http-threads",
+	             set_int_1_to_65535, opt_show_intval, &httpsrv_threads,
+	             "Number of threads serving HTTP getwork miners"),
 #endif
 	OPT_WITH_ARG("--expiry",
 		     set_int_0_to_9999, opt_show_intval, &opt_expiry,
@@ -2533,6 +2708,9 @@ static struct opt_table opt_config_table[] = {
 	OPT_WITHOUT_ARG("--log-microseconds",
 	                opt_set_bool, &opt_log_microseconds,
 	                "Include microseconds in log output"),
+	OPT_WITHOUT_ARG("--minerloop-reactor",
+	                opt_set_bool, &opt_minerloop_reactor,
+	                "Drive non-blocking devices from shared threads, instead of one thread each"),
 #if defined(unix) || defined(__APPLE__)
 	OPT_WITH_ARG("--monitor|-m",
 		     opt_set_charp, NULL, &opt_stderr_cmd,
@@ -2552,6 +2730,9 @@ static struct opt_table opt_config_table[] = {
 	OPT_WITHOUT_ARG("--no-gbt",
 			opt_set_invbool, &want_gbt,
 			"Disable getblocktemplate support"),
+	OPT_WITHOUT_ARG("--no-gbt-localgen",
+			opt_set_invbool, &want_gbt_localgen,
+			"Disable local extranonce rolling of getblocktemplate templates"),
 	OPT_WITHOUT_ARG("--no-getwork",
 			opt_set_invbool, &want_getwork,
 			"Disable getwork support"),
@@ -2613,9 +2794,15 @@ static struct opt_table opt_config_table[] = {
 	                opt_hidden
 #endif
 	),
+	OPT_WITH_ARG("--nonce-rate",
+	             opt_set_floatval, opt_show_floatval, &opt_nonce_rate,
+	             "Target nonces per second from devices with adjustable nonce difficulty (0 = disabled)"),
 	OPT_WITH_ARG("--noncelog",
 		     set_noncelog, NULL, NULL,
 		     "Create log of all nonces found"),
+	OPT_WITH_ARG("--noncelog-binary",
+		     set_noncelog_binary, NULL, NULL,
+		     "Create compact binary log of all nonces found (decode with bfgminer-binlog)"),
 	OPT_WITH_ARG("--pass|-p",
 		     set_pass, NULL, NULL,
 		     "Password for bitcoin JSON-RPC server"),
@@ -2637,6 +2824,12 @@ static struct opt_table opt_config_table[] = {
 	OPT_WITH_ARG("--force-rollntime",  // NOTE: must be after --pass for config file ordering
 			 set_pool_force_rollntime, NULL, NULL,
 			 opt_hidden),
+	OPT_WITH_ARG("--probe-cache",
+	             opt_set_charp, NULL, &opt_probe_cache,
+	             "Remember which driver claimed each device in this file, and probe it first next time"),
+	OPT_WITH_ARG("--probe-threads",
+	             set_int_0_to_9999, opt_show_intval, &opt_probe_threads,
+	             "Maximum number of devices to probe at once (0 = unlimited)"),
 	OPT_WITHOUT_ARG("--protocol-dump|-P",
 			opt_set_bool, &opt_protocol,
 			"Verbose dump of protocol-level activities"),
@@ -2720,6 +2913,9 @@ static struct opt_table opt_config_table[] = {
 	OPT_WITH_ARG("--sharelog",
 		     set_sharelog, NULL, NULL,
 		     "Append share log to file"),
+	OPT_WITH_ARG("--sharelog-binary",
+		     set_sharelog_binary, NULL, NULL,
+		     "Append compact binary share log to file (decode with bfgminer-binlog)"),
 	OPT_WITH_ARG("--shares",
 		     opt_set_floatval, NULL, &opt_shares,
 		     "Quit after mining 2^32 * N hashes worth of shares (default: unlimited)"),
@@ -2735,6 +2931,11 @@ static struct opt_table opt_config_table[] = {
 	OPT_WITH_ARG("--socks-proxy",
 		     opt_set_charp, NULL, &opt_socks_proxy,
 		     "Set socks proxy (host:port)"),
+#ifdef NEED_BFG_LOWL_SPI
+	OPT_WITH_ARG("--spi-transport",
+	             opt_set_charp, NULL, &opt_spi_transport,
+	             "Use a software SPI transport instead of hardware: loopback or replay:<capture file>[:<speed>]"),
+#endif
 #ifdef USE_LIBEVENT
 	OPT_WITH_ARG("--stratum-port",
 	             set_long_1_to_65535_or_neg1, opt_show_longval, &stratumsrv_port,
@@ -2800,6 +3001,9 @@ static struct opt_table opt_config_table[] = {
 	OPT_WITHOUT_ARG("--verbose-work-updates|--verbose-work-update",
 			opt_set_invbool, &opt_quiet_work_updates,
 			opt_hidden),
+	OPT_WITH_ARG("--verify-threads",
+	             set_int_0_to_9999, opt_show_intval, &opt_verify_threads,
+	             "Number of threads verifying nonces for drivers that hand them off (0 verifies on the device thread)"),
 	OPT_WITHOUT_ARG("--weighed-stats",
 	                opt_set_bool, &opt_weighed_stats,
 	                "Display statistics weighed to difficulty 1"),
@@ -3470,6 +3674,7 @@ void refresh_bitcoind_address(struct mining_goal_info * const goal, const bool f
 #endif
 
 #define GBT_XNONCESZ (sizeof(uint32_t))
+#define GBT_LOCALGEN_MAX_BATCH  0x40
 
 #if BLKMAKER_VERSION > 6
 #define blkmk_append_coinbase_safe(tmpl, append, appendsz)  \
@@ -3680,11 +3885,13 @@ static bool work_decode(struct pool *pool, struct work *work, json_t *val)
 			tmpl_incref(swork->tr);
 			bytes_assimilate_raw(&swork->coinbase, cbtxn, cbtxnsz, cbtxnsz);
 			swork->nonce2_offset = cbextranonceoffset;
+			swork->cb_midstate_valid = false;
 			bytes_assimilate_raw(&swork->merkle_bin, branches, branchdatasz, branchdatasz);
 			swork->merkles = branchcount;
 			swap32yes(swork->header1, &buf[0], 36 / 4);
 			swork->ntime = le32toh(*(uint32_t *)(&buf[68]));
 			swork->tv_received = tv_now;
+			swork->ntime_roll_limits = work->ntime_roll_limits;
 			swap32yes(swork->diffbits, &buf[72], 4 / 4);
 			memcpy(swork->target, work->target, sizeof(swork->target));
 			free(swork->job_id);
@@ -3710,7 +3917,7 @@ static bool work_decode(struct pool *pool, struct work *work, json_t *val)
 /* Returns whether the pool supports local work generation or not. */
 static bool pool_localgen(struct pool *pool)
 {
-	return (pool->last_work_copy || pool->has_stratum);
+	return (pool->last_work_copy || pool->has_stratum || (want_gbt_localgen && pool->swork.tr));
 }
 
 int dev_from_id(int thr_id)
@@ -3751,6 +3958,126 @@ static int total_staged(const bool include_spares)
 	return ret;
 }
 
+/* The staged queue is sized per algorithm, beyond one work per processor
+ * (base_queue), from how fast work is consumed and how long it takes to get
+ * more. --queue is the minimum, and underruns raise the target right away */
+#define QUEUE_ADJUST_INTERVAL  10
+
+static int queue_target_max(void)
+{
+	return max(opt_queue, 10 + mining_threads);
+}
+
+static int __malgo_queue_target(const struct mining_algorithm * const malgo)
+{
+	return max(malgo->queue_target, opt_queue);
+}
+
+int malgo_queue_target(const struct mining_algorithm * const malgo)
+{
+	int ret;
+
+	mutex_lock(stgd_lock);
+	ret = __malgo_queue_target(malgo);
+	mutex_unlock(stgd_lock);
+
+	return ret;
+}
+
+static int __queue_target_total(void)
+{
+	struct mining_algorithm *malgo;
+	int total = 0;
+
+	LL_FOREACH(mining_algorithms, malgo)
+	{
+		if (malgo->goal_refs && malgo->base_queue)
+			total += __malgo_queue_target(malgo);
+	}
+	return total ?: opt_queue;
+}
+
+static int queue_target_total(void)
+{
+	int ret;
+
+	mutex_lock(stgd_lock);
+	ret = __queue_target_total();
+	mutex_unlock(stgd_lock);
+
+	return ret;
+}
+
+/* Called with stgd_lock held for every work popped */
+static void __queue_target_update(struct mining_algorithm * const malgo)
+{
+	struct timeval tv_now;
+	double elapsed, rate;
+	int target, desired;
+
+	++malgo->queue_pops;
+	timer_set_now(&tv_now);
+	if (!timer_isset(&malgo->tv_queue_adjust))
+	{
+		malgo->tv_queue_adjust = tv_now;
+		return;
+	}
+	elapsed = timer_elapsed(&malgo->tv_queue_adjust, &tv_now);
+	if (elapsed < QUEUE_ADJUST_INTERVAL)
+		return;
+
+	rate = malgo->queue_pops / elapsed;
+	malgo->queue_pop_rate = (malgo->queue_pop_rate + rate * 0.63) / 1.63;
+
+	/* Enough staged to cover the time it takes to get more, with 100%
+	 * headroom; shrink only one at a time, and not right after an underrun */
+	desired = ceil(malgo->queue_pop_rate * malgo->upstream_latency * 2);
+	target = __malgo_queue_target(malgo);
+	if (desired < target)
+		desired = malgo->queue_underrun ? target : (target - 1);
+	desired = min(max(desired, opt_queue), queue_target_max());
+	if (desired != target)
+		applog(LOG_DEBUG, "%s queue target adjusted from %d to %d (%.2f work/s, %.3fs upstream latency)",
+		       malgo->name, target, desired, malgo->queue_pop_rate, malgo->upstream_latency);
+
+	malgo->queue_target = desired;
+	malgo->queue_underrun = false;
+	malgo->queue_pops = 0;
+	malgo->tv_queue_adjust = tv_now;
+}
+
+/* Called with stgd_lock held when proc found nothing usable staged */
+static void __queue_target_underrun(struct cgpu_info * const proc)
+{
+	struct mining_algorithm *malgo;
+	int target;
+
+	LL_FOREACH(mining_algorithms, malgo)
+	{
+		if (!malgo->goal_refs)
+			continue;
+		if (drv_min_nonce_diff(proc->drv, proc, malgo) < 0)
+			continue;
+		malgo->queue_underrun = true;
+		target = __malgo_queue_target(malgo);
+		if (likely(target < queue_target_max()))
+		{
+			malgo->queue_target = target + 1;
+			applog(LOG_WARNING, "Staged work underrun; increasing %s queue target to %d", malgo->name, malgo->queue_target);
+		}
+		else
+			applog(LOG_WARNING, "Staged work underrun; not automatically increasing %s queue target above %d", malgo->name, target);
+	}
+}
+
+static void queue_target_update_latency(struct mining_algorithm * const malgo, const struct timeval * const tvp_elapsed)
+{
+	mutex_lock(stgd_lock);
+	malgo->upstream_latency += ((double)tvp_elapsed->tv_sec + ((double)tvp_elapsed->tv_usec / 1000000)) * 0.63;
+	malgo->upstream_latency /= 1.63;
+	mutex_unlock(stgd_lock);
+}
+
 #ifdef HAVE_CURSES
 WINDOW *mainwin, *statuswin, *logwin;
 #endif
@@ -6137,6 +6464,8 @@ tryagain:
 	timersub(&(work->tv_getwork_reply), &(work->tv_getwork), &tv_elapsed);
 	pool_stats->getwork_wait_rolling += ((double)tv_elapsed.tv_sec + ((double)tv_elapsed.tv_usec / 1000000)) * 0.63;
 	pool_stats->getwork_wait_rolling /= 1.63;
+	if (likely(val))
+		queue_target_update_latency(pool->goal->malgo, &tv_elapsed);
 
 	timeradd(&tv_elapsed, &(pool_stats->getwork_wait), &(pool_stats->getwork_wait));
 	if (timercmp(&tv_elapsed, &(pool_stats->getwork_wait_max), >)) {
@@ -6337,7 +6666,7 @@ static void recruit_curl(struct pool *pool)
  * network delays/outages. */
 static struct curl_ent *pop_curl_entry3(struct pool *pool, int blocking)
 {
-	int curl_limit = opt_delaynet ? 5 : (mining_threads + opt_queue) * 2;
+	int curl_limit = opt_delaynet ? 5 : (mining_threads + queue_target_total()) * 2;
 	bool recruited = false;
 	struct curl_ent *ce;
 
@@ -6434,7 +6763,7 @@ static inline bool can_roll(struct work *work)
 		work->rolls < 7000 && !stale_work(work, false));
 }
 
-static void roll_work(struct work *work)
+static void roll_work2(struct work * const work, const int n)
 {
 	if (work->tr)
 	{
@@ -6452,15 +6781,15 @@ static void roll_work(struct work *work)
 
 	work_ntime = (uint32_t *)(work->data + 68);
 	ntime = be32toh(*work_ntime);
-	ntime++;
+	ntime += n;
 	*work_ntime = htobe32(ntime);
 		work_set_simple_ntime_roll_limit(work, 0, &work->ntime_roll_limits.tv_ref);
 
 		applog(LOG_DEBUG, "Successfully rolled time header in work");
 	}
 
-	local_work++;
-	work->rolls++;
+	local_work += n;
+	work->rolls += n;
 	work->blk.nonce = 0;
 
 	/* This is now a different work item so it needs a different ID for the
@@ -6468,6 +6797,11 @@ static void roll_work(struct work *work)
 	work->id = total_work++;
 }
 
+static void roll_work(struct work *work)
+{
+	roll_work2(work, 1);
+}
+
 /* Duplicates any dynamically allocated arrays within the work struct to
  * prevent a copied work struct from freeing ram belonging to another struct */
 static void _copy_work(struct work *work, const struct work *base_work, int noffset)
@@ -6479,6 +6813,8 @@ static void _copy_work(struct work *work, const struct work *base_work, int noff
 	/* Keep the unique new id assigned during make_work to prevent copied
 	 * work from having the same id. */
 	work->id = id;
+	// The copy is not in any queue indexes
+	work->queued_subid_indexed = false;
 	if (base_work->job_id)
 		work->job_id = strdup(base_work->job_id);
 	if (base_work->nonce1)
@@ -6519,9 +6855,9 @@ void __copy_work(struct work *work, const struct work *base_work)
 	_copy_work(work, base_work, 0);
 }
 
-static struct work *make_clone(struct work *work)
+static struct work *make_clone_noffset(struct work *work, int noffset)
 {
-	struct work *work_clone = copy_work(work);
+	struct work *work_clone = copy_work_noffset(work, noffset);
 
 	work_clone->clone = true;
 	cgtime((struct timeval *)&(work_clone->tv_cloned));
@@ -6530,16 +6866,66 @@ static struct work *make_clone(struct work *work)
 	/* Make cloned work appear slightly older to bias towards keeping the
 	 * master work item which can be further rolled */
 	work_clone->tv_staged.tv_sec -= 1;
+	if (noffset)
+		work_set_simple_ntime_roll_limit(work_clone, 0, &work_clone->ntime_roll_limits.tv_ref);
 
 	return work_clone;
 }
 
+static struct work *make_clone(struct work *work)
+{
+	return make_clone_noffset(work, 0);
+}
+
+/* Most clones produced from a single rollable work item in one go */
+#define ROLL_BULK_MAX  0x40
+
+/* Rolls work up to count times, storing a clone of each roll in clones.
+ * Plain ntime rolls are done as offsets in a single pass. The base work is
+ * then rolled once more so it never duplicates the last clone. The caller
+ * must have checked can_roll and should_roll; returns the number of clones */
+static int roll_work_bulk(struct work * const work, struct work ** const clones, int count)
+{
+	int i;
+	
+	if (count > ROLL_BULK_MAX)
+		count = ROLL_BULK_MAX;
+	
+	if (work->tr)
+	{
+		for (i = 0; i < count && blkmk_work_left(work->tr->tmpl) > 1; ++i)
+		{
+			roll_work(work);
+			clones[i] = make_clone(work);
+		}
+		if (i)
+			roll_work(work);
+		return i;
+	}
+	
+	// Keep within the 7000 roll limit, including the final roll of the base
+	if (count > 6999 - work->rolls)
+		count = 6999 - work->rolls;
+	for (i = 0; i < count; ++i)
+	{
+		clones[i] = make_clone_noffset(work, i + 1);
+		clones[i]->rolls += i + 1;
+		clones[i]->blk.nonce = 0;
+	}
+	if (count > 0)
+		roll_work2(work, count + 1);
+	return (count > 0) ? count : 0;
+}
+
 static void stage_work(struct work *work);
+static void stage_work_batch(struct work **works, int count);
 
-static bool clone_available(void)
+/* Rolls up to want clones from the first suitable staged work, and stages
+ * them all together */
+static bool clone_available(int want)
 {
-	struct work *work_clone = NULL, *work, *tmp;
-	bool cloned = false;
+	struct work *clones[ROLL_BULK_MAX], *work, *tmp;
+	int cloned = 0;
 
 	mutex_lock(stgd_lock);
 	if (!staged_rollable)
@@ -6547,11 +6933,9 @@ static bool clone_available(void)
 
 	HASH_ITER(hh, staged_work, work, tmp) {
 		if (can_roll(work) && should_roll(work)) {
-			roll_work(work);
-			work_clone = make_clone(work);
-			applog(LOG_DEBUG, "%s: Rolling work %d to %d", __func__, work->id, work_clone->id);
-			roll_work(work);
-			cloned = true;
+			cloned = roll_work_bulk(work, clones, (want > 1) ? want : 1);
+			if (cloned)
+				applog(LOG_DEBUG, "%s: Rolled work %d into %d clone(s) starting with %d", __func__, work->id, cloned, clones[0]->id);
 			break;
 		}
 	}
@@ -6560,8 +6944,8 @@ out_unlock:
 	mutex_unlock(stgd_lock);
 
 	if (cloned) {
-		applog(LOG_DEBUG, "Pushing cloned available work to stage thread");
-		stage_work(work_clone);
+		applog(LOG_DEBUG, "Pushing %d cloned available work to stage thread", cloned);
+		stage_work_batch(clones, cloned);
 	}
 	return cloned;
 }
@@ -6929,9 +7313,21 @@ static void *submit_work_thread(__maybe_unused void *userdata)
 		}
 		
 		// Receive any new submissions
+		if (submit_waiting)
+			timer_set_now(&tv_now);
 		while (submit_waiting) {
 			struct work *work = submit_waiting;
 			DL_DELETE(submit_waiting, work);
+			if (timer_isset(&work->tv_work_found))
+			{
+				const double latency = timer_elapsed(&work->tv_work_found, &tv_now);
+				mutex_lock(&stats_lock);
+				total_submit_latency += latency;
+				++total_submit_latency_count;
+				if (latency > max_submit_latency)
+					max_submit_latency = latency;
+				mutex_unlock(&stats_lock);
+			}
 			if ( (sws = begin_submission(work)) ) {
 				if (sws->ce)
 					curl_multi_add_handle(curlm, sws->ce->curl);
@@ -7434,6 +7830,7 @@ void pool_update_work_restart_time(struct pool * const pool)
 static void restart_threads(void)
 {
 	struct pool *cp = current_pool();
+	struct timeval tv_now;
 	int i;
 	struct thr_info *thr;
 
@@ -7446,9 +7843,11 @@ static void restart_threads(void)
 
 	rd_lock(&mining_thr_lock);
 	
+	timer_set_now(&tv_now);
 	for (i = 0; i < mining_threads; i++)
 	{
 		thr = mining_thr[i];
+		thr->tv_restart = tv_now;
 		thr->work_restart = true;
 	}
 	
@@ -7680,21 +8079,27 @@ static bool work_rollable(struct work *work)
 	return (!work->clone && work->rolltime);
 }
 
-static bool hash_push(struct work *work)
+static bool hash_push_batch(struct work ** const works, const int count)
 {
+	struct work *work;
 	bool rc = true;
 
 	mutex_lock(stgd_lock);
-	if (work_rollable(work))
-		staged_rollable++;
-	++work_mining_algorithm(work)->staged;
-	if (work->spare)
-		++staged_spare;
-	if (likely(!getq->frozen)) {
-		HASH_ADD_INT(staged_work, id, work);
+	for (int i = 0; i < count; ++i)
+	{
+		work = works[i];
+		if (work_rollable(work))
+			staged_rollable++;
+		++work_mining_algorithm(work)->staged;
+		if (work->spare)
+			++staged_spare;
+		if (likely(!getq->frozen))
+			HASH_ADD_INT(staged_work, id, work);
+		else
+			rc = false;
+	}
+	if (likely(rc))
 		HASH_SORT(staged_work, tv_sort);
-	} else
-		rc = false;
 	pthread_cond_broadcast(&getq->cond);
 	mutex_unlock(stgd_lock);
 
@@ -7703,14 +8108,27 @@ static bool hash_push(struct work *work)
 
 static void stage_work(struct work *work)
 {
-	applog(LOG_DEBUG, "Pushing work %d from pool %d to hash queue",
-	       work->id, work->pool->pool_no);
-	work->work_restart_id = work->pool->work_restart_id;
+	stage_work_batch(&work, 1);
+}
+
+/* Stages works that all share the same previous block (eg, clones of one
+ * base), so only the first needs checking for a block change */
+static void stage_work_batch(struct work ** const works, const int count)
+{
+	struct work *work;
+	
+	for (int i = 0; i < count; ++i)
+	{
+		work = works[i];
+		applog(LOG_DEBUG, "Pushing work %d from pool %d to hash queue",
+		       work->id, work->pool->pool_no);
+		work->work_restart_id = work->pool->work_restart_id;
+		work->pool->works++;
+	}
 	work->pool->last_work_time = time(NULL);
 	cgtime(&work->pool->tv_last_work_time);
-	test_work_current(work);
-	work->pool->works++;
-	hash_push(work);
+	test_work_current(works[0]);
+	hash_push_batch(works, count);
 }
 
 #ifdef HAVE_CURSES
@@ -7973,6 +8391,8 @@ void write_config(FILE *fcfg)
 #ifdef USE_LIBMICROHTTPD
 	if (httpsrv_port != -1)
 		fprintf(fcfg, ",\n\"http-port\" : %d", httpsrv_port);
+	if (httpsrv_threads != 1)
+		fprintf(fcfg, ",\n\"http-threads\" : %d", httpsrv_threads);
 #endif
 #ifdef USE_LIBEVENT
 	if (stratumsrv_port != -1)
@@ -8031,6 +8451,9 @@ void zero_stats(void)
 	new_blocks = 0;
 	local_work = 0;
 	total_go = 0;
+	total_pop_rolled = total_pop_fresh = 0;
+	total_submit_latency = max_submit_latency = 0;
+	total_submit_latency_count = 0;
 	total_ro = 0;
 	total_secs = 1.0;
 	total_diff1 = 0;
@@ -8110,6 +8533,14 @@ void zero_stats(void)
 		cgpu->diff_rejected = 0;
 		cgpu->diff_stale = 0;
 		cgpu->last_share_diff = 0;
+		cgpu->nonces_found = 0;
+		cgpu->auto_nonce_diff1_start = 0;
+		cgpu->auto_nonces_start = 0;
+		cgpu->tv_work_wait.tv_sec = 0;
+		cgpu->tv_work_wait.tv_usec = 0;
+		timerclear(&cgpu->tv_restart_latency);
+		timerclear(&cgpu->tv_restart_latency_max);
+		cgpu->restarts = 0;
 		cgpu->thread_fail_init_count = 0;
 		cgpu->thread_zero_hash_count = 0;
 		cgpu->thread_fail_queue_count = 0;
@@ -9027,12 +9458,20 @@ static void hashmeter(int thr_id, struct timeval *diff,
 	/* So we can call hashmeter from a non worker thread */
 	if (thr_id >= 0) {
 		struct cgpu_info *cgpu = thr->cgpu;
+		struct cgpu_info * const dev = cgpu->device;
 		int threadobj = cgpu->threads ?: 1;
 		double thread_rolling = 0.0;
 		int i;
 
 		applog(LOG_DEBUG, "[thread %d: %"PRIu64" hashes, %.1f khash/sec]",
 			thr_id, hashes_done, hashes_done / 1000 / secs);
+		
+		if (unlikely(timer_isset(&dev->tv_hotplugged)) && hashes_done)
+		{
+			applog(LOG_NOTICE, "%s: Hashing %.3f seconds after being plugged in",
+			       dev->dev_repr, timer_elapsed_us(&dev->tv_hotplugged, NULL) / 1e6);
+			timer_unset(&dev->tv_hotplugged);
+		}
 
 		/* Rolling average for each thread and each device */
 		decay_time(&thr->rolling, local_mhashes / secs, secs);
@@ -10035,7 +10474,8 @@ void *cmd_idle_thread(void * const __maybe_unused userp)
 	return NULL;
 }
 
-static struct work *hash_pop(struct cgpu_info * const proc)
+// If !wait, returns NULL rather than waiting when there is no usable work staged
+static struct work *hash_pop(struct cgpu_info * const proc, const bool wait)
 {
 	int hc;
 	struct work *work, *work_found, *tmp;
@@ -10091,16 +10531,17 @@ retry:
 			break;
 		}
 		
+		if (!wait)
+		{
+			pthread_cond_signal(&gws_cond);
+			mutex_unlock(stgd_lock);
+			return NULL;
+		}
+		
 		// Failed to get a usable work
 		if (unlikely(staged_full))
 		{
-			if (likely(opt_queue < 10 + mining_threads))
-			{
-				++opt_queue;
-				applog(LOG_WARNING, "Staged work underrun; increasing queue minimum to %d", opt_queue);
-			}
-			else
-				applog(LOG_WARNING, "Staged work underrun; not automatically increasing above %d", opt_queue);
+			__queue_target_underrun(proc);
 			staged_full = false;  // Let it fill up before triggering an underrun again
 			no_work = true;
 		}
@@ -10122,10 +10563,15 @@ retry:
 	{
 		// Instead of consuming it, force it to be cloned and grab the clone
 		mutex_unlock(stgd_lock);
-		clone_available();
+		clone_available(1);
 		goto retry;
 	}
 	
+	if (work->clone || work->rolls)
+		++total_pop_rolled;
+	else
+		++total_pop_fresh;
+	__queue_target_update(work_mining_algorithm(work));
 	unstage_work(work);
 
 	/* Signal the getwork scheduler to look for more work */
@@ -10145,34 +10591,24 @@ retry:
  * the future */
 static struct work *clone_work(struct work *work)
 {
-	int mrs = mining_threads + opt_queue - total_staged(false);
-	struct work *work_clone;
-	bool cloned;
+	int mrs = mining_threads + queue_target_total() - total_staged(false);
+	struct work *clones[ROLL_BULK_MAX + 1], *work_clone;
+	int cloned;
 
-	if (mrs < 1)
+	if (mrs < 1 || !(can_roll(work) && should_roll(work)))
 		return work;
 
-	cloned = false;
-	work_clone = make_clone(work);
-	while (mrs-- > 0 && can_roll(work) && should_roll(work)) {
-		applog(LOG_DEBUG, "Pushing rolled converted work to stage thread");
-		stage_work(work_clone);
-		roll_work(work);
-		work_clone = make_clone(work);
-		/* Roll it again to prevent duplicates should this be used
-		 * directly later on */
-		roll_work(work);
-		cloned = true;
-	}
-
-	if (cloned) {
-		stage_work(work);
-		return work_clone;
-	}
-
-	free_work(work_clone);
+	cloned = roll_work_bulk(work, clones, mrs);
+	if (!cloned)
+		return work;
 
-	return work;
+	/* Hand back the last clone, and stage the rest along with the
+	 * (further rollable) original */
+	work_clone = clones[cloned - 1];
+	clones[cloned - 1] = work;
+	applog(LOG_DEBUG, "Pushing %d rolled converted work to stage thread", cloned);
+	stage_work_batch(clones, cloned);
+	return work_clone;
 }
 
 void gen_hash(unsigned char *data, unsigned char *hash, int len)
@@ -10357,6 +10793,21 @@ static void gen_stratum_work(struct pool *pool, struct work *work)
 	cgtime(&work->tv_staged);
 }
 
+/* Caches the SHA256 state of the coinbase up to the last whole block before
+ * nonce2, so only the tail needs hashing for each new nonce2 */
+static
+void stratum_work_update_cb_midstate(struct stratum_work * const swork)
+{
+	const size_t prefixsz = swork->nonce2_offset - (swork->nonce2_offset % SHA256_BLOCK_SIZE);
+	sha256_ctx ctx;
+	
+	sha256_init(&ctx);
+	sha256_update(&ctx, bytes_buf(&swork->coinbase), prefixsz);
+	memcpy(swork->cb_midstate, ctx.h, sizeof(swork->cb_midstate));
+	swork->cb_midstate_len = prefixsz;
+	swork->cb_midstate_valid = true;
+}
+
 void gen_stratum_work2(struct work *work, struct stratum_work *swork)
 {
 	unsigned char *coinbase;
@@ -10364,6 +10815,9 @@ void gen_stratum_work2(struct work *work, struct stratum_work *swork)
 	/* Generate coinbase */
 	coinbase = bytes_buf(&swork->coinbase);
 	memcpy(&coinbase[swork->nonce2_offset], bytes_buf(&work->nonce2), bytes_len(&work->nonce2));
+	
+	if (!swork->cb_midstate_valid)
+		stratum_work_update_cb_midstate(swork);
 
 	/* Downgrade to a read lock to read off the variables */
 	if (swork->data_lock_p)
@@ -10392,7 +10846,21 @@ void gen_stratum_work3(struct work * const work, struct stratum_work * const swo
 	coinbase = bytes_buf(&swork->coinbase);
 	
 	/* Generate merkle root */
-	gen_hash(coinbase, merkle_root, bytes_len(&swork->coinbase));
+	if (swork->cb_midstate_valid)
+	{
+		const size_t prefixsz = swork->cb_midstate_len;
+		unsigned char hash1[32];
+		sha256_ctx ctx = {
+			.tot_len = prefixsz,
+			.len = 0,
+		};
+		memcpy(ctx.h, swork->cb_midstate, sizeof(ctx.h));
+		sha256_update(&ctx, &coinbase[prefixsz], bytes_len(&swork->coinbase) - prefixsz);
+		sha256_final(&ctx, hash1);
+		sha256(hash1, 32, merkle_root);
+	}
+	else
+		gen_hash(coinbase, merkle_root, bytes_len(&swork->coinbase));
 	memcpy(merkle_sha, merkle_root, 32);
 	merkle_bin = bytes_buf(&swork->merkle_bin);
 	for (i = 0; i < swork->merkles; ++i, merkle_bin += 32) {
@@ -10406,7 +10874,10 @@ void gen_stratum_work3(struct work * const work, struct stratum_work * const swo
 	
 	memcpy(&work->data[0], swork->header1, 36);
 	memcpy(&work->data[36], merkle_root, 32);
-	*((uint32_t*)&work->data[68]) = htobe32(swork->ntime + timer_elapsed(&swork->tv_received, NULL));
+	uint32_t ntime = swork->ntime + timer_elapsed(&swork->tv_received, NULL);
+	if (swork->tr && ntime > swork->ntime_roll_limits.max)
+		ntime = swork->ntime_roll_limits.max;
+	*((uint32_t*)&work->data[68]) = htobe32(ntime);
 	memcpy(&work->data[72], swork->diffbits, 4);
 	memset(&work->data[76], 0, 4);  // nonce
 	memcpy(&work->data[80], workpadding_bin, 48);
@@ -10432,6 +10903,10 @@ void gen_stratum_work3(struct work * const work, struct stratum_work * const swo
 		work->getwork_mode = GETWORK_MODE_GBT;
 		work->tr = swork->tr;
 		tmpl_incref(work->tr);
+		// stale_work uses rolltime as the expiry for GBT work
+		struct timeval tv_now;
+		timer_set_now(&tv_now);
+		work->rolltime = blkmk_time_left(work->tr->tmpl, tv_now.tv_sec);
 	}
 	calc_diff(work, 0);
 }
@@ -10456,6 +10931,26 @@ void request_work(struct thr_info *thr)
 	cgtime(&dev_stats->_get_start);
 }
 
+static
+void get_work_set_nonce_diff(struct cgpu_info * const cgpu, struct work * const work)
+{
+	if (work->work_difficulty < 1)
+	{
+		const float min_nonce_diff = drv_min_nonce_diff(cgpu->drv, cgpu, work_mining_algorithm(work));
+		if (unlikely(work->work_difficulty < min_nonce_diff))
+		{
+			if (min_nonce_diff - work->work_difficulty > 1./0x10000000)
+				applog(LOG_WARNING, "%"PRIpreprv": Using work with lower difficulty than device supports",
+				       cgpu->proc_repr);
+			work->nonce_diff = min_nonce_diff;
+		}
+		else
+			work->nonce_diff = work->work_difficulty;
+	}
+	else
+		work->nonce_diff = 1;
+}
+
 // FIXME: Make this non-blocking (and remove HACK above)
 struct work *get_work(struct thr_info *thr)
 {
@@ -10468,7 +10963,7 @@ struct work *get_work(struct thr_info *thr)
 
 	applog(LOG_DEBUG, "%"PRIpreprv": Popping work from get queue to get work", cgpu->proc_repr);
 	while (!work) {
-		work = hash_pop(cgpu);
+		work = hash_pop(cgpu, true);
 		if (stale_work(work, false)) {
 			staged_full = false;  // It wasn't really full, since it was stale :(
 			discard_work(work);
@@ -10512,35 +11007,52 @@ struct work *get_work(struct thr_info *thr)
 		pool_stats->getwork_wait_min = tv_get;
 	++pool_stats->getwork_calls;
 	
-	if (work->work_difficulty < 1)
-	{
-		const float min_nonce_diff = drv_min_nonce_diff(cgpu->drv, cgpu, work_mining_algorithm(work));
-		if (unlikely(work->work_difficulty < min_nonce_diff))
-		{
-			if (min_nonce_diff - work->work_difficulty > 1./0x10000000)
-				applog(LOG_WARNING, "%"PRIpreprv": Using work with lower difficulty than device supports",
-				       cgpu->proc_repr);
-			work->nonce_diff = min_nonce_diff;
-		}
-		else
-			work->nonce_diff = work->work_difficulty;
-	}
-	else
-		work->nonce_diff = 1;
+	get_work_set_nonce_diff(cgpu, work);
 
 	return work;
 }
 
-struct dupe_hash_elem {
-	uint8_t hash[0x20];
-	struct timeval tv_prune;
-	UT_hash_handle hh;
-};
-
-static
-void _submit_work_async(struct work *work)
+/* Like get_work, but returns NULL instead of waiting if no usable work is
+ * staged, so work can be fetched ahead of time while the device is busy */
+struct work *try_get_work(struct thr_info * const thr)
 {
-	applog(LOG_DEBUG, "Pushing submit work to work thread");
+	struct cgpu_info * const cgpu = thr->cgpu;
+	struct work *work;
+	
+	while (true)
+	{
+		work = hash_pop(cgpu, false);
+		if (!work)
+			return NULL;
+		if (!stale_work(work, false))
+			break;
+		staged_full = false;
+		discard_work(work);
+		wake_gws();
+	}
+	last_getwork = time(NULL);
+	applog(LOG_DEBUG, "%"PRIpreprv": Got work %d from get queue without waiting",
+	       cgpu->proc_repr, work->id);
+	
+	work->thr_id = thr->id;
+	work->mined = true;
+	work->blk.nonce = 0;
+	
+	get_work_set_nonce_diff(cgpu, work);
+	
+	return work;
+}
+
+struct dupe_hash_elem {
+	uint8_t hash[0x20];
+	struct timeval tv_prune;
+	UT_hash_handle hh;
+};
+
+static
+void _submit_work_async(struct work *work)
+{
+	applog(LOG_DEBUG, "Pushing submit work to work thread");
 	
 	if (opt_benchmark)
 	{
@@ -10628,8 +11140,13 @@ void inc_hw_errors3(struct thr_info *thr, const struct work *work, const uint32_
 	{
 		total_bad_diff1 += nonce_diff;
 		cgpu->bad_diff1 += nonce_diff;
+		++cgpu->nonces_found;
 	}
 	mutex_unlock(&stats_lock);
+	
+	if (bad_nonce_p)
+		bfg_tseries_add(cgpu, BTSM_NONCES, 1);
+	bfg_tseries_add(cgpu, BTSM_HW_ERRORS, 1);
 
 	if (thr->cgpu->drv->hw_error)
 		thr->cgpu->drv->hw_error(thr);
@@ -10658,13 +11175,76 @@ bool test_hash(const void * const phash, const float diff)
 	return (tmp_hash7 <= Htarg);
 }
 
-enum test_nonce2_result _test_nonce2(struct work *work, uint32_t nonce, bool checktarget)
+// Whether hashes for this work can be computed by sha256d_80_lanes
+static inline
+bool work_hashes_in_lanes(const struct work * const work)
 {
-	uint32_t *work_nonce = (uint32_t *)(work->data + 64 + 12);
-	*work_nonce = htole32(nonce);
+#ifdef USE_SHA256D
+	return (work_mining_algorithm(work)->algo == POW_SHA256D);
+#else
+	return false;
+#endif
+}
 
-	work_hash(work);
+// Sets up a sha256d_80_lanes lane to hash the work with the given nonce
+static
+void work_sha256d_lane(const struct work * const work, const uint32_t nonce, uint32_t * const midstate, uint32_t * const tail)
+{
+	const uint32_t * const midstate32 = (const uint32_t *)work->midstate;
+	const uint32_t * const data32 = (const uint32_t *)work->data;
+	
+	for (int i = 0; i < 8; ++i)
+		midstate[i] = le32toh(midstate32[i]);
+	for (int i = 0; i < 3; ++i)
+		tail[i] = le32toh(data32[16 + i]);
+	tail[3] = nonce;
+}
+
+/* Tests several candidate nonces for one work, setting out_good[i] if
+ * nonces[i] meets work->nonce_diff, and returns the number which do. Unlike
+ * test_nonce, the work itself is left unmodified. */
+unsigned test_nonce_candidates(const struct work * const work, const uint32_t * const nonces, bool * const out_good, const unsigned count)
+{
+	uint32_t midstates[SHA256D_LANES][8], tails[SHA256D_LANES][4];
+	union {
+		unsigned char c[SHA256D_LANES][SHA256_DIGEST_SIZE];
+		uint32_t i[SHA256D_LANES][SHA256_DIGEST_SIZE / 4];
+	} digests;
+	unsigned good = 0;
+	
+	if (!work_hashes_in_lanes(work))
+	{
+		const struct mining_algorithm * const malgo = work_mining_algorithm(work);
+		unsigned char data[sizeof(work->data)];
+		
+		memcpy(data, work->data, sizeof(data));
+		for (unsigned i = 0; i < count; ++i)
+		{
+			*(uint32_t *)&data[76] = htole32(nonces[i]);
+			malgo->hash_data_f(digests.c[0], data);
+			if ((out_good[i] = test_hash(digests.i[0], work->nonce_diff)))
+				++good;
+		}
+		return good;
+	}
 	
+	for (unsigned i = 0; i < count; i += SHA256D_LANES)
+	{
+		const unsigned n = min(count - i, SHA256D_LANES);
+		for (unsigned j = 0; j < n; ++j)
+			work_sha256d_lane(work, nonces[i + j], midstates[j], tails[j]);
+		sha256d_80_lanes(midstates, tails, digests.c, n);
+		for (unsigned j = 0; j < n; ++j)
+			if ((out_good[i + j] = test_hash(digests.i[j], work->nonce_diff)))
+				++good;
+	}
+	return good;
+}
+
+// Tests work->hash, which must already be set for the nonce in work->data
+static
+enum test_nonce2_result test_nonce2_hashed(struct work * const work, const bool checktarget)
+{
 	if (!test_hash(work->hash, work->nonce_diff))
 		return TNR_BAD;
 	
@@ -10693,12 +11273,24 @@ enum test_nonce2_result _test_nonce2(struct work *work, uint32_t nonce, bool che
 	return TNR_GOOD;
 }
 
+enum test_nonce2_result _test_nonce2(struct work *work, uint32_t nonce, bool checktarget)
+{
+	uint32_t *work_nonce = (uint32_t *)(work->data + 64 + 12);
+	*work_nonce = htole32(nonce);
+
+	work_hash(work);
+	
+	return test_nonce2_hashed(work, checktarget);
+}
+
 /* Returns true if nonce for work was a valid share */
 bool submit_nonce(struct thr_info *thr, struct work *work, uint32_t nonce)
 {
 	return submit_noffset_nonce(thr, work, nonce, 0);
 }
 
+static bool submit_nonce_copied(struct thr_info *, struct work *, uint32_t nonce, struct timeval *tvp_work_found, bool hashed);
+
 /* Allows drivers to submit work items where the driver has changed the ntime
  * value by noffset. Must be only used with a work protocol that does not ntime
  * roll itself intrinsically to generate work (eg stratum). We do not touch
@@ -10709,20 +11301,33 @@ bool submit_noffset_nonce(struct thr_info *thr, struct work *work_in, uint32_t n
 	struct work *work = make_work();
 	_copy_work(work, work_in, noffset);
 	
-	uint32_t *work_nonce = (uint32_t *)(work->data + 64 + 12);
 	struct timeval tv_work_found;
-	enum test_nonce2_result res;
-	bool ret = true;
+	bool ret;
 
 	thread_reportout(thr);
-
 	cgtime(&tv_work_found);
+	ret = submit_nonce_copied(thr, work, nonce, &tv_work_found, false);
+	thread_reportin(thr);
+
+	return ret;
+}
+
+/* Tests a nonce found for a private copy of the work (which it takes), and
+ * records the statistics and submits the share if it is valid. If hashed,
+ * work->hash has already been computed for the nonce. */
+static
+bool submit_nonce_copied(struct thr_info * const thr, struct work *work, const uint32_t nonce, struct timeval * const tvp_work_found, const bool hashed)
+{
+	uint32_t *work_nonce = (uint32_t *)(work->data + 64 + 12);
+	enum test_nonce2_result res;
+	bool ret = true;
+
 	*work_nonce = htole32(nonce);
 	work->thr_id = thr->id;
 
 	/* Do one last check before attempting to submit the work */
 	/* Side effect: sets work->data and work->hash for us */
-	res = test_nonce2(work, nonce);
+	res = hashed ? test_nonce2_hashed(work, true) : test_nonce2(work, nonce);
 	
 	if (unlikely(res == TNR_BAD))
 		{
@@ -10735,10 +11340,12 @@ bool submit_noffset_nonce(struct thr_info *thr, struct work *work_in, uint32_t n
 	total_diff1       += work->nonce_diff;
 	thr ->cgpu->diff1 += work->nonce_diff;
 	work->pool->diff1 += work->nonce_diff;
+	++thr->cgpu->nonces_found;
 	thr->cgpu->last_device_valid_work = time(NULL);
 	mutex_unlock(&stats_lock);
+	bfg_tseries_add(thr->cgpu, BTSM_NONCES, 1);
 	
-	if (noncelog_file)
+	if (noncelog_file || noncelog_binlog)
 		noncelog(work);
 	
 	if (res == TNR_HIGH)
@@ -10750,16 +11357,133 @@ bool submit_noffset_nonce(struct thr_info *thr, struct work *work_in, uint32_t n
 			goto out;
 	}
 	
-	submit_work_async2(work, &tv_work_found);
+	submit_work_async2(work, tvp_work_found);
 	work = NULL;  // Taken by submit_work_async2
 out:
 	if (work)
 		free_work(work);
-	thread_reportin(thr);
 
 	return ret;
 }
 
+/* Nonces submitted with submit_noffset_nonce_async are verified by a pool of
+ * --verify-threads workers, so the device thread only copies the work */
+struct verify_nonce_rec {
+	struct thr_info *thr;
+	struct work *work;
+	uint32_t nonce;
+	struct timeval tv_work_found;
+	bool hashed;
+	struct verify_nonce_rec *next;
+};
+
+#define VERIFY_BATCH_MAX  0x10
+
+static struct verify_nonce_rec *verify_queue, **verify_queue_tailp = &verify_queue;
+static pthread_mutex_t verify_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t verify_cond = PTHREAD_COND_INITIALIZER;
+static bool verify_threads_started;
+
+static
+void verify_nonce_hash_lanes(struct verify_nonce_rec ** const recs, const unsigned n)
+{
+	uint32_t midstates[SHA256D_LANES][8], tails[SHA256D_LANES][4];
+	unsigned char digests[SHA256D_LANES][SHA256_DIGEST_SIZE];
+	
+	for (unsigned i = 0; i < n; ++i)
+		work_sha256d_lane(recs[i]->work, recs[i]->nonce, midstates[i], tails[i]);
+	sha256d_80_lanes(midstates, tails, digests, n);
+	for (unsigned i = 0; i < n; ++i)
+	{
+		memcpy(recs[i]->work->hash, digests[i], sizeof(recs[i]->work->hash));
+		recs[i]->hashed = true;
+	}
+}
+
+static
+void *verify_nonce_thread(__maybe_unused void * const userp)
+{
+	struct verify_nonce_rec *batch, *rec, *tmp, *lanes[SHA256D_LANES];
+	unsigned lanes_used;
+	int n;
+
+	pthread_detach(pthread_self());
+	RenameThread("verify");
+
+	while (true)
+	{
+		// Take a batch at a time, to keep lock traffic down at high nonce rates
+		mutex_lock(&verify_lock);
+		while (!verify_queue)
+			pthread_cond_wait(&verify_cond, &verify_lock);
+		batch = rec = verify_queue;
+		for (n = 1; n < VERIFY_BATCH_MAX && rec->next; ++n)
+			rec = rec->next;
+		verify_queue = rec->next;
+		if (!verify_queue)
+			verify_queue_tailp = &verify_queue;
+		rec->next = NULL;
+		mutex_unlock(&verify_lock);
+
+		// SHA256d nonces are hashed several at a time before the usual checks
+		lanes_used = 0;
+		LL_FOREACH(batch, rec)
+		{
+			if (!work_hashes_in_lanes(rec->work))
+				continue;
+			lanes[lanes_used++] = rec;
+			if (lanes_used == SHA256D_LANES)
+			{
+				verify_nonce_hash_lanes(lanes, lanes_used);
+				lanes_used = 0;
+			}
+		}
+		if (lanes_used)
+			verify_nonce_hash_lanes(lanes, lanes_used);
+		
+		LL_FOREACH_SAFE(batch, rec, tmp)
+		{
+			submit_nonce_copied(rec->thr, rec->work, rec->nonce, &rec->tv_work_found, rec->hashed);
+			free(rec);
+		}
+	}
+	return NULL;
+}
+
+/* Like submit_noffset_nonce, but returns before testing the nonce when
+ * verification threads are enabled, so drivers which do not use the result
+ * are not held up hashing it */
+void submit_noffset_nonce_async(struct thr_info * const thr, struct work * const work_in, const uint32_t nonce, const int noffset)
+{
+	if (!opt_verify_threads)
+	{
+		submit_noffset_nonce(thr, work_in, nonce, noffset);
+		return;
+	}
+
+	struct verify_nonce_rec * const rec = malloc(sizeof(*rec));
+	*rec = (struct verify_nonce_rec){
+		.thr = thr,
+		.work = copy_work_noffset(work_in, noffset),
+		.nonce = nonce,
+	};
+	cgtime(&rec->tv_work_found);
+
+	mutex_lock(&verify_lock);
+	if (unlikely(!verify_threads_started))
+	{
+		pthread_t pth;
+		for (int i = 0; i < opt_verify_threads; ++i)
+			if (unlikely(pthread_create(&pth, NULL, verify_nonce_thread, NULL)))
+				quit(1, "Failed to create nonce verification thread");
+		verify_threads_started = true;
+	}
+	*verify_queue_tailp = rec;
+	verify_queue_tailp = &rec->next;
+	pthread_cond_signal(&verify_cond);
+	mutex_unlock(&verify_lock);
+}
+
 // return true of we should stop working on this piece of work
 // returning false means we will keep scanning for a nonce
 // assumptions: work->blk.nonce is the number of nonces completed in the work
@@ -10801,34 +11525,59 @@ void mt_disable_start(struct thr_info *mythr)
 	mythr->_mt_disable_called = true;
 }
 
-/* Put a new unqueued work item in cgpu->unqueued_work under cgpu->qlock till
- * the driver tells us it's full so that it may extract the work item using
- * the get_queued() function which adds it to the hashtable on
+static inline
+bool unqueued_work_full(const struct cgpu_info * const cgpu)
+{
+	return (cgpu->unqueued_head - cgpu->unqueued_tail >= UNQUEUED_WORK_RING_SZ);
+}
+
+/* Only fill_queue may call this, since the ring has a single producer */
+static
+bool unqueued_work_push(struct cgpu_info * const cgpu, struct work * const work)
+{
+	const unsigned head = cgpu->unqueued_head;
+
+	if (unqueued_work_full(cgpu))
+		return false;
+	/* Don't overwrite the slot before the consumer is done reading it */
+	__sync_synchronize();
+	cgpu->unqueued_work[head % UNQUEUED_WORK_RING_SZ] = work;
+	/* Publish the slot before the new head */
+	__sync_synchronize();
+	cgpu->unqueued_head = head + 1;
+	return true;
+}
+
+static
+struct work *unqueued_work_pop(struct cgpu_info * const cgpu)
+{
+	struct work *work;
+	unsigned tail;
+
+	do {
+		tail = cgpu->unqueued_tail;
+		if (tail == cgpu->unqueued_head)
+			return NULL;
+		__sync_synchronize();
+		work = cgpu->unqueued_work[tail % UNQUEUED_WORK_RING_SZ];
+	} while (!__sync_bool_compare_and_swap(&cgpu->unqueued_tail, tail, tail + 1));
+	return work;
+}
+
+/* Put new unqueued work items in the cgpu->unqueued_work ring till the
+ * driver tells us it's full so that it may extract the work items using
+ * the get_queued() function which adds them to the hashtable on
  * cgpu->queued_work. */
 static void fill_queue(struct thr_info *mythr, struct cgpu_info *cgpu, struct device_drv *drv, const int thr_id)
 {
 	thread_reportout(mythr);
 	do {
-		bool need_work;
-
-		/* Do this lockless just to know if we need more unqueued work. */
-		need_work = (!cgpu->unqueued_work);
-
-		/* get_work is a blocking function so do it outside of lock
-		 * to prevent deadlocks with other locks. */
-		if (need_work) {
+		/* get_work is a blocking function, so only call it when
+		 * there is room to hand the work over. */
+		if (!unqueued_work_full(cgpu)) {
 			struct work *work = get_work(mythr);
 
-			wr_lock(&cgpu->qlock);
-			/* Check we haven't grabbed work somehow between
-			 * checking and picking up the lock. */
-			if (likely(!cgpu->unqueued_work))
-				cgpu->unqueued_work = work;
-			else
-				need_work = false;
-			wr_unlock(&cgpu->qlock);
-
-			if (unlikely(!need_work))
+			if (unlikely(!unqueued_work_push(cgpu, work)))
 				discard_work(work);
 		}
 		/* The queue_full function should be used by the driver to
@@ -10842,6 +11591,37 @@ void __add_queued(struct cgpu_info *cgpu, struct work *work)
 {
 	cgpu->queued_count++;
 	HASH_ADD_INT(cgpu->queued_work, id, work);
+	memcpy(work->queued_midstate_key, work->midstate, 0x20);
+	memcpy(&work->queued_midstate_key[0x20], &work->data[0x40], 0xc);
+	HASH_ADD(hh_midstate, cgpu->queued_work_bymidstate, queued_midstate_key, WORK_QUEUED_MIDSTATE_KEY_SZ, work);
+	work->queued_subid_indexed = false;
+}
+
+/* Sets work->subid on a queued work item and indexes it for the *_bysubid
+ * lookups. If another queued item has the same subid, (eg, because the
+ * device's job ids wrapped around) it is no longer found by subid. */
+void __set_queued_work_subid(struct cgpu_info *cgpu, struct work *work, int subid)
+{
+	struct work *old;
+
+	if (work->queued_subid_indexed)
+		HASH_DELETE(hh_subid, cgpu->queued_work_bysubid, work);
+	HASH_FIND(hh_subid, cgpu->queued_work_bysubid, &subid, sizeof(subid), old);
+	if (old)
+	{
+		HASH_DELETE(hh_subid, cgpu->queued_work_bysubid, old);
+		old->queued_subid_indexed = false;
+	}
+	work->subid = subid;
+	HASH_ADD(hh_subid, cgpu->queued_work_bysubid, subid, sizeof(work->subid), work);
+	work->queued_subid_indexed = true;
+}
+
+void set_queued_work_subid(struct cgpu_info *cgpu, struct work *work, int subid)
+{
+	wr_lock(&cgpu->qlock);
+	__set_queued_work_subid(cgpu, work, subid);
+	wr_unlock(&cgpu->qlock);
 }
 
 /* This function is for retrieving one work item from the unqueued pointer and
@@ -10849,19 +11629,18 @@ void __add_queued(struct cgpu_info *cgpu, struct work *work)
  * able to handle NULL as a return which implies there is no work available. */
 struct work *get_queued(struct cgpu_info *cgpu)
 {
-	struct work *work = NULL;
+	struct work *work = unqueued_work_pop(cgpu);
 
-	wr_lock(&cgpu->qlock);
-	if (cgpu->unqueued_work) {
-		work = cgpu->unqueued_work;
-		if (unlikely(stale_work(work, false))) {
-			discard_work(work);
-			work = NULL;
-			wake_gws();
-		} else
-			__add_queued(cgpu, work);
-		cgpu->unqueued_work = NULL;
+	if (!work)
+		return NULL;
+	if (unlikely(stale_work(work, false))) {
+		discard_work(work);
+		wake_gws();
+		return NULL;
 	}
+
+	wr_lock(&cgpu->qlock);
+	__add_queued(cgpu, work);
 	wr_unlock(&cgpu->qlock);
 
 	return work;
@@ -10903,6 +11682,23 @@ struct work *__find_work_bymidstate(struct work *que, char *midstate, size_t mid
 	return ret;
 }
 
+/* Uses the midstate index for the common values, and otherwise falls back to
+ * searching the whole queue. The caller must hold cgpu->qlock. */
+static
+struct work *__find_queued_work_bymidstate(struct cgpu_info *cgpu, char *midstate, size_t midstatelen, char *data, int offset, size_t datalen)
+{
+	unsigned char key[WORK_QUEUED_MIDSTATE_KEY_SZ];
+	struct work *ret;
+
+	if (!(midstatelen == 0x20 && offset == 0x40 && datalen == 0xc))
+		return __find_work_bymidstate(cgpu->queued_work, midstate, midstatelen, data, offset, datalen);
+
+	memcpy(key, midstate, 0x20);
+	memcpy(&key[0x20], data, 0xc);
+	HASH_FIND(hh_midstate, cgpu->queued_work_bymidstate, key, sizeof(key), ret);
+	return ret;
+}
+
 /* This function is for finding an already queued work item in the
  * device's queued_work hashtable. Code using this function must be able
  * to handle NULL as a return which implies there is no matching work.
@@ -10912,7 +11708,7 @@ struct work *find_queued_work_bymidstate(struct cgpu_info *cgpu, char *midstate,
 	struct work *ret;
 
 	rd_lock(&cgpu->qlock);
-	ret = __find_work_bymidstate(cgpu->queued_work, midstate, midstatelen, data, offset, datalen);
+	ret = __find_queued_work_bymidstate(cgpu, midstate, midstatelen, data, offset, datalen);
 	rd_unlock(&cgpu->qlock);
 
 	return ret;
@@ -10923,7 +11719,30 @@ struct work *clone_queued_work_bymidstate(struct cgpu_info *cgpu, char *midstate
 	struct work *work, *ret = NULL;
 
 	rd_lock(&cgpu->qlock);
-	work = __find_work_bymidstate(cgpu->queued_work, midstate, midstatelen, data, offset, datalen);
+	work = __find_queued_work_bymidstate(cgpu, midstate, midstatelen, data, offset, datalen);
+	if (work)
+		ret = copy_work(work);
+	rd_unlock(&cgpu->qlock);
+
+	return ret;
+}
+
+/* Finds a queued work item by the subid set with __set_queued_work_subid.
+ * The caller must hold cgpu->qlock. */
+struct work *__find_queued_work_bysubid(struct cgpu_info *cgpu, int subid)
+{
+	struct work *ret;
+
+	HASH_FIND(hh_subid, cgpu->queued_work_bysubid, &subid, sizeof(subid), ret);
+	return ret;
+}
+
+struct work *clone_queued_work_bysubid(struct cgpu_info *cgpu, int subid)
+{
+	struct work *work, *ret = NULL;
+
+	rd_lock(&cgpu->qlock);
+	work = __find_queued_work_bysubid(cgpu, subid);
 	if (work)
 		ret = copy_work(work);
 	rd_unlock(&cgpu->qlock);
@@ -10935,6 +11754,12 @@ void __work_completed(struct cgpu_info *cgpu, struct work *work)
 {
 	cgpu->queued_count--;
 	HASH_DEL(cgpu->queued_work, work);
+	HASH_DELETE(hh_midstate, cgpu->queued_work_bymidstate, work);
+	if (work->queued_subid_indexed)
+	{
+		HASH_DELETE(hh_subid, cgpu->queued_work_bysubid, work);
+		work->queued_subid_indexed = false;
+	}
 }
 
 /* This iterates over a queued hashlist finding work started more than secs
@@ -10978,7 +11803,7 @@ struct work *take_queued_work_bymidstate(struct cgpu_info *cgpu, char *midstate,
 	struct work *work;
 
 	wr_lock(&cgpu->qlock);
-	work = __find_work_bymidstate(cgpu->queued_work, midstate, midstatelen, data, offset, datalen);
+	work = __find_queued_work_bymidstate(cgpu, midstate, midstatelen, data, offset, datalen);
 	if (work)
 		__work_completed(cgpu, work);
 	wr_unlock(&cgpu->qlock);
@@ -10986,16 +11811,26 @@ struct work *take_queued_work_bymidstate(struct cgpu_info *cgpu, char *midstate,
 	return work;
 }
 
-void flush_queue(struct cgpu_info *cgpu)
+/* Combines finding a queued work item by subid and work_completed, withOUT
+ * destroying the work so the driver must free it. */
+struct work *take_queued_work_bysubid(struct cgpu_info *cgpu, int subid)
 {
-	struct work *work = NULL;
+	struct work *work;
 
 	wr_lock(&cgpu->qlock);
-	work = cgpu->unqueued_work;
-	cgpu->unqueued_work = NULL;
+	work = __find_queued_work_bysubid(cgpu, subid);
+	if (work)
+		__work_completed(cgpu, work);
 	wr_unlock(&cgpu->qlock);
 
-	if (work) {
+	return work;
+}
+
+void flush_queue(struct cgpu_info *cgpu)
+{
+	struct work *work;
+
+	while ((work = unqueued_work_pop(cgpu))) {
 		free_work(work);
 		applog(LOG_DEBUG, "Discarded queued work item");
 	}
@@ -11067,6 +11902,8 @@ void mt_disable_finish(struct thr_info *mythr)
 	__thr_being_msg(LOG_WARNING, mythr, "being re-enabled");
 	if (drv->thread_enable)
 		drv->thread_enable(mythr);
+	// Restarts while disabled are not counted toward restart latency
+	timer_unset(&mythr->tv_restart);
 	mythr->_mt_disable_called = false;
 }
 
@@ -11707,6 +12544,13 @@ void bfg_watchdog(struct cgpu_info * const cgpu, struct timeval * const tvp_now)
 			if (cgpu->drv->watchdog)
 				cgpu->drv->watchdog(cgpu, tvp_now);
 			
+			// Sampled every pass, so the series averages over each interval
+			if (cgpu->temp > 0)
+				bfg_tseries_add(cgpu, BTSM_TEMP, cgpu->temp);
+			
+			if (cgpu->autotune && cgpu->deven == DEV_ENABLED)
+				bfg_autotune_poll(cgpu, tvp_now);
+			
 			/* Thread is disabled */
 			if (*denable == DEV_DISABLED)
 				return;
@@ -11937,10 +12781,17 @@ void _bfg_clean_up(bool restarting)
 #endif
 #ifdef HAVE_LIBUSB
 	if (likely(have_libusb))
-        libusb_exit(NULL);
+	{
+		usb_async_thread_stop();
+		libusb_exit(NULL);
+	}
 #endif
 
 	cgtime(&total_tv_end);
+	if (sharelog_binlog)
+		bfg_binlog_close(sharelog_binlog);
+	if (noncelog_binlog)
+		bfg_binlog_close(noncelog_binlog);
 #ifdef WIN32
 	timeEndPeriod(1);
 #endif
@@ -12398,6 +13249,10 @@ void register_device(struct cgpu_info *cgpu)
 
 	rwlock_init(&cgpu->qlock);
 	cgpu->queued_work = NULL;
+	cgpu->queued_work_bymidstate = NULL;
+	cgpu->queued_work_bysubid = NULL;
+	cgpu->unqueued_head = cgpu->unqueued_tail = 0;
+	cgpu->tseries = bfg_tseries_new();
 }
 
 struct _cgpu_devid_counter {
@@ -12483,9 +13338,175 @@ extern struct sigaction pcwm_orig_term_handler;
 #endif
 
 bool bfg_need_detect_rescan;
-extern void probe_device(struct lowlevel_device_info *);
 static void schedule_rescan(const struct timeval *);
 
+#ifdef HAVE_BFG_LOWLEVEL
+static void probe_devices(struct lowlevel_device_info *);
+struct probe_cache_entry {
+	char *key;
+	char *dname;
+	UT_hash_handle hh;
+};
+
+static struct probe_cache_entry *probe_cache;
+static pthread_mutex_t probe_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+static bool probe_cache_loaded, probe_cache_dirty;
+
+// Identifies a device across restarts, where possible independently of its bus address
+static
+bool probe_cache_key(char * const key, const size_t keysz, const struct lowlevel_device_info * const info)
+{
+	int n;
+	if (info->serial && info->serial[0])
+		n = snprintf(key, keysz, "%s %04x:%04x %s", info->lowl->dname, (unsigned)info->vid, (unsigned)info->pid, info->serial);
+	else
+	if (info->path)
+		n = snprintf(key, keysz, "%s path %s", info->lowl->dname, info->path);
+	else
+		n = snprintf(key, keysz, "%s devid %s", info->lowl->dname, info->devid);
+	if (n < 0 || n >= keysz)
+		return false;
+	return !key[strcspn(key, "\t\r\n")];
+}
+
+// Must hold probe_cache_mutex
+static
+void _probe_cache_set(const char * const key, const char * const dname)
+{
+	struct probe_cache_entry *pce;
+	HASH_FIND_STR(probe_cache, key, pce);
+	if (pce)
+	{
+		if (!strcmp(pce->dname, dname))
+			return;
+		free(pce->dname);
+	}
+	else
+	{
+		pce = malloc(sizeof(*pce));
+		pce->key = strdup(key);
+		HASH_ADD_KEYPTR(hh, probe_cache, pce->key, strlen(pce->key), pce);
+	}
+	pce->dname = strdup(dname);
+	probe_cache_dirty = true;
+}
+
+static
+void probe_cache_load()
+{
+	char buf[0x200];
+	
+	if (!opt_probe_cache)
+		return;
+	mutex_lock(&probe_cache_mutex);
+	if (probe_cache_loaded)
+		goto out;
+	probe_cache_loaded = true;
+	FILE * const F = fopen(opt_probe_cache, "r");
+	if (!F)
+	{
+		if (errno != ENOENT)
+			applog(LOG_WARNING, "Failed to open probe cache %s: %s", opt_probe_cache, bfg_strerror(errno, BST_ERRNO));
+		goto out;
+	}
+	while (fgets(buf, sizeof(buf), F))
+	{
+		char * const tab = strchr(buf, '\t');
+		if (!tab)
+			continue;
+		*tab = '\0';
+		char * const dname = &tab[1];
+		dname[strcspn(dname, "\r\n")] = '\0';
+		_probe_cache_set(buf, dname);
+	}
+	fclose(F);
+	applog(LOG_DEBUG, "Loaded %u entries from probe cache %s", (unsigned)HASH_COUNT(probe_cache), opt_probe_cache);
+	probe_cache_dirty = false;
+out:
+	mutex_unlock(&probe_cache_mutex);
+}
+
+static
+void probe_cache_save()
+{
+	struct probe_cache_entry *pce, *tmp;
+	
+	if (!opt_probe_cache)
+		return;
+	mutex_lock(&probe_cache_mutex);
+	if (!probe_cache_dirty)
+		goto out;
+	{
+		char tmpfn[strlen(opt_probe_cache) + 5];
+		sprintf(tmpfn, "%s.tmp", opt_probe_cache);
+		FILE * const F = fopen(tmpfn, "w");
+		if (!F)
+		{
+			applog(LOG_WARNING, "Failed to write probe cache %s: %s", tmpfn, bfg_strerror(errno, BST_ERRNO));
+			goto out;
+		}
+		HASH_ITER(hh, probe_cache, pce, tmp)
+		{
+			fprintf(F, "%s\t%s\n", pce->key, pce->dname);
+		}
+		if (fclose(F))
+		{
+			applog(LOG_WARNING, "Failed to write probe cache %s: %s", tmpfn, bfg_strerror(errno, BST_ERRNO));
+			goto out;
+		}
+#ifdef WIN32
+		unlink(opt_probe_cache);
+#endif
+		if (rename(tmpfn, opt_probe_cache))
+			applog(LOG_WARNING, "Failed to replace probe cache %s: %s", opt_probe_cache, bfg_strerror(errno, BST_ERRNO));
+		else
+			probe_cache_dirty = false;
+	}
+out:
+	mutex_unlock(&probe_cache_mutex);
+}
+
+static
+void probe_cache_record(const struct lowlevel_device_info * const info, const struct device_drv * const drv)
+{
+	char key[0x100];
+	
+	if (!opt_probe_cache)
+		return;
+	if (!probe_cache_key(key, sizeof(key), info))
+		return;
+	mutex_lock(&probe_cache_mutex);
+	_probe_cache_set(key, drv->dname);
+	mutex_unlock(&probe_cache_mutex);
+}
+
+static
+const struct device_drv *probe_cache_lookup(const struct lowlevel_device_info * const info)
+{
+	struct probe_cache_entry *pce;
+	struct driver_registration *dreg;
+	char key[0x100], *dname = NULL;
+	
+	if (!opt_probe_cache)
+		return NULL;
+	if (!probe_cache_key(key, sizeof(key), info))
+		return NULL;
+	mutex_lock(&probe_cache_mutex);
+	HASH_FIND_STR(probe_cache, key, pce);
+	if (pce)
+		dname = strdup(pce->dname);
+	mutex_unlock(&probe_cache_mutex);
+	if (!dname)
+		return NULL;
+	
+	BFG_FOREACH_DRIVER_BY_DNAME(dreg)
+		if (!strcmp(dreg->drv->dname, dname))
+			break;
+	free(dname);
+	return dreg ? dreg->drv : NULL;
+}
+#endif
+
 static
 void drv_detect_all()
 {
@@ -12494,12 +13515,10 @@ rescan:
 	bfg_need_detect_rescan = false;
 	
 #ifdef HAVE_BFG_LOWLEVEL
-	struct lowlevel_device_info * const infolist = lowlevel_scan(), *info, *infotmp;
+	struct lowlevel_device_info * const infolist = lowlevel_scan();
 	
-	LL_FOREACH_SAFE(infolist, info, infotmp)
-		probe_device(info);
-	LL_FOREACH_SAFE(infolist, info, infotmp)
-		pthread_join(info->probe_pth, NULL);
+	probe_devices(infolist);
+	probe_cache_save();
 #endif
 	
 	struct driver_registration *reg;
@@ -12579,6 +13598,8 @@ void allocate_cgpu(struct cgpu_info *cgpu, unsigned int *kp)
 		thr->device_thread = j;
 		thr->work_restart_notifier[1] = INVSOCK;
 		thr->mutex_request[1] = INVSOCK;
+		thr->notifier_epfd = -1;
+		thr->poll_fd = thr->poll_fd_epfd = -1;
 		thr->_job_transition_in_progress = true;
 		timerclear(&thr->tv_morework);
 
@@ -12587,6 +13608,7 @@ void allocate_cgpu(struct cgpu_info *cgpu, unsigned int *kp)
 		timerclear(&thr->tv_hashes_done);
 		cgtime(&thr->tv_lastupdate);
 		thr->tv_poll.tv_sec = -1;
+		timer_unset(&thr->tv_restart);
 		thr->_max_nonce = api->can_limit_work ? api->can_limit_work(thr) : 0xffffffff;
 
 		cgpu->thr[j] = thr;
@@ -12685,7 +13707,10 @@ bool _probe_device_do_probe(const struct device_drv * const drv, const struct lo
 	if (drv->lowl_probe(info))
 	{
 		if (!(bfg_probe_result_flags & BPR_CONTINUE_PROBES))
+		{
+			probe_cache_record(info, drv);
 			return true;
+		}
 	}
 	else
 	if (request_rescan_p && opt_hotplug && !(bfg_probe_result_flags & BPR_DONT_RESCAN))
@@ -12693,10 +13718,73 @@ bool _probe_device_do_probe(const struct device_drv * const drv, const struct lo
 	return false;
 }
 
+// Check for "noauto" flag
+// NOTE: driver-specific configuration overrides general
+static
+bool _probe_device_doauto(const struct device_drv * const drv)
+{
+	struct string_elist *sd_iter, *sd_tmp;
+	bool doauto = true;
+	DL_FOREACH_SAFE(scan_devices, sd_iter, sd_tmp)
+	{
+		const char * const dname = sd_iter->string;
+		// NOTE: Only checking flags here, NOT path/serial, so @ is unacceptable
+		const char *colon = strchr(dname, ':');
+		if (!colon)
+			colon = &dname[-1];
+		if (strcasecmp("noauto", &colon[1]) && strcasecmp("auto", &colon[1]))
+			continue;
+		const ssize_t dnamelen = (colon - dname);
+		if (dnamelen >= 0) {
+			char dname_nt[dnamelen + 1];
+			memcpy(dname_nt, dname, dnamelen);
+			dname_nt[dnamelen] = '\0';
+			
+			if (strcasecmp(drv->dname, dname_nt) && strcasecmp(drv->name, dname_nt))
+				continue;
+		}
+		doauto = (tolower(colon[1]) == 'a');
+		if (dnamelen != -1)
+			break;
+	}
+	return doauto;
+}
+
+// Would the 'all' scan entries probe this driver on this device?
+static
+bool _probe_device_all_p(const struct device_drv * const drv, const struct lowlevel_device_info * const info)
+{
+	struct string_elist *sd_iter;
+	DL_FOREACH(scan_devices, sd_iter)
+	{
+		const char * const dname = sd_iter->string;
+		const char * const colon = strchr(dname, ':');
+		if (!colon)
+		{
+			if (drv->lowl_probe_by_name_only)
+				continue;
+			if (
+#ifdef NEED_BFG_LOWL_VCOM
+				(info->lowl == &lowl_vcom && !strcasecmp(dname, "all")) ||
+#endif
+				_probe_device_match(info, (dname[0] == '@') ? &dname[1] : dname))
+				return true;
+			continue;
+		}
+		if (strcasecmp(&colon[1], "all") || info->lowl->exclude_from_all)
+			continue;
+		const size_t dnamelen = (colon - dname);
+		if ((!strncasecmp(drv->dname, dname, dnamelen) && !drv->dname[dnamelen])
+		 || (!strncasecmp(drv->name, dname, dnamelen) && !drv->name[dnamelen]))
+			return true;
+	}
+	return false;
+}
+
 bool dummy_check_never_true = false;
 
 static
-void *probe_device_thread(void *p)
+void *_probe_device_thread(void *p)
 {
 	struct lowlevel_device_info * const infolist = p;
 	struct lowlevel_device_info *info = infolist;
@@ -12745,6 +13833,19 @@ void *probe_device_thread(void *p)
 		}
 	}
 	
+	// probe the driver that claimed this device last time, if it would have been probed anyway
+	LL_FOREACH2(infolist, info, same_devid_next)
+	{
+		const struct device_drv * const drv = probe_cache_lookup(info);
+		if (!(drv && drv->lowl_probe && drv_algo_check(drv)))
+			continue;
+		if (!((drv->lowl_match && _probe_device_doauto(drv) && drv->lowl_match(info)) || _probe_device_all_p(drv, info)))
+			continue;
+		applog(LOG_DEBUG, "%s: Probing %s first for %s, from probe cache", __func__, drv->dname, info->devid);
+		if (_probe_device_do_probe(drv, info, NULL))
+			return NULL;
+	}
+	
 	// probe driver(s) with auto enabled and matching VID/PID/Product/etc of device
 	BFG_FOREACH_DRIVER_BY_PRIORITY(dreg)
 	{
@@ -12753,33 +13854,7 @@ void *probe_device_thread(void *p)
 		if (!drv_algo_check(drv))
 			continue;
 		
-		// Check for "noauto" flag
-		// NOTE: driver-specific configuration overrides general
-		bool doauto = true;
-		DL_FOREACH_SAFE(scan_devices, sd_iter, sd_tmp)
-		{
-			const char * const dname = sd_iter->string;
-			// NOTE: Only checking flags here, NOT path/serial, so @ is unacceptable
-			const char *colon = strchr(dname, ':');
-			if (!colon)
-				colon = &dname[-1];
-			if (strcasecmp("noauto", &colon[1]) && strcasecmp("auto", &colon[1]))
-				continue;
-			const ssize_t dnamelen = (colon - dname);
-			if (dnamelen >= 0) {
-				char dname_nt[dnamelen + 1];
-				memcpy(dname_nt, dname, dnamelen);
-				dname_nt[dnamelen] = '\0';
-				
-				if (strcasecmp(drv->dname, dname_nt) && strcasecmp(drv->name, dname_nt))
-					continue;
-			}
-			doauto = (tolower(colon[1]) == 'a');
-			if (dnamelen != -1)
-				break;
-		}
-		
-		if (doauto && drv->lowl_match)
+		if (_probe_device_doauto(drv) && drv->lowl_match)
 		{
 			LL_FOREACH2(infolist, info, same_devid_next)
 			{
@@ -12877,9 +13952,60 @@ void *probe_device_thread(void *p)
 	return NULL;
 }
 
-void probe_device(struct lowlevel_device_info * const info)
+struct probe_queue {
+	pthread_mutex_t mutex;
+	struct lowlevel_device_info *next;
+};
+
+// Each worker probes devices from the queue until it is empty
+static
+void *probe_worker_thread(void * const p)
 {
-	pthread_create(&info->probe_pth, NULL, probe_device_thread, info);
+	struct probe_queue * const pq = p;
+	struct lowlevel_device_info *info;
+	
+	while (true)
+	{
+		mutex_lock(&pq->mutex);
+		info = pq->next;
+		if (info)
+			pq->next = info->next;
+		mutex_unlock(&pq->mutex);
+		if (!info)
+			break;
+		_probe_device_thread(info);
+	}
+	return NULL;
+}
+
+// Probes every device in the list, with up to opt_probe_threads workers (0 = one per device), and waits for them all
+static
+void probe_devices(struct lowlevel_device_info * const infolist)
+{
+	struct probe_queue pq = {
+		.next = infolist,
+	};
+	struct lowlevel_device_info *info;
+	int workers = 0, i;
+	
+	LL_FOREACH(infolist, info)
+		++workers;
+	if (opt_probe_threads && workers > opt_probe_threads)
+		workers = opt_probe_threads;
+	if (!workers)
+		return;
+	
+	probe_cache_load();
+	mutex_init(&pq.mutex);
+	pthread_t pths[workers];
+	for (i = 0; i < workers; ++i)
+		if (unlikely(pthread_create(&pths[i], NULL, probe_worker_thread, &pq)))
+			break;
+	if (unlikely(!i))
+		probe_worker_thread(&pq);
+	while (i--)
+		pthread_join(pths[i], NULL);
+	mutex_destroy(&pq.mutex);
 }
 #endif
 
@@ -12973,6 +14099,51 @@ int scan_serial(const char *s)
 	return create_new_cgpus(_scan_serial, (void*)s);
 }
 
+#ifdef HAVE_BFG_LOWLEVEL
+struct hotplug_probe_info {
+	struct string_elist *targets;
+	const struct timeval *tvp_event;
+};
+
+static
+void _hotplug_probe(void * const p)
+{
+	struct hotplug_probe_info * const hpi = p;
+	struct string_elist *iter;
+	struct lowlevel_device_info *infolist;
+	
+	bfg_need_detect_rescan = false;
+	DL_FOREACH(hpi->targets, iter)
+	{
+		infolist = lowlevel_scan_one(iter->string);
+		if (!infolist)
+			applog(LOG_DEBUG, "%s: Nothing found for %s", __func__, iter->string);
+		probe_devices(infolist);
+		lowlevel_scan_free();
+	}
+	probe_cache_save();
+	
+	for (int i = 0; i < total_devices_new; ++i)
+		devices_new[i]->tv_hotplugged = *hpi->tvp_event;
+}
+
+// Probes only the listed hotplugged devices (devnodes or USB devids); returns false if a full rescan is still needed
+static
+bool hotplug_probe(struct string_elist * const targets, const struct timeval * const tvp_event)
+{
+	struct hotplug_probe_info hpi = {
+		.targets = targets,
+		.tvp_event = tvp_event,
+	};
+	
+	if (!create_new_cgpus(_hotplug_probe, &hpi))
+		return false;
+	if (bfg_need_detect_rescan)
+		return false;
+	return true;
+}
+#endif
+
 static pthread_mutex_t rescan_mutex = PTHREAD_MUTEX_INITIALIZER;
 static bool rescan_active;
 static struct timeval tv_rescan;
@@ -13064,6 +14235,53 @@ void hotplug_trigger()
 
 #if defined(HAVE_LIBUDEV) && defined(HAVE_SYS_EPOLL_H)
 
+#ifdef HAVE_BFG_LOWLEVEL
+// Adds the device to targets if it can be probed on its own; returns false if a full rescan is needed instead
+static
+bool hotplug_udev_target(struct udev_device * const device, struct string_elist ** const targets)
+{
+	const char * const subsystem = udev_device_get_subsystem(device);
+	const char * const devtype = udev_device_get_devtype(device);
+	struct string_elist *iter;
+	char *target;
+	
+	if (!subsystem)
+		return false;
+	if (!strcmp(subsystem, "tty"))
+	{
+		const char * const devnode = udev_device_get_devnode(device);
+		if (!devnode)
+			return false;
+		target = strdup(devnode);
+	}
+	else
+	if (!strcmp(subsystem, "usb"))
+	{
+		// Interfaces are covered by their parent usb_device event
+		if (!(devtype && !strcmp(devtype, "usb_device")))
+			return true;
+		const char * const busnum = udev_device_get_sysattr_value(device, "busnum");
+		const char * const devnum = udev_device_get_sysattr_value(device, "devnum");
+		if (!(busnum && devnum))
+			return false;
+		target = bfg_make_devid_usb(atoi(busnum), atoi(devnum));
+	}
+	else
+		return false;
+	
+	DL_FOREACH((*targets), iter)
+		if (!strcmp(iter->string, target))
+			break;
+	if (!iter)
+	{
+		applog(LOG_DEBUG, "%s: Will probe %s", __func__, target);
+		string_elist_add(target, targets);
+	}
+	free(target);
+	return true;
+}
+#endif
+
 static
 void *hotplug_thread(__maybe_unused void *p)
 {
@@ -13093,7 +14311,9 @@ void *hotplug_thread(__maybe_unused void *p)
 	
 	struct epoll_event ev;
 	int rv;
-	bool pending = false;
+	bool pending = false, pending_full = false;
+	struct string_elist *targets = NULL, *iter, *tmp;
+	struct timeval tv_event;
 	while (true)
 	{
 		rv = epoll_wait(epfd, &ev, 1, pending ? hotplug_delay_ms : -1);
@@ -13105,8 +14325,15 @@ void *hotplug_thread(__maybe_unused void *p)
 		}
 		if (!rv)
 		{
-			hotplug_trigger();
-			pending = false;
+#ifdef HAVE_BFG_LOWLEVEL
+			if (pending_full || !hotplug_probe(targets, &tv_event))
+#endif
+				hotplug_trigger();
+			DL_FOREACH_SAFE(targets, iter, tmp)
+			{
+				string_elist_del(&targets, iter);
+			}
+			pending = pending_full = false;
 			continue;
 		}
 		struct udev_device * const device = udev_monitor_receive_device(mon);
@@ -13115,7 +14342,17 @@ void *hotplug_thread(__maybe_unused void *p)
 		const char * const action = udev_device_get_action(device);
 		applog(LOG_DEBUG, "%s: Received %s event", __func__, action);
 		if (!strcmp(action, "add"))
+		{
+			if (!pending)
+				timer_set_now(&tv_event);
 			pending = true;
+#ifdef HAVE_BFG_LOWLEVEL
+			if (!pending_full)
+				pending_full = !hotplug_udev_target(device, &targets);
+#else
+			pending_full = true;
+#endif
+		}
 		udev_device_unref(device);
 	}
 	
@@ -13825,7 +15062,7 @@ begin_bench:
 
 	/* Once everything is set up, main() becomes the getwork scheduler */
 	while (42) {
-		int ts, max_staged = opt_queue;
+		int ts, max_staged;
 		struct pool *pool, *cp;
 		bool lagging = false;
 		struct curl_ent *ce;
@@ -13834,10 +15071,9 @@ begin_bench:
 
 		cp = current_pool();
 
-		// Generally, each processor needs a new work, and all at once during work restarts
-		max_staged += base_queue;
-
 		mutex_lock(stgd_lock);
+		// Generally, each processor needs a new work, and all at once during work restarts
+		max_staged = base_queue + __queue_target_total();
 		ts = __total_staged(false);
 
 		if (!pool_localgen(cp) && !ts && !opt_fail_only)
@@ -13852,7 +15088,7 @@ begin_bench:
 						continue;
 					if (!malgo->base_queue)
 						continue;
-					if (malgo->staged < malgo->base_queue + opt_queue)
+					if (malgo->staged < malgo->base_queue + __malgo_queue_target(malgo))
 					{
 						mutex_unlock(stgd_lock);
 						pool = select_pool(lagging, malgo);
@@ -13901,6 +15137,26 @@ retry:
 			continue;
 		}
 
+#if BLKMAKER_VERSION > 6
+		if (want_gbt_localgen && pool->proto == PLP_GETBLOCKTEMPLATE && pool_has_usable_swork(pool)) {
+			/* Expand the latest template locally by rolling the coinbase
+			 * extranonce, filling the whole shortfall in one go */
+			int batch = max_staged - ts;
+			if (batch > GBT_LOCALGEN_MAX_BATCH)
+				batch = GBT_LOCALGEN_MAX_BATCH;
+			while (true)
+			{
+				gen_stratum_work(pool, work);
+				stage_work(work);
+				if (--batch <= 0)
+					break;
+				work = make_work();
+			}
+			applog(LOG_DEBUG, "Generated work locally from GBT template for pool %u", pool->pool_no);
+			continue;
+		}
+#endif
+
 		if (pool->last_work_copy) {
 			mutex_lock(&pool->last_work_lock);
 			struct work *last_work = pool->last_work_copy;
@@ -13926,7 +15182,7 @@ retry:
 			mutex_unlock(&pool->last_work_lock);
 		}
 
-		if (clone_available()) {
+		if (clone_available(max_staged - ts)) {
 			applog(LOG_DEBUG, "Cloned getwork work");
 			free_work(work);
 			continue;
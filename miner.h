@@ -360,9 +360,14 @@ struct device_drv {
 	void (*thread_enable)(struct thr_info *);
 
 	// Can be used per-thread or per-processor (only with minerloop async or queue!)
+	// Also called whenever the fd given to mt_poll_fd is readable
 	void (*poll)(struct thr_info *);
 
 	// === Implemented by minerloop_async ===
+	/* Set if the callbacks below never sleep or wait on anything but brief
+	 * device I/O, and the driver does not use control requests, so
+	 * --minerloop-reactor may run its devices alongside others */
+	bool minerloop_reactor_safe;
 	bool (*job_prepare)(struct thr_info*, struct work*, uint64_t);
 	void (*job_start)(struct thr_info*);
 	void (*job_get_results)(struct thr_info*, struct work*);
@@ -371,6 +376,8 @@ struct device_drv {
 	// === Implemented by minerloop_queue ===
 	bool (*queue_append)(struct thr_info *, struct work *);
 	void (*queue_flush)(struct thr_info *);
+	// Optional: flush the queue and append work in a single device command; returns false (without taking the work) to fall back to queue_flush + queue_append
+	bool (*queue_replace)(struct thr_info *, struct work *);
 };
 
 enum dev_enable {
@@ -479,6 +486,8 @@ struct cgminer_pool_stats {
 #define ALLOC_H2B_SPACED  8
 #define ALLOC_H2B_SHORTV  7
 
+// Must be a power of 2, so the ring indexes stay valid when they wrap
+#define UNQUEUED_WORK_RING_SZ  2
 
 struct cgpu_info {
 	int cgminer_id;
@@ -568,11 +577,28 @@ struct cgpu_info {
 	time_t last_share_pool_time;
 	double last_share_diff;
 	time_t last_device_valid_work;
+	unsigned long nonces_found;
+	// Time spent waiting for work with nothing prefetched
+	struct timeval tv_work_wait;
+	// Time from a work restart until fresh work reaches the device
+	struct timeval tv_restart_latency;
+	struct timeval tv_restart_latency_max;
+	unsigned int restarts;
+	struct bfg_tseries *tseries;
+	struct bfg_autotune *autotune;
+
+	// Automatic nonce difficulty state (see cgpu_auto_nonce_diff)
+	float auto_nonce_diff;
+	double auto_nonce_rate;
+	struct timeval tv_auto_nonce_start;
+	double auto_nonce_diff1_start;
+	unsigned long auto_nonces_start;
 
 	time_t device_last_well;
 	time_t device_last_not_well;
 	struct timeval tv_device_last_not_well;
 	enum dev_reason device_not_well_reason;
+	struct timeval tv_hotplugged;  // Set until the first hashes are reported
 	float reinit_backoff;
 	int thread_fail_init_count;
 	int thread_zero_hash_count;
@@ -589,7 +615,14 @@ struct cgpu_info {
 
 	pthread_rwlock_t qlock;
 	struct work *queued_work;
-	struct work *unqueued_work;
+	// Secondary indexes of queued_work, by midstate and by driver-assigned subid
+	struct work *queued_work_bymidstate;
+	struct work *queued_work_bysubid;
+	// Work handed from fill_queue (the only producer) to get_queued without
+	// qlock; consumers claim items by advancing unqueued_tail atomically
+	struct work *unqueued_work[UNQUEUED_WORK_RING_SZ];
+	volatile unsigned unqueued_head;
+	volatile unsigned unqueued_tail;
 	unsigned int queued_count;
 
 	bool disable_watchdog;
@@ -643,6 +676,8 @@ struct thr_info {
 	struct work *prev_work;
 	struct work *work;
 	struct work *next_work;
+	// Work fetched without waiting while the current job runs (also used by minerloop_queue)
+	struct work *prefetch_work;
 	enum thr_busy_state busy_state;
 	bool _mt_disable_called;
 	struct timeval tv_morework;
@@ -651,12 +686,27 @@ struct thr_info {
 	bool _proceed_with_new_job;
 	struct timeval tv_results_jobstart;
 	struct timeval tv_jobstart;
+	struct timeval tv_job_prepare;
+	// When restart_threads last flagged this thread (unset once fresh work has been started)
+	struct timeval tv_restart;
 	struct timeval tv_poll;
 	struct timeval tv_watchdog;
 	notifier_t notifier;
 	bool starting_next_work;
 	uint32_t _max_nonce;
 	notifier_t mutex_request;
+	// Owned by the minerloop: poll/watchdog deadlines of its processors, and the notifier wait set
+	struct bfg_timer_wheel *timer_wheel;
+	// This processor's timers in the wheel of the minerloop running it
+	struct bfg_wheel_proc *timer_wheel_proc;
+	int notifier_epfd;
+	bool notifier_epoll_mutex_request;
+	// Device fd watched by the minerloop for the device's first processor (set with mt_poll_fd)
+	int poll_fd;
+	// epoll set poll_fd is registered in, or -1
+	int poll_fd_epfd;
+	// Run by a reactor shared with other devices, so it must never wait for work
+	bool minerloop_shared;
 
 	// Used by minerloop_queue
 	struct work *work_list;
@@ -1165,6 +1215,14 @@ struct mining_algorithm {
 	int staged;
 	int base_queue;
 	
+	// Adaptive staged queue depth beyond base_queue; protected by stgd_lock
+	int queue_target;
+	bool queue_underrun;
+	unsigned queue_pops;
+	struct timeval tv_queue_adjust;
+	double queue_pop_rate;
+	double upstream_latency;
+	
 	struct mining_algorithm *next;
 	
 #ifdef USE_OPENCL
@@ -1238,6 +1296,10 @@ extern double total_diff1, total_bad_diff1;
 extern double total_diff_accepted, total_diff_rejected, total_diff_stale;
 extern unsigned int local_work;
 extern unsigned int total_go, total_ro;
+extern unsigned int total_pop_rolled, total_pop_fresh;
+extern double total_submit_latency, max_submit_latency;
+extern unsigned int total_submit_latency_count;
+extern int malgo_queue_target(const struct mining_algorithm *);
 extern const int opt_cutofftemp;
 extern int opt_hysteresis;
 extern int opt_fail_pause;
@@ -1295,6 +1357,11 @@ struct stratum_work {
 	size_t nonce2_offset;
 	int n2size;
 	
+	// SHA256 state after the whole blocks of coinbase preceding nonce2
+	bool cb_midstate_valid;
+	size_t cb_midstate_len;
+	uint32_t cb_midstate[8];
+	
 	int merkles;
 	bytes_t merkle_bin;
 	
@@ -1470,6 +1537,9 @@ struct pool {
 typedef unsigned work_device_id_t;
 #define PRIwdi "04x"
 
+// Midstate followed by the last 12 bytes of header data (merkle tail, ntime, nbits)
+#define WORK_QUEUED_MIDSTATE_KEY_SZ  (0x20 + 0xc)
+
 struct work {
 	unsigned char	data[128];
 	unsigned char	midstate[32];
@@ -1522,6 +1592,12 @@ struct work {
 	// DEPRECATED: New code should be using multiple processors instead
 	int		subid;
 	
+	// Keys of the cgpu queued_work secondary indexes
+	unsigned char queued_midstate_key[WORK_QUEUED_MIDSTATE_KEY_SZ];
+	UT_hash_handle hh_midstate;
+	bool queued_subid_indexed;
+	UT_hash_handle hh_subid;
+	
 	// Allow devices to timestamp work for their own purposes
 	struct timeval	tv_stamp;
 
@@ -1550,6 +1626,7 @@ extern void stratum_work_clean(struct stratum_work *);
 extern bool pool_has_usable_swork(const struct pool *);
 extern void gen_stratum_work2(struct work *, struct stratum_work *);
 extern void gen_stratum_work3(struct work *, struct stratum_work *, cglock_t *data_lock_p);
+extern float cgpu_auto_nonce_diff(struct cgpu_info *, int procs, const struct mining_algorithm *, float default_nonce_diff, float max_nonce_diff);
 extern void inc_hw_errors3(struct thr_info *thr, const struct work *work, const uint32_t *bad_nonce_p, float nonce_diff);
 static inline
 void inc_hw_errors2(struct thr_info * const thr, const struct work * const work, const uint32_t *bad_nonce_p)
@@ -1571,9 +1648,14 @@ enum test_nonce2_result {
 extern enum test_nonce2_result _test_nonce2(struct work *, uint32_t nonce, bool checktarget);
 #define test_nonce(work, nonce, checktarget)  (_test_nonce2(work, nonce, checktarget) == TNR_GOOD)
 #define test_nonce2(work, nonce)  (_test_nonce2(work, nonce, true))
+extern unsigned test_nonce_candidates(const struct work *, const uint32_t *nonces, bool *out_good, unsigned count);
 extern bool submit_nonce(struct thr_info *thr, struct work *work, uint32_t nonce);
 extern bool submit_noffset_nonce(struct thr_info *thr, struct work *work, uint32_t nonce,
 			  int noffset);
+extern int opt_verify_threads;
+extern float opt_nonce_rate;
+extern void submit_noffset_nonce_async(struct thr_info *, struct work *, uint32_t nonce, int noffset);
+#define submit_nonce_async(thr, work, nonce)  submit_noffset_nonce_async(thr, work, nonce, 0)
 extern void __add_queued(struct cgpu_info *cgpu, struct work *work);
 extern struct work *get_queued(struct cgpu_info *cgpu);
 extern void add_queued(struct cgpu_info *cgpu, struct work *work);
@@ -1581,6 +1663,11 @@ extern struct work *get_queue_work(struct thr_info *thr, struct cgpu_info *cgpu,
 extern struct work *__find_work_bymidstate(struct work *que, char *midstate, size_t midstatelen, char *data, int offset, size_t datalen);
 extern struct work *find_queued_work_bymidstate(struct cgpu_info *cgpu, char *midstate, size_t midstatelen, char *data, int offset, size_t datalen);
 extern struct work *clone_queued_work_bymidstate(struct cgpu_info *cgpu, char *midstate, size_t midstatelen, char *data, int offset, size_t datalen);
+extern void __set_queued_work_subid(struct cgpu_info *, struct work *, int subid);
+extern void set_queued_work_subid(struct cgpu_info *, struct work *, int subid);
+extern struct work *__find_queued_work_bysubid(struct cgpu_info *, int subid);
+extern struct work *clone_queued_work_bysubid(struct cgpu_info *, int subid);
+extern struct work *take_queued_work_bysubid(struct cgpu_info *, int subid);
 extern void __work_completed(struct cgpu_info *cgpu, struct work *work);
 extern int age_queued_work(struct cgpu_info *cgpu, double secs);
 extern void work_completed(struct cgpu_info *cgpu, struct work *work);
@@ -209,3 +209,93 @@ void sha256_final(sha256_ctx *ctx, unsigned char *digest)
         UNPACK32(ctx->h[i], &digest[i << 2]);
     }
 }
+
+/* Multi-lane SHA-256d of 80-byte block headers */
+
+static
+void sha256_transf_lanes(uint32_t h[8][SHA256D_LANES],
+                         uint32_t w[64][SHA256D_LANES])
+{
+    uint32_t wv[8][SHA256D_LANES];
+    uint32_t t1, t2;
+    int j, l;
+
+    for (j = 16; j < 64; j++) {
+        for (l = 0; l < SHA256D_LANES; l++) {
+            w[j][l] =  SHA256_F4(w[j -  2][l]) + w[j -  7][l]
+                     + SHA256_F3(w[j - 15][l]) + w[j - 16][l];
+        }
+    }
+
+    memcpy(wv, h, sizeof(wv));
+
+    for (j = 0; j < 64; j++) {
+        for (l = 0; l < SHA256D_LANES; l++) {
+            t1 = wv[7][l] + SHA256_F2(wv[4][l])
+                + CH(wv[4][l], wv[5][l], wv[6][l])
+                + sha256_k[j] + w[j][l];
+            t2 = SHA256_F1(wv[0][l]) + MAJ(wv[0][l], wv[1][l], wv[2][l]);
+            wv[7][l] = wv[6][l];
+            wv[6][l] = wv[5][l];
+            wv[5][l] = wv[4][l];
+            wv[4][l] = wv[3][l] + t1;
+            wv[3][l] = wv[2][l];
+            wv[2][l] = wv[1][l];
+            wv[1][l] = wv[0][l];
+            wv[0][l] = t1 + t2;
+        }
+    }
+
+    for (j = 0; j < 8; j++) {
+        for (l = 0; l < SHA256D_LANES; l++) {
+            h[j][l] += wv[j][l];
+        }
+    }
+}
+
+void sha256d_80_lanes(const uint32_t midstates[][8], const uint32_t tails[][4],
+                      unsigned char digests[][SHA256_DIGEST_SIZE],
+                      unsigned int n)
+{
+    uint32_t h[8][SHA256D_LANES];
+    uint32_t w[64][SHA256D_LANES];
+    int j, l, src;
+
+    /* Unused lanes duplicate the first, rather than hashing garbage */
+    for (l = 0; l < SHA256D_LANES; l++) {
+        src = (l < (int) n) ? l : 0;
+        for (j = 0; j < 8; j++) {
+            h[j][l] = midstates[src][j];
+        }
+        for (j = 0; j < 4; j++) {
+            w[j][l] = tails[src][j];
+        }
+        w[4][l] = 0x80000000;
+        for (j = 5; j < 15; j++) {
+            w[j][l] = 0;
+        }
+        w[15][l] = 80 << 3;
+    }
+
+    sha256_transf_lanes(h, w);
+
+    for (l = 0; l < SHA256D_LANES; l++) {
+        for (j = 0; j < 8; j++) {
+            w[j][l] = h[j][l];
+            h[j][l] = sha256_h0[j];
+        }
+        w[8][l] = 0x80000000;
+        for (j = 9; j < 15; j++) {
+            w[j][l] = 0;
+        }
+        w[15][l] = SHA256_DIGEST_SIZE << 3;
+    }
+
+    sha256_transf_lanes(h, w);
+
+    for (l = 0; l < (int) n; l++) {
+        for (j = 0; j < 8; j++) {
+            UNPACK32(h[j][l], &digests[l][j << 2]);
+        }
+    }
+}
@@ -70,4 +70,14 @@ void sha256_final(sha256_ctx *ctx, unsigned char *digest);
 void sha256(const unsigned char *message, unsigned int len,
             unsigned char *digest);
 
+/* Double SHA-256 of up to SHA256D_LANES 80-byte block headers at once.
+ * Each lane takes the state after the first 64 bytes of its header, and the
+ * remaining 16 bytes as big endian words (the nonce is the last); digests are
+ * written in the same byte order as sha256_final. */
+#define SHA256D_LANES  8
+
+void sha256d_80_lanes(const uint32_t midstates[][8], const uint32_t tails[][4],
+                      unsigned char digests[][SHA256_DIGEST_SIZE],
+                      unsigned int n);
+
 #endif /* !SHA2_H */
@@ -0,0 +1,658 @@
+/*
+ * Copyright 2026 BFGMiner contributors
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.  See COPYING for more details.
+ */
+
+// Simulated serial ASICs, for load-testing drivers without hardware
+
+#include "config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "logging.h"
+#include "lowl-capture.h"
+#include "lowlevel.h"
+#include "miner.h"
+#include "sha2.h"
+#include "util.h"
+#include "vcom-sim.h"
+
+#define VSIM_ICARUS_JOB_SZ  64
+#define VSIM_BFL_ZDX_SZ  60
+#define VSIM_BFL_ZPX_SZ  68
+
+enum vsim_proto {
+	VSP_ICARUS,
+	VSP_BITFORCE,
+	VSP_REPLAY,
+};
+
+static const char * const vsim_protonames[] = {
+	[VSP_ICARUS] = "icarus",
+	[VSP_BITFORCE] = "bitforce",
+	[VSP_REPLAY] = "replay",
+};
+
+static const double vsim_default_ghs[] = {
+	[VSP_ICARUS] = 0.38,
+	[VSP_BITFORCE] = 0.86,
+};
+
+struct vsim_device {
+	const char *spec;
+	enum vsim_proto proto;
+	double hashrate;
+	long latency_us;
+	int masterfd;
+	int slavefd;
+	char *path;
+	uint32_t rng;
+
+	uint8_t inbuf[VSIM_BFL_ZPX_SZ];
+	size_t inlen;
+	// BitForce: job bytes expected following ZDX/ZPX
+	size_t payload_sz;
+
+	char outbuf[0x400];
+	size_t outlen;
+	struct timeval tv_out;
+
+	bool job_active;
+	bool job_have_nonce;
+	uint32_t job_nonce;
+	struct timeval tv_job_done;
+
+	// Replay: bytes still expected of the current captured host transfer
+	struct bfg_capture *replay;
+	float replay_speed;
+	size_t replay_txleft;
+	int64_t replay_tx_us;
+
+	struct vsim_device *next;
+};
+
+// Jobs the drivers send during detection, and what a real device answers
+static const struct {
+	const char *job;
+	uint32_t nonce;
+} vsim_icarus_known[] = {
+	// icarus_detect_custom golden nonce
+	{
+		"4679ba4ec99876bf4bfe086082b400254df6c356451471139a3afa71e48f544a"
+		"000000000000000000000000000000000000000087320b1a1426674f2fa722ce",
+		0x000187a2,
+	},
+	// icarus_probe_work_division, answered as a single chip
+	{
+		"2e4c8f91fd595d2d7ea20aaacb64a2a04382860277cf26b6a1ee04c56a5b504a"
+		"00000000000000000000000000000000000000006461011ac906a951fb9b3c73",
+		0x04c0fdb4,
+	},
+};
+
+extern struct lowlevel_device_info *_vcom_devinfo_findorcreate(struct lowlevel_device_info **, const char *);
+
+static struct vsim_device *vsim_devices;
+static pthread_mutex_t vsim_mutex = PTHREAD_MUTEX_INITIALIZER;
+static bool vsim_thread_started;
+static notifier_t vsim_notifier;
+
+static
+uint32_t vsim_rand(struct vsim_device * const vd)
+{
+	// xorshift32; deterministic per device so runs are repeatable
+	uint32_t x = vd->rng;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return vd->rng = x;
+}
+
+static
+long vsim_hashes_to_us(const struct vsim_device * const vd, const double hashes)
+{
+	return vd->latency_us + (long)(hashes / vd->hashrate * 1e6);
+}
+
+static
+void vsim_reply(struct vsim_device * const vd, const struct timeval * const tvp_now, const char * const s)
+{
+	const size_t len = strlen(s);
+	if (len > sizeof(vd->outbuf) - vd->outlen)
+		applogr(, LOG_WARNING, "%s: Output buffer full, dropping reply", vd->path);
+	if (!vd->outlen)
+		timer_set_delay(&vd->tv_out, tvp_now, vd->latency_us);
+	memcpy(&vd->outbuf[vd->outlen], s, len);
+	vd->outlen += len;
+}
+
+/* Hashes the job's nonces from first to last, stopping at the first which
+ * meets VCOM_SIM_NONCE_PDIFF. midstate and tail are as sha256d_80_lanes takes
+ * them. */
+static
+bool vsim_find_nonce(const uint32_t * const midstate, const uint32_t * const tail, const uint32_t first, const uint32_t last, uint32_t * const out_nonce)
+{
+	uint32_t midstates[SHA256D_LANES][8], tails[SHA256D_LANES][4];
+	unsigned char digests[SHA256D_LANES][SHA256_DIGEST_SIZE];
+	const uint32_t htarg = (uint32_t)(1. / VCOM_SIM_NONCE_PDIFF) - 1;
+	uint32_t nonce = first;
+	unsigned i, n;
+
+	for (i = 0; i < SHA256D_LANES; ++i)
+	{
+		memcpy(midstates[i], midstate, sizeof(midstates[i]));
+		memcpy(tails[i], tail, sizeof(*tail) * 3);
+	}
+	while (true)
+	{
+		for (n = 0; n < SHA256D_LANES; ++nonce)
+		{
+			tails[n++][3] = nonce;
+			if (nonce == last)
+				break;
+		}
+		sha256d_80_lanes(midstates, tails, digests, n);
+		for (i = 0; i < n; ++i)
+			if (upk_u32le(digests[i], 28) <= htarg)
+			{
+				*out_nonce = tails[i][3];
+				return true;
+			}
+		if (tails[n - 1][3] == last)
+			return false;
+	}
+}
+
+static
+void vsim_icarus_job(struct vsim_device * const vd, const struct timeval * const tvp_now)
+{
+	char hex[(VSIM_ICARUS_JOB_SZ * 2) + 1];
+	uint32_t midstate[8], tail[3], nonce;
+
+	bin2hex(hex, vd->inbuf, VSIM_ICARUS_JOB_SZ);
+	for (unsigned i = 0; i < sizeof(vsim_icarus_known) / sizeof(*vsim_icarus_known); ++i)
+		if (!strcasecmp(hex, vsim_icarus_known[i].job))
+		{
+			nonce = vsim_icarus_known[i].nonce;
+			goto found;
+		}
+	// The job carries the midstate and data tail byte-reversed
+	for (int i = 0; i < 8; ++i)
+		midstate[i] = upk_u32be(vd->inbuf, 28 - (i * 4));
+	for (int i = 0; i < 3; ++i)
+		tail[i] = upk_u32be(vd->inbuf, 60 - (i * 4));
+	// Scan from a random point, so nonces arrive spread over the job as a
+	// real device's do; a new job aborts the old one with its pending nonce
+	if (!vsim_find_nonce(midstate, tail, vsim_rand(vd), 0xffffffff, &nonce))
+	{
+		vd->outlen = 0;
+		return;
+	}
+
+found:
+	pk_u32be(vd->outbuf, 0, nonce);
+	vd->outlen = 4;
+	timer_set_delay(&vd->tv_out, tvp_now, vsim_hashes_to_us(vd, nonce));
+}
+
+static
+void vsim_bfl_job(struct vsim_device * const vd, const struct timeval * const tvp_now)
+{
+	uint32_t start = 0, range = 0xffffffff, midstate[8], tail[3];
+
+	if (vd->payload_sz == VSIM_BFL_ZPX_SZ)
+	{
+		start = upk_u32be(vd->inbuf, 52);
+		range = upk_u32be(vd->inbuf, 56) - start;
+	}
+	// ">>>>>>>>", then the midstate and data tail as in the work
+	for (int i = 0; i < 8; ++i)
+		midstate[i] = upk_u32le(vd->inbuf, 8 + (i * 4));
+	for (int i = 0; i < 3; ++i)
+		tail[i] = upk_u32le(vd->inbuf, 40 + (i * 4));
+	vd->job_active = true;
+	vd->job_have_nonce = vsim_find_nonce(midstate, tail, start + (uint32_t)((uint64_t)vsim_rand(vd) * range >> 32), start + range, &vd->job_nonce);
+	timer_set_delay(&vd->tv_job_done, tvp_now, vsim_hashes_to_us(vd, (double)range + 1));
+	vsim_reply(vd, tvp_now, "OK\n");
+}
+
+static
+void vsim_bfl_command(struct vsim_device * const vd, const char * const cmd, const struct timeval * const tvp_now)
+{
+	char buf[0x20];
+
+	switch (cmd[1])
+	{
+		case 'G':
+			vsim_reply(vd, tvp_now, ">>>ID: BitFORCE SHA256 Simulator>>>\n");
+			break;
+		case 'C':
+			vsim_reply(vd, tvp_now, "OK\n");
+			break;
+		case 'D':
+		case 'P':
+			vd->payload_sz = (cmd[1] == 'D') ? VSIM_BFL_ZDX_SZ : VSIM_BFL_ZPX_SZ;
+			vsim_reply(vd, tvp_now, "OK\n");
+			break;
+		case 'F':
+			if (!vd->job_active)
+				vsim_reply(vd, tvp_now, "NO-NONCE\n");
+			else
+			if (!timer_passed(&vd->tv_job_done, tvp_now))
+				vsim_reply(vd, tvp_now, "BUSY\n");
+			else
+			{
+				vd->job_active = false;
+				if (vd->job_have_nonce)
+				{
+					snprintf(buf, sizeof(buf), "NONCE-FOUND:%08lX\n", (unsigned long)vd->job_nonce);
+					vsim_reply(vd, tvp_now, buf);
+				}
+				else
+					vsim_reply(vd, tvp_now, "NO-NONCE\n");
+			}
+			break;
+		case 'L':
+			vsim_reply(vd, tvp_now, "TEMP:40.0\n");
+			break;
+		case 'M':
+			// Flash LED has no reply
+			break;
+		default:
+			vsim_reply(vd, tvp_now, "ERR:UNKNOWN COMMAND\n");
+	}
+}
+
+// Queues the device output captured after the host transfer just completed
+static
+void vsim_replay_respond(struct vsim_device * const vd, const struct timeval * const tvp_now)
+{
+	const struct bfg_capture_rec *rec;
+	int64_t delay_us;
+
+	while ((rec = bfg_capture_peek(vd->replay))->dir == BCD_RX)
+	{
+		bfg_capture_next(vd->replay, BCD_RX, NULL);
+		if (rec->len > sizeof(vd->outbuf) - vd->outlen)
+		{
+			applog(LOG_WARNING, "%s: Output buffer full, dropping replayed data", vd->path);
+			continue;
+		}
+		if (!vd->outlen)
+		{
+			delay_us = 0;
+			if (vd->replay_speed > 0 && rec->us > vd->replay_tx_us)
+				delay_us = (rec->us - vd->replay_tx_us) / vd->replay_speed;
+			timer_set_delay(&vd->tv_out, tvp_now, delay_us);
+		}
+		memcpy(&vd->outbuf[vd->outlen], rec->data, rec->len);
+		vd->outlen += rec->len;
+	}
+}
+
+// Host data is not compared against the capture, only counted, so drivers can be profiled against any traffic
+static
+void vsim_replay_input(struct vsim_device * const vd, const struct timeval * const tvp_now)
+{
+	const struct bfg_capture_rec *rec;
+	size_t n;
+
+	while (vd->inlen)
+	{
+		if (!vd->replay_txleft)
+		{
+			rec = bfg_capture_next(vd->replay, BCD_TX, NULL);
+			vd->replay_txleft = rec->len ?: 1;
+			vd->replay_tx_us = rec->us;
+		}
+		n = (vd->inlen < vd->replay_txleft) ? vd->inlen : vd->replay_txleft;
+		vd->inlen -= n;
+		memmove(vd->inbuf, &vd->inbuf[n], vd->inlen);
+		vd->replay_txleft -= n;
+		if (!vd->replay_txleft)
+			vsim_replay_respond(vd, tvp_now);
+	}
+}
+
+static
+void vsim_consume(struct vsim_device * const vd, const size_t sz)
+{
+	vd->inlen -= sz;
+	memmove(vd->inbuf, &vd->inbuf[sz], vd->inlen);
+}
+
+static
+void vsim_process_input(struct vsim_device * const vd, const struct timeval * const tvp_now)
+{
+	switch (vd->proto)
+	{
+		case VSP_ICARUS:
+			if (vd->inlen < VSIM_ICARUS_JOB_SZ)
+				return;
+			vsim_icarus_job(vd, tvp_now);
+			vsim_consume(vd, VSIM_ICARUS_JOB_SZ);
+			return;
+		case VSP_BITFORCE:
+			while (true)
+			{
+				if (vd->payload_sz)
+				{
+					if (vd->inlen < vd->payload_sz)
+						return;
+					vsim_bfl_job(vd, tvp_now);
+					vsim_consume(vd, vd->payload_sz);
+					vd->payload_sz = 0;
+					continue;
+				}
+				// Resync on the 'Z' every command starts with, so we ignore other drivers' probes
+				size_t skip = 0;
+				while (skip < vd->inlen && vd->inbuf[skip] != 'Z')
+					++skip;
+				vsim_consume(vd, skip);
+				if (vd->inlen < 3)
+					return;
+				vsim_bfl_command(vd, (const char *)vd->inbuf, tvp_now);
+				vsim_consume(vd, 3);
+			}
+		case VSP_REPLAY:
+			vsim_replay_input(vd, tvp_now);
+			return;
+	}
+}
+
+static
+void vsim_service(struct vsim_device * const vd, const short revents, const struct timeval * const tvp_now)
+{
+	ssize_t r;
+
+	if (revents & POLLIN)
+	{
+		r = read(vd->masterfd, &vd->inbuf[vd->inlen], sizeof(vd->inbuf) - vd->inlen);
+		if (r > 0)
+		{
+			vd->inlen += r;
+			vsim_process_input(vd, tvp_now);
+		}
+	}
+	if (vd->outlen && timer_passed(&vd->tv_out, tvp_now))
+	{
+		r = write(vd->masterfd, vd->outbuf, vd->outlen);
+		if (r > 0)
+		{
+			vd->outlen -= r;
+			memmove(vd->outbuf, &vd->outbuf[r], vd->outlen);
+		}
+		else
+		if (r < 0 && errno != EAGAIN)
+			// Nobody is reading; drop it like a real device would
+			vd->outlen = 0;
+	}
+}
+
+static
+void *vsim_thread(__maybe_unused void * const userp)
+{
+	struct pollfd *pfds = NULL;
+	size_t pfds_sz = 0, n;
+	struct vsim_device *vd, *vd_list;
+	struct timeval tv_now, tv_timeout;
+	int timeout_ms;
+
+	RenameThread("vsim");
+
+	while (true)
+	{
+		// Devices are only ever added, at the head
+		mutex_lock(&vsim_mutex);
+		vd_list = vsim_devices;
+		mutex_unlock(&vsim_mutex);
+
+		n = 1;
+		for (vd = vd_list; vd; vd = vd->next)
+			++n;
+		if (n > pfds_sz)
+		{
+			pfds_sz = n;
+			pfds = realloc(pfds, sizeof(*pfds) * pfds_sz);
+		}
+
+		timer_unset(&tv_timeout);
+		pfds[0] = (struct pollfd){ .fd = vsim_notifier[0], .events = POLLIN, };
+		n = 1;
+		for (vd = vd_list; vd; vd = vd->next, ++n)
+		{
+			pfds[n] = (struct pollfd){ .fd = vd->masterfd, .events = POLLIN, };
+			if (vd->outlen)
+				reduce_timeout_to(&tv_timeout, &vd->tv_out);
+		}
+
+		timer_set_now(&tv_now);
+		if (!timer_isset(&tv_timeout))
+			timeout_ms = -1;
+		else
+		if (timer_passed(&tv_timeout, &tv_now))
+			timeout_ms = 0;
+		else
+			timeout_ms = (timer_remaining_us(&tv_timeout, &tv_now) + 999) / 1000;
+
+		if (poll(pfds, n, timeout_ms) < 0 && errno != EINTR)
+			quit(1, "%s: poll failed: %s", __func__, bfg_strerror(errno, BST_ERRNO));
+
+		if (pfds[0].revents & POLLIN)
+			notifier_read(vsim_notifier);
+		timer_set_now(&tv_now);
+		n = 1;
+		for (vd = vd_list; vd; vd = vd->next, ++n)
+			vsim_service(vd, pfds[n].revents, &tv_now);
+	}
+	return NULL;
+}
+
+static
+struct vsim_device *vsim_create(const char * const spec, const enum vsim_proto proto, const double hashrate, const long latency_us, const unsigned index)
+{
+	struct termios tio;
+	const char *slavename;
+	int masterfd, slavefd;
+
+	masterfd = posix_openpt(O_RDWR | O_NOCTTY);
+	if (masterfd == -1)
+		goto err;
+	if (grantpt(masterfd) || unlockpt(masterfd) || !(slavename = ptsname(masterfd)))
+		goto err_master;
+	// Keep the slave open ourselves, so the master never sees a hangup between driver opens
+	slavefd = open(slavename, O_RDWR | O_NOCTTY);
+	if (slavefd == -1)
+		goto err_master;
+	if (!tcgetattr(slavefd, &tio))
+	{
+		cfmakeraw(&tio);
+		tcsetattr(slavefd, TCSANOW, &tio);
+	}
+	fcntl(masterfd, F_SETFL, fcntl(masterfd, F_GETFL) | O_NONBLOCK);
+
+	struct vsim_device * const vd = malloc(sizeof(*vd));
+	*vd = (struct vsim_device){
+		.spec = spec,
+		.proto = proto,
+		.hashrate = hashrate,
+		.latency_us = latency_us,
+		.masterfd = masterfd,
+		.slavefd = slavefd,
+		.path = strdup(slavename),
+		.rng = 0x9e3779b9 * (index + 1),
+	};
+	applog(LOG_DEBUG, "Simulated %s device %s#%u at %s", vsim_protonames[proto], spec, index, vd->path);
+	return vd;
+
+err_master:
+	close(masterfd);
+err:
+	applog(LOG_ERR, "Failed to create pty for simulated device %s: %s", spec, bfg_strerror(errno, BST_ERRNO));
+	return NULL;
+}
+
+// Loads a capture file to play back; the filename may contain colons itself
+static
+struct bfg_capture *vsim_replay_load(const char * const arg, float * const out_speed)
+{
+	const char * const colon = strrchr(arg, ':');
+	size_t filenamelen = strlen(arg);
+	char *endptr;
+
+	*out_speed = 1;
+	if (colon)
+	{
+		const float speed = strtof(&colon[1], &endptr);
+		if (colon[1] && !*endptr)
+		{
+			*out_speed = speed;
+			filenamelen = colon - arg;
+		}
+	}
+	char filename[filenamelen + 1];
+	memcpy(filename, arg, filenamelen);
+	filename[filenamelen] = '\0';
+
+	struct bfg_capture * const cap = bfg_capture_load(filename);
+	if (!cap)
+		return NULL;
+	// Anything the device sent before the first host transfer is not replayed
+	while (bfg_capture_peek(cap)->dir != BCD_TX)
+		if (!bfg_capture_next(cap, BCD_RX, NULL))
+			break;
+	if (bfg_capture_peek(cap)->dir != BCD_TX)
+	{
+		applog(LOG_ERR, "Capture file %s has no host transfers to replay", filename);
+		bfg_capture_free(cap);
+		return NULL;
+	}
+	return cap;
+}
+
+// Whether devpath is the port of a simulated device
+bool vcom_sim_path_p(const char * const devpath)
+{
+	struct vsim_device *vd;
+
+	if (!devpath)
+		return false;
+	mutex_lock(&vsim_mutex);
+	for (vd = vsim_devices; vd; vd = vd->next)
+		if (!strcmp(vd->path, devpath))
+			break;
+	mutex_unlock(&vsim_mutex);
+	return vd;
+}
+
+// spec: vsim:<icarus|bitforce>[:count[:GH/s[:latency ms]]]
+//       vsim:replay:<capture file>[:speed]
+void vcom_sim_devinfo_scan(struct lowlevel_device_info ** const devinfo_list, const char * const spec)
+{
+	char buf[strlen(spec) + 1], *p, *saveptr;
+	enum vsim_proto proto;
+	unsigned count = 1, have = 0;
+	double ghs;
+	long latency_us = 1000;
+	const char *spec_dup = NULL;
+	struct vsim_device *vd, *vd_new = NULL, **vd_tailp = &vd_new;
+	struct lowlevel_device_info *devinfo;
+
+	strcpy(buf, &spec[sizeof(VCOM_SIM_PREFIX) - 1]);
+	if (!strncasecmp(buf, "replay:", 7))
+	{
+		proto = VSP_REPLAY;
+		ghs = 1;
+		goto create;
+	}
+	p = strtok_r(buf, ":", &saveptr);
+	if (p && !strcasecmp(p, "icarus"))
+		proto = VSP_ICARUS;
+	else
+	if (p && (!strcasecmp(p, "bitforce") || !strcasecmp(p, "bfl")))
+		proto = VSP_BITFORCE;
+	else
+		applogr(, LOG_ERR, "%s: Unknown simulated protocol", spec);
+	ghs = vsim_default_ghs[proto];
+	if ((p = strtok_r(NULL, ":", &saveptr)))
+		count = atoi(p);
+	if (p && (p = strtok_r(NULL, ":", &saveptr)))
+		ghs = atof(p);
+	if (p && (p = strtok_r(NULL, ":", &saveptr)))
+		latency_us = atof(p) * 1000;
+	if (count < 1 || ghs <= 0 || latency_us < 0)
+		applogr(, LOG_ERR, "%s: Invalid simulated device parameters", spec);
+
+create:
+	mutex_lock(&vsim_mutex);
+	// Simulators persist across rescans, so only create any that are missing
+	for (vd = vsim_devices; vd; vd = vd->next)
+		if (!strcmp(vd->spec, spec))
+		{
+			spec_dup = vd->spec;
+			++have;
+		}
+	for ( ; have < count; ++have)
+	{
+		if (!spec_dup)
+			spec_dup = strdup(spec);
+		vd = vsim_create(spec_dup, proto, ghs * 1e9, latency_us, have);
+		if (!vd)
+			break;
+		if (proto == VSP_REPLAY && !(vd->replay = vsim_replay_load(&buf[7], &vd->replay_speed)))
+		{
+			close(vd->slavefd);
+			close(vd->masterfd);
+			free(vd->path);
+			free(vd);
+			break;
+		}
+		*vd_tailp = vd;
+		vd_tailp = &vd->next;
+	}
+	if (vd_new)
+	{
+		*vd_tailp = vsim_devices;
+		vsim_devices = vd_new;
+	}
+	if (!vsim_thread_started && vsim_devices)
+	{
+		pthread_t pth;
+		notifier_init(vsim_notifier);
+		if (unlikely(pthread_create(&pth, NULL, vsim_thread, NULL)))
+			quit(1, "Failed to create simulated device thread");
+		pthread_detach(pth);
+		vsim_thread_started = true;
+	}
+	else
+	if (vd_new)
+		notifier_wake(vsim_notifier);
+
+	for (vd = vsim_devices; vd; vd = vd->next)
+	{
+		if (strcmp(vd->spec, spec))
+			continue;
+		devinfo = _vcom_devinfo_findorcreate(devinfo_list, vd->path);
+		if (!devinfo)
+			continue;
+		BFGINIT(devinfo->manufacturer, strdup("BFGMiner"));
+		BFGINIT(devinfo->product, strdup((vd->proto == VSP_BITFORCE) ? "BitFORCE SHA256 Simulator" : (vd->proto == VSP_REPLAY) ? "Capture Replay" : "Icarus Simulator"));
+		BFGINIT(devinfo->serial, strdup(vd->spec));
+	}
+	mutex_unlock(&vsim_mutex);
+}
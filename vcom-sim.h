@@ -0,0 +1,33 @@
+#ifndef BFG_VCOM_SIM_H
+#define BFG_VCOM_SIM_H
+
+#include <stdbool.h>
+#include <string.h>
+
+struct lowlevel_device_info;
+
+#define VCOM_SIM_PREFIX  "vsim:"
+
+// Simulated devices hash their jobs for real, so they report nonces at this
+// difficulty; difficulty 1 ones would take as long to find as on the device
+#define VCOM_SIM_NONCE_PDIFF  (1. / 0x1000000)
+
+static inline
+bool vcom_sim_spec_p(const char * const dev)
+{
+	return !strncasecmp(dev, VCOM_SIM_PREFIX, sizeof(VCOM_SIM_PREFIX) - 1);
+}
+
+extern void vcom_sim_devinfo_scan(struct lowlevel_device_info **, const char *spec);
+
+#ifndef WIN32
+extern bool vcom_sim_path_p(const char *devpath);
+#else
+static inline
+bool vcom_sim_path_p(const char * const devpath)
+{
+	return false;
+}
+#endif
+
+#endif